@@ -121,7 +121,8 @@ namespace liblichtenstein {
     unsigned int port = std::stoi(portStr.value());
 
     this->rtClient = std::make_unique<api::RealtimeClient>(this, host.value(),
-                                                           port);
+                                                           port, nullptr,
+                                                           this->realtimeBatchedIO);
 
     // done!
     this->setNextState(IDLE);
@@ -160,7 +161,8 @@ namespace liblichtenstein {
 
     this->apiHandler = new api::API(this->apiHost, this->apiPort,
                                     this->apiCertPath,
-                                    this->apiCertKeyPath, this);
+                                    this->apiCertKeyPath, this,
+                                    this->apiOptions);
 
 
 
@@ -314,8 +316,22 @@ namespace liblichtenstein {
     // try to connect
     int portNum = std::stoi(port.value());
 
+    auto session = this->dataStore->get("server.tls.session");
+
     this->serverApiClient = std::make_unique<TLSClient>(host.value(),
-                                                        portNum);
+                                                        portNum,
+                                                        session.value_or(""));
+
+    // keep track of whether we could resume
+    if(this->serverApiClient->isSessionReused()) {
+      this->serverResumedHandshakes++;
+    } else {
+      this->serverFullHandshakes++;
+    }
+
+    VLOG(1) << "Connected to server (session resumed: "
+            << this->serverApiClient->isSessionReused() << ", "
+            << this->serverApiClient->getCipherDescription() << ")";
 
     // TODO: configure the certificate validation
 
@@ -333,6 +349,7 @@ namespace liblichtenstein {
       // it was not valid, so clear state and return
       LOG(ERROR) << "Server rejected token, invalidating adoption";
       this->dataStore->set("adoption.valid", "0");
+      this->dataStore->set("server.tls.session", "");
 
       this->serverApiClient->close();
       this->serverApiClient = nullptr;
@@ -341,6 +358,10 @@ namespace liblichtenstein {
     }
 
     // success, the connection was authenticated
+    // save the session for next time; with TLS 1.3, the server's ticket has
+    // only been received now that we've read its responses
+    this->dataStore->set("server.tls.session",
+                         this->serverApiClient->exportSession());
   }
 
   /**
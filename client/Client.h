@@ -6,6 +6,7 @@
 #define LIBLICHTENSTEIN_CLIENT_H
 
 #include "IClientDataStore.h"
+#include "api/APIOptions.h"
 
 #include <string>
 #include <thread>
@@ -95,6 +96,16 @@ namespace liblichtenstein {
         this->dataStore = store;
       }
 
+      /// sets options for the API server; must be called before start()
+      void setApiOptions(const api::APIOptions &options) {
+        this->apiOptions = options;
+      }
+
+      /// sets whether realtime datagrams are received in batches
+      void setRealtimeBatchedIO(bool batched) {
+        this->realtimeBatchedIO = batched;
+      }
+
     public:
       bool isAdopted() const {
         auto result = this->dataStore->get("adoption.valid");
@@ -110,6 +121,16 @@ namespace liblichtenstein {
         return this->dataStore;
       }
 
+      /// number of connections to the server API that did a full handshake
+      uint64_t getServerFullHandshakes() const {
+        return this->serverFullHandshakes;
+      }
+
+      /// number of connections to the server API that resumed a session
+      uint64_t getServerResumedHandshakes() const {
+        return this->serverResumedHandshakes;
+      }
+
     private:
       void checkConfig();
 
@@ -172,10 +193,17 @@ namespace liblichtenstein {
       std::string apiCertPath;
       // path to API certificate private key
       std::string apiCertKeyPath;
+      // options for the API server
+      api::APIOptions apiOptions;
+      // whether the realtime client receives datagrams in batches
+      bool realtimeBatchedIO = false;
 
     private:
       // TLS client to server API
       std::shared_ptr<io::TLSClient> serverApiClient;
+      // handshake counters for the server API connection
+      std::atomic<uint64_t> serverFullHandshakes = 0;
+      std::atomic<uint64_t> serverResumedHandshakes = 0;
 
     private:
       // data store containing our internal state
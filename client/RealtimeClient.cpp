@@ -7,12 +7,14 @@
 #include "protocol/HmacChallengeHandler.h"
 
 #include "io/OpenSSLError.h"
+#include "io/SSLSessionClosedError.h"
 #include "io/DTLSClient.h"
 
 #include "protocol/version.h"
 #include "protocol/MessageSerializer.h"
 #include "protocol/WireMessage.h"
 #include "protocol/ProtocolError.h"
+#include "protocol/FramingError.h"
 #include "protocol/MessageIO.h"
 
 #include "shared/Message.pb.h"
@@ -21,14 +23,31 @@
 
 #include <google/protobuf/message.h>
 
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#endif
+
 
 using DTLSClient = liblichtenstein::io::DTLSClient;
 using SSLError = liblichtenstein::io::OpenSSLError;
+using SSLSessionClosedError = liblichtenstein::io::SSLSessionClosedError;
 
 using liblichtenstein::api::HmacChallengeHandler;
 
 using liblichtenstein::api::MessageSerializer;
 using liblichtenstein::api::ProtocolError;
+using liblichtenstein::api::FramingError;
 
 
 namespace liblichtenstein::api {
@@ -38,14 +57,22 @@ namespace liblichtenstein::api {
    * @param client Client instance on which the connection stems from
    * @param host Host to connect to
    * @param port Port to connect to
+   * @param observer If not null, invoked for every message received once the
+   * client has authenticated; it's called from the client's worker thread.
+   * @param batchedIO Whether the connection receives datagrams in batches,
+   * with a BatchedDatagramBIO (and coalesced by the kernel, if supported)
    */
   RealtimeClient::RealtimeClient(Client *client, const std::string &host,
-                                 const unsigned int port) : client(client) {
+                                 const unsigned int port,
+                                 MessageObserver observer,
+                                 bool batchedIO) : client(client),
+                                                   observer(std::move(
+                                                           observer)),
+                                                   host(host), port(port),
+                                                   batchedIO(batchedIO) {
     // create the DTLS client
     try {
-      this->dtlsClient = std::make_shared<DTLSClient>(host, port);
-
-      this->io = std::make_shared<MessageIO>(this->dtlsClient);
+      this->connect();
     } catch(SSLError &e) {
       LOG(ERROR) << "SSL error while creating DTLS client: " << e.what();
       throw e;
@@ -54,7 +81,9 @@ namespace liblichtenstein::api {
       throw e;
     }
 
-    // create the worker thread
+    // create the worker thread, and the file descriptors to wake it up
+    this->createEventFds();
+
     this->thread = std::make_unique<std::thread>(&RealtimeClient::threadEntry,
                                                  this);
   }
@@ -63,29 +92,365 @@ namespace liblichtenstein::api {
    * Cleans up the resources used by the realtime client.
    */
   RealtimeClient::~RealtimeClient() {
-    // mark shutdown
-    this->shutdown = true;
-
-    // close connection
-    if(this->dtlsClient) {
-      this->dtlsClient->close();
-      this->dtlsClient = nullptr;
+    // mark shutdown and wake up the worker, which closes the connection
+    {
+      std::lock_guard<std::mutex> lg(this->connectionLock);
+      this->shutdown = true;
     }
 
+    this->wake();
+    this->shutdownCv.notify_all();
+
     // stop thread
     if(this->thread->joinable()) {
       this->thread->join();
     }
 
     this->thread = nullptr;
+    this->closeEventFds();
   }
 
 
   /**
-   * Entry point of the worker thread
+   * Creates the file descriptors the worker thread waits on besides the
+   * connection: one to wake it up and, on Linux, a timer.
+   *
+   * @throws std::system_error
    */
-  void RealtimeClient::threadEntry() {
-    // attempt to authenticate
+  void RealtimeClient::createEventFds() {
+#ifdef __linux__
+    int fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if(fd == -1) {
+      throw std::system_error(errno, std::system_category(),
+                              "eventfd() failed");
+    }
+
+    this->wakeFd[0] = this->wakeFd[1] = fd;
+
+    // steady_clock is CLOCK_MONOTONIC, so deadlines can be used as they are
+    this->timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if(this->timerFd == -1) {
+      int error = errno;
+      this->closeEventFds();
+
+      throw std::system_error(error, std::system_category(),
+                              "timerfd_create() failed");
+    }
+#else
+    if(pipe(this->wakeFd) != 0) {
+      throw std::system_error(errno, std::system_category(), "pipe() failed");
+    }
+
+    fcntl(this->wakeFd[0], F_SETFL, O_NONBLOCK);
+    fcntl(this->wakeFd[1], F_SETFL, O_NONBLOCK);
+#endif
+  }
+
+  /**
+   * Closes the wakeup and timer file descriptors.
+   */
+  void RealtimeClient::closeEventFds() {
+    if(this->wakeFd[1] != this->wakeFd[0] && this->wakeFd[1] != -1) {
+      ::close(this->wakeFd[1]);
+    }
+    if(this->wakeFd[0] != -1) {
+      ::close(this->wakeFd[0]);
+    }
+    if(this->timerFd != -1) {
+      ::close(this->timerFd);
+    }
+
+    this->wakeFd[0] = this->wakeFd[1] = this->timerFd = -1;
+  }
+
+  /**
+   * Wakes up the worker thread if it's waiting for the connection, e.g. so it
+   * notices that we're shutting down.
+   */
+  void RealtimeClient::wake() {
+#ifdef __linux__
+    const uint64_t value = 1;
+#else
+    const char value = 0;
+#endif
+
+    // if this fails, a wakeup is already pending
+    ssize_t written = write(this->wakeFd[1], &value, sizeof(value));
+    (void) written;
+  }
+
+  /**
+   * Consumes pending wakeups, so the worker doesn't keep waking up.
+   */
+  void RealtimeClient::clearWakeup() {
+#ifdef __linux__
+    uint64_t value;
+#else
+    char value[64];
+#endif
+
+    while(read(this->wakeFd[0], &value, sizeof(value)) > 0) {
+      // keep going until the pipe is empty
+    }
+  }
+
+
+  /**
+   * Schedules a callback to be run on the worker thread, e.g. to send
+   * acknowledgements or keepalives. Timers only fire while the link is up;
+   * any that became due while reconnecting fire once it's back.
+   *
+   * @param delay Time until the timer first fires
+   * @param callback Function to invoke when the timer fires
+   * @param repeat Whether the timer keeps firing every `delay`; if firings
+   * are missed (e.g. a callback ran long) they're skipped, not caught up on
+   * @return Identifier of the timer, to cancel it
+   * @throws std::invalid_argument If a repeating timer has no delay
+   */
+  RealtimeClient::TimerId RealtimeClient::schedule(Clock::duration delay,
+                                                   TimerCallback callback,
+                                                   bool repeat) {
+    if(repeat && delay <= Clock::duration::zero()) {
+      throw std::invalid_argument("Repeating timers need an interval");
+    }
+
+    std::lock_guard<std::mutex> lg(this->timerLock);
+
+    Timer timer;
+    timer.id = this->nextTimerId++;
+    timer.deadline = Clock::now() + delay;
+    timer.interval = repeat ? delay : Clock::duration::zero();
+    timer.callback = std::move(callback);
+
+    this->timers.push_back(std::move(timer));
+    this->armTimer();
+
+#ifndef __linux__
+    // the poll timeout has to be recalculated
+    this->wake();
+#endif
+
+    return this->timers.back().id;
+  }
+
+  /**
+   * Cancels a timer. If it's already firing, its callback may still run
+   * once more.
+   *
+   * @param id Timer to cancel, as returned by schedule()
+   */
+  void RealtimeClient::cancel(TimerId id) {
+    std::lock_guard<std::mutex> lg(this->timerLock);
+
+    this->timers.erase(std::remove_if(this->timers.begin(), this->timers.end(),
+                                      [id](const Timer &timer) {
+                                        return timer.id == id;
+                                      }), this->timers.end());
+    this->armTimer();
+  }
+
+  /**
+   * Arms the timerfd for the earliest timer, or disarms it if there are
+   * none. The timer lock must be held. Without a timerfd, this does nothing;
+   * the poll timeout is calculated instead.
+   */
+  void RealtimeClient::armTimer() {
+#ifdef __linux__
+    struct itimerspec spec{};
+
+    auto next = std::min_element(this->timers.begin(), this->timers.end(),
+                                 [](const Timer &a, const Timer &b) {
+                                   return a.deadline < b.deadline;
+                                 });
+
+    if(next != this->timers.end()) {
+      const auto since = next->deadline.time_since_epoch();
+      const auto secs = std::chrono::duration_cast<std::chrono::seconds>(since);
+      const auto nsecs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+              since - secs);
+
+      spec.it_value.tv_sec = secs.count();
+      spec.it_value.tv_nsec = nsecs.count();
+
+      // an all-zero time would disarm the timer
+      if(!spec.it_value.tv_sec && !spec.it_value.tv_nsec) {
+        spec.it_value.tv_nsec = 1;
+      }
+    }
+
+    if(timerfd_settime(this->timerFd, TFD_TIMER_ABSTIME, &spec, nullptr) != 0) {
+      PLOG(ERROR) << "timerfd_settime() failed";
+    }
+#endif
+  }
+
+  /**
+   * Gets how long the worker may wait for the connection before the next
+   * timer is due.
+   *
+   * @return Timeout for poll() in msec, or -1 to wait indefinitely
+   */
+  int RealtimeClient::getPollTimeout() {
+#ifdef __linux__
+    // the timerfd wakes us up
+    return -1;
+#else
+    std::lock_guard<std::mutex> lg(this->timerLock);
+
+    if(this->timers.empty()) return -1;
+
+    auto next = std::min_element(this->timers.begin(), this->timers.end(),
+                                 [](const Timer &a, const Timer &b) {
+                                   return a.deadline < b.deadline;
+                                 });
+
+    // round up, so we don't wake up just before the timer is due
+    const auto remaining = next->deadline - Clock::now();
+    const auto msec = std::chrono::ceil<std::chrono::milliseconds>(remaining);
+
+    return std::max<int>(0, msec.count());
+#endif
+  }
+
+  /**
+   * Runs the callbacks of all timers that are due, then re-arms the timer
+   * for the next one. Callbacks are invoked without holding the timer lock,
+   * so they may schedule or cancel timers.
+   */
+  void RealtimeClient::runTimers() {
+#ifdef __linux__
+    // acknowledge the expiration, if any
+    uint64_t expirations;
+    ssize_t len = read(this->timerFd, &expirations, sizeof(expirations));
+    (void) len;
+#endif
+
+    std::vector<TimerCallback> due;
+
+    {
+      std::lock_guard<std::mutex> lg(this->timerLock);
+      const auto now = Clock::now();
+
+      for(auto it = this->timers.begin(); it != this->timers.end();) {
+        if(it->deadline > now) {
+          ++it;
+          continue;
+        }
+
+        due.push_back(it->callback);
+
+        if(it->interval != Clock::duration::zero()) {
+          it->deadline += it->interval;
+
+          if(it->deadline <= now) {
+            it->deadline = now + it->interval;
+          }
+
+          ++it;
+        } else {
+          it = this->timers.erase(it);
+        }
+      }
+
+      if(!due.empty()) {
+        this->armTimer();
+      }
+    }
+
+    for(auto &callback : due) {
+      try {
+        callback();
+      } catch(std::exception &e) {
+        LOG(WARNING) << "Realtime client timer failed: " << e.what();
+      }
+    }
+  }
+
+
+  /**
+   * Establishes the DTLS connection to the server. If we've connected to the
+   * server before, the previous session is resumed, which saves most of the
+   * handshake; the new session is then stored for the next connection.
+   *
+   * @throws SSLError, std::system_error
+   */
+  void RealtimeClient::connect() {
+    auto *dataStore = this->client->dataStore.get();
+    auto session = dataStore->get("rt.dtls.session");
+
+    auto dtls = std::make_shared<DTLSClient>(this->host, this->port,
+                                             session.value_or(""),
+                                             this->batchedIO);
+
+    if(this->batchedIO) {
+      dtls->enableDatagramOffload();
+    }
+
+    auto messageIo = std::make_shared<MessageIO>(dtls);
+    messageIo->setMaxRecordSize(kMaxDatagramPayload);
+
+    if(dtls->isSessionReused()) {
+      this->resumedHandshakes++;
+    } else {
+      this->fullHandshakes++;
+    }
+
+    dataStore->set("rt.dtls.session", dtls->exportSession());
+
+    // publish the connection, unless we've been asked to shut down meanwhile
+    std::lock_guard<std::mutex> lg(this->connectionLock);
+
+    if(this->shutdown) {
+      dtls->close();
+      throw std::system_error(ECONNABORTED, std::system_category(),
+                              "Realtime client is shutting down");
+    }
+
+    this->dtlsClient = dtls;
+    this->io = messageIo;
+  }
+
+  /**
+   * Re-establishes the connection after the link was lost. The first attempt
+   * is made immediately; subsequent attempts back off exponentially.
+   *
+   * @return Whether the connection was re-established; false if shutting down
+   */
+  bool RealtimeClient::reconnect() {
+    auto delay = kReconnectMinDelay;
+
+    while(!this->shutdown) {
+      try {
+        this->connect();
+        this->reconnects++;
+
+        VLOG(1) << "Reconnected realtime client (session resumed: "
+                << this->dtlsClient->isSessionReused() << ")";
+        return true;
+      } catch(std::exception &e) {
+        LOG(WARNING) << "Failed to reconnect realtime client: " << e.what();
+      }
+
+      // wait before trying again (or until we're shutting down)
+      std::unique_lock<std::mutex> lk(this->connectionLock);
+      this->shutdownCv.wait_for(lk, delay, [this] {
+        return this->shutdown.load();
+      });
+
+      delay = std::min(delay * 2, kReconnectMaxDelay);
+    }
+
+    return false;
+  }
+
+  /**
+   * Authenticates with the server over the current connection, using the
+   * HMAC challenge/response. This is done for every connection, even if the
+   * DTLS session was resumed.
+   *
+   * @return Whether the server accepted us
+   */
+  bool RealtimeClient::authenticate() {
     auto secret = this->client->dataStore->get("adoption.secret");
 
     HmacChallengeHandler handler(this->io, secret.value(),
@@ -95,55 +460,147 @@ namespace liblichtenstein::api {
       handler.authenticate();
 
       VLOG(1) << "Successfully authenticated realtime client";
+      return true;
     } catch(std::exception &e) {
       LOG(ERROR) << "Failed to authenticate realtime client: " << e.what();
+      return false;
+    }
+  }
 
-      this->shutdown = true;
+
+  /**
+   * Entry point of the worker thread
+   */
+  void RealtimeClient::threadEntry() {
+    while(!this->shutdown) {
+      // attempt to authenticate
+      if(!this->authenticate()) {
+        break;
+      }
+
+      // process messages until the link drops
+      this->receiveMessages();
+
+      if(this->shutdown) break;
+
+      // try to get the link back up
+      this->linkLost = Clock::now();
+      this->hasLostLink = true;
+
+      if(!this->reconnect()) break;
+    }
+
+    // clean up
+    VLOG(1) << "Realtime client shutting down";
+
+    std::lock_guard<std::mutex> lg(this->connectionLock);
+
+    if(this->dtlsClient) {
+      this->dtlsClient->close();
+      this->dtlsClient = nullptr;
     }
+  }
+
+  /**
+   * Receives messages until the connection fails or we shut down. The
+   * connection is made non-blocking, then we wait for it to become readable,
+   * for a wakeup or for a timer, and handle whichever happened.
+   */
+  void RealtimeClient::receiveMessages() {
+    int err;
+
+    try {
+      this->dtlsClient->setBlocking(false);
+    } catch(std::system_error &e) {
+      LOG(WARNING) << "Failed to set up realtime connection: " << e.what();
+      return;
+    }
+
+    struct pollfd fds[3] = {
+            {this->dtlsClient->getFd(), POLLIN, 0},
+            {this->wakeFd[0],           POLLIN, 0},
+            {this->timerFd,             POLLIN, 0},
+    };
+    const nfds_t numFds = (this->timerFd != -1) ? 3 : 2;
 
+    // set if a read was interrupted by an error, and left messages buffered
+    bool drainAgain = false;
 
-    // wait for a message
     while(!this->shutdown) {
+      const int timeout = drainAgain ? 0 : this->getPollTimeout();
+
+      err = poll(fds, numFds, timeout);
+
+      if(err < 0) {
+        if(errno == EINTR) continue;
+
+        PLOG(WARNING) << "poll() failed in realtime client";
+        return;
+      }
+
+      if(fds[1].revents) {
+        this->clearWakeup();
+        if(this->shutdown) break;
+      }
+
+      // on Linux, the timerfd is readable when a timer is due; otherwise,
+      // the poll timeout expired
+      this->runTimers();
+
+      if(!fds[0].revents && !drainAgain) {
+        continue;
+      }
+
+      drainAgain = false;
+
       try {
-        // wait for a message
-        this->io->readMessage([this](protoMessageType &message) {
+        // read everything that's been received so far
+        this->io->drainMessages([this](protoMessageType &message) {
+          // after reconnecting, note how long it took to get data again
+          if(this->hasLostLink) {
+            this->hasLostLink = false;
+            this->lastRecoveryTime = std::chrono::duration_cast<
+                    std::chrono::microseconds>(Clock::now() - this->linkLost);
+
+            VLOG(1) << "Realtime link recovered after "
+                    << this->lastRecoveryTime.load().count() << " usec";
+          }
+
+          if(this->observer) {
+            this->observer(message);
+          }
+
           // TODO: process message
           VLOG(1) << "Received realtime message: " << message.DebugString();
         });
       } catch(SSLError &e) {
         LOG(WARNING) << "SSL error on realtime client: " << e.what();
-        goto fatalError;
+        return;
       } catch(std::system_error &e) {
         LOG(WARNING) << "System error in realtime client: " << e.what();
-        goto fatalError;
+        return;
+      } catch(SSLSessionClosedError &e) {
+        LOG(WARNING) << "Realtime connection was closed: " << e.what();
+        return;
+      }
+        // the stream can't be read any further, so start over with a new one
+      catch(FramingError &e) {
+        LOG(WARNING) << "Framing error in realtime client: " << e.what();
+        this->io->sendException(e);
+        return;
       }
-        // protocol errors may be recoverable
+        // protocol errors may be recoverable; the message was skipped
       catch(ProtocolError &e) {
         LOG(WARNING) << "Protocol error in realtime client: " << e.what();
         this->io->sendException(e);
+        drainAgain = this->io->hasBufferedData();
       }
         // runtime errors may be recoverable
       catch(std::runtime_error &e) {
         LOG(WARNING) << "Runtime error in realtime client: " << e.what();
         this->io->sendException(e);
+        drainAgain = this->io->hasBufferedData();
       }
     }
-
-    // clean up
-    shutdown:;
-    VLOG(1) << "Realtime client shutting down";
-
-    if(this->dtlsClient) {
-      this->dtlsClient->close();
-      this->dtlsClient = nullptr;
-    }
-
-    return;
-
-    // handle an error that requires the client to be closed
-    fatalError:;
-    LOG(ERROR) << "Fatal error in handling realtime client";
-
-    goto shutdown;
   }
-}
\ No newline at end of file
+}
@@ -8,8 +8,12 @@
 #include <string>
 #include <memory>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
 #include <thread>
 #include <cstddef>
+#include <cstdint>
 #include <vector>
 #include <functional>
 
@@ -35,27 +39,115 @@ namespace liblichtenstein::api {
    * primarily used to receive pixel data.
    *
    * It's automagically instantiated once the adoption token has been validated.
+   *
+   * The worker thread waits for the connection to become readable, for a
+   * wakeup (e.g. to shut down) and for the next timer at once, so it reacts
+   * to each of them immediately. On Linux, wakeups go through an eventfd and
+   * timers through a timerfd; elsewhere, a pipe and the poll timeout are used
+   * instead.
    */
   class RealtimeClient {
       using protoMessageType = lichtenstein::protocol::Message;
+      using Clock = std::chrono::steady_clock;
+
+    public:
+      /// invoked with every message received on the realtime connection
+      using MessageObserver = std::function<void(const protoMessageType &)>;
+      /// invoked on the worker thread when a timer fires
+      using TimerCallback = std::function<void()>;
+      /// identifies a scheduled timer
+      using TimerId = uint64_t;
 
     public:
       RealtimeClient() = delete;
 
       RealtimeClient(Client *client, const std::string &host,
-                     const unsigned int port);
+                     const unsigned int port,
+                     MessageObserver observer = nullptr,
+                     bool batchedIO = false);
 
       ~RealtimeClient();
 
+    public:
+      /// number of times the link was re-established after it dropped
+      [[nodiscard]] size_t getReconnects() const {
+        return this->reconnects;
+      }
+
+      /// number of connections that resumed the previous DTLS session
+      [[nodiscard]] size_t getResumedHandshakes() const {
+        return this->resumedHandshakes;
+      }
+
+      /// number of connections that required a full DTLS handshake
+      [[nodiscard]] size_t getFullHandshakes() const {
+        return this->fullHandshakes;
+      }
+
+      /// time from losing the link until data was received again, last time
+      [[nodiscard]] std::chrono::microseconds getLastRecoveryTime() const {
+        return this->lastRecoveryTime;
+      }
+
+      TimerId schedule(Clock::duration delay, TimerCallback callback,
+                       bool repeat = false);
+
+      void cancel(TimerId id);
+
     private:
+      /// a scheduled callback
+      struct Timer {
+        /// returned by schedule(), to cancel the timer
+        TimerId id = 0;
+        /// when the timer fires next
+        Clock::time_point deadline;
+        /// time between firings of a repeating timer; zero for one-shot
+        Clock::duration interval{};
+        /// function to invoke
+        TimerCallback callback;
+      };
+
+    private:
+      void createEventFds();
+
+      void closeEventFds();
+
+      void wake();
+
+      void clearWakeup();
+
+      void armTimer();
+
+      int getPollTimeout();
+
+      void runTimers();
+
       void threadEntry();
 
+      void connect();
+
+      bool reconnect();
+
+      bool authenticate();
+
+      void receiveMessages();
+
+    private:
+      /// most message bytes to put in a single datagram when batching
+      static const size_t kMaxDatagramPayload = 1200;
+      /// delay before the second reconnection attempt
+      static constexpr std::chrono::milliseconds kReconnectMinDelay{50};
+      /// longest delay between reconnection attempts
+      static constexpr std::chrono::milliseconds kReconnectMaxDelay{2000};
+
     private:
       // client instance
       Client *client = nullptr;
 
       // message IO handler
       std::shared_ptr<MessageIO> io;
+      // observer for received messages (may be null)
+      MessageObserver observer;
 
       // worker thread for handling the realtime protocol
       std::unique_ptr<std::thread> thread = nullptr;
@@ -63,6 +155,41 @@ namespace liblichtenstein::api {
       std::atomic_bool shutdown = false;
       // DTLS client to realtime API
       std::shared_ptr<io::DTLSClient> dtlsClient;
+
+      // host and port of the realtime API
+      std::string host;
+      unsigned int port = 0;
+      // whether datagrams are received in batches
+      bool batchedIO = false;
+
+      // file descriptors the worker thread is woken up through: on Linux, an
+      // eventfd (in both slots); otherwise the read and write end of a pipe
+      int wakeFd[2] = {-1, -1};
+      // timerfd armed for the next timer to fire (Linux only)
+      int timerFd = -1;
+
+      // protects the timers
+      std::mutex timerLock;
+      // all scheduled timers, in no particular order
+      std::vector<Timer> timers;
+      // identifier of the next timer to be scheduled
+      TimerId nextTimerId = 1;
+
+      // protects the connection while reconnecting or shutting down
+      std::mutex connectionLock;
+      // signalled when shutting down, to abort the reconnection backoff
+      std::condition_variable shutdownCv;
+
+      // when the link was lost, and whether we're waiting to recover from it
+      Clock::time_point linkLost;
+      bool hasLostLink = false;
+      // how long it took to receive data again after the last link loss
+      std::atomic<std::chrono::microseconds> lastRecoveryTime{};
+
+      // connection statistics
+      std::atomic_size_t reconnects = 0;
+      std::atomic_size_t resumedHandshakes = 0;
+      std::atomic_size_t fullHandshakes = 0;
   };
 }
 
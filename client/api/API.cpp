@@ -4,11 +4,15 @@
 
 #include "API.h"
 #include "ClientHandler.h"
+#include "Reactor.h"
 
 #include <glog/logging.h>
 
+#include <algorithm>
 #include <system_error>
 
+#include <unistd.h>
+
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <arpa/inet.h>
@@ -16,6 +20,8 @@
 #include "io/OpenSSLError.h"
 #include "io/SSLSessionClosedError.h"
 #include "io/TLSServer.h"
+#include "io/ShardedListener.h"
+#include "io/KernelTLS.h"
 #include "io/GenericServerClient.h"
 
 
@@ -27,30 +33,38 @@ namespace liblichtenstein::api {
    * @param port Port on which to listen
    * @param certPath Path to the certificate
    * @param certKeyPath Path to the certificate private key
+   * @param options Additional options for the API server
+   *
+   * @throws io::OpenSSLError If the certificate couldn't be loaded
    */
   API::API(std::string &listenHost, const unsigned int port,
            std::string &certPath,
-           std::string &certKeyPath) : listenAddress(
+           std::string &certKeyPath, const APIOptions &options) : listenAddress(
           listenHost), listenPort(port), certPath(certPath), certKeyPath(
-          certKeyPath) {
+          certKeyPath), options(options) {
+    this->registry = std::make_shared<io::ConnectionRegistry>(
+            options.maxConnections);
+
+    // the server exists before the thread does, so it can always be stopped
+    this->apiCreateServer();
+
     // create the API thread
     this->shutdown = false;
     this->thread = new std::thread(&API::apiEntry, this);
   }
 
   /**
-   * Tears down the API handler.
+   * Tears down the API handler. The server is stopped first, which makes the
+   * API thread's run() fail; it's only destroyed once that thread exited.
    */
   API::~API() {
-    int err;
-
     // mark to the API to terminate
     this->shutdown = true;
 
-    // close the listening socket and join that thread
-    if(socket != -1) {
-      err = close(this->socket);
-      PLOG_IF(ERROR, err != 0) << "close() on API socket failed";
+    if(this->listener) {
+      this->listener->stop();
+    } else if(this->tlsServer) {
+      this->tlsServer->stop();
     }
 
     if(this->thread) {
@@ -61,34 +75,78 @@ namespace liblichtenstein::api {
       delete this->thread;
       this->thread = nullptr;
     }
-  }
 
+    // delete the API server; this also closes the listening socket
+    this->listener.reset();
+    this->tlsServer.reset();
+    this->socket = -1;
+  }
 
   /**
-   * Entry point for the API worker thread
+   * Creates the TLS server (or the listening shards) for the API, and loads
+   * its certificate.
+   *
+   * @throws io::OpenSSLError If the certificate couldn't be loaded
    */
-  void API::apiEntry() {
+  void API::apiCreateServer() {
     int err;
 
-    // create socket and listen on it
-    this->apiCreateSocket();
+    if(this->options.listenShards > 1) {
+      // each shard creates its own socket
+      this->listener = std::make_unique<io::ShardedListener>(
+              io::ShardedListener::Protocol::TLS, this->apiGetListenAddress(),
+              this->options.listenShards);
+      this->listener->loadCert(this->certPath, this->certKeyPath);
+    } else {
+      // create socket and listen on it
+      this->apiCreateSocket();
+
+      err = listen(this->socket, 5);
+      PCHECK(err == 0) << "listen() failed";
+
+      // now, create the TLS server
+      this->tlsServer = std::make_unique<io::TLSServer>(this->socket);
+      this->tlsServer->loadCert(this->certPath, this->certKeyPath);
+    }
+
+    // all sessions count against the API's connection limit
+    if(this->listener) {
+      this->listener->setRegistry(this->registry);
+    } else {
+      this->tlsServer->setRegistry(this->registry);
+    }
 
-    err = listen(this->socket, 5);
-    PCHECK(err == 0) << "listen() failed";
+    if(this->options.kernelTLS) {
+      auto *server = this->listener ? this->listener->getShard(0)
+                                    : this->tlsServer.get();
+      io::KernelTLS::enable(server->getContext());
+    }
+  }
 
-    // now, create the TLS server
-    this->tlsServer = new io::TLSServer(this->socket);
-    this->tlsServer->loadCert(this->certPath, this->certKeyPath);
+
+  /**
+   * Entry point for the API worker thread
+   */
+  void API::apiEntry() {
+    // set up the reactor, if requested
+    if(this->options.useReactor) {
+      if(Reactor::isSupported()) {
+        this->reactor = std::make_unique<Reactor>(this->options.reactorThreads,
+                                                  this->options.workerThreads);
+      } else {
+        LOG(WARNING) << "Reactor not supported, using a thread per client";
+      }
+    }
 
     // API server main loop
     while(!this->shutdown) {
       try {
         // try to get a client
-        auto client = this->tlsServer->run();
+        auto client = this->listener ? this->listener->run()
+                                     : this->tlsServer->run();
 
-        // instantiate a handler and add it to our list
-        auto *handler = new ClientHandler(this, client);
-        this->clients.emplace_back().reset(handler);
+        this->reapClients();
+        this->addClient(client);
       } catch (io::OpenSSLError &e) {
         LOG(ERROR) << "TLS error accepting client: " << e.what();
       } catch (std::system_error &e) {
@@ -105,16 +163,67 @@ namespace liblichtenstein::api {
       }
     }
 
-    // close all clients
+    // close all clients; the server is deleted once this thread exits
+    this->reactor.reset();
     this->clients.clear();
+  }
+
+  /**
+   * Sets up a handler for a newly accepted client. With the reactor, the
+   * client's socket is made non-blocking and the handler is invoked whenever
+   * it becomes readable; otherwise, the handler creates its own thread.
+   *
+   * @param client Client that was accepted
+   */
+  void API::addClient(std::shared_ptr<io::GenericServerClient> client) {
+    if(this->reactor) {
+      client->setBlocking(false);
+
+      auto handler = std::make_shared<ClientHandler>(this, client, false);
+
+      // the reactor holds on to the handler as long as the client is connected
+      this->reactor->add(client->getFd(), [handler] {
+        return handler->processAvailable();
+      }, [client] {
+        VLOG(1) << "Shutting down API client for client " << client;
+        client->close();
+      });
+
+      VLOG(1) << "Got new client: " << client << " (" << this->reactor->size()
+              << " connected)";
+    } else {
+      // instantiate a handler and add it to our list
+      auto *handler = new ClientHandler(this, client);
+      this->clients.emplace_back().reset(handler);
+    }
+  }
 
-    // delete the API server
-    delete this->tlsServer;
-    this->tlsServer = nullptr;
+  /**
+   * Deletes the handlers of clients that have disconnected, joining their
+   * (already exited) threads. Their sessions are reaped by the TLS server.
+   */
+  void API::reapClients() {
+    auto end = std::remove_if(this->clients.begin(), this->clients.end(),
+                              [](const std::shared_ptr<ClientHandler> &handler) {
+                                return handler->isFinished();
+                              });
+
+    if(end != this->clients.end()) {
+      VLOG(2) << "Reaping " << std::distance(end, this->clients.end())
+              << " finished API clients";
+      this->clients.erase(end, this->clients.end());
+    }
+  }
 
-    // close socket (XXX: state machine does this for us)
-    // close(this->socket);
-    // this->socket = -1;
+  /**
+   * Gets statistics about the clients connected to the API: how many are
+   * connected, how many were turned away, and how much memory their sessions
+   * take up, approximately.
+   *
+   * @return Connection counters
+   */
+  io::ConnectionRegistry::Stats API::getConnectionStats() const {
+    return this->registry->getStats();
   }
 
   /**
@@ -122,10 +231,39 @@ namespace liblichtenstein::api {
    */
   void API::apiCreateSocket() {
     int err;
-    struct sockaddr_in servaddr{};
+    struct sockaddr_in servaddr = this->apiGetListenAddress();
 
     int on = 1;
 
+    // create listening socket
+    this->socket = ::socket(servaddr.sin_family, SOCK_STREAM, 0);
+    PCHECK(this->socket > 0) << "socket() failed";
+
+    // bind to the given address
+    err = bind(this->socket, (const struct sockaddr *) &servaddr,
+               sizeof(servaddr));
+    PCHECK(err >= 0) << "bind() failed";
+
+    // allow address reuse
+    setsockopt(this->socket, SOL_SOCKET, SO_REUSEADDR, (const void *) &on,
+               (socklen_t) sizeof(on));
+#if defined(SO_REUSEPORT) && !defined(__linux__)
+    setsockopt(this->socket, SOL_SOCKET, SO_REUSEPORT, (const void *) &on,
+               (socklen_t) sizeof(on));
+#endif
+
+    // the socket has been created!
+  }
+
+  /**
+   * Parses the address the API should listen on.
+   *
+   * @return Listen address, including the port
+   */
+  struct sockaddr_in API::apiGetListenAddress() {
+    int err;
+    struct sockaddr_in servaddr{};
+
     // parse the address
     servaddr.sin_family = AF_INET;
     err = inet_pton(servaddr.sin_family, this->listenAddress.c_str(),
@@ -147,25 +285,8 @@ namespace liblichtenstein::api {
       }
     }
 
-    // create listening socket
-    this->socket = ::socket(servaddr.sin_family, SOCK_STREAM, 0);
-    PCHECK(this->socket > 0) << "socket() failed";
-
     servaddr.sin_port = htons(this->listenPort);
 
-    // bind to the given address
-    err = bind(this->socket, (const struct sockaddr *) &servaddr,
-               sizeof(servaddr));
-    PCHECK(err >= 0) << "bind() failed";
-
-    // allow address reuse
-    setsockopt(this->socket, SOL_SOCKET, SO_REUSEADDR, (const void *) &on,
-               (socklen_t) sizeof(on));
-#if defined(SO_REUSEPORT) && !defined(__linux__)
-    setsockopt(this->socket, SOL_SOCKET, SO_REUSEPORT, (const void *) &on,
-               (socklen_t) sizeof(on));
-#endif
-
-    // the socket has been created!
+    return servaddr;
   }
 }
\ No newline at end of file
@@ -5,13 +5,23 @@
 #ifndef LIBLICHTENSTEIN_API_H
 #define LIBLICHTENSTEIN_API_H
 
+#include "APIOptions.h"
+
+#include "io/ConnectionRegistry.h"
+
+#include <atomic>
+#include <memory>
 #include <string>
 #include <vector>
 #include <thread>
 
+#include <netinet/in.h>
+
 namespace liblichtenstein::io {
   class TLSServer;
 
+  class ShardedListener;
+
   class GenericServerClient;
 }
 
@@ -22,6 +32,8 @@ namespace liblichtenstein {
 namespace liblichtenstein::api {
   class ClientHandler;
 
+  class Reactor;
+
   /**
    * A standalone handler for the client API.
    */
@@ -30,21 +42,34 @@ namespace liblichtenstein::api {
 
     public:
       API(std::string &listenHost, unsigned int port,
-          std::string &certPath, std::string &certKeyPath);
+          std::string &certPath, std::string &certKeyPath,
+          const APIOptions &options = APIOptions());
 
       API(std::string &listenHost, unsigned int port,
-          std::string &certPath, std::string &certKeyPath, Client *client)
-              : API(listenHost, port, certPath, certKeyPath) {
+          std::string &certPath, std::string &certKeyPath, Client *client,
+          const APIOptions &options = APIOptions())
+              : API(listenHost, port, certPath, certKeyPath, options) {
         this->client = client;
       };
 
       virtual ~API();
 
+    public:
+      [[nodiscard]] io::ConnectionRegistry::Stats getConnectionStats() const;
+
     private:
       void apiEntry();
 
+      void apiCreateServer();
+
       void apiCreateSocket();
 
+      struct sockaddr_in apiGetListenAddress();
+
+      void addClient(std::shared_ptr<io::GenericServerClient> client);
+
+      void reapClients();
+
     private:
       // worker thread for handling the client API
       std::thread *thread = nullptr;
@@ -64,10 +89,19 @@ namespace liblichtenstein::api {
       // socket on which we're listening for the API
       int socket = -1;
       // TLS server for the client API
-      io::TLSServer *tlsServer = nullptr;
+      std::unique_ptr<io::TLSServer> tlsServer;
+      // listening shards, used instead of the TLS server if enabled
+      std::unique_ptr<io::ShardedListener> listener;
 
-      // a list of clients we've accepted and their threads
+      // clients we've accepted and their threads; finished ones are reaped
       std::vector<std::shared_ptr<ClientHandler>> clients;
+      // sessions of all connected clients, shared with the TLS server(s)
+      std::shared_ptr<io::ConnectionRegistry> registry;
+
+      // options the API was created with
+      APIOptions options;
+      // services clients if the reactor is in use
+      std::unique_ptr<Reactor> reactor;
 
       // client state machine
       Client *client = nullptr;
@@ -0,0 +1,51 @@
+//
+// Created by Tristan Seifert on 2019-09-02.
+//
+
+#ifndef LIBLICHTENSTEIN_APIOPTIONS_H
+#define LIBLICHTENSTEIN_APIOPTIONS_H
+
+#include <cstddef>
+
+namespace liblichtenstein::api {
+  /**
+   * Tunables for the client API server.
+   */
+  struct APIOptions {
+    /**
+     * When set, all client connections are serviced by a small number of
+     * reactor threads (using epoll) instead of a thread per connection. This
+     * is only available on Linux; elsewhere, it's ignored.
+     */
+    bool useReactor = false;
+
+    /// number of threads waiting for events on client sockets
+    size_t reactorThreads = 1;
+    /// number of threads that run request handlers
+    size_t workerThreads = 2;
+
+    /**
+     * Number of sockets to listen on with SO_REUSEPORT; connections are
+     * spread between them, and each accepts and performs handshakes on its
+     * own threads. Sharding is only available on Linux; elsewhere, a single
+     * socket is used.
+     */
+    size_t listenShards = 1;
+
+    /**
+     * Whether record encryption is handed to the kernel (kTLS) once the
+     * handshake completes, if both the kernel and the negotiated cipher
+     * suite support it. Otherwise, sessions stay in userspace.
+     */
+    bool kernelTLS = false;
+
+    /**
+     * Maximum number of clients connected at once; while this many are
+     * connected, further connections are closed right after they're
+     * accepted. 0 means no limit.
+     */
+    size_t maxConnections = 0;
+  };
+}
+
+#endif //LIBLICHTENSTEIN_APIOPTIONS_H
@@ -7,6 +7,7 @@
 #include "ClientHandler.h"
 #include "HandlerFactory.h"
 #include "protocol/ProtocolError.h"
+#include "protocol/MessageSerializer.h"
 
 #include <glog/logging.h>
 
@@ -18,7 +19,7 @@
 
 #include "io/OpenSSLError.h"
 #include "io/SSLSessionClosedError.h"
-#include "io/GenericServerClient.h"
+#include "io/ITransport.h"
 
 #include "shared/Message.pb.h"
 
@@ -32,12 +33,20 @@ namespace liblichtenstein::api {
    *
    * @param api API to which the client connected
    * @param client Client connection
+   * @param startThread Whether a thread should be created to read from the
+   * client; if not, processAvailable() must be called when data is available.
    */
   ClientHandler::ClientHandler(liblichtenstein::api::API *api,
-                               std::shared_ptr<io::GenericServerClient> client)
+                               std::shared_ptr<io::ITransport> client,
+                               bool startThread)
           : GenericClientHandler(client), api(api) {
+    // handlers are created as needed, and then reused for the connection
+    this->handlers.resize(HandlerFactory::getTypeTableSize());
+
     // set up thread
-    this->thread = new std::thread(&ClientHandler::handle, this);
+    if(startThread) {
+      this->thread = new std::thread(&ClientHandler::handle, this);
+    }
   }
 
   /**
@@ -47,11 +56,13 @@ namespace liblichtenstein::api {
     this->shutdown = true;
 
     // wait for thread to join and delete it
-    if(this->thread->joinable()) {
-      this->thread->join();
-    }
+    if(this->thread) {
+      if(this->thread->joinable()) {
+        this->thread->join();
+      }
 
-    delete thread;
+      delete this->thread;
+    }
   }
 
 
@@ -63,36 +74,7 @@ namespace liblichtenstein::api {
 
     // service requests as long as the API is running
     while(!this->shutdown) {
-      // try to read from the client
-      try {
-        this->readMessage([this](protoMessageType &message) {
-          this->processMessage(message);
-        });
-      }
-        // an error in the TLS library happened
-      catch(io::OpenSSLError &e) {
-        // ignore TLS errors if we're shutting down
-        if(!this->shutdown) {
-          LOG(ERROR) << "TLS error reading from client: " << e.what();
-        }
-      }
-        // if we get this exception, session was closed
-      catch(io::SSLSessionClosedError &e) {
-        VLOG(1) << "Connection was closed: " << e.what();
-        break;
-      }
-        // an error decoding message
-      catch(ProtocolError &e) {
-        LOG(ERROR) << "Protocol error, closing connection: " << e.what();
-        this->sendException(e);
-
-        break;
-      }
-        // some other runtime error happened
-      catch(std::runtime_error &e) {
-        LOG(ERROR) << "Runtime error reading from client: " << e.what();
-        this->sendException(e);
-
+      if(!this->readAndDispatch(false)) {
         break;
       }
     }
@@ -100,20 +82,94 @@ namespace liblichtenstein::api {
     // clean up client
     VLOG(1) << "Shutting down API client for client " << this->client;
     client->close();
+
+    this->finished = true;
+  }
+
+  /**
+   * Processes all messages that can be read from the client without blocking.
+   * This is used when the handler doesn't have its own thread, but is instead
+   * invoked whenever the client's socket becomes readable; the socket must be
+   * non-blocking.
+   *
+   * @return Whether the connection should be kept open
+   */
+  bool ClientHandler::processAvailable() {
+    return this->readAndDispatch(true);
+  }
+
+  /**
+   * Reads messages from the client and dispatches them to their handlers.
+   *
+   * @param drain If set, read until the (non-blocking) client has no more
+   * data; otherwise, wait for at least one message.
+   * @return Whether the connection should be kept open
+   */
+  bool ClientHandler::readAndDispatch(bool drain) {
+    auto dispatch = [this](protoMessageType &message) {
+      this->processMessage(message);
+    };
+
+    // try to read from the client
+    try {
+      if(drain) {
+        this->drainMessages(dispatch);
+      } else {
+        this->readMessages(dispatch);
+      }
+    }
+      // an error in the TLS library happened
+    catch(io::OpenSSLError &e) {
+      // the session is unusable, so close it; quietly if we're shutting down
+      if(!this->shutdown) {
+        LOG(ERROR) << "TLS error reading from client: " << e.what();
+      }
+
+      return false;
+    }
+      // if we get this exception, session was closed
+    catch(io::SSLSessionClosedError &e) {
+      VLOG(1) << "Connection was closed: " << e.what();
+      return false;
+    }
+      // an error decoding message
+    catch(ProtocolError &e) {
+      LOG(ERROR) << "Protocol error, closing connection: " << e.what();
+      this->sendException(e);
+
+      return false;
+    }
+      // some other runtime error happened
+    catch(std::runtime_error &e) {
+      LOG(ERROR) << "Runtime error reading from client: " << e.what();
+      this->sendException(e);
+
+      return false;
+    }
+
+    return true;
   }
 
   /**
-   * Processes a received message. Its type URL is looked up in the internal
+   * Processes a received message. Its type is looked up in the internal
    * registry and the appropriate handler function is invoked.
    *
    * @param received Message received from the client
    */
   void
   ClientHandler::processMessage(lichtenstein::protocol::Message &received) {
-    // get the type and try to allocate a handler
-    std::string type = received.payload().type_url();
+    // get the type and find its handler
+    auto type = MessageSerializer::getType(received);
+    std::unique_ptr<IRequestHandler> uncachedHandler;
+
+    IRequestHandler *handler = this->getHandler(type);
 
-    auto handler = HandlerFactory::create(type, this->api, this);
+    // messages without a numeric type are looked up by their type URL
+    if(!handler && type == MessageType::Unknown) {
+      uncachedHandler = HandlerFactory::create(received.payload().type_url(),
+                                               this->api, this);
+      handler = uncachedHandler.get();
+    }
 
     // invoke handler function
     if(handler) {
@@ -125,11 +181,37 @@ namespace liblichtenstein::api {
 
       HandlerFactory::dump();
 
-      error << "Received message of unknown type " << type;
+      error << "Received message of unknown type "
+            << received.payload().type_url() << " ("
+            << static_cast<uint32_t>(type) << ")";
       throw ProtocolError(error.str().c_str());
     }
   }
 
+  /**
+   * Gets the handler for the given message type. Handlers are created the
+   * first time a message of their type is received, then reused for all
+   * subsequent messages of that type on this connection.
+   *
+   * @param type Numeric message type
+   * @return Handler instance, or nullptr if there is no handler for the type
+   */
+  IRequestHandler *ClientHandler::getHandler(MessageType type) {
+    const auto index = static_cast<uint32_t>(type);
+
+    if(type == MessageType::Unknown || index >= this->handlers.size()) {
+      return nullptr;
+    }
+
+    auto &handler = this->handlers[index];
+
+    if(!handler) {
+      handler = HandlerFactory::create(type, this->api, this);
+    }
+
+    return handler.get();
+  }
+
   /**
    * Returns the pointer to the client state machine.
    *
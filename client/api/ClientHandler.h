@@ -6,11 +6,13 @@
 #define LIBLICHTENSTEIN_CLIENTHANDLER_H
 
 #include "protocol/GenericClientHandler.h"
+#include "protocol/MessageTypes.h"
 
 #include <atomic>
 #include <thread>
 #include <memory>
 #include <cstddef>
+#include <vector>
 #include <google/protobuf/message.h>
 
 namespace lichtenstein::protocol {
@@ -30,7 +32,7 @@ namespace liblichtenstein {
 }
 
 namespace liblichtenstein::io {
-  class GenericServerClient;
+  class ITransport;
 }
 
 namespace liblichtenstein::api {
@@ -44,18 +46,31 @@ namespace liblichtenstein::api {
       friend class IRequestHandler;
 
     public:
-      ClientHandler(API *api, std::shared_ptr<io::GenericServerClient> client);
+      ClientHandler(API *api, std::shared_ptr<io::ITransport> client,
+                    bool startThread = true);
 
       ~ClientHandler() override;
 
+    public:
+      bool processAvailable();
+
+      /// whether the worker thread has exited, so the handler can be deleted
+      [[nodiscard]] bool isFinished() const {
+        return this->finished;
+      }
+
     protected:
       Client *getClient();
 
     private:
       void handle();
 
+      bool readAndDispatch(bool drain);
+
       void processMessage(lichtenstein::protocol::Message &received);
 
+      IRequestHandler *getHandler(MessageType type);
+
     private:
       // API that this client connected to
       API *api = nullptr;
@@ -64,6 +79,11 @@ namespace liblichtenstein::api {
       std::thread *thread = nullptr;
       // should we shut down?
       std::atomic_bool shutdown = false;
+      // set once the worker thread is about to exit
+      std::atomic_bool finished = false;
+
+      // handlers for this connection, indexed by numeric message type
+      std::vector<std::unique_ptr<IRequestHandler>> handlers;
   };
 }
 
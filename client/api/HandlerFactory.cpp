@@ -6,6 +6,7 @@
 
 #include <glog/logging.h>
 
+#include <algorithm>
 #include <iomanip>
 #include <sstream>
 #include <mutex>
@@ -15,9 +16,22 @@ namespace liblichtenstein::api {
   /// holds registered classes
   std::map<std::string, HandlerFactory::createMethod> *HandlerFactory::registrations = nullptr;
 
+  /// whether registrations have been frozen
+  bool HandlerFactory::frozen = false;
+  /// registered classes, indexed by their numeric message type
+  std::vector<HandlerFactory::createMethod> HandlerFactory::typeTable;
+  /// registered classes, by their type URL
+  std::unordered_map<std::string_view, HandlerFactory::createMethod> HandlerFactory::urlTable;
+
+  /// protects registration and building of the lookup tables
+  static std::mutex registerLock;
+  /// used to build the lookup tables exactly once
+  static std::once_flag freezeFlag;
+
 
   /**
-   * Registers a class with the factory.
+   * Registers a class with the factory. This must happen before the factory
+   * is frozen.
    *
    * @param name Type name of the class' protobuf message
    * @param funcCreate Constructor of the class
@@ -26,9 +40,14 @@ namespace liblichtenstein::api {
   bool HandlerFactory::registerClass(const std::string type,
                                      createMethod funcCreate) {
     // keep a lock
-    static std::mutex registerLock;
     std::lock_guard guard(registerLock);
 
+    if(frozen) {
+      LOG(ERROR) << "Attempt to register handler for " << type
+                 << " after registrations were frozen";
+      return false;
+    }
+
     // allocate map if needed
     if(registrations == nullptr) {
       registrations = new std::map<std::string, createMethod>();
@@ -37,7 +56,6 @@ namespace liblichtenstein::api {
     // register if we haven't already got this registration
     if(auto it = registrations->find(type); it == registrations->end()) {
       registrations->insert(std::make_pair(type, funcCreate));
-//      registrations[type] = funcCreate;
       return true;
     }
 
@@ -47,6 +65,99 @@ namespace liblichtenstein::api {
     return false;
   }
 
+  /**
+   * Freezes the registrations, building the lookup tables. No further classes
+   * can be registered after this.
+   *
+   * This happens automatically on the first lookup, but can be called ahead of
+   * time so the first message doesn't incur the cost.
+   */
+  void HandlerFactory::freeze() {
+    std::call_once(freezeFlag, HandlerFactory::buildTables);
+  }
+
+  /**
+   * Builds the lookup tables from all registrations.
+   */
+  void HandlerFactory::buildTables() {
+    std::lock_guard guard(registerLock);
+
+    if(registrations == nullptr) {
+      registrations = new std::map<std::string, createMethod>();
+    }
+
+    // the numeric types are small and dense, so index a table directly
+    uint32_t maxType = 0;
+
+    for(auto const &[type, func] : *registrations) {
+      auto numericType = static_cast<uint32_t>(MessageTypes::forTypeUrl(type));
+      maxType = std::max(maxType, numericType);
+    }
+
+    typeTable.assign(maxType + 1, nullptr);
+    urlTable.reserve(registrations->size());
+
+    for(auto const &[type, func] : *registrations) {
+      urlTable.emplace(std::string_view(type), func);
+
+      auto numericType = MessageTypes::forTypeUrl(type);
+
+      if(numericType != MessageType::Unknown) {
+        typeTable[static_cast<uint32_t>(numericType)] = func;
+      }
+    }
+
+    frozen = true;
+
+    VLOG(1) << "Froze " << registrations->size() << " handler registrations";
+  }
+
+  /**
+   * Finds the create method for the given type URL.
+   *
+   * @param type Type URL of the protobuf message
+   * @return Create method, or nullptr if there is no handler for the type
+   */
+  HandlerFactory::createMethod HandlerFactory::lookup(std::string_view type) {
+    freeze();
+
+    if(auto it = urlTable.find(type); it != urlTable.end()) {
+      return it->second;
+    }
+
+    return nullptr;
+  }
+
+  /**
+   * Finds the create method for the given numeric message type.
+   *
+   * @param type Numeric message type
+   * @return Create method, or nullptr if there is no handler for the type
+   */
+  HandlerFactory::createMethod HandlerFactory::lookup(MessageType type) {
+    freeze();
+
+    const auto index = static_cast<uint32_t>(type);
+
+    if(index < typeTable.size()) {
+      return typeTable[index];
+    }
+
+    return nullptr;
+  }
+
+  /**
+   * Returns the size of the table indexed by numeric message type; no handler
+   * has a type equal to or greater than this.
+   *
+   * @return Number of entries in the type table
+   */
+  size_t HandlerFactory::getTypeTableSize() {
+    freeze();
+
+    return typeTable.size();
+  }
+
   /**
    * Instantiates a handler for the given message type.
    *
@@ -56,11 +167,28 @@ namespace liblichtenstein::api {
    * @return An instance of a handler or nullptr
    */
   std::unique_ptr<IRequestHandler>
-  HandlerFactory::create(const std::string &type, API *api,
+  HandlerFactory::create(std::string_view type, API *api,
                          ClientHandler *client) {
-    // try to find a handler for this name
-    if(auto it = registrations->find(type); it != registrations->end()) {
-      return it->second(api, client);
+    if(auto func = lookup(type); func != nullptr) {
+      return func(api, client);
+    }
+
+    // no such handler :(
+    return nullptr;
+  }
+
+  /**
+   * Instantiates a handler for the given numeric message type.
+   *
+   * @param type Numeric message type
+   * @param api API instance associated with this message
+   * @param client Client handler that received the request
+   * @return An instance of a handler or nullptr
+   */
+  std::unique_ptr<IRequestHandler>
+  HandlerFactory::create(MessageType type, API *api, ClientHandler *client) {
+    if(auto func = lookup(type); func != nullptr) {
+      return func(api, client);
     }
 
     // no such handler :(
@@ -73,6 +201,10 @@ namespace liblichtenstein::api {
   void HandlerFactory::dump() {
     std::stringstream str;
 
+    std::lock_guard guard(registerLock);
+
+    if(registrations == nullptr) return;
+
     for(auto const &[key, func] : *registrations) {
       str << std::setw(40) << std::setfill(' ') << key << std::setw(0);
       str << func << std::endl;
@@ -80,4 +212,4 @@ namespace liblichtenstein::api {
 
     LOG(INFO) << "Registered handlers: " << std::endl << str.str();
   }
-}
\ No newline at end of file
+}
@@ -6,10 +6,14 @@
 #define LIBLICHTENSTEIN_HANDLERFACTORY_H
 
 #include "IRequestHandler.h"
+#include "protocol/MessageTypes.h"
 
 #include <memory>
 #include <string>
+#include <string_view>
 #include <map>
+#include <unordered_map>
+#include <vector>
 
 namespace liblichtenstein::api {
   class API;
@@ -17,7 +21,13 @@ namespace liblichtenstein::api {
   class ClientHandler;
 
   /**
-   * The handler factory contains a registry of all API handlers
+   * The handler factory contains a registry of all API handlers.
+   *
+   * Handlers register themselves during static initialization. The first time
+   * a handler is looked up (or when freeze() is called explicitly) the
+   * registrations are frozen into immutable lookup tables: a table indexed
+   * directly by the numeric message type, and a hash table keyed by type URL.
+   * Lookups after that point take no locks and don't allocate.
    */
   class HandlerFactory {
     public:
@@ -31,13 +41,34 @@ namespace liblichtenstein::api {
       static bool
       registerClass(const std::string type, createMethod funcCreate);
 
+      static void freeze();
+
+      static createMethod lookup(std::string_view type);
+
+      static createMethod lookup(MessageType type);
+
+      static std::unique_ptr<IRequestHandler>
+      create(std::string_view type, API *api, ClientHandler *client);
+
       static std::unique_ptr<IRequestHandler>
-      create(const std::string &type, API *api, ClientHandler *client);
+      create(MessageType type, API *api, ClientHandler *client);
+
+      static size_t getTypeTableSize();
 
       static void dump();
 
+    private:
+      static void buildTables();
+
     private:
       static std::map<std::string, createMethod> *registrations;
+
+      /// set once the lookup tables have been built
+      static bool frozen;
+      /// create method for each numeric type, indexed by its value
+      static std::vector<createMethod> typeTable;
+      /// create methods keyed by type URL; keys point into `registrations`
+      static std::unordered_map<std::string_view, createMethod> urlTable;
   };
 };
 
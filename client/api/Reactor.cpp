@@ -0,0 +1,318 @@
+//
+// Created by Tristan Seifert on 2019-09-02.
+//
+
+#include "Reactor.h"
+#include "WorkerPool.h"
+
+#include <glog/logging.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <system_error>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
+
+namespace liblichtenstein::api {
+  /**
+   * Determines whether the reactor can be used on this platform.
+   *
+   * @return Whether the reactor is supported
+   */
+  bool Reactor::isSupported() {
+#ifdef __linux__
+    return true;
+#else
+    return false;
+#endif
+  }
+
+#ifdef __linux__
+  /**
+   * Creates the reactor and starts its threads.
+   *
+   * @param numThreads Number of threads waiting for socket events
+   * @param numWorkers Number of threads on which callbacks are run
+   * @throws std::system_error If the epoll instance can't be created
+   */
+  Reactor::Reactor(size_t numThreads, size_t numWorkers) {
+    int err;
+
+    this->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if(this->epollFd == -1) {
+      throw std::system_error(errno, std::system_category(),
+                              "epoll_create1() failed");
+    }
+
+    this->wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if(this->wakeFd == -1) {
+      ::close(this->epollFd);
+      throw std::system_error(errno, std::system_category(),
+                              "eventfd() failed");
+    }
+
+    // the wake event is level triggered so it wakes up all threads
+    struct epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = this->wakeFd;
+
+    err = epoll_ctl(this->epollFd, EPOLL_CTL_ADD, this->wakeFd, &event);
+    if(err == -1) {
+      ::close(this->wakeFd);
+      ::close(this->epollFd);
+      throw std::system_error(errno, std::system_category(),
+                              "epoll_ctl() failed");
+    }
+
+    // set up the workers, then the reactor threads
+    this->pool = std::make_unique<WorkerPool>(numWorkers);
+
+    if(numThreads == 0) numThreads = 1;
+
+    for(size_t i = 0; i < numThreads; i++) {
+      this->threads.emplace_back(&Reactor::reactorEntry, this);
+    }
+  }
+
+  /**
+   * Stops the reactor, and removes all sockets that are still registered.
+   */
+  Reactor::~Reactor() {
+    this->stop();
+
+    // remove all remaining sockets
+    decltype(this->entries) remaining;
+
+    {
+      std::lock_guard<std::mutex> lg(this->entriesLock);
+      remaining.swap(this->entries);
+    }
+
+    for(auto &[fd, entry] : remaining) {
+      epoll_ctl(this->epollFd, EPOLL_CTL_DEL, fd, nullptr);
+
+      if(entry->onRemoved) {
+        entry->onRemoved();
+      }
+    }
+
+    remaining.clear();
+
+    // lastly, close the epoll instance
+    ::close(this->wakeFd);
+    ::close(this->epollFd);
+  }
+
+
+  /**
+   * Stops the reactor threads and waits for all callbacks that are executing
+   * or queued to complete. Sockets are not re-armed after this.
+   */
+  void Reactor::stop() {
+    if(!this->shutdown.exchange(true)) {
+      uint64_t value = 1;
+      ssize_t written = ::write(this->wakeFd, &value, sizeof(value));
+      PLOG_IF(ERROR, written != sizeof(value)) << "Failed to wake reactor";
+    }
+
+    for(auto &thread : this->threads) {
+      if(thread.joinable()) {
+        thread.join();
+      }
+    }
+
+    this->threads.clear();
+
+    if(this->pool) {
+      this->pool->stop();
+    }
+  }
+
+
+  /**
+   * Registers a socket with the reactor.
+   *
+   * @param fd Socket to watch; it should be in non-blocking mode
+   * @param onReadable Callback to invoke when the socket is readable
+   * @param onRemoved Callback invoked once the socket was removed
+   * @throws std::system_error If the socket couldn't be registered
+   */
+  void Reactor::add(int fd, ReadableCallback onReadable,
+                    RemovedCallback onRemoved) {
+    auto entry = std::make_shared<Entry>();
+    entry->fd = fd;
+    entry->onReadable = std::move(onReadable);
+    entry->onRemoved = std::move(onRemoved);
+
+    {
+      std::lock_guard<std::mutex> lg(this->entriesLock);
+      this->entries[fd] = entry;
+    }
+
+    try {
+      this->arm(fd, true);
+    } catch(std::system_error &) {
+      std::lock_guard<std::mutex> lg(this->entriesLock);
+      this->entries.erase(fd);
+      throw;
+    }
+  }
+
+  /**
+   * Removes a socket from the reactor and invokes its removal callback. The
+   * socket must not be closed before this is called, since its descriptor
+   * could otherwise be reused by another connection.
+   *
+   * @param fd Socket to remove
+   */
+  void Reactor::remove(int fd) {
+    std::shared_ptr<Entry> entry;
+
+    {
+      std::lock_guard<std::mutex> lg(this->entriesLock);
+
+      auto it = this->entries.find(fd);
+      if(it == this->entries.end()) return;
+
+      entry = it->second;
+      this->entries.erase(it);
+
+      // stop watching before the descriptor can be reused
+      int err = epoll_ctl(this->epollFd, EPOLL_CTL_DEL, fd, nullptr);
+      PLOG_IF(ERROR, err != 0) << "Failed to remove fd " << fd;
+    }
+
+    // the entry (and whatever its callbacks hold on to) dies outside the lock
+    if(entry->onRemoved) {
+      entry->onRemoved();
+    }
+  }
+
+  /**
+   * Gets the number of sockets registered with the reactor.
+   *
+   * @return Number of sockets
+   */
+  size_t Reactor::size() const {
+    std::lock_guard<std::mutex> lg(this->entriesLock);
+    return this->entries.size();
+  }
+
+
+  /**
+   * Reactor thread entry point: waits for events and dispatches them to the
+   * worker pool.
+   */
+  void Reactor::reactorEntry() {
+    struct epoll_event events[kMaxEvents];
+
+    while(!this->shutdown) {
+      int num = epoll_wait(this->epollFd, events, kMaxEvents, -1);
+
+      if(num == -1) {
+        if(errno == EINTR) continue;
+
+        PLOG(ERROR) << "epoll_wait() failed";
+        return;
+      }
+
+      for(int i = 0; i < num; i++) {
+        const int fd = events[i].data.fd;
+
+        if(fd == this->wakeFd) {
+          return;
+        }
+
+        // find the entry; it may have been removed in the meantime
+        std::shared_ptr<Entry> entry;
+
+        {
+          std::lock_guard<std::mutex> lg(this->entriesLock);
+
+          auto it = this->entries.find(fd);
+          if(it == this->entries.end()) continue;
+
+          entry = it->second;
+        }
+
+        this->pool->submit([this, entry] {
+          this->service(entry);
+        });
+      }
+    }
+  }
+
+  /**
+   * Runs the readable callback for a socket, then re-arms or removes it.
+   *
+   * @param entry Entry for the socket that became readable
+   */
+  void Reactor::service(const std::shared_ptr<Entry> &entry) {
+    bool keep = false;
+
+    try {
+      keep = entry->onReadable();
+    } catch(std::exception &e) {
+      LOG(ERROR) << "Unhandled exception servicing fd " << entry->fd << ": "
+                 << e.what();
+    }
+
+    // sockets are left alone during shutdown; the destructor cleans up
+    if(this->shutdown) return;
+
+    if(keep) {
+      try {
+        this->arm(entry->fd, false);
+        return;
+      } catch(std::system_error &e) {
+        LOG(ERROR) << "Failed to re-arm fd " << entry->fd << ": " << e.what();
+      }
+    }
+
+    this->remove(entry->fd);
+  }
+
+  /**
+   * Arms a socket for a single readability event.
+   *
+   * @param fd Socket to arm
+   * @param initial Whether the socket is being added to the epoll instance
+   * @throws std::system_error
+   */
+  void Reactor::arm(int fd, bool initial) {
+    struct epoll_event event{};
+    event.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+    event.data.fd = fd;
+
+    int err = epoll_ctl(this->epollFd, initial ? EPOLL_CTL_ADD : EPOLL_CTL_MOD,
+                        fd, &event);
+
+    if(err == -1) {
+      throw std::system_error(errno, std::system_category(),
+                              "epoll_ctl() failed");
+    }
+  }
+#else
+  Reactor::Reactor(size_t, size_t) {
+    throw std::system_error(ENOTSUP, std::system_category(),
+                            "Reactor is not supported on this platform");
+  }
+
+  Reactor::~Reactor() = default;
+
+  void Reactor::add(int, ReadableCallback, RemovedCallback) {}
+
+  void Reactor::remove(int) {}
+
+  void Reactor::stop() {}
+
+  size_t Reactor::size() const {
+    return 0;
+  }
+#endif
+}
@@ -0,0 +1,98 @@
+//
+// Created by Tristan Seifert on 2019-09-02.
+//
+
+#ifndef LIBLICHTENSTEIN_REACTOR_H
+#define LIBLICHTENSTEIN_REACTOR_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+
+namespace liblichtenstein::api {
+  class WorkerPool;
+
+  /**
+   * Multiplexes many sockets onto a few threads: reactor threads wait for
+   * sockets to become readable (using epoll) and then hand them off to a
+   * worker pool, which runs the readable callback for that socket.
+   *
+   * Sockets are registered as one-shot: while a callback runs, no further
+   * events are delivered for that socket, so a connection is only ever
+   * serviced by one worker at a time. Once the callback returns, the socket
+   * is re-armed, or removed if the callback says so.
+   *
+   * This is only available on Linux.
+   */
+  class Reactor {
+    public:
+      /// invoked on a worker when the socket is readable; return false to close
+      using ReadableCallback = std::function<bool()>;
+      /// invoked once the socket was removed from the reactor
+      using RemovedCallback = std::function<void()>;
+
+    public:
+      Reactor(size_t numThreads, size_t numWorkers);
+
+      virtual ~Reactor();
+
+    public:
+      static bool isSupported();
+
+      void add(int fd, ReadableCallback onReadable, RemovedCallback onRemoved);
+
+      void remove(int fd);
+
+      void stop();
+
+      [[nodiscard]] size_t size() const;
+
+    private:
+      struct Entry {
+        /// socket being watched
+        int fd = -1;
+
+        /// called when the socket becomes readable
+        ReadableCallback onReadable;
+        /// called when the socket is removed
+        RemovedCallback onRemoved;
+      };
+
+    private:
+      void reactorEntry();
+
+      void service(const std::shared_ptr<Entry> &entry);
+
+      void arm(int fd, bool initial);
+
+    private:
+      /// maximum number of events to handle per wakeup
+      static const size_t kMaxEvents = 32;
+
+    private:
+      /// epoll instance all sockets are registered with
+      int epollFd = -1;
+      /// eventfd used to wake up the reactor threads on shutdown
+      int wakeFd = -1;
+
+      /// reactor threads
+      std::vector<std::thread> threads;
+      /// workers on which callbacks run
+      std::unique_ptr<WorkerPool> pool;
+
+      /// protects the entries map
+      mutable std::mutex entriesLock;
+      /// all registered sockets
+      std::unordered_map<int, std::shared_ptr<Entry>> entries;
+
+      /// when set, the reactor is shutting down
+      std::atomic_bool shutdown = false;
+  };
+}
+
+#endif //LIBLICHTENSTEIN_REACTOR_H
@@ -0,0 +1,108 @@
+//
+// Created by Tristan Seifert on 2019-09-02.
+//
+
+#include "WorkerPool.h"
+
+#include <glog/logging.h>
+
+#include <exception>
+
+
+namespace liblichtenstein::api {
+  /**
+   * Creates a worker pool and starts its threads.
+   *
+   * @param numThreads Number of worker threads; at least one is created
+   */
+  WorkerPool::WorkerPool(size_t numThreads) {
+    if(numThreads == 0) numThreads = 1;
+
+    this->threads.reserve(numThreads);
+
+    for(size_t i = 0; i < numThreads; i++) {
+      this->threads.emplace_back(&WorkerPool::workerEntry, this);
+    }
+  }
+
+  /**
+   * Stops all workers, after they've run any jobs still in the queue.
+   */
+  WorkerPool::~WorkerPool() {
+    this->stop();
+  }
+
+
+  /**
+   * Adds a job to the queue. It will be run on the next available worker.
+   *
+   * @param job Job to run
+   */
+  void WorkerPool::submit(Job job) {
+    {
+      std::lock_guard<std::mutex> lg(this->queueLock);
+
+      if(this->shutdown) {
+        LOG(WARNING) << "Ignoring job submitted to stopped worker pool";
+        return;
+      }
+
+      this->queue.push_back(std::move(job));
+    }
+
+    this->queueCv.notify_one();
+  }
+
+  /**
+   * Signals all workers to exit once the queue has been drained, and waits for
+   * them to do so.
+   */
+  void WorkerPool::stop() {
+    {
+      std::lock_guard<std::mutex> lg(this->queueLock);
+      this->shutdown = true;
+    }
+
+    this->queueCv.notify_all();
+
+    for(auto &thread : this->threads) {
+      if(thread.joinable()) {
+        thread.join();
+      }
+    }
+
+    this->threads.clear();
+  }
+
+
+  /**
+   * Worker thread entry point; runs jobs until the pool is stopped.
+   */
+  void WorkerPool::workerEntry() {
+    while(true) {
+      Job job;
+
+      {
+        std::unique_lock<std::mutex> lk(this->queueLock);
+        this->queueCv.wait(lk, [this] {
+          return this->shutdown || !this->queue.empty();
+        });
+
+        if(this->queue.empty()) {
+          // shutting down and nothing left to do
+          return;
+        }
+
+        job = std::move(this->queue.front());
+        this->queue.pop_front();
+      }
+
+      // jobs are expected to handle their own errors
+      try {
+        job();
+      } catch(std::exception &e) {
+        LOG(ERROR) << "Unhandled exception in worker job: " << e.what();
+      }
+    }
+  }
+}
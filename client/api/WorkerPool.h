@@ -0,0 +1,59 @@
+//
+// Created by Tristan Seifert on 2019-09-02.
+//
+
+#ifndef LIBLICHTENSTEIN_WORKERPOOL_H
+#define LIBLICHTENSTEIN_WORKERPOOL_H
+
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+namespace liblichtenstein::api {
+  /**
+   * A fixed number of threads that run jobs from a shared queue, in the order
+   * they were submitted.
+   */
+  class WorkerPool {
+    public:
+      using Job = std::function<void()>;
+
+    public:
+      explicit WorkerPool(size_t numThreads);
+
+      virtual ~WorkerPool();
+
+    public:
+      void submit(Job job);
+
+      void stop();
+
+      /// returns the number of threads in the pool
+      [[nodiscard]] size_t getNumThreads() const {
+        return this->threads.size();
+      }
+
+    private:
+      void workerEntry();
+
+    private:
+      /// worker threads
+      std::vector<std::thread> threads;
+
+      /// protects the job queue and shutdown flag
+      std::mutex queueLock;
+      /// signalled when a job is added to the queue, or on shutdown
+      std::condition_variable queueCv;
+      /// jobs waiting to be executed
+      std::deque<Job> queue;
+
+      /// when set, workers exit once the queue is empty
+      bool shutdown = false;
+  };
+}
+
+#endif //LIBLICHTENSTEIN_WORKERPOOL_H
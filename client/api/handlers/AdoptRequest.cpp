@@ -5,6 +5,7 @@
 #include "../ClientHandler.h"
 #include "../HandlerFactory.h"
 #include "../../Client.h"
+#include "protocol/MessageSerializer.h"
 
 #include "shared/Message.pb.h"
 #include "client/AdoptRequest.pb.h"
@@ -15,9 +16,11 @@
 #include <string>
 #include <algorithm>
 
-using MessageType = lichtenstein::protocol::client::AdoptRequest;
+using RequestMessageType = lichtenstein::protocol::client::AdoptRequest;
 using AckMessageType = lichtenstein::protocol::client::AdoptAck;
 
+using liblichtenstein::api::MessageSerializer;
+using google::protobuf::Arena;
 
 namespace liblichtenstein::api::handler {
   /// register with the factory
@@ -49,9 +52,10 @@ namespace liblichtenstein::api::handler {
   void AdoptRequest::handle(const lichtenstein::protocol::Message &received) {
     auto store = this->getClient()->getDataStore();
 
-    // unpack message
-    MessageType request;
-    if(!received.payload().UnpackTo(&request)) {
+    // unpack message (onto the connection's arena)
+    auto &request = *Arena::CreateMessage<RequestMessageType>(
+            received.GetArena());
+    if(!MessageSerializer::unpack(received, request)) {
       throw std::runtime_error("Failed to unpack AdoptRequest");
     }
 
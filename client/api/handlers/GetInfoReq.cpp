@@ -6,6 +6,9 @@
 #include "../ClientHandler.h"
 #include "../HandlerFactory.h"
 #include "../../Client.h"
+#include "protocol/MessageSerializer.h"
+#include "io/GenericServerClient.h"
+#include "io/CipherPolicy.h"
 
 #include <glog/logging.h>
 
@@ -29,6 +32,8 @@ using lichtenstein::protocol::client::GetInfoResponse;
 using lichtenstein::protocol::client::NodeInfo;
 using lichtenstein::protocol::client::AdoptionStatus;
 using lichtenstein::protocol::client::PerformanceInfo;
+using liblichtenstein::api::MessageSerializer;
+using google::protobuf::Arena;
 
 namespace liblichtenstein::api::handler {
   /// register with the factory
@@ -55,28 +60,31 @@ namespace liblichtenstein::api::handler {
    * @param received Received request
    */
   void GetInfoReq::handle(const lichtenstein::protocol::Message &received) {
+    // all messages are allocated on the connection's arena
+    auto *arena = received.GetArena();
+
     // unpack message
-    GetInfo getInfo;
-    received.payload().UnpackTo(&getInfo);
+    auto &getInfo = *Arena::CreateMessage<GetInfo>(arena);
+    MessageSerializer::unpack(received, getInfo);
 
     LOG(INFO) << "Get info: " << getInfo.DebugString();
 
     // craft response message
-    GetInfoResponse response;
+    auto &response = *Arena::CreateMessage<GetInfoResponse>(arena);
 
     // shall it include node info?
     if(getInfo.wantsnodeinfo()) {
-      response.set_allocated_node(this->makeNodeInfo());
+      response.set_allocated_node(this->makeNodeInfo(arena));
     }
 
     // shall it include adoption info?
     if(getInfo.wantsadoptioninfo()) {
-      response.set_allocated_adoption(this->makeAdoptionStatus());
+      response.set_allocated_adoption(this->makeAdoptionStatus(arena));
     }
 
     // shall it include performance info?
     if(getInfo.wantsperformanceinfo()) {
-      response.set_allocated_performance(this->makePerformanceInfo());
+      response.set_allocated_performance(this->makePerformanceInfo(arena));
     }
 
     // send it
@@ -87,13 +95,14 @@ namespace liblichtenstein::api::handler {
   /**
    * Gets node information into an allocated message.
    *
+   * @param arena Arena on which to allocate the message
    * @return Allocated node info
    */
-  NodeInfo *GetInfoReq::makeNodeInfo() {
+  NodeInfo *GetInfoReq::makeNodeInfo(Arena *arena) {
     int err;
 
     // create the node info message
-    auto *node = new NodeInfo();
+    auto *node = Arena::CreateMessage<NodeInfo>(arena);
 
     // get hostname
     char hostname[256]{};
@@ -131,10 +140,21 @@ namespace liblichtenstein::api::handler {
   /**
    * Gets performance information into an allocated message.
    *
+   * @param arena Arena on which to allocate the message
    * @return Allocated performance info
    */
-  PerformanceInfo *GetInfoReq::makePerformanceInfo() {
-    auto *performance = new PerformanceInfo();
+  PerformanceInfo *GetInfoReq::makePerformanceInfo(Arena *arena) {
+    auto *performance = Arena::CreateMessage<PerformanceInfo>(arena);
+
+    // describe the connection's encryption, if it's encrypted at all
+    auto transport = this->client->GenericClientHandler::getClient();
+    auto tls = std::dynamic_pointer_cast<io::GenericServerClient>(transport);
+
+    if(tls) {
+      performance->set_cipher(tls->getCipherDescription());
+    }
+
+    performance->set_aesacceleration(io::CipherPolicy::hasAESAcceleration());
 
     return performance;
   }
@@ -142,10 +162,11 @@ namespace liblichtenstein::api::handler {
   /**
    * Gets adoption status into an allocated message.
    *
+   * @param arena Arena on which to allocate the message
    * @return Allocated adoption status
    */
-  AdoptionStatus *GetInfoReq::makeAdoptionStatus() {
-    auto *adoption = new AdoptionStatus();
+  AdoptionStatus *GetInfoReq::makeAdoptionStatus(Arena *arena) {
+    auto *adoption = Arena::CreateMessage<AdoptionStatus>(arena);
 
     // are we adopted?
     adoption->set_isadopted(this->getClient()->isAdopted());
@@ -9,6 +9,10 @@
 
 #include <memory>
 
+namespace google::protobuf {
+  class Arena;
+}
+
 namespace lichtenstein::protocol {
   class Message;
 
@@ -37,11 +41,14 @@ namespace liblichtenstein::api::handler {
       construct(API *api, ClientHandler *client);
 
     private:
-      lichtenstein::protocol::client::NodeInfo *makeNodeInfo();
+      lichtenstein::protocol::client::NodeInfo *
+      makeNodeInfo(google::protobuf::Arena *arena);
 
-      lichtenstein::protocol::client::PerformanceInfo *makePerformanceInfo();
+      lichtenstein::protocol::client::PerformanceInfo *
+      makePerformanceInfo(google::protobuf::Arena *arena);
 
-      lichtenstein::protocol::client::AdoptionStatus *makeAdoptionStatus();
+      lichtenstein::protocol::client::AdoptionStatus *
+      makeAdoptionStatus(google::protobuf::Arena *arena);
 
     private:
       static bool registered;
@@ -0,0 +1,951 @@
+//
+// Created by Tristan Seifert on 2019-09-13.
+//
+
+#include "BatchedDatagramBIO.h"
+#include "OpenSSLError.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+
+#include <openssl/ssl.h>
+
+
+namespace liblichtenstein::io {
+  /// largest MTU we assume if the socket can't tell us
+  static const long kFallbackMtu = 1500;
+  /// size of the IPv4 and UDP headers
+  static const long kIPv4Overhead = 28;
+  /// size of the IPv6 and UDP headers
+  static const long kIPv6Overhead = 48;
+  /// size of the control message buffer for a single GSO/GRO segment size
+  static const size_t kControlSize = CMSG_SPACE(sizeof(int));
+
+#if defined(__linux__)
+  // older C libraries don't define these yet
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+#endif
+
+#if !defined(__linux__)
+  /**
+   * Header of a message in a batch, as used by recvmmsg() and sendmmsg().
+   */
+  struct mmsghdr {
+    struct msghdr msg_hdr;
+    unsigned int msg_len;
+  };
+
+  /**
+   * recvmmsg() replacement for platforms that don't have it: receives a
+   * single datagram.
+   */
+  static int recvmmsg(int fd, struct mmsghdr *msgs, unsigned int, int flags,
+                      struct timespec *) {
+    ssize_t len = recvmsg(fd, &msgs[0].msg_hdr, flags & MSG_DONTWAIT);
+    if(len < 0) return -1;
+
+    msgs[0].msg_len = len;
+    return 1;
+  }
+
+  /**
+   * sendmmsg() replacement for platforms that don't have it: sends a single
+   * datagram.
+   */
+  static int sendmmsg(int fd, struct mmsghdr *msgs, unsigned int, int flags) {
+    ssize_t len = sendmsg(fd, &msgs[0].msg_hdr, flags);
+    if(len < 0) return -1;
+
+    msgs[0].msg_len = len;
+    return 1;
+  }
+
+#ifndef MSG_WAITFORONE
+#define MSG_WAITFORONE 0
+#endif
+#endif
+
+
+  /**
+   * State of a batched datagram BIO.
+   */
+  struct BatchedDatagramState {
+    /// socket to send and receive on
+    int fd = -1;
+
+    /// buffers for received datagrams, kMaxDatagramSize each
+    std::vector<unsigned char> recvBuffer;
+    /// message headers for received datagrams
+    struct mmsghdr recvMsgs[BatchedDatagramBIO::kBatchSize]{};
+    /// IO vectors for received datagrams
+    struct iovec recvIov[BatchedDatagramBIO::kBatchSize]{};
+    /// control buffers for received datagrams (with GRO)
+    alignas(struct cmsghdr) unsigned char
+            recvControl[BatchedDatagramBIO::kBatchSize][kControlSize]{};
+    /// size of the datagrams making up each received message
+    size_t recvSegment[BatchedDatagramBIO::kBatchSize]{};
+    /// number of receive slots the buffer is divided into, and their size
+    size_t recvSlots = BatchedDatagramBIO::kBatchSize;
+    size_t recvSlotSize = BatchedDatagramBIO::kMaxDatagramSize;
+    /// number of messages in the current batch
+    size_t recvCount = 0;
+    /// index of the message from which the next datagram is returned
+    size_t recvNext = 0;
+    /// offset of the next datagram in that message (with GRO)
+    size_t recvOffset = 0;
+
+    /// whether writes are queued rather than sent immediately
+    bool corked = false;
+    /// buffers for queued datagrams; allocated the first time we're corked
+    std::vector<unsigned char> sendBuffer;
+    /// message headers for queued datagrams
+    struct mmsghdr sendMsgs[BatchedDatagramBIO::kBatchSize]{};
+    /// IO vectors for queued datagrams
+    struct iovec sendIov[BatchedDatagramBIO::kBatchSize]{};
+    /// number of datagrams queued
+    size_t sendCount = 0;
+    /// bytes of the send buffer used by queued datagrams
+    size_t sendUsed = 0;
+
+    /// whether equal sized queued datagrams are sent as GSO super-packets
+    bool sendOffload = false;
+    /// whether the kernel may coalesce received datagrams (GRO)
+    bool receiveOffload = false;
+    /// message headers for super-packets being sent
+    struct mmsghdr gsoMsgs[BatchedDatagramBIO::kBatchSize]{};
+    /// IO vectors for super-packets being sent
+    struct iovec gsoIov[BatchedDatagramBIO::kBatchSize]{};
+    /// control buffers for super-packets being sent
+    alignas(struct cmsghdr) unsigned char
+            gsoControl[BatchedDatagramBIO::kBatchSize][kControlSize]{};
+    /// number of datagrams in each super-packet being sent
+    size_t gsoDatagrams[BatchedDatagramBIO::kBatchSize]{};
+
+    /// how long reads wait for data; zero to wait forever
+    struct timeval recvTimeout{};
+    /// when the DTLS timer expires; zero if not running
+    struct timeval nextTimeout{};
+    /// set when the last read timed out
+    bool timedOut = false;
+
+    /// MTU set by OpenSSL
+    long mtu = 0;
+    /// error of the last failed send
+    int lastSendError = 0;
+
+    /// counters
+    BatchedDatagramBIO::Stats stats;
+  };
+
+
+  /**
+   * Returns the number of milliseconds until the given time, or 0 if it's
+   * already passed.
+   */
+  static int MsecUntil(const struct timeval &deadline) {
+    struct timeval now{};
+    gettimeofday(&now, nullptr);
+
+    long msec = (deadline.tv_sec - now.tv_sec) * 1000 +
+                (deadline.tv_usec - now.tv_usec) / 1000;
+
+    return static_cast<int>(std::max(0L, msec));
+  }
+
+  /**
+   * Divides the receive buffer into slots of the given size (as many as fit,
+   * up to the batch size) and points each message header at its slot.
+   */
+  static void LayoutReceiveSlots(BatchedDatagramState *state,
+                                 size_t slotSize) {
+    state->recvSlotSize = slotSize;
+    state->recvSlots = std::min(BatchedDatagramBIO::kBatchSize,
+                                state->recvBuffer.size() / slotSize);
+
+    for(size_t i = 0; i < state->recvSlots; i++) {
+      state->recvIov[i].iov_base = state->recvBuffer.data() + (i * slotSize);
+      state->recvIov[i].iov_len = slotSize;
+
+      auto &hdr = state->recvMsgs[i].msg_hdr;
+      hdr.msg_iov = &state->recvIov[i];
+      hdr.msg_iovlen = 1;
+
+      if(state->receiveOffload) {
+        hdr.msg_control = state->recvControl[i];
+        hdr.msg_controllen = kControlSize;
+      }
+    }
+  }
+
+  /**
+   * Enables send (UDP_SEGMENT) or receive (UDP_GRO) offload on the BIO's
+   * socket, if the kernel supports it.
+   *
+   * @param which 1 for send offload, 2 for receive offload
+   * @return Whether the offload is enabled
+   */
+  static bool EnableOffload(BatchedDatagramState *state, long which) {
+#if defined(__linux__)
+    if(which == 1) {
+      // the kernel supports UDP_SEGMENT if it lets us read the default size
+      int size = 0;
+      socklen_t sizeLen = sizeof(size);
+
+      if(getsockopt(state->fd, SOL_UDP, UDP_SEGMENT, &size, &sizeLen) != 0) {
+        PLOG(INFO) << "UDP_SEGMENT not supported";
+        return false;
+      }
+
+      state->sendOffload = true;
+      return true;
+    } else if(which == 2) {
+      if(state->receiveOffload) return true;
+
+      // the slots can't be resized while a batch is being returned
+      if(state->recvNext < state->recvCount) return false;
+
+      int on = 1;
+
+      if(setsockopt(state->fd, SOL_UDP, UDP_GRO, &on, sizeof(on)) != 0) {
+        PLOG(INFO) << "UDP_GRO not supported";
+        return false;
+      }
+
+      // a coalesced message can be as large as a UDP datagram can be
+      state->receiveOffload = true;
+      LayoutReceiveSlots(state, BatchedDatagramBIO::kMaxSuperPacketSize);
+
+      return true;
+    }
+#endif
+
+    return false;
+  }
+
+  /**
+   * Sends all queued datagrams as GSO super-packets: each run of datagrams of
+   * the same size (plus a shorter one at its end, if any) is sent as one
+   * message, which the kernel splits into datagrams of that size. Since the
+   * queued datagrams are packed back to back, each run is contiguous.
+   *
+   * If the kernel rejects the first super-packet (e.g. because the interface
+   * can't checksum segments) offload is disabled, and nothing is sent.
+   *
+   * @return 1 if all datagrams were sent, 0 if some were dropped, or -1 if
+   * offload was disabled instead
+   */
+  static int FlushSegmented(BatchedDatagramState *state) {
+#if defined(__linux__)
+    size_t runs = 0;
+
+    for(size_t i = 0; i < state->sendCount; runs++) {
+      const size_t segment = state->sendIov[i].iov_len;
+      size_t bytes = 0, count = 0;
+
+      while((i + count) < state->sendCount) {
+        const size_t len = state->sendIov[i + count].iov_len;
+
+        if(len > segment ||
+           (bytes + len) > BatchedDatagramBIO::kMaxSuperPacketSize) {
+          break;
+        }
+
+        bytes += len;
+        count++;
+
+        // a shorter datagram can only end the super-packet
+        if(len < segment) break;
+      }
+
+      auto &msg = state->gsoMsgs[runs].msg_hdr;
+
+      state->gsoIov[runs].iov_base = state->sendIov[i].iov_base;
+      state->gsoIov[runs].iov_len = bytes;
+      state->gsoDatagrams[runs] = count;
+
+      msg.msg_iov = &state->gsoIov[runs];
+      msg.msg_iovlen = 1;
+      msg.msg_control = nullptr;
+      msg.msg_controllen = 0;
+
+      if(count > 1) {
+        msg.msg_control = state->gsoControl[runs];
+        msg.msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+
+        auto *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_UDP;
+        cmsg->cmsg_type = UDP_SEGMENT;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+
+        const auto segmentSize = static_cast<uint16_t>(segment);
+        memcpy(CMSG_DATA(cmsg), &segmentSize, sizeof(segmentSize));
+      }
+
+      i += count;
+    }
+
+    size_t sent = 0;
+
+    while(sent < runs) {
+      int ret = sendmmsg(state->fd, state->gsoMsgs + sent, runs - sent, 0);
+      state->stats.sendCalls++;
+
+      if(ret < 0) {
+        if(errno == EINTR) continue;
+
+        if(sent == 0 && (errno == EIO || errno == EINVAL)) {
+          PLOG(WARNING) << "UDP_SEGMENT rejected, disabling send offload";
+          state->sendOffload = false;
+          return -1;
+        }
+
+        state->lastSendError = errno;
+        PLOG(WARNING) << "sendmmsg() failed, dropping "
+                      << (runs - sent) << " super-packets";
+
+        state->sendCount = state->sendUsed = 0;
+        return 0;
+      }
+
+      for(int i = 0; i < ret; i++) {
+        const auto count = state->gsoDatagrams[sent + i];
+
+        state->stats.sendDatagrams += count;
+        if(count > 1) state->stats.sendSegmented += count;
+      }
+
+      sent += ret;
+    }
+
+    state->sendCount = state->sendUsed = 0;
+    return 1;
+#else
+    return -1;
+#endif
+  }
+
+  /**
+   * Sends all queued datagrams.
+   *
+   * @return Whether all datagrams were sent
+   */
+  static bool FlushQueue(BatchedDatagramState *state) {
+    if(state->sendOffload && state->sendCount > 1) {
+      int ret = FlushSegmented(state);
+      if(ret >= 0) return (ret == 1);
+    }
+
+    size_t sent = 0;
+
+    while(sent < state->sendCount) {
+      int ret = sendmmsg(state->fd, state->sendMsgs + sent,
+                         state->sendCount - sent, 0);
+      state->stats.sendCalls++;
+
+      if(ret < 0) {
+        if(errno == EINTR) continue;
+
+        // the remaining datagrams are lost, as if the network dropped them
+        state->lastSendError = errno;
+        PLOG(WARNING) << "sendmmsg() failed, dropping "
+                      << (state->sendCount - sent) << " datagrams";
+
+        state->sendCount = state->sendUsed = 0;
+        return false;
+      }
+
+      state->stats.sendDatagrams += ret;
+      sent += ret;
+    }
+
+    state->sendCount = state->sendUsed = 0;
+    return true;
+  }
+
+  /**
+   * Receives a batch of datagrams, waiting for at most the receive timeout
+   * (or until the DTLS timer expires, if sooner) for the first one.
+   *
+   * @return Number of datagrams received, 0 on timeout or -1 on error
+   */
+  static int ReceiveBatch(BatchedDatagramState *state) {
+    int timeout = -1;
+
+    if(state->recvTimeout.tv_sec || state->recvTimeout.tv_usec) {
+      timeout = state->recvTimeout.tv_sec * 1000 +
+                state->recvTimeout.tv_usec / 1000;
+    }
+
+    if(state->nextTimeout.tv_sec || state->nextTimeout.tv_usec) {
+      int timer = MsecUntil(state->nextTimeout);
+      timeout = (timeout < 0) ? timer : std::min(timeout, timer);
+    }
+
+    // wait for the first datagram, then take whatever else is waiting
+    int flags = MSG_WAITFORONE;
+
+    if(timeout >= 0) {
+      struct pollfd pfd = {state->fd, POLLIN, 0};
+      int err;
+
+      do {
+        err = poll(&pfd, 1, timeout);
+      } while(err < 0 && errno == EINTR);
+
+      if(err == 0) {
+        state->timedOut = true;
+        errno = EAGAIN;
+        return 0;
+      } else if(err < 0) {
+        return -1;
+      }
+
+      flags = MSG_DONTWAIT;
+    }
+
+    for(size_t i = 0; i < state->recvSlots; i++) {
+      state->recvMsgs[i].msg_len = 0;
+      state->recvMsgs[i].msg_hdr.msg_flags = 0;
+
+      if(state->receiveOffload) {
+        state->recvMsgs[i].msg_hdr.msg_controllen = kControlSize;
+      }
+    }
+
+    int ret;
+
+    do {
+      ret = recvmmsg(state->fd, state->recvMsgs, state->recvSlots, flags,
+                     nullptr);
+    } while(ret < 0 && errno == EINTR);
+
+    state->stats.recvCalls++;
+
+    if(ret > 0) {
+      // figure out the size of the datagrams in each (coalesced) message
+      for(int i = 0; i < ret; i++) {
+        auto &msg = state->recvMsgs[i];
+        size_t segment = msg.msg_len;
+
+#if defined(__linux__)
+        if(state->receiveOffload) {
+          for(auto *cmsg = CMSG_FIRSTHDR(&msg.msg_hdr); cmsg;
+              cmsg = CMSG_NXTHDR(&msg.msg_hdr, cmsg)) {
+            if(cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+              int size;
+              memcpy(&size, CMSG_DATA(cmsg), sizeof(size));
+
+              if(size > 0) segment = size;
+            }
+          }
+        }
+#endif
+
+        state->recvSegment[i] = std::max(segment, static_cast<size_t>(1));
+
+        const size_t count = (msg.msg_len + state->recvSegment[i] - 1) /
+                             state->recvSegment[i];
+        state->stats.recvDatagrams += std::max(count, static_cast<size_t>(1));
+        if(count > 1) state->stats.recvCoalesced += count;
+      }
+
+      state->recvCount = ret;
+      state->recvNext = state->recvOffset = 0;
+    } else if(ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      state->timedOut = true;
+      return 0;
+    }
+
+    return ret;
+  }
+
+
+  /**
+   * Creates a batched BIO on the given (connected) datagram socket.
+   *
+   * @param fd Socket to send and receive on
+   * @param closeFlag BIO_CLOSE to close the socket when the BIO is freed, or
+   * BIO_NOCLOSE otherwise
+   * @return A new BIO
+   * @throws OpenSSLError
+   */
+  BIO *BatchedDatagramBIO::create(int fd, int closeFlag) {
+    BIO *bio = BIO_new(getMethod());
+
+    if(!bio) {
+      throw OpenSSLError("BIO_new() failed");
+    }
+
+    BIO_set_fd(bio, fd, closeFlag);
+    return bio;
+  }
+
+  /**
+   * Determines whether the given BIO is a batched datagram BIO.
+   */
+  bool BatchedDatagramBIO::isBatched(BIO *bio) {
+    return bio && BIO_method_type(bio) == kBioType;
+  }
+
+  /**
+   * Corks or uncorks the BIO: while corked, writes are queued, and sent once
+   * it's uncorked. This has no effect on other BIOs.
+   *
+   * @param bio BIO to (un)cork
+   * @param corked Whether writes should be queued
+   */
+  void BatchedDatagramBIO::setCorked(BIO *bio, bool corked) {
+    if(!isBatched(bio)) return;
+
+    BIO_ctrl(bio, kCtrlSetCorked, corked ? 1 : 0, nullptr);
+  }
+
+  /**
+   * Gets the syscall counters of the BIO.
+   *
+   * @param bio A batched datagram BIO
+   * @return Counters; all zero if the BIO isn't batched
+   */
+  BatchedDatagramBIO::Stats BatchedDatagramBIO::getStats(BIO *bio) {
+    Stats stats;
+
+    if(isBatched(bio)) {
+      BIO_ctrl(bio, kCtrlGetStats, 0, &stats);
+    }
+
+    return stats;
+  }
+
+  /**
+   * Enables send segmentation offload (GSO): while the BIO is corked, queued
+   * datagrams of equal size are handed to the kernel as one super-packet.
+   * This requires Linux 4.18 or later.
+   *
+   * @param bio A batched datagram BIO
+   * @return Whether send offload is enabled
+   */
+  bool BatchedDatagramBIO::enableSendOffload(BIO *bio) {
+    if(!isBatched(bio)) return false;
+
+    return BIO_ctrl(bio, kCtrlSetOffload, 1, nullptr) == 1;
+  }
+
+  /**
+   * Enables receive offload (GRO): the kernel may then coalesce datagrams
+   * from the peer into one message, which the BIO splits up again. This
+   * requires Linux 5.0 or later.
+   *
+   * @param bio A batched datagram BIO
+   * @return Whether receive offload is enabled
+   */
+  bool BatchedDatagramBIO::enableReceiveOffload(BIO *bio) {
+    if(!isBatched(bio)) return false;
+
+    return BIO_ctrl(bio, kCtrlSetOffload, 2, nullptr) == 1;
+  }
+
+  /**
+   * Whether the BIO sends GSO super-packets.
+   */
+  bool BatchedDatagramBIO::isSendOffloaded(BIO *bio) {
+    return isBatched(bio) && (BIO_ctrl(bio, kCtrlGetOffload, 0, nullptr) & 1);
+  }
+
+  /**
+   * Whether the BIO accepts GRO super-packets.
+   */
+  bool BatchedDatagramBIO::isReceiveOffloaded(BIO *bio) {
+    return isBatched(bio) && (BIO_ctrl(bio, kCtrlGetOffload, 0, nullptr) & 2);
+  }
+
+  /**
+   * Gets the number of bytes allocated for the BIO's state, including its
+   * receive and send buffers; this is most of a datagram session's memory.
+   *
+   * @param bio A batched datagram BIO
+   * @return Bytes allocated, or 0 if the BIO isn't batched
+   */
+  size_t BatchedDatagramBIO::getMemoryUsage(BIO *bio) {
+    if(!isBatched(bio)) return 0;
+
+    return static_cast<size_t>(BIO_ctrl(bio, kCtrlGetMemoryUsage, 0, nullptr));
+  }
+
+
+  /**
+   * Gets the BIO method, creating it the first time.
+   */
+  const BIO_METHOD *BatchedDatagramBIO::getMethod() {
+    static std::once_flag once;
+    static BIO_METHOD *method = nullptr;
+
+    std::call_once(once, [] {
+      method = BIO_meth_new(kBioType, "batched datagram socket");
+      CHECK(method != nullptr) << "BIO_meth_new() failed";
+
+      BIO_meth_set_create(method, BatchedDatagramBIO::bioCreate);
+      BIO_meth_set_destroy(method, BatchedDatagramBIO::bioDestroy);
+      BIO_meth_set_read(method, BatchedDatagramBIO::bioRead);
+      BIO_meth_set_write(method, BatchedDatagramBIO::bioWrite);
+      BIO_meth_set_ctrl(method, BatchedDatagramBIO::bioCtrl);
+    });
+
+    return method;
+  }
+
+  /**
+   * Allocates the state of a new BIO.
+   */
+  int BatchedDatagramBIO::bioCreate(BIO *bio) {
+    auto *state = new BatchedDatagramState;
+
+    // point each message at its slice of the receive buffer
+    state->recvBuffer.resize(kBatchSize * kMaxDatagramSize);
+    LayoutReceiveSlots(state, kMaxDatagramSize);
+
+    for(size_t i = 0; i < kBatchSize; i++) {
+      state->sendMsgs[i].msg_hdr.msg_iov = &state->sendIov[i];
+      state->sendMsgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    BIO_set_data(bio, state);
+    BIO_set_init(bio, 0);
+
+    return 1;
+  }
+
+  /**
+   * Releases the BIO's state, and closes the socket if requested.
+   */
+  int BatchedDatagramBIO::bioDestroy(BIO *bio) {
+    auto *state = static_cast<BatchedDatagramState *>(BIO_get_data(bio));
+    if(!state) return 0;
+
+    if(BIO_get_init(bio)) {
+      FlushQueue(state);
+
+      if(BIO_get_shutdown(bio)) {
+        ::close(state->fd);
+      }
+    }
+
+    delete state;
+
+    BIO_set_data(bio, nullptr);
+    BIO_set_init(bio, 0);
+
+    return 1;
+  }
+
+  /**
+   * Reads a single datagram, receiving a new batch if the current one has
+   * been consumed. Before waiting for more data, any queued writes are sent,
+   * since the peer may be waiting for them.
+   */
+  int BatchedDatagramBIO::bioRead(BIO *bio, char *out, int outLen) {
+    auto *state = static_cast<BatchedDatagramState *>(BIO_get_data(bio));
+
+    if(!out) return 0;
+    BIO_clear_retry_flags(bio);
+
+    while(true) {
+      if(state->recvNext >= state->recvCount) {
+        state->recvCount = state->recvNext = state->recvOffset = 0;
+
+        if(state->sendCount) {
+          FlushQueue(state);
+        }
+
+        int ret = ReceiveBatch(state);
+
+        if(ret <= 0) {
+          if(ret == 0) {
+            BIO_set_retry_read(bio);
+          }
+
+          return -1;
+        }
+      }
+
+      // copy out the next datagram, unless it was too large to receive; with
+      // GRO, a message may hold several, all but the last of the same size
+      const auto &msg = state->recvMsgs[state->recvNext];
+
+      if(msg.msg_hdr.msg_flags & MSG_TRUNC) {
+        LOG(WARNING) << "Dropping truncated datagram";
+        state->recvNext++;
+        state->recvOffset = 0;
+        continue;
+      }
+
+      const auto *data = state->recvBuffer.data() +
+                         (state->recvNext * state->recvSlotSize) +
+                         state->recvOffset;
+      const size_t size = std::min(state->recvSegment[state->recvNext],
+                                   msg.msg_len - state->recvOffset);
+
+      state->recvOffset += size;
+
+      if(state->recvOffset >= msg.msg_len) {
+        state->recvNext++;
+        state->recvOffset = 0;
+      }
+
+      size_t len = std::min(size, static_cast<size_t>(outLen));
+      memcpy(out, data, len);
+
+      return static_cast<int>(len);
+    }
+  }
+
+  /**
+   * Writes a single datagram: it's either sent immediately, or queued if the
+   * BIO is corked.
+   */
+  int BatchedDatagramBIO::bioWrite(BIO *bio, const char *in, int inLen) {
+    auto *state = static_cast<BatchedDatagramState *>(BIO_get_data(bio));
+
+    BIO_clear_retry_flags(bio);
+    state->lastSendError = 0;
+
+    if(!state->corked || static_cast<size_t>(inLen) > kMaxDatagramSize) {
+      // preserve ordering with anything that's still queued
+      if(state->sendCount) {
+        FlushQueue(state);
+      }
+
+      ssize_t ret = send(state->fd, in, inLen, 0);
+      state->stats.sendCalls++;
+
+      if(ret < 0) {
+        state->lastSendError = errno;
+
+        if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+          BIO_set_retry_write(bio);
+        }
+
+        return -1;
+      }
+
+      state->stats.sendDatagrams++;
+      return static_cast<int>(ret);
+    }
+
+    // queue the datagram, sending the queue first if it's full; datagrams are
+    // packed back to back, so a batch of small ones stays in a few pages
+    if(state->sendCount == kBatchSize ||
+       (state->sendUsed + inLen) > state->sendBuffer.size()) {
+      FlushQueue(state);
+    }
+
+    const size_t index = state->sendCount++;
+    auto *slot = state->sendBuffer.data() + state->sendUsed;
+    state->sendUsed += inLen;
+
+    memcpy(slot, in, inLen);
+    state->sendIov[index].iov_base = slot;
+    state->sendIov[index].iov_len = inLen;
+
+    return inLen;
+  }
+
+  /**
+   * Handles control requests; these mirror those of OpenSSL's datagram BIO
+   * that DTLS relies on.
+   */
+  long BatchedDatagramBIO::bioCtrl(BIO *bio, int cmd, long num, void *ptr) {
+    auto *state = static_cast<BatchedDatagramState *>(BIO_get_data(bio));
+
+    switch(cmd) {
+      case BIO_C_SET_FD:
+        state->fd = *static_cast<int *>(ptr);
+        BIO_set_shutdown(bio, static_cast<int>(num));
+        BIO_set_init(bio, 1);
+        return 1;
+
+      case BIO_C_GET_FD:
+        if(!BIO_get_init(bio)) return -1;
+        if(ptr) *static_cast<int *>(ptr) = state->fd;
+        return state->fd;
+
+      case BIO_CTRL_GET_CLOSE:
+        return BIO_get_shutdown(bio);
+
+      case BIO_CTRL_SET_CLOSE:
+        BIO_set_shutdown(bio, static_cast<int>(num));
+        return 1;
+
+      case BIO_CTRL_FLUSH:
+        return FlushQueue(state) ? 1 : 0;
+
+      case BIO_CTRL_DUP:
+        return 1;
+
+      case BIO_CTRL_PENDING: {
+        size_t pending = 0;
+
+        for(size_t i = state->recvNext; i < state->recvCount; i++) {
+          pending += state->recvMsgs[i].msg_len;
+        }
+
+        return static_cast<long>(pending - state->recvOffset);
+      }
+
+      case BIO_CTRL_WPENDING: {
+        size_t pending = 0;
+
+        for(size_t i = 0; i < state->sendCount; i++) {
+          pending += state->sendIov[i].iov_len;
+        }
+
+        return static_cast<long>(pending);
+      }
+
+      // the socket is already connected
+      case BIO_CTRL_DGRAM_CONNECT:
+      case BIO_CTRL_DGRAM_SET_CONNECTED:
+      case BIO_CTRL_DGRAM_SET_PEER:
+        return 1;
+
+      case BIO_CTRL_DGRAM_GET_PEER: {
+        struct sockaddr_storage addr{};
+        socklen_t addrLen = sizeof(addr);
+
+        if(getpeername(state->fd, reinterpret_cast<struct sockaddr *>(&addr),
+                       &addrLen) != 0) {
+          return 0;
+        }
+
+        if(num <= 0 || num > static_cast<long>(addrLen)) {
+          num = addrLen;
+        }
+
+        memcpy(ptr, &addr, num);
+        return num;
+      }
+
+      case BIO_CTRL_DGRAM_SET_RECV_TIMEOUT:
+        memcpy(&state->recvTimeout, ptr, sizeof(struct timeval));
+        return 1;
+
+      case BIO_CTRL_DGRAM_GET_RECV_TIMEOUT:
+        memcpy(ptr, &state->recvTimeout, sizeof(struct timeval));
+        return sizeof(struct timeval);
+
+      case BIO_CTRL_DGRAM_SET_SEND_TIMEOUT:
+        return setsockopt(state->fd, SOL_SOCKET, SO_SNDTIMEO, ptr,
+                          sizeof(struct timeval)) == 0 ? 1 : -1;
+
+      case BIO_CTRL_DGRAM_SET_NEXT_TIMEOUT:
+        memcpy(&state->nextTimeout, ptr, sizeof(struct timeval));
+        return 1;
+
+      case BIO_CTRL_DGRAM_GET_RECV_TIMER_EXP:
+        if(state->timedOut) {
+          state->timedOut = false;
+          return 1;
+        }
+
+        return 0;
+
+      case BIO_CTRL_DGRAM_GET_SEND_TIMER_EXP:
+        return 0;
+
+      case BIO_CTRL_DGRAM_MTU_EXCEEDED:
+        return (state->lastSendError == EMSGSIZE) ? 1 : 0;
+
+      case BIO_CTRL_DGRAM_SET_MTU:
+        state->mtu = num;
+        return num;
+
+      case BIO_CTRL_DGRAM_GET_MTU:
+        return state->mtu;
+
+#ifdef BIO_CTRL_DGRAM_GET_FALLBACK_MTU
+      case BIO_CTRL_DGRAM_GET_FALLBACK_MTU:
+#endif
+      case BIO_CTRL_DGRAM_QUERY_MTU:
+#ifdef BIO_CTRL_DGRAM_GET_MTU_OVERHEAD
+      case BIO_CTRL_DGRAM_GET_MTU_OVERHEAD:
+#endif
+      {
+        struct sockaddr_storage addr{};
+        socklen_t addrLen = sizeof(addr);
+        getsockname(state->fd, reinterpret_cast<struct sockaddr *>(&addr),
+                    &addrLen);
+
+        const long overhead = (addr.ss_family == AF_INET6) ? kIPv6Overhead
+                                                           : kIPv4Overhead;
+
+#ifdef BIO_CTRL_DGRAM_GET_MTU_OVERHEAD
+        if(cmd == BIO_CTRL_DGRAM_GET_MTU_OVERHEAD) return overhead;
+#endif
+
+#if defined(__linux__) && defined(IP_MTU)
+        if(cmd == BIO_CTRL_DGRAM_QUERY_MTU && addr.ss_family == AF_INET) {
+          int mtu = 0;
+          socklen_t mtuLen = sizeof(mtu);
+
+          if(getsockopt(state->fd, IPPROTO_IP, IP_MTU, &mtu, &mtuLen) == 0 &&
+             mtu > overhead) {
+            return mtu - overhead;
+          }
+        }
+#endif
+
+        return kFallbackMtu - overhead;
+      }
+
+      case kCtrlSetCorked:
+        if(num && state->sendBuffer.empty()) {
+          state->sendBuffer.resize(kBatchSize * kMaxDatagramSize);
+        }
+
+        state->corked = (num != 0);
+
+        if(!state->corked && state->sendCount) {
+          return FlushQueue(state) ? 1 : 0;
+        }
+
+        return 1;
+
+      case kCtrlGetStats:
+        *static_cast<Stats *>(ptr) = state->stats;
+        return 1;
+
+      case kCtrlSetOffload:
+        return EnableOffload(state, num) ? 1 : 0;
+
+      case kCtrlGetOffload:
+        return (state->sendOffload ? 1 : 0) | (state->receiveOffload ? 2 : 0);
+
+      case kCtrlGetMemoryUsage:
+        return static_cast<long>(sizeof(*state) +
+                                 state->recvBuffer.capacity() +
+                                 state->sendBuffer.capacity());
+
+      default:
+        return 0;
+    }
+  }
+}
@@ -0,0 +1,111 @@
+//
+// Created by Tristan Seifert on 2019-09-13.
+//
+
+#ifndef LIBLICHTENSTEIN_BATCHEDDATAGRAMBIO_H
+#define LIBLICHTENSTEIN_BATCHEDDATAGRAMBIO_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <openssl/bio.h>
+
+namespace liblichtenstein::io {
+  /**
+   * An OpenSSL BIO for connected datagram sockets that moves datagrams in
+   * batches, using recvmmsg() and sendmmsg() where available.
+   *
+   * Reads receive as many datagrams as are waiting on the socket (up to the
+   * batch size) with a single syscall; subsequent reads are then served from
+   * that batch, one datagram at a time, as OpenSSL expects. Writes are sent
+   * immediately, unless the BIO is corked: then, they're queued and sent
+   * together once the BIO is uncorked or flushed, or the queue fills up.
+   *
+   * On Linux, segmentation offload can be enabled as well: queued datagrams
+   * of equal size are then sent as a single UDP_SEGMENT (GSO) super-packet,
+   * and with UDP_GRO, the kernel may hand us such a super-packet in one piece
+   * as well. Either way, the super-packet only takes a single trip through
+   * the network stack, and is split into datagrams by the NIC (or the kernel
+   * just before it's transmitted) and by this BIO, respectively.
+   *
+   * It otherwise behaves like the BIO created by `BIO_new_dgram()`, including
+   * the receive timeouts and timers used by DTLS, so it can be used in its
+   * place on any connection.
+   */
+  class BatchedDatagramBIO {
+    public:
+      /// syscall counters, for monitoring purposes
+      struct Stats {
+        /// receive syscalls made
+        uint64_t recvCalls = 0;
+        /// datagrams received
+        uint64_t recvDatagrams = 0;
+        /// send syscalls made
+        uint64_t sendCalls = 0;
+        /// datagrams sent
+        uint64_t sendDatagrams = 0;
+        /// datagrams sent as part of a GSO super-packet
+        uint64_t sendSegmented = 0;
+        /// datagrams received as part of a GRO super-packet
+        uint64_t recvCoalesced = 0;
+      };
+
+    public:
+      static BIO *create(int fd, int closeFlag);
+
+      static bool isBatched(BIO *bio);
+
+      static void setCorked(BIO *bio, bool corked);
+
+      static Stats getStats(BIO *bio);
+
+      static bool enableSendOffload(BIO *bio);
+
+      static bool enableReceiveOffload(BIO *bio);
+
+      static bool isSendOffloaded(BIO *bio);
+
+      static bool isReceiveOffloaded(BIO *bio);
+
+      static size_t getMemoryUsage(BIO *bio);
+
+    private:
+      static const BIO_METHOD *getMethod();
+
+      static int bioCreate(BIO *bio);
+
+      static int bioDestroy(BIO *bio);
+
+      static int bioRead(BIO *bio, char *out, int outLen);
+
+      static int bioWrite(BIO *bio, const char *in, int inLen);
+
+      static long bioCtrl(BIO *bio, int cmd, long num, void *ptr);
+
+    public:
+      /// maximum number of datagrams moved per syscall
+      static constexpr size_t kBatchSize = 16;
+      /// largest datagram that can be received (a full DTLS record)
+      static constexpr size_t kMaxDatagramSize = (1024 * 18);
+      /// largest GSO/GRO super-packet (the maximum UDP payload)
+      static constexpr size_t kMaxSuperPacketSize = (65535 - 8);
+
+    private:
+      /// type of the BIO (a source/sink with a file descriptor)
+      static const int kBioType = (0xE1 | BIO_TYPE_SOURCE_SINK |
+                                   BIO_TYPE_DESCRIPTOR);
+      /// private ctrl to cork (num = 1) or uncork (num = 0) the BIO
+      static const int kCtrlSetCorked = 0x4C01;
+      /// private ctrl to get the BIO's statistics
+      static const int kCtrlGetStats = 0x4C02;
+      /// private ctrl to enable segmentation offload (num = 1 for send, 2
+      /// for receive)
+      static const int kCtrlSetOffload = 0x4C03;
+      /// private ctrl to get the enabled offloads (same bits as above)
+      static const int kCtrlGetOffload = 0x4C04;
+      /// private ctrl to get the bytes allocated for the BIO's state
+      static const int kCtrlGetMemoryUsage = 0x4C05;
+  };
+}
+
+#endif //LIBLICHTENSTEIN_BATCHEDDATAGRAMBIO_H
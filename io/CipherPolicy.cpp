@@ -0,0 +1,148 @@
+//
+// Created by Tristan Seifert on 2019-09-16.
+//
+
+#include "CipherPolicy.h"
+#include "OpenSSLError.h"
+
+#include <glog/logging.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#elif defined(__linux__) && (defined(__aarch64__) || defined(__arm__))
+#include <sys/auxv.h>
+#endif
+
+// TLS 1.3 suites are configured separately from the cipher list
+#if defined(TLS1_3_VERSION) && (!defined(LIBRESSL_VERSION_NUMBER) || \
+        LIBRESSL_VERSION_NUMBER >= 0x3040000fL)
+#define HAVE_TLS13_CIPHERSUITES 1
+#endif
+
+
+namespace liblichtenstein::io {
+  const char *CipherPolicy::kCipherListAES =
+          "ECDHE-ECDSA-AES128-GCM-SHA256:ECDHE-RSA-AES128-GCM-SHA256:"
+          "ECDHE-ECDSA-AES256-GCM-SHA384:ECDHE-RSA-AES256-GCM-SHA384:"
+          "ECDHE-ECDSA-CHACHA20-POLY1305:ECDHE-RSA-CHACHA20-POLY1305";
+  const char *CipherPolicy::kCipherListChaCha =
+          "ECDHE-ECDSA-CHACHA20-POLY1305:ECDHE-RSA-CHACHA20-POLY1305:"
+          "ECDHE-ECDSA-AES128-GCM-SHA256:ECDHE-RSA-AES128-GCM-SHA256:"
+          "ECDHE-ECDSA-AES256-GCM-SHA384:ECDHE-RSA-AES256-GCM-SHA384";
+
+  const char *CipherPolicy::kCipherSuitesAES =
+          "TLS_AES_128_GCM_SHA256:TLS_AES_256_GCM_SHA384:"
+          "TLS_CHACHA20_POLY1305_SHA256";
+  const char *CipherPolicy::kCipherSuitesChaCha =
+          "TLS_CHACHA20_POLY1305_SHA256:TLS_AES_128_GCM_SHA256:"
+          "TLS_AES_256_GCM_SHA384";
+
+
+  /**
+   * Whether the CPU has instructions that accelerate AES. This is detected
+   * once, then cached.
+   */
+  bool CipherPolicy::hasAESAcceleration() {
+    static const bool accelerated = CipherPolicy::detectAESAcceleration();
+    return accelerated;
+  }
+
+  /**
+   * Asks the CPU (or on ARM, the kernel) whether AES instructions are
+   * available.
+   */
+  bool CipherPolicy::detectAESAcceleration() {
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int eax, ebx, ecx, edx;
+
+    if(!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return false;
+    return (ecx & bit_AES) != 0;
+#elif defined(__linux__) && defined(__aarch64__)
+    // HWCAP_AES from asm/hwcap.h
+    return (getauxval(AT_HWCAP) & (1 << 3)) != 0;
+#elif defined(__linux__) && defined(__arm__)
+    // HWCAP2_AES from asm/hwcap.h; only ARMv8 cores in AArch32 mode have it
+    return (getauxval(AT_HWCAP2) & (1 << 0)) != 0;
+#elif defined(__APPLE__) && defined(__aarch64__)
+    return true;
+#else
+    return false;
+#endif
+  }
+
+
+  /**
+   * Configures a context to use the cipher suites preferred for this CPU.
+   *
+   * @param ctx Context to configure; may be TLS or DTLS
+   * @param server Whether the context is used to accept connections
+   * @param preference Which family of suites to prefer
+   *
+   * @throws OpenSSLError
+   */
+  void CipherPolicy::apply(SSL_CTX *ctx, bool server, Preference preference) {
+    bool chacha;
+
+    switch(preference) {
+      case Preference::AESGCM:
+        chacha = false;
+        break;
+      case Preference::ChaCha20:
+        chacha = true;
+        break;
+      case Preference::Automatic:
+      default:
+        chacha = !CipherPolicy::hasAESAcceleration();
+        break;
+    }
+
+    VLOG(2) << "Preferring " << (chacha ? "ChaCha20-Poly1305" : "AES-GCM")
+            << " (AES acceleration: " << CipherPolicy::hasAESAcceleration()
+            << ")";
+
+    const char *list = chacha ? kCipherListChaCha : kCipherListAES;
+
+    if(SSL_CTX_set_cipher_list(ctx, list) != 1) {
+      throw OpenSSLError("SSL_CTX_set_cipher_list() failed");
+    }
+
+#ifdef HAVE_TLS13_CIPHERSUITES
+    const char *suites = chacha ? kCipherSuitesChaCha : kCipherSuitesAES;
+
+    if(SSL_CTX_set_ciphersuites(ctx, suites) != 1) {
+      throw OpenSSLError("SSL_CTX_set_ciphersuites() failed");
+    }
+#endif
+
+    if(server) {
+      SSL_CTX_set_options(ctx, SSL_OP_CIPHER_SERVER_PREFERENCE);
+
+#ifdef SSL_OP_PRIORITIZE_CHACHA
+      // a client that lists ChaCha20-Poly1305 first likely has no AES-NI
+      SSL_CTX_set_options(ctx, SSL_OP_PRIORITIZE_CHACHA);
+#endif
+    }
+  }
+
+
+  /**
+   * Describes the protocol version and cipher suite negotiated on a session,
+   * e.g. for logging or diagnostics.
+   *
+   * @param ssl Session to describe
+   * @return A string like "TLSv1.3 TLS_AES_128_GCM_SHA256", or an empty
+   * string if no handshake has completed
+   */
+  std::string CipherPolicy::describe(const SSL *ssl) {
+    if(!ssl) return "";
+
+    const SSL_CIPHER *cipher = SSL_get_current_cipher(ssl);
+    if(!cipher) return "";
+
+    std::string description = SSL_get_version(ssl);
+    description += " ";
+    description += SSL_CIPHER_get_name(cipher);
+
+    return description;
+  }
+}
@@ -0,0 +1,63 @@
+//
+// Created by Tristan Seifert on 2019-09-16.
+//
+
+#ifndef LIBLICHTENSTEIN_CIPHERPOLICY_H
+#define LIBLICHTENSTEIN_CIPHERPOLICY_H
+
+#include <string>
+
+#include <openssl/ssl.h>
+
+namespace liblichtenstein::io {
+  /**
+   * Selects the cipher suites offered (or accepted) on TLS and DTLS
+   * connections, based on what the CPU can do quickly.
+   *
+   * Only forward secret (ECDHE) AEAD suites are offered. On CPUs with AES
+   * instructions, AES-GCM is faster than ChaCha20-Poly1305, so it's listed
+   * first; on those without (e.g. most ARMv7 nodes) ChaCha20-Poly1305 is
+   * several times faster than a software AES, so it's listed first instead.
+   * Servers pick the suite by their own preference, except that they'll
+   * honour a client that prefers ChaCha20-Poly1305, since that client most
+   * likely has no AES instructions.
+   *
+   * This applies to both the TLS 1.2 (and DTLS) cipher list and, where the
+   * library supports it, the TLS 1.3 cipher suites.
+   */
+  class CipherPolicy {
+    public:
+      /// which family of cipher suites to prefer
+      enum class Preference {
+        /// decide based on whether the CPU has AES instructions
+        Automatic,
+        /// prefer AES-GCM
+        AESGCM,
+        /// prefer ChaCha20-Poly1305
+        ChaCha20,
+      };
+
+    public:
+      static bool hasAESAcceleration();
+
+      static void apply(SSL_CTX *ctx, bool server,
+                        Preference preference = Preference::Automatic);
+
+      static std::string describe(const SSL *ssl);
+
+    private:
+      static bool detectAESAcceleration();
+
+    private:
+      /// TLS 1.2 AEAD suites, with AES-GCM first
+      static const char *kCipherListAES;
+      /// TLS 1.2 AEAD suites, with ChaCha20-Poly1305 first
+      static const char *kCipherListChaCha;
+      /// TLS 1.3 suites, with AES-GCM first
+      static const char *kCipherSuitesAES;
+      /// TLS 1.3 suites, with ChaCha20-Poly1305 first
+      static const char *kCipherSuitesChaCha;
+  };
+}
+
+#endif //LIBLICHTENSTEIN_CIPHERPOLICY_H
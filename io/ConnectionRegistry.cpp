@@ -0,0 +1,209 @@
+//
+// Created by Tristan Seifert on 2019-09-15.
+//
+
+#include "ConnectionRegistry.h"
+#include "GenericServerClient.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <exception>
+#include <utility>
+
+
+namespace liblichtenstein::io {
+  /**
+   * Creates an empty registry.
+   *
+   * @param maxConnections Maximum number of sessions open at once; 0 for no
+   * limit
+   */
+  ConnectionRegistry::ConnectionRegistry(size_t maxConnections)
+          : maxConnections(maxConnections) {
+  }
+
+  /**
+   * Closes any sessions that are still open.
+   */
+  ConnectionRegistry::~ConnectionRegistry() {
+    this->closeAll();
+  }
+
+
+  /**
+   * Registers a newly established session. Closed sessions are reaped first,
+   * so they don't count against the limit.
+   *
+   * @param client Session to register
+   * @return Whether the session was registered; if the registry is full, it
+   * isn't, and the caller should close it.
+   */
+  bool ConnectionRegistry::add(std::shared_ptr<GenericServerClient> client) {
+    std::lock_guard<std::mutex> lg(this->lock);
+
+    this->reapLocked();
+
+    const size_t max = this->maxConnections;
+
+    if(max && this->clients.size() >= max) {
+      this->statRejected++;
+      return false;
+    }
+
+    this->clients.push_back(std::move(client));
+    this->count = this->clients.size();
+    this->statAdded++;
+
+    if(this->count > this->statPeak) {
+      this->statPeak = this->count.load();
+    }
+
+    return true;
+  }
+
+  /**
+   * Removes all sessions that have been closed.
+   *
+   * @return Number of sessions removed
+   */
+  size_t ConnectionRegistry::reap() {
+    std::lock_guard<std::mutex> lg(this->lock);
+    return this->reapLocked();
+  }
+
+  /**
+   * Reaps closed sessions, unless that was done recently. Servers call this
+   * from their event loops, which may run far more often than is worth
+   * walking the whole list.
+   */
+  void ConnectionRegistry::reapIfDue() {
+    const auto now = std::chrono::steady_clock::now().time_since_epoch();
+    auto due = this->nextReap.load();
+
+    if(now.count() < due) return;
+
+    // only one caller needs to do the work
+    const auto next = now + kReapInterval;
+    const auto nextTicks =
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    next).count();
+
+    if(this->nextReap.compare_exchange_strong(due, nextTicks)) {
+      this->reap();
+    }
+  }
+
+  /**
+   * Removes all closed sessions. The lock must be held.
+   *
+   * @return Number of sessions removed
+   */
+  size_t ConnectionRegistry::reapLocked() {
+    const auto end = std::remove_if(this->clients.begin(), this->clients.end(),
+                                    [](const auto &client) {
+                                      return !client->isSessionOpen();
+                                    });
+    const size_t reaped = std::distance(end, this->clients.end());
+
+    if(reaped) {
+      this->clients.erase(end, this->clients.end());
+      this->count = this->clients.size();
+      this->statReaped += reaped;
+
+      VLOG(2) << "Reaped " << reaped << " closed sessions, " << this->count
+              << " still open";
+    }
+
+    return reaped;
+  }
+
+  /**
+   * Checks whether another session could be registered. Servers call this
+   * before they accept a connection, so they don't perform a handshake only
+   * to have the session rejected.
+   *
+   * @param pending Sessions that are about to be registered (e.g. handshakes
+   * in progress) which should be counted against the limit
+   * @return Whether there's room for another session
+   */
+  bool ConnectionRegistry::hasCapacity(size_t pending) const {
+    const size_t max = this->maxConnections;
+    return !max || (this->count + pending) < max;
+  }
+
+  /**
+   * Records that a connection was turned away before it was added, e.g.
+   * because hasCapacity() returned false.
+   */
+  void ConnectionRegistry::reject() {
+    this->statRejected++;
+  }
+
+  /**
+   * Closes all sessions that are still open and removes them.
+   */
+  void ConnectionRegistry::closeAll() {
+    std::vector<std::shared_ptr<GenericServerClient>> clients;
+
+    {
+      std::lock_guard<std::mutex> lg(this->lock);
+      clients.swap(this->clients);
+      this->count = 0;
+    }
+
+    // closing a session may call back into its server, so don't hold the lock
+    for(auto &client : clients) {
+      if(client->isSessionOpen()) {
+        // swallow any errors
+        try {
+          client->close();
+        } catch(std::exception &e) {
+          LOG(ERROR) << "Error closing client " << client << ": " << e.what();
+        }
+      }
+    }
+  }
+
+
+  /**
+   * Gets the number of registered sessions. This may include sessions that
+   * were closed but not yet reaped.
+   */
+  size_t ConnectionRegistry::size() const {
+    return this->count;
+  }
+
+  /**
+   * Estimates how much memory the registered sessions take up, in bytes.
+   */
+  size_t ConnectionRegistry::getMemoryEstimate() const {
+    std::lock_guard<std::mutex> lg(this->lock);
+
+    size_t bytes = 0;
+
+    for(const auto &client : this->clients) {
+      bytes += client->estimateMemoryUsage();
+    }
+
+    return bytes;
+  }
+
+  /**
+   * Gets the current statistics, including a memory estimate.
+   *
+   * @return Counters
+   */
+  ConnectionRegistry::Stats ConnectionRegistry::getStats() const {
+    Stats stats;
+
+    stats.active = this->count;
+    stats.peak = this->statPeak;
+    stats.added = this->statAdded;
+    stats.rejected = this->statRejected;
+    stats.reaped = this->statReaped;
+    stats.memory = this->getMemoryEstimate();
+
+    return stats;
+  }
+}
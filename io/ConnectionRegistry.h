@@ -0,0 +1,119 @@
+//
+// Created by Tristan Seifert on 2019-09-15.
+//
+
+#ifndef LIBLICHTENSTEIN_CONNECTIONREGISTRY_H
+#define LIBLICHTENSTEIN_CONNECTIONREGISTRY_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace liblichtenstein {
+  namespace io {
+    class GenericServerClient;
+
+    /**
+     * Keeps track of the sessions a server (or several servers, e.g. the
+     * shards of a ShardedListener) has established, so they can be closed
+     * when the server goes away.
+     *
+     * Sessions that were closed are reaped: the registry drops its reference
+     * to them, so they're deallocated once nobody else is using them. This
+     * happens whenever a session is added, and periodically by servers that
+     * have a thread to do it on.
+     *
+     * Optionally, the number of sessions open at once can be limited; servers
+     * turn away connections while the registry is full.
+     *
+     * All methods can be called from any thread.
+     */
+    class ConnectionRegistry {
+      public:
+        /// counters, for monitoring purposes
+        struct Stats {
+          /// sessions currently registered
+          uint64_t active = 0;
+          /// most sessions that were registered at once
+          uint64_t peak = 0;
+          /// sessions that were registered
+          uint64_t added = 0;
+          /// connections turned away because the registry was full
+          uint64_t rejected = 0;
+          /// closed sessions that were removed
+          uint64_t reaped = 0;
+          /// estimated bytes of memory used by the active sessions
+          uint64_t memory = 0;
+        };
+
+      public:
+        explicit ConnectionRegistry(size_t maxConnections = 0);
+
+        ~ConnectionRegistry();
+
+        ConnectionRegistry(const ConnectionRegistry &) = delete;
+
+        ConnectionRegistry &operator=(const ConnectionRegistry &) = delete;
+
+      public:
+        bool add(std::shared_ptr<GenericServerClient> client);
+
+        size_t reap();
+
+        void reapIfDue();
+
+        bool hasCapacity(size_t pending = 0) const;
+
+        void reject();
+
+        void closeAll();
+
+        [[nodiscard]] size_t size() const;
+
+        [[nodiscard]] size_t getMemoryEstimate() const;
+
+        [[nodiscard]] Stats getStats() const;
+
+        /// sets the maximum number of sessions open at once; 0 for no limit
+        void setMaxConnections(size_t max) {
+          this->maxConnections = max;
+        }
+
+        /// returns the maximum number of sessions open at once
+        [[nodiscard]] size_t getMaxConnections() const {
+          return this->maxConnections;
+        }
+
+      private:
+        size_t reapLocked();
+
+      private:
+        /// how often reapIfDue() actually reaps
+        static constexpr std::chrono::milliseconds kReapInterval{1000};
+
+      private:
+        /// protects the clients list
+        mutable std::mutex lock;
+        /// all sessions that haven't been reaped yet
+        std::vector<std::shared_ptr<GenericServerClient>> clients;
+
+        /// maximum number of sessions; 0 if unlimited
+        std::atomic<size_t> maxConnections;
+        /// number of entries in the clients list, readable without the lock
+        std::atomic<size_t> count = 0;
+
+        /// when reapIfDue() reaps next
+        std::atomic<std::chrono::steady_clock::rep> nextReap = 0;
+
+        /// counters
+        std::atomic<uint64_t> statPeak = 0, statAdded = 0, statRejected = 0,
+                statReaped = 0;
+    };
+  }
+}
+
+#endif //LIBLICHTENSTEIN_CONNECTIONREGISTRY_H
@@ -3,6 +3,8 @@
 //
 #include "DTLSClient.h"
 #include "OpenSSLError.h"
+#include "BatchedDatagramBIO.h"
+#include "CipherPolicy.h"
 
 #include <glog/logging.h>
 
@@ -32,18 +34,27 @@ namespace liblichtenstein {
      *
      * @param host Hostname (such as 172.16.12.1) to connect to
      * @param port Port to connect to
+     * @param session A previously exported session to try to resume, if any
+     * @param batchedIO Whether datagrams are received (and, in batches started
+     * with beginBatch(), sent) several at a time
      *
      * @throws OpenSSLError, std::system_error
      */
-    DTLSClient::DTLSClient(std::string host, int port) : GenericTLSClient(
-            std::move(host), port) {
+    DTLSClient::DTLSClient(std::string host, int port,
+                           const std::string &session, bool batchedIO)
+            : GenericTLSClient(std::move(host), port) {
       int err, errType;
 
       // clear some variables
       memset(&this->connectedAddr, 0, sizeof(this->connectedAddr));
 
       // create the context
-      this->createContext();
+      this->createContext(batchedIO);
+
+      // try to resume the previous session (this falls back to a full handshake)
+      if (!session.empty() && !this->resumeSession(session)) {
+        LOG(WARNING) << "Ignoring invalid DTLS session";
+      }
 
       // try to connect
       err = SSL_connect(this->ssl);
@@ -71,7 +82,8 @@ namespace liblichtenstein {
       }
 
       // configure timeouts on the DTLS socket
-      VLOG(1) << "DTLS handshake complete";
+      VLOG(1) << "DTLS handshake complete (resumed: " << this->isSessionReused()
+              << ", " << this->getCipherDescription() << ")";
 
       struct timeval timeout{};
       memset(&timeout, 0, sizeof(timeout));
@@ -96,9 +108,11 @@ namespace liblichtenstein {
     /**
      * Sets up the DTLS client context.
      *
+     * @param batchedIO Whether to use a batched datagram BIO
+     *
      * @throws OpenSSLError, std::system_error
      */
-    void DTLSClient::createContext() {
+    void DTLSClient::createContext(bool batchedIO) {
       // resolve the server and create a socket
       this->servinfo = DTLSClient::resolveHost(this->serverHost,
                                                this->serverPort);
@@ -108,6 +122,8 @@ namespace liblichtenstein {
       this->ctx = SSL_CTX_new(DTLS_client_method());
       SSL_CTX_set_read_ahead(this->ctx, 1);
 
+      CipherPolicy::apply(this->ctx, false);
+
       // create SSL context
       this->ssl = SSL_new(this->ctx);
 
@@ -116,7 +132,12 @@ namespace liblichtenstein {
       }
 
       // create a BIO for the socket, then attempt to connect it
-      this->bio = BIO_new_dgram(this->connectedSocket, BIO_CLOSE);
+      if (batchedIO) {
+        this->bio = BatchedDatagramBIO::create(this->connectedSocket,
+                                               BIO_CLOSE);
+      } else {
+        this->bio = BIO_new_dgram(this->connectedSocket, BIO_CLOSE);
+      }
 
       this->connectSocket();
 
@@ -17,12 +17,13 @@ namespace liblichtenstein {
   namespace io {
     class DTLSClient : public GenericTLSClient {
       public:
-        DTLSClient(std::string host, int port);
+        DTLSClient(std::string host, int port,
+                   const std::string &session = "", bool batchedIO = false);
 
         ~DTLSClient() override;
 
       private:
-        void createContext();
+        void createContext(bool batchedIO);
 
         void createSocket();
 
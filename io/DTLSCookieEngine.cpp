@@ -0,0 +1,550 @@
+//
+// Created by Tristan Seifert on 2019-09-14.
+//
+
+#include "DTLSCookieEngine.h"
+#include "OpenSSLError.h"
+
+#include <glog/logging.h>
+
+#include <cstring>
+
+#include <netinet/in.h>
+
+#include <openssl/bio.h>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+
+// HMAC_CTX is deprecated as of OpenSSL 3, which provides HMAC as an EVP_MAC
+#if !defined(LIBRESSL_VERSION_NUMBER) && OPENSSL_VERSION_NUMBER >= 0x30000000L
+#define USE_EVP_MAC 1
+#include <openssl/core_names.h>
+#include <openssl/params.h>
+#else
+#include <openssl/hmac.h>
+#endif
+
+
+namespace liblichtenstein::io {
+  /// source of engine ids; 0 marks an unused cache entry
+  static std::atomic<uint64_t> nextEngineId = 1;
+
+#ifdef USE_EVP_MAC
+  using MacContext = EVP_MAC_CTX;
+
+  /**
+   * Returns the HMAC implementation; it's fetched only once, since that
+   * involves a lookup in the provider's algorithm table.
+   */
+  static EVP_MAC *GetHmac() {
+    static EVP_MAC *hmac = EVP_MAC_fetch(nullptr, "HMAC", nullptr);
+    return hmac;
+  }
+
+  /// creates an unkeyed context
+  static MacContext *NewMac() {
+    EVP_MAC *hmac = GetHmac();
+    return hmac ? EVP_MAC_CTX_new(hmac) : nullptr;
+  }
+
+  /// keys a context for HMAC-SHA256 with the given secret
+  static bool KeyMac(MacContext *ctx, const unsigned char *key,
+                     size_t keyLen) {
+    char digest[] = "SHA256";
+    const OSSL_PARAM params[] = {
+            OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, digest, 0),
+            OSSL_PARAM_construct_end()
+    };
+
+    return EVP_MAC_init(ctx, key, keyLen, params);
+  }
+
+  /// resets a context to its keyed state
+  static bool ResetMac(MacContext *ctx) {
+    return EVP_MAC_init(ctx, nullptr, 0, nullptr);
+  }
+
+  /// authenticates a message with a freshly reset context
+  static bool FinishMac(MacContext *ctx, const unsigned char *data,
+                        size_t dataLen, unsigned char *out, size_t &outLen) {
+    return EVP_MAC_update(ctx, data, dataLen) &&
+           EVP_MAC_final(ctx, out, &outLen, EVP_MAX_MD_SIZE);
+  }
+
+  /// frees a context and its key
+  static void FreeMac(MacContext *ctx) {
+    EVP_MAC_CTX_free(ctx);
+  }
+#else
+  using MacContext = HMAC_CTX;
+
+  /// creates an unkeyed context
+  static MacContext *NewMac() {
+    return HMAC_CTX_new();
+  }
+
+  /// keys a context for HMAC-SHA256 with the given secret
+  static bool KeyMac(MacContext *ctx, const unsigned char *key,
+                     size_t keyLen) {
+    return HMAC_Init_ex(ctx, key, static_cast<int>(keyLen), EVP_sha256(),
+                        nullptr);
+  }
+
+  /// resets a context to its keyed state
+  static bool ResetMac(MacContext *ctx) {
+    return HMAC_Init_ex(ctx, nullptr, 0, nullptr, nullptr);
+  }
+
+  /// authenticates a message with a freshly reset context
+  static bool FinishMac(MacContext *ctx, const unsigned char *data,
+                        size_t dataLen, unsigned char *out, size_t &outLen) {
+    unsigned int len = 0;
+
+    if(!HMAC_Update(ctx, data, dataLen) || !HMAC_Final(ctx, out, &len)) {
+      return false;
+    }
+
+    outLen = len;
+    return true;
+  }
+
+  /// frees a context and its key
+  static void FreeMac(MacContext *ctx) {
+    HMAC_CTX_free(ctx);
+  }
+#endif
+
+  /**
+   * Keyed HMAC contexts of the calling thread. Keying a context hashes the
+   * padded secret twice, which costs about as much as the HMAC of a cookie
+   * itself, so it's only done the first time a thread uses a secret; after
+   * that, the context is just reset to its keyed state.
+   *
+   * There's normally a single engine with two live secrets, so a handful of
+   * entries suffice; they're replaced round robin.
+   */
+  struct ThreadContextCache {
+    /// a context keyed with one secret of one engine
+    struct Entry {
+      uint64_t engine = 0;
+      uint64_t generation = 0;
+      MacContext *ctx = nullptr;
+    };
+
+    static constexpr size_t kEntries = 4;
+
+    Entry entries[kEntries];
+    size_t next = 0;
+
+    ~ThreadContextCache() {
+      for(auto &entry : this->entries) {
+        if(entry.ctx) FreeMac(entry.ctx);
+      }
+    }
+  };
+
+  static thread_local ThreadContextCache contextCache;
+
+
+  /**
+   * Creates a cookie engine with a fresh secret.
+   *
+   * @param rotationInterval How often the secret is replaced; zero to only
+   * replace it when rotate() is called
+   * @throws OpenSSLError If no secret could be generated
+   */
+  DTLSCookieEngine::DTLSCookieEngine(
+          std::chrono::steady_clock::duration rotationInterval)
+          : id(nextEngineId++) {
+    if(!RAND_bytes(this->secrets[0], kSecretLength)) {
+      throw OpenSSLError("Could not generate DTLS cookie secret");
+    }
+
+    this->statRotations = 1;
+    this->setRotationInterval(rotationInterval);
+  }
+
+  /**
+   * Clears the secrets. Threads may still hold contexts keyed with them, but
+   * those are never used again, since engine ids aren't reused.
+   */
+  DTLSCookieEngine::~DTLSCookieEngine() {
+    OPENSSL_cleanse(this->secrets, sizeof(this->secrets));
+  }
+
+  /**
+   * Gets the engine shared by all DTLS servers in the process, so that any of
+   * them can verify a cookie issued by another (e.g. by another shard.) It's
+   * created the first time it's used.
+   *
+   * @throws OpenSSLError If no secret could be generated
+   */
+  DTLSCookieEngine &DTLSCookieEngine::shared() {
+    static DTLSCookieEngine engine;
+    return engine;
+  }
+
+
+  /**
+   * OpenSSL callback to generate a cookie with the shared engine, for the
+   * peer address of the SSL object's read BIO (which must be a datagram BIO.)
+   *
+   * @param ssl SSL object for which to generate the cookie
+   * @param cookie Buffer into which we write the cookie
+   * @param cookieLen Length of cookie, in bytes
+   * @return 1 if successful, 0 otherwise.
+   */
+  int DTLSCookieEngine::generateCookieCb(SSL *ssl, unsigned char *cookie,
+                                         unsigned int *cookieLen) {
+    struct sockaddr_storage addr{};
+    BIO_dgram_get_peer(SSL_get_rbio(ssl), &addr);
+
+    unsigned char peer[kMaxPeerLength];
+    const size_t peerLen = encodePeer(addr, peer);
+
+    if(!peerLen) {
+      LOG(ERROR) << "Invalid family: " << addr.ss_family;
+      return 0;
+    }
+
+    return shared().generate(peer, peerLen, cookie, cookieLen) ? 1 : 0;
+  }
+
+  /**
+   * OpenSSL callback to verify a cookie with the shared engine.
+   *
+   * @param ssl SSL object on which we received the cookie
+   * @param cookie Buffer containing the cookie
+   * @param cookieLen Length of cookie, in bytes
+   * @return 1 if the cookie is valid, 0 otherwise.
+   */
+  int DTLSCookieEngine::verifyCookieCb(SSL *ssl, const unsigned char *cookie,
+                                       unsigned int cookieLen) {
+    struct sockaddr_storage addr{};
+    BIO_dgram_get_peer(SSL_get_rbio(ssl), &addr);
+
+    unsigned char peer[kMaxPeerLength];
+    const size_t peerLen = encodePeer(addr, peer);
+
+    if(!peerLen) {
+      LOG(ERROR) << "Invalid family: " << addr.ss_family;
+      return 0;
+    }
+
+    if(!shared().verify(peer, peerLen, cookie, cookieLen)) {
+      shared().warnRejected(cookieLen);
+      return 0;
+    }
+
+    return 1;
+  }
+
+  /**
+   * Encodes a peer's port and address as the input to a cookie.
+   *
+   * @param addr Address of the peer
+   * @param out Buffer of at least kMaxPeerLength bytes
+   * @return Number of bytes written, or 0 if the address family isn't
+   * supported
+   */
+  size_t DTLSCookieEngine::encodePeer(const struct sockaddr_storage &addr,
+                                      unsigned char *out) {
+    if(addr.ss_family == AF_INET) {
+      const auto *in = reinterpret_cast<const struct sockaddr_in *>(&addr);
+
+      memcpy(out, &in->sin_port, sizeof(in->sin_port));
+      memcpy(out + sizeof(in->sin_port), &in->sin_addr, sizeof(in->sin_addr));
+
+      return sizeof(in->sin_port) + sizeof(in->sin_addr);
+    } else if(addr.ss_family == AF_INET6) {
+      const auto *in6 = reinterpret_cast<const struct sockaddr_in6 *>(&addr);
+
+      memcpy(out, &in6->sin6_port, sizeof(in6->sin6_port));
+      memcpy(out + sizeof(in6->sin6_port), &in6->sin6_addr,
+             sizeof(in6->sin6_addr));
+
+      return sizeof(in6->sin6_port) + sizeof(in6->sin6_addr);
+    }
+
+    return 0;
+  }
+
+
+  /**
+   * Generates a cookie for the given peer with the current secret, rotating
+   * it first if it's due.
+   *
+   * @param peer Encoded address of the peer (see encodePeer())
+   * @param peerLen Length of the encoded address
+   * @param cookie Buffer into which the cookie is written; it must be at
+   * least kCookieLength bytes
+   * @param cookieLen Set to the length of the cookie
+   * @return Whether the cookie was generated
+   */
+  bool DTLSCookieEngine::generate(const unsigned char *peer, size_t peerLen,
+                                  unsigned char *cookie,
+                                  unsigned int *cookieLen) {
+    this->rotateIfDue();
+
+    const uint64_t current = this->generation.load();
+
+    if(!this->computeMac(current, peer, peerLen, cookie + 1)) {
+      return false;
+    }
+
+    cookie[0] = static_cast<unsigned char>(current & 0xFF);
+    *cookieLen = kCookieLength;
+
+    this->statGenerated.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  /**
+   * Verifies a cookie returned by a peer: it must have been generated for
+   * the same address with the current or the previous secret. The secret is
+   * rotated first if it's due, so that a cookie never outlives its grace
+   * period just because no cookies were generated in the meantime.
+   *
+   * @param peer Encoded address of the peer (see encodePeer())
+   * @param peerLen Length of the encoded address
+   * @param cookie Cookie returned by the peer
+   * @param cookieLen Length of the cookie
+   * @return Whether the cookie is valid
+   */
+  bool DTLSCookieEngine::verify(const unsigned char *peer, size_t peerLen,
+                                const unsigned char *cookie,
+                                unsigned int cookieLen) {
+    this->rotateIfDue();
+
+    const uint64_t current = this->generation.load();
+    uint64_t generation;
+
+    // figure out which secret the cookie claims to be made with
+    if(cookieLen != kCookieLength) {
+      goto reject;
+    } else if(cookie[0] == (current & 0xFF)) {
+      generation = current;
+    } else if(current > 0 && cookie[0] == ((current - 1) & 0xFF)) {
+      generation = current - 1;
+    } else {
+      goto reject;
+    }
+
+    {
+      unsigned char expected[kMacLength];
+
+      if(this->computeMac(generation, peer, peerLen, expected) &&
+         CRYPTO_memcmp(expected, cookie + 1, kMacLength) == 0) {
+        this->statVerified.fetch_add(1, std::memory_order_relaxed);
+        return true;
+      }
+    }
+
+    reject:;
+    this->statRejected.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  /**
+   * Replaces the secret. Cookies made with the secret that was current until
+   * now remain valid until the next rotation; older ones are rejected.
+   *
+   * @throws OpenSSLError If no secret could be generated
+   */
+  void DTLSCookieEngine::rotate() {
+    std::lock_guard<std::mutex> lock(this->secretsLock);
+
+    if(!this->rotateLocked()) {
+      throw OpenSSLError("Could not generate DTLS cookie secret");
+    }
+  }
+
+  /**
+   * Logs that a cookie was rejected. Since peers decide how many invalid
+   * cookies they send, this logs at most once every kRejectWarningInterval,
+   * along with the number of cookies rejected in between.
+   *
+   * @param cookieLen Length of the rejected cookie
+   */
+  void DTLSCookieEngine::warnRejected(unsigned int cookieLen) {
+    const auto now = std::chrono::steady_clock::now();
+    auto due = this->nextRejectWarning.load(std::memory_order_relaxed);
+
+    if(now.time_since_epoch().count() < due) {
+      this->unloggedRejects.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+
+    // only one thread logs
+    const auto next = std::chrono::duration_cast<
+            std::chrono::steady_clock::duration>(
+            now.time_since_epoch() + kRejectWarningInterval).count();
+
+    if(!this->nextRejectWarning.compare_exchange_strong(due, next)) {
+      this->unloggedRejects.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+
+    LOG(WARNING) << "DTLS cookie failed HMAC (len = " << cookieLen << "); "
+                 << this->unloggedRejects.exchange(0)
+                 << " more rejected since the last warning";
+  }
+
+  /**
+   * Sets how often the secret is rotated, starting now.
+   *
+   * @param interval Time between rotations; zero to only rotate when
+   * rotate() is called
+   */
+  void DTLSCookieEngine::setRotationInterval(
+          std::chrono::steady_clock::duration interval) {
+    const auto period = interval.count();
+    const auto now = std::chrono::steady_clock::now().time_since_epoch();
+
+    this->interval = period;
+    this->nextRotation = now.count() + period;
+  }
+
+  /**
+   * Returns the engine's counters.
+   */
+  DTLSCookieEngine::Stats DTLSCookieEngine::getStats() const {
+    Stats stats;
+
+    stats.generated = this->statGenerated;
+    stats.verified = this->statVerified;
+    stats.rejected = this->statRejected;
+    stats.rotations = this->statRotations;
+
+    return stats;
+  }
+
+
+  /**
+   * Rotates the secret if the rotation interval has elapsed. If a new secret
+   * can't be generated, the current one is kept until the next interval; this
+   * is called from OpenSSL callbacks, so it can't throw.
+   */
+  void DTLSCookieEngine::rotateIfDue() {
+    if(!this->interval.load(std::memory_order_relaxed)) return;
+
+    const auto now = std::chrono::steady_clock::now().time_since_epoch();
+    if(now.count() < this->nextRotation.load(std::memory_order_relaxed)) {
+      return;
+    }
+
+    std::unique_lock<std::mutex> lock(this->secretsLock, std::try_to_lock);
+    const auto due = this->nextRotation.load();
+
+    // another thread is already rotating, or did so since we checked
+    if(!lock.owns_lock() || now.count() < due) {
+      return;
+    }
+
+    // rotation is lazy, so after an idle period even the previous secret may
+    // be past its grace period of one interval; then replace both of them
+    const int rotations = (now.count() >= due + this->interval.load()) ? 2 : 1;
+
+    for(int i = 0; i < rotations; i++) {
+      if(!this->rotateLocked()) {
+        LOG(ERROR) << "Failed to rotate DTLS cookie secret: "
+                   << OpenSSLError().what();
+
+        this->nextRotation = now.count() + this->interval.load();
+        return;
+      }
+    }
+  }
+
+  /**
+   * Generates the next secret and makes it current. The caller must hold the
+   * secrets lock.
+   *
+   * @return Whether a new secret could be generated
+   */
+  bool DTLSCookieEngine::rotateLocked() {
+    const uint64_t next = this->generation.load() + 1;
+
+    if(!RAND_bytes(this->secrets[next % 2], kSecretLength)) {
+      return false;
+    }
+
+    this->generation = next;
+    this->statRotations++;
+
+    const auto now = std::chrono::steady_clock::now().time_since_epoch();
+    this->nextRotation = now.count() + this->interval.load();
+
+    return true;
+  }
+
+  /**
+   * Computes the truncated HMAC of a peer's address with the given secret,
+   * using (and if needed, keying) this thread's context for that secret.
+   *
+   * @param generation Number of the secret to use
+   * @param peer Encoded address of the peer
+   * @param peerLen Length of the encoded address
+   * @param mac Buffer of kMacLength bytes to receive the HMAC
+   * @return Whether the HMAC was computed; false if the secret has expired
+   */
+  bool DTLSCookieEngine::computeMac(uint64_t generation,
+                                    const unsigned char *peer, size_t peerLen,
+                                    unsigned char *mac) {
+    auto &cache = contextCache;
+    MacContext *ctx = nullptr;
+
+    for(auto &entry : cache.entries) {
+      if(entry.engine == this->id && entry.generation == generation) {
+        ctx = entry.ctx;
+        break;
+      }
+    }
+
+    if(ctx) {
+      // reset the context to its keyed state
+      if(!ResetMac(ctx)) return false;
+    } else {
+      unsigned char secret[kSecretLength];
+
+      {
+        std::lock_guard<std::mutex> lock(this->secretsLock);
+        const uint64_t current = this->generation.load();
+
+        if(generation > current || (generation + 1) < current) {
+          return false;
+        }
+
+        memcpy(secret, this->secrets[generation % 2], kSecretLength);
+      }
+
+      auto &entry = cache.entries[cache.next++ % ThreadContextCache::kEntries];
+      entry.engine = 0;
+
+      if(!entry.ctx && !(entry.ctx = NewMac())) {
+        OPENSSL_cleanse(secret, kSecretLength);
+        return false;
+      }
+
+      const bool ok = KeyMac(entry.ctx, secret, kSecretLength);
+      OPENSSL_cleanse(secret, kSecretLength);
+
+      if(!ok) return false;
+
+      entry.engine = this->id;
+      entry.generation = generation;
+      ctx = entry.ctx;
+    }
+
+    unsigned char full[EVP_MAX_MD_SIZE];
+    size_t fullLen = 0;
+
+    if(!FinishMac(ctx, peer, peerLen, full, fullLen)) {
+      return false;
+    }
+
+    memcpy(mac, full, kMacLength);
+    return true;
+  }
+}
@@ -0,0 +1,140 @@
+//
+// Created by Tristan Seifert on 2019-09-14.
+//
+
+#ifndef LIBLICHTENSTEIN_DTLSCOOKIEENGINE_H
+#define LIBLICHTENSTEIN_DTLSCOOKIEENGINE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+#include <sys/socket.h>
+
+#include <openssl/ssl.h>
+
+namespace liblichtenstein {
+  namespace io {
+    /**
+     * Generates and verifies the stateless cookies DTLS servers send in reply
+     * to a ClientHello, so that a peer has to prove it can receive datagrams
+     * at its address before the server commits any state to it.
+     *
+     * A cookie is an HMAC-SHA256 of the peer's address and port, keyed with a
+     * random secret, prefixed by a byte identifying that secret. Secrets are
+     * rotated periodically: cookies made with the previous secret are still
+     * accepted until the next rotation, so a handshake in progress during a
+     * rotation isn't rejected.
+     *
+     * The keyed HMAC state is set up once per secret and thread, rather than
+     * for every cookie, and no allocations are made when generating or
+     * verifying a cookie. All methods can be called from any thread.
+     */
+    class DTLSCookieEngine {
+      public:
+        /// counters, for monitoring purposes
+        struct Stats {
+          /// cookies generated
+          uint64_t generated = 0;
+          /// cookies that were verified successfully
+          uint64_t verified = 0;
+          /// cookies that were rejected (invalid, or from an expired secret)
+          uint64_t rejected = 0;
+          /// secrets generated, including the first
+          uint64_t rotations = 0;
+        };
+
+      public:
+        explicit DTLSCookieEngine(
+                std::chrono::steady_clock::duration rotationInterval =
+                        kDefaultRotationInterval);
+
+        ~DTLSCookieEngine();
+
+        DTLSCookieEngine(const DTLSCookieEngine &) = delete;
+
+        DTLSCookieEngine &operator=(const DTLSCookieEngine &) = delete;
+
+      public:
+        static DTLSCookieEngine &shared();
+
+        static int generateCookieCb(SSL *ssl, unsigned char *cookie,
+                                    unsigned int *cookieLen);
+
+        static int verifyCookieCb(SSL *ssl, const unsigned char *cookie,
+                                  unsigned int cookieLen);
+
+        static size_t encodePeer(const struct sockaddr_storage &addr,
+                                 unsigned char *out);
+
+      public:
+        bool generate(const unsigned char *peer, size_t peerLen,
+                      unsigned char *cookie, unsigned int *cookieLen);
+
+        bool verify(const unsigned char *peer, size_t peerLen,
+                    const unsigned char *cookie, unsigned int cookieLen);
+
+        void rotate();
+
+        void warnRejected(unsigned int cookieLen);
+
+        void setRotationInterval(std::chrono::steady_clock::duration interval);
+
+        [[nodiscard]] Stats getStats() const;
+
+      private:
+        void rotateIfDue();
+
+        bool rotateLocked();
+
+        bool computeMac(uint64_t generation, const unsigned char *peer,
+                        size_t peerLen, unsigned char *mac);
+
+      public:
+        /// largest encoded peer address (IPv6 address and port)
+        static constexpr size_t kMaxPeerLength = 18;
+        /// length of the cookies generated
+        static constexpr size_t kCookieLength = 17;
+        /// how often the secret is rotated by default
+        static constexpr std::chrono::seconds kDefaultRotationInterval{600};
+
+      private:
+        /// size of each secret
+        static constexpr size_t kSecretLength = 32;
+        /// number of bytes of the HMAC included in the cookie
+        static constexpr size_t kMacLength = (kCookieLength - 1);
+        /// most often a rejected cookie is logged; peers choose how many
+        /// invalid cookies they send
+        static constexpr std::chrono::seconds kRejectWarningInterval{10};
+
+      private:
+        /// uniquely identifies this engine in the per-thread HMAC caches
+        const uint64_t id;
+
+        /// protects the secrets and rotation
+        std::mutex secretsLock;
+        /// the current secret (at index generation % 2) and the previous one
+        unsigned char secrets[2][kSecretLength];
+        /// number of the current secret; its low byte starts each cookie
+        std::atomic<uint64_t> generation = 0;
+
+        /// how often secrets are rotated; zero to rotate only on request
+        std::atomic<std::chrono::steady_clock::rep> interval;
+        /// when the secret is rotated next
+        std::atomic<std::chrono::steady_clock::rep> nextRotation;
+
+        /// earliest time the next rejected cookie is logged
+        std::atomic<std::chrono::steady_clock::rep> nextRejectWarning = 0;
+        /// cookies rejected since the last one that was logged
+        std::atomic<uint64_t> unloggedRejects = 0;
+
+        /// counters
+        std::atomic<uint64_t> statGenerated = 0, statVerified = 0,
+                statRejected = 0, statRotations = 0;
+    };
+  }
+}
+
+#endif //LIBLICHTENSTEIN_DTLSCOOKIEENGINE_H
@@ -0,0 +1,187 @@
+//
+// Created by Tristan Seifert on 2019-09-10.
+//
+
+#include "DTLSMuxClient.h"
+#include "DTLSMuxServer.h"
+#include "OpenSSLError.h"
+#include "SSLSessionClosedError.h"
+
+#include <glog/logging.h>
+
+#include <cstring>
+#include <string>
+#include <system_error>
+
+#include <openssl/err.h>
+
+
+namespace liblichtenstein::io {
+  /**
+   * Returns the IPv4 address of the peer, if it has one; otherwise, the
+   * returned address is empty.
+   */
+  static struct sockaddr_in GetPeerAddr(const DTLSMuxPeer &peer) {
+    struct sockaddr_in addr{};
+
+    if(peer.addr.ss_family == AF_INET) {
+      memcpy(&addr, &peer.addr, sizeof(addr));
+    }
+
+    return addr;
+  }
+
+  /**
+   * Creates a client for a peer whose handshake has completed.
+   *
+   * @param server Server that accepted the peer
+   * @param peer Peer state
+   */
+  DTLSMuxClient::DTLSMuxClient(DTLSMuxServer *server,
+                               std::shared_ptr<DTLSMuxPeer> peer)
+          : GenericServerClient(server, server->getSocket(), peer->ssl,
+                                GetPeerAddr(*peer)), muxServer(server),
+            peer(std::move(peer)) {
+  }
+
+  /**
+   * Closes the session, if needed. The SSL object is owned by the peer state
+   * and the socket by the server, so neither is released here.
+   */
+  DTLSMuxClient::~DTLSMuxClient() {
+    if(this->isOpen) {
+      this->close();
+    }
+
+    this->ctx = nullptr;
+    this->fd = -1;
+  }
+
+
+  /**
+   * Sends a close notification to the peer and removes it from the server.
+   */
+  void DTLSMuxClient::close() {
+    if(!this->isOpen.exchange(false)) return;
+
+    {
+      std::lock_guard<std::mutex> lg(this->peer->lock);
+
+      if(!this->peer->removed) {
+        SSL_shutdown(this->peer->ssl);
+        ERR_clear_error();
+      }
+    }
+
+    this->muxServer->removePeer(this->peer->key);
+  }
+
+  /**
+   * Writes data to the peer. Records are sent straight to the shared socket.
+   *
+   * @param buf Pointer to the bytes to write to the connection
+   * @param bufSz Number of bytes to write
+   * @return Number of bytes written
+   * @throws std::system_error, OpenSSLError, SSLSessionClosedError
+   */
+  size_t DTLSMuxClient::write(const std::byte *buf, size_t bufSz) {
+    std::lock_guard<std::mutex> lg(this->peer->lock);
+
+    if(this->peer->removed) {
+      throw SSLSessionClosedError("Peer was removed");
+    }
+
+    int err = SSL_write(this->peer->ssl, buf, bufSz);
+
+    if(err <= 0) {
+      int errType = SSL_get_error(this->peer->ssl, err);
+
+      if(errType == SSL_ERROR_SYSCALL) {
+        throw std::system_error(errno, std::system_category(),
+                                "SSL_write() failed");
+      } else if(errType == SSL_ERROR_ZERO_RETURN) {
+        throw SSLSessionClosedError("Session closed by peer");
+      } else {
+        throw OpenSSLError(
+                "SSL_write() failed (type " + std::to_string(errType) +
+                ", err " + std::to_string(err) + ")");
+      }
+    }
+
+    return err;
+  }
+
+  /**
+   * Reads data from the peer. If no data has been received, this waits (up to
+   * a timeout) for the server to route a datagram to us, unless the client is
+   * in non-blocking mode.
+   *
+   * @param buf Buffer into which data should be read
+   * @param bufSz How many bytes are desired to read
+   * @return How many bytes were actually read
+   * @throws std::system_error, OpenSSLError, SSLSessionClosedError
+   */
+  size_t DTLSMuxClient::read(std::byte *buf, size_t bufSz) {
+    std::unique_lock<std::mutex> lk(this->peer->lock);
+
+    while(true) {
+      if(this->peer->removed) {
+        throw SSLSessionClosedError("Peer was removed");
+      }
+
+      int err = SSL_read(this->peer->ssl, buf, bufSz);
+
+      if(err > 0) {
+        return err;
+      }
+
+      int errType = SSL_get_error(this->peer->ssl, err);
+
+      if(errType == SSL_ERROR_WANT_READ || errType == SSL_ERROR_WANT_WRITE) {
+        // wait for the server to give us more data
+        if(!this->blocking) return 0;
+
+        auto status = this->peer->readable.wait_for(lk, kReadTimeout);
+
+        if(status == std::cv_status::timeout) {
+          return 0;
+        }
+      } else if(errType == SSL_ERROR_ZERO_RETURN) {
+        lk.unlock();
+
+        this->close();
+        throw SSLSessionClosedError("Session closed by peer");
+      } else if(errType == SSL_ERROR_SYSCALL) {
+        throw std::system_error(errno, std::system_category(),
+                                "SSL_read() failed");
+      } else {
+        throw OpenSSLError(
+                "SSL_read() failed (type " + std::to_string(errType) +
+                ", err " + std::to_string(err) + ")");
+      }
+    }
+  }
+
+  /**
+   * Gets the number of bytes that can be read without waiting: this is the
+   * decrypted data buffered by the SSL object, plus any datagrams that have
+   * been received but not yet processed.
+   *
+   * @return Number of bytes available
+   */
+  size_t DTLSMuxClient::pending() const {
+    std::lock_guard<std::mutex> lg(this->peer->lock);
+
+    return SSL_pending(this->peer->ssl) + BIO_ctrl_pending(this->peer->rbio);
+  }
+
+  /**
+   * The socket is shared with all other peers, so its mode can't be changed;
+   * in non-blocking mode, reads just don't wait for datagrams to arrive.
+   *
+   * @param blocking Whether reads should wait for data
+   */
+  void DTLSMuxClient::setBlocking(bool blocking) {
+    this->blocking = blocking;
+  }
+}
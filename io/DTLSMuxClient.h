@@ -0,0 +1,103 @@
+//
+// Created by Tristan Seifert on 2019-09-10.
+//
+
+#ifndef LIBLICHTENSTEIN_DTLSMUXCLIENT_H
+#define LIBLICHTENSTEIN_DTLSMUXCLIENT_H
+
+#include "GenericServerClient.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+
+#include <openssl/ssl.h>
+
+namespace liblichtenstein {
+  namespace io {
+    class DTLSMuxServer;
+
+    /**
+     * State of a single peer of a DTLSMuxServer. Datagrams from the peer are
+     * appended to a memory BIO, from which its SSL object reads; records are
+     * written directly to the shared socket, addressed to the peer.
+     *
+     * All access to the SSL object must hold the lock.
+     */
+    struct DTLSMuxPeer {
+      ~DTLSMuxPeer() {
+        if(this->ssl) {
+          SSL_free(this->ssl);
+        }
+      }
+
+      /// key under which the peer is stored by the server
+      std::string key;
+      /// address of the peer
+      struct sockaddr_storage addr{};
+
+      /// DTLS session with the peer
+      SSL *ssl = nullptr;
+      /// memory BIO holding received datagrams (owned by the SSL object)
+      BIO *rbio = nullptr;
+
+      /// protects everything below
+      std::mutex lock;
+      /// signalled when a datagram was received, or the peer is removed
+      std::condition_variable readable;
+
+      /// set once the handshake has completed
+      bool established = false;
+      /// set once the peer was removed from the server
+      bool removed = false;
+      /// when the handshake times out
+      std::chrono::steady_clock::time_point deadline;
+    };
+
+    /**
+     * A client of a DTLSMuxServer. Unlike other server clients, it does not
+     * own a socket: it shares the server's socket with all other peers, and
+     * reads whatever the server routed to it.
+     */
+    class DTLSMuxClient : public GenericServerClient {
+        friend class DTLSMuxServer;
+
+      protected:
+        DTLSMuxClient(DTLSMuxServer *server, std::shared_ptr<DTLSMuxPeer> peer);
+
+      public:
+        ~DTLSMuxClient() override;
+
+      public:
+        void close() override;
+
+        size_t write(const std::byte *buf, size_t bufSz) override;
+
+        using ITransport::read;
+
+        size_t read(std::byte *buf, size_t bufSz) override;
+
+        [[nodiscard]] size_t pending() const override;
+
+        void setBlocking(bool blocking) override;
+
+      private:
+        /// how long a blocking read waits for data before returning nothing
+        static constexpr std::chrono::seconds kReadTimeout{2};
+
+      private:
+        /// server that routes datagrams to us
+        DTLSMuxServer *muxServer = nullptr;
+        /// peer state shared with the server
+        std::shared_ptr<DTLSMuxPeer> peer;
+    };
+  }
+}
+
+#endif //LIBLICHTENSTEIN_DTLSMUXCLIENT_H
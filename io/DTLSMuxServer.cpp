@@ -0,0 +1,661 @@
+//
+// Created by Tristan Seifert on 2019-09-10.
+//
+
+#include "DTLSMuxServer.h"
+#include "DTLSMuxClient.h"
+#include "OpenSSLError.h"
+#include "DTLSCookieEngine.h"
+#include "CipherPolicy.h"
+
+#include <glog/logging.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+#include <system_error>
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+
+
+namespace liblichtenstein::io {
+  /// identifies sessions created by this server
+  static const unsigned char kSessionIdContext[] = "lichtenstein-rt";
+
+  /// MTU assumed for all peers; leaves room for IPv6 and UDP headers
+  static const long kLinkMtu = 1400;
+
+  /**
+   * Initializes the DTLS server.
+   *
+   * @param fd UDP socket to serve all peers on; it should already be bound.
+   */
+  DTLSMuxServer::DTLSMuxServer(int fd) : GenericTLSServer(fd) {
+    // make sure a cookie secret exists before the first hello arrives
+    DTLSCookieEngine::shared();
+
+    this->createContext();
+    this->configureSocket();
+  }
+
+  /**
+   * Initializes a DTLS server that shares the SSL context of another
+   * DTLSMuxServer. Cookies are generated by the engine shared by all servers
+   * in the process, so a cookie issued by either server is accepted by both.
+   *
+   * @param fd UDP socket to serve all peers on; it should already be bound.
+   * @param ctx Context created by another DTLSMuxServer, which must outlive
+   * this server
+   */
+  DTLSMuxServer::DTLSMuxServer(int fd, SSL_CTX *ctx)
+          : GenericTLSServer(fd, ctx) {
+    this->configureSocket();
+  }
+
+  /**
+   * Stops the server and closes all sessions. This has to happen here, rather
+   * than in the superclass, since clients call back into the server when
+   * they're closed.
+   */
+  DTLSMuxServer::~DTLSMuxServer() {
+    this->stop();
+    this->registry->closeAll();
+  }
+
+
+  /**
+   * Creates the OpenSSL context for DTLS. Cookies are generated from the
+   * peer's address, and sessions can be resumed.
+   *
+   * @throws OpenSSLError
+   */
+  void DTLSMuxServer::createContext() {
+    this->ctx = SSL_CTX_new(DTLS_server_method());
+    if(this->ctx == nullptr) {
+      throw OpenSSLError("SSL_CTX_new() failed");
+    }
+
+    SSL_CTX_set_app_data(this->ctx, this);
+    SSL_CTX_set_read_ahead(this->ctx, 1);
+
+    CipherPolicy::apply(this->ctx, true);
+
+    SSL_CTX_set_cookie_generate_cb(this->ctx, DTLSMuxServer::generateCookie);
+    SSL_CTX_set_cookie_verify_cb(this->ctx, DTLSMuxServer::verifyCookie);
+
+    // allow nodes to resume their session when they reconnect
+    SSL_CTX_set_session_cache_mode(this->ctx, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(this->ctx, kSessionCacheSize);
+    SSL_CTX_set_timeout(this->ctx, kSessionTimeout);
+    SSL_CTX_set_session_id_context(this->ctx, kSessionIdContext,
+                                   sizeof(kSessionIdContext) - 1);
+    SSL_CTX_clear_options(this->ctx, SSL_OP_NO_TICKET);
+  }
+
+
+  /**
+   * Enlarges the socket's buffers: all peers share them.
+   */
+  void DTLSMuxServer::configureSocket() {
+    int size = kSocketBufferSize;
+    setsockopt(this->listeningSocket, SOL_SOCKET, SO_RCVBUF, &size,
+               sizeof(size));
+    setsockopt(this->listeningSocket, SOL_SOCKET, SO_SNDBUF, &size,
+               sizeof(size));
+  }
+
+
+  /**
+   * Starts the receive thread. This is done automatically the first time
+   * run() is called; once the server was stopped, it does nothing.
+   */
+  void DTLSMuxServer::start() {
+    // held throughout, so stop() can't miss a thread that's being started
+    std::lock_guard<std::mutex> lg(this->readyLock);
+
+    if(this->receiveThread || this->stopped) return;
+
+    this->shutdown = false;
+    this->receiveThread = new std::thread(&DTLSMuxServer::receiveEntry, this);
+  }
+
+  /**
+   * Stops the receive thread. Callers blocked in (or subsequently calling)
+   * run() will get an error, and reads on existing clients no longer receive
+   * any data.
+   */
+  void DTLSMuxServer::stop() {
+    {
+      // so that a caller about to wait in run() can't miss the wakeup
+      std::lock_guard<std::mutex> lg(this->readyLock);
+      this->stopped = true;
+      this->shutdown = true;
+    }
+
+    this->readyCv.notify_all();
+
+    if(!this->receiveThread) return;
+
+    if(this->receiveThread->joinable()) {
+      this->receiveThread->join();
+    }
+
+    delete this->receiveThread;
+    this->receiveThread = nullptr;
+  }
+
+  /**
+   * Gets the current server statistics.
+   *
+   * @return Server counters
+   */
+  DTLSMuxServer::Stats DTLSMuxServer::getStats() const {
+    Stats stats;
+
+    stats.datagrams = this->statDatagrams;
+    stats.dropped = this->statDropped;
+    stats.completed = this->statCompleted;
+    stats.resumed = this->statResumed;
+    stats.failed = this->statFailed;
+    stats.timedOut = this->statTimedOut;
+
+    {
+      std::lock_guard<std::mutex> lg(this->peersLock);
+      stats.peers = this->peers.size();
+    }
+
+    return stats;
+  }
+
+
+  /**
+   * Waits for a peer to complete its handshake.
+   *
+   * @return A reference to the accepted client
+   * @throws std::system_error If the server was stopped
+   */
+  std::shared_ptr<GenericServerClient> DTLSMuxServer::run() {
+    this->start();
+
+    std::unique_lock<std::mutex> lk(this->readyLock);
+    this->readyCv.wait(lk, [this] {
+      return !this->ready.empty() || this->shutdown;
+    });
+
+    if(!this->ready.empty()) {
+      auto client = this->ready.front();
+      this->ready.pop_front();
+
+      return client;
+    }
+
+    throw std::system_error(ECONNABORTED, std::system_category(),
+                            "DTLS server was stopped");
+  }
+
+
+  /**
+   * Receive thread entry point: reads datagrams from the socket and routes
+   * them to their peers, and periodically services handshake timers.
+   */
+  void DTLSMuxServer::receiveEntry() {
+    std::vector<unsigned char> buffer(kMaxDatagramSize);
+    auto lastService = std::chrono::steady_clock::now();
+
+    while(!this->shutdown) {
+      struct pollfd pfd{};
+      pfd.fd = this->listeningSocket;
+      pfd.events = POLLIN;
+
+      int err = poll(&pfd, 1, kTimerInterval);
+
+      if(err < 0 && errno != EINTR) {
+        PLOG(ERROR) << "poll() failed in DTLS receive thread";
+        break;
+      } else if(err > 0 && (pfd.revents & (POLLERR | POLLNVAL))) {
+        LOG(ERROR) << "DTLS socket is no longer valid";
+        break;
+      }
+
+      // read all datagrams that are waiting
+      while(err > 0) {
+        struct sockaddr_storage addr{};
+        socklen_t addrLen = sizeof(addr);
+
+        ssize_t read = recvfrom(this->listeningSocket, buffer.data(),
+                                buffer.size(), MSG_DONTWAIT,
+                                reinterpret_cast<struct sockaddr *>(&addr),
+                                &addrLen);
+
+        if(read < 0) {
+          if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            PLOG(WARNING) << "recvfrom() failed";
+          }
+          break;
+        }
+
+        this->statDatagrams++;
+        this->handleDatagram(addr, buffer.data(), read);
+      }
+
+      // retransmit handshake messages and expire handshakes as needed
+      const auto now = std::chrono::steady_clock::now();
+
+      if((now - lastService) >= std::chrono::milliseconds(kTimerInterval)) {
+        this->serviceHandshakes();
+        this->registry->reapIfDue();
+        lastService = now;
+      }
+    }
+
+    // wake up anyone waiting in run()
+    {
+      std::lock_guard<std::mutex> lg(this->readyLock);
+      this->shutdown = true;
+    }
+
+    this->readyCv.notify_all();
+  }
+
+  /**
+   * Routes a datagram to the peer that sent it. Datagrams from unknown
+   * addresses must be a ClientHello with a valid cookie; only then is state
+   * for the peer created.
+   *
+   * @param addr Address of the peer
+   * @param data Datagram payload
+   * @param length Number of bytes in the datagram
+   */
+  void DTLSMuxServer::handleDatagram(const struct sockaddr_storage &addr,
+                                     const unsigned char *data,
+                                     size_t length) {
+    const auto key = DTLSMuxServer::makeKey(addr);
+    std::shared_ptr<DTLSMuxPeer> peer;
+
+    // find the peer, or check whether there's room for another handshake
+    {
+      std::lock_guard<std::mutex> lg(this->peersLock);
+
+      auto it = this->peers.find(key);
+
+      if(it != this->peers.end()) {
+        peer = it->second;
+      } else if(this->handshaking.size() >= this->maxPendingHandshakes) {
+        this->statDropped++;
+        return;
+      } else if(!this->registry->hasCapacity(this->handshaking.size())) {
+        this->registry->reject();
+        this->statDropped++;
+        return;
+      }
+    }
+
+    // new peers have to return a cookie before we keep any state for them
+    if(!peer) {
+      try {
+        peer = this->acceptHello(key, addr, data, length);
+      } catch(OpenSSLError &e) {
+        LOG(ERROR) << "Failed to create DTLS listener: " << e.what();
+        this->statDropped++;
+        return;
+      }
+
+      if(!peer) return;
+
+      {
+        std::lock_guard<std::mutex> lg(this->peersLock);
+
+        this->peers[key] = peer;
+        this->handshaking[key] = peer;
+      }
+
+      // the ClientHello was already consumed, so there's nothing to write
+      data = nullptr;
+    }
+
+    // hand the datagram to its SSL object
+    bool completed = false, failed = false;
+
+    {
+      std::lock_guard<std::mutex> lg(peer->lock);
+
+      if(peer->removed) return;
+
+      if(data) {
+        // don't let a peer that sends faster than it's read fill up memory
+        if(BIO_ctrl_pending(peer->rbio) + length > kMaxBufferedBytes) {
+          this->statDropped++;
+          return;
+        }
+
+        BIO_write(peer->rbio, data, length);
+      }
+
+      if(peer->established) {
+        peer->readable.notify_all();
+      } else if(this->continueHandshake(peer)) {
+        completed = peer->established;
+        failed = !completed;
+      }
+    }
+
+    // deliver the client, or get rid of the peer
+    if(completed) {
+      {
+        std::lock_guard<std::mutex> lg(this->peersLock);
+        this->handshaking.erase(key);
+      }
+
+      auto *client = new DTLSMuxClient(this, peer);
+      std::shared_ptr<GenericServerClient> ptr(client);
+
+      // a shared registry may have filled up during the handshake
+      if(!this->registry->add(ptr)) {
+        VLOG(1) << "Closing DTLS client " << ptr << ": too many connections";
+        ptr->close();
+        return;
+      }
+
+      {
+        std::lock_guard<std::mutex> lg(this->readyLock);
+        this->ready.push_back(ptr);
+      }
+
+      this->readyCv.notify_one();
+    } else if(failed) {
+      this->removePeer(key);
+    }
+  }
+
+  /**
+   * Checks whether a datagram from an unknown peer is a ClientHello that
+   * carries a valid cookie. All such datagrams are handled by the same
+   * listener, which answers a ClientHello without a cookie with a
+   * HelloVerifyRequest; so no state is kept for a peer until it has proven
+   * that it receives datagrams at its address.
+   *
+   * Once a cookie checks out, the listener (which holds the ClientHello)
+   * becomes the peer's state, and a new one is created for the next peer.
+   *
+   * @param key Key of the peer
+   * @param addr Address of the peer
+   * @param data Datagram payload
+   * @param length Number of bytes in the datagram
+   * @return State for the peer, whose handshake should be continued; or
+   * nullptr if the datagram didn't contain a valid cookie
+   * @throws OpenSSLError If the listener couldn't be created
+   */
+  std::shared_ptr<DTLSMuxPeer>
+  DTLSMuxServer::acceptHello(const std::string &key,
+                             const struct sockaddr_storage &addr,
+                             const unsigned char *data, size_t length) {
+    if(!this->listener) {
+      this->listener = this->createPeer();
+    }
+
+    auto &peer = this->listener;
+
+    // the cookie callbacks identify the peer by its key
+    peer->key = key;
+    peer->addr = addr;
+    BIO_dgram_set_peer(SSL_get_wbio(peer->ssl), &peer->addr);
+
+    // drop anything left over from an earlier datagram
+    (void) BIO_reset(peer->rbio);
+    BIO_write(peer->rbio, data, length);
+
+    if(DTLSMuxServer::listen(peer->ssl) <= 0) {
+      ERR_clear_error();
+      return nullptr;
+    }
+
+    auto verified = std::move(this->listener);
+    verified->deadline = std::chrono::steady_clock::now() +
+                         this->handshakeTimeout;
+
+    return verified;
+  }
+
+  /**
+   * Calls DTLSv1_listen() on a listener; this takes a BIO_ADDR in OpenSSL
+   * 1.1 and later, but a sockaddr in LibreSSL. The address is ignored, since
+   * the listener's read BIO is a memory BIO.
+   *
+   * @param ssl SSL object of the listener
+   * @return Result of DTLSv1_listen()
+   */
+  int DTLSMuxServer::listen(SSL *ssl) {
+#if !defined(LIBRESSL_VERSION_NUMBER) && OPENSSL_VERSION_NUMBER >= 0x10100000L
+    BIO_ADDR *client = BIO_ADDR_new();
+    if(!client) return -1;
+
+    int err = DTLSv1_listen(ssl, client);
+
+    BIO_ADDR_free(client);
+    return err;
+#else
+    struct sockaddr_storage client{};
+    return DTLSv1_listen(ssl, reinterpret_cast<struct sockaddr *>(&client));
+#endif
+  }
+
+  /**
+   * Creates the state for a peer: its SSL object reads from a memory BIO
+   * (into which the receive thread writes datagrams) and writes directly to
+   * the shared socket. Its address is filled in by acceptHello().
+   *
+   * @return Peer state
+   * @throws OpenSSLError
+   */
+  std::shared_ptr<DTLSMuxPeer> DTLSMuxServer::createPeer() {
+    auto peer = std::make_shared<DTLSMuxPeer>();
+
+    peer->ssl = SSL_new(this->ctx);
+    if(!peer->ssl) {
+      throw OpenSSLError("SSL_new() failed");
+    }
+
+    // reads come from memory; an empty BIO means "try again later"
+    peer->rbio = BIO_new(BIO_s_mem());
+    BIO_set_mem_eof_return(peer->rbio, -1);
+
+    BIO *wbio = BIO_new_dgram(this->listeningSocket, BIO_NOCLOSE);
+
+    SSL_set_bio(peer->ssl, peer->rbio, wbio);
+    SSL_set_app_data(peer->ssl, peer.get());
+
+    // the socket isn't connected, so its MTU can't be queried
+    SSL_set_options(peer->ssl, SSL_OP_COOKIE_EXCHANGE | SSL_OP_NO_QUERY_MTU);
+    SSL_set_mtu(peer->ssl, kLinkMtu);
+
+    SSL_set_accept_state(peer->ssl);
+
+    return peer;
+  }
+
+  /**
+   * Continues the handshake with a peer. The peer must be locked.
+   *
+   * @param peer Peer whose handshake to continue
+   * @return Whether the handshake is done; check the peer's `established`
+   * flag to see whether it was successful.
+   */
+  bool
+  DTLSMuxServer::continueHandshake(const std::shared_ptr<DTLSMuxPeer> &peer) {
+    int err = SSL_do_handshake(peer->ssl);
+
+    if(err == 1) {
+      peer->established = true;
+
+      this->statCompleted++;
+
+      if(SSL_session_reused(peer->ssl)) {
+        this->statResumed++;
+      }
+
+      VLOG(1) << "DTLS handshake complete (resumed: "
+              << SSL_session_reused(peer->ssl) << ", "
+              << CipherPolicy::describe(peer->ssl) << ")";
+      return true;
+    }
+
+    switch(SSL_get_error(peer->ssl, err)) {
+      case SSL_ERROR_WANT_READ:
+      case SSL_ERROR_WANT_WRITE:
+        return false;
+
+      default:
+        VLOG(1) << "DTLS handshake failed: "
+                << OpenSSLError("SSL_do_handshake() failed").what();
+
+        this->statFailed++;
+        return true;
+    }
+  }
+
+  /**
+   * Retransmits handshake messages whose timers expired, and removes peers
+   * that haven't completed their handshake in time.
+   */
+  void DTLSMuxServer::serviceHandshakes() {
+    std::vector<std::shared_ptr<DTLSMuxPeer>> pending;
+    std::vector<std::string> expired;
+
+    {
+      std::lock_guard<std::mutex> lg(this->peersLock);
+      pending.reserve(this->handshaking.size());
+
+      for(auto &[key, peer] : this->handshaking) {
+        pending.push_back(peer);
+      }
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+
+    for(auto &peer : pending) {
+      std::lock_guard<std::mutex> lg(peer->lock);
+
+      if(peer->established || peer->removed) continue;
+
+      if(now >= peer->deadline) {
+        this->statTimedOut++;
+        expired.push_back(peer->key);
+      } else {
+        DTLSv1_handle_timeout(peer->ssl);
+      }
+    }
+
+    for(const auto &key : expired) {
+      this->removePeer(key);
+    }
+  }
+
+  /**
+   * Removes a peer; any further datagrams from its address will start a new
+   * handshake. Clients waiting for data from it are woken up.
+   *
+   * @param key Key of the peer to remove
+   */
+  void DTLSMuxServer::removePeer(const std::string &key) {
+    std::shared_ptr<DTLSMuxPeer> peer;
+
+    {
+      std::lock_guard<std::mutex> lg(this->peersLock);
+
+      auto it = this->peers.find(key);
+      if(it == this->peers.end()) return;
+
+      peer = it->second;
+
+      this->peers.erase(it);
+      this->handshaking.erase(key);
+    }
+
+    std::lock_guard<std::mutex> lg(peer->lock);
+    peer->removed = true;
+    peer->readable.notify_all();
+  }
+
+
+  /**
+   * Builds the key under which a peer is stored: its address family, port
+   * and address.
+   *
+   * @param addr Address of the peer
+   * @return Key for the peer
+   */
+  std::string DTLSMuxServer::makeKey(const struct sockaddr_storage &addr) {
+    std::string key;
+    key.push_back(static_cast<char>(addr.ss_family));
+
+    if(addr.ss_family == AF_INET) {
+      const auto *in = reinterpret_cast<const struct sockaddr_in *>(&addr);
+
+      key.append(reinterpret_cast<const char *>(&in->sin_port),
+                 sizeof(in->sin_port));
+      key.append(reinterpret_cast<const char *>(&in->sin_addr),
+                 sizeof(in->sin_addr));
+    } else if(addr.ss_family == AF_INET6) {
+      const auto *in6 = reinterpret_cast<const struct sockaddr_in6 *>(&addr);
+
+      key.append(reinterpret_cast<const char *>(&in6->sin6_port),
+                 sizeof(in6->sin6_port));
+      key.append(reinterpret_cast<const char *>(&in6->sin6_addr),
+                 sizeof(in6->sin6_addr));
+    }
+
+    return key;
+  }
+
+  /**
+   * Generates a DTLS cookie for the peer's address with the shared cookie
+   * engine; the address is taken from the peer rather than the BIO, since
+   * peers use memory BIOs.
+   *
+   * @param ssl SSL object of the peer
+   * @param cookie Buffer into which we write the cookie
+   * @param cookieLen Length of cookie, in bytes
+   * @return 1 if successful, 0 otherwise.
+   */
+  int DTLSMuxServer::generateCookie(SSL *ssl, unsigned char *cookie,
+                                    unsigned int *cookieLen) {
+    auto *peer = static_cast<DTLSMuxPeer *>(SSL_get_app_data(ssl));
+    if(!peer) return 0;
+
+    const auto *key = reinterpret_cast<const unsigned char *>(peer->key.data());
+
+    return DTLSCookieEngine::shared().generate(key, peer->key.size(), cookie,
+                                               cookieLen) ? 1 : 0;
+  }
+
+  /**
+   * Verifies a DTLS cookie.
+   *
+   * @param ssl SSL object of the peer
+   * @param cookie Buffer containing the cookie
+   * @param cookieLen Length of cookie, in bytes
+   * @return 1 if the cookie is valid, 0 otherwise.
+   */
+  int DTLSMuxServer::verifyCookie(SSL *ssl, const unsigned char *cookie,
+                                  unsigned int cookieLen) {
+    auto *peer = static_cast<DTLSMuxPeer *>(SSL_get_app_data(ssl));
+    if(!peer) return 0;
+
+    const auto *key = reinterpret_cast<const unsigned char *>(peer->key.data());
+
+    if(!DTLSCookieEngine::shared().verify(key, peer->key.size(), cookie,
+                                          cookieLen)) {
+      DTLSCookieEngine::shared().warnRejected(cookieLen);
+      return 0;
+    }
+
+    return 1;
+  }
+}
@@ -0,0 +1,191 @@
+//
+// Created by Tristan Seifert on 2019-09-10.
+//
+
+#ifndef LIBLICHTENSTEIN_DTLSMUXSERVER_H
+#define LIBLICHTENSTEIN_DTLSMUXSERVER_H
+
+#include "GenericTLSServer.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include <sys/socket.h>
+
+namespace liblichtenstein {
+  namespace io {
+    class GenericServerClient;
+
+    struct DTLSMuxPeer;
+
+    /**
+     * A DTLS server that serves all peers from a single UDP socket.
+     *
+     * Unlike DTLSServer, which creates a connected socket for every client,
+     * a single thread receives all datagrams on the listening socket and
+     * routes them (by the peer's address) to that peer's SSL object through a
+     * memory BIO. Handshakes are driven by the receive thread as datagrams
+     * arrive, so any number of them can be in progress at once.
+     *
+     * State for a peer is only created once it returned a valid cookie; until
+     * then, its datagrams are answered statelessly by a shared listener.
+     *
+     * Clients that completed the handshake are returned from `run()`; their
+     * reads wait for the receive thread to deliver data, while writes go
+     * directly to the shared socket.
+     *
+     * @note OpenSSL _must_ be initialized before trying to construct this class.
+     */
+    class DTLSMuxServer : public GenericTLSServer {
+        friend class DTLSMuxClient;
+
+      public:
+        /// server counters, for monitoring purposes
+        struct Stats {
+          /// datagrams received
+          uint64_t datagrams = 0;
+          /// datagrams dropped (e.g. because too many handshakes are pending)
+          uint64_t dropped = 0;
+          /// handshakes that completed successfully
+          uint64_t completed = 0;
+          /// completed handshakes that resumed an earlier session
+          uint64_t resumed = 0;
+          /// handshakes that failed
+          uint64_t failed = 0;
+          /// handshakes that didn't complete in time
+          uint64_t timedOut = 0;
+          /// number of peers known to the server
+          uint64_t peers = 0;
+        };
+
+      public:
+        explicit DTLSMuxServer(int fd);
+
+        DTLSMuxServer(int fd, SSL_CTX *ctx);
+
+        virtual ~DTLSMuxServer();
+
+      public:
+        virtual std::shared_ptr<GenericServerClient> run();
+
+        void start();
+
+        void stop();
+
+        [[nodiscard]] Stats getStats() const;
+
+        /// sets how long a peer has to complete the handshake
+        void setHandshakeTimeout(std::chrono::milliseconds timeout) {
+          this->handshakeTimeout = timeout;
+        }
+
+        /// sets how many handshakes may be in progress at once
+        void setMaxPendingHandshakes(size_t max) {
+          this->maxPendingHandshakes = max;
+        }
+
+        /// returns the socket all peers share
+        [[nodiscard]] int getSocket() const {
+          return this->listeningSocket;
+        }
+
+      private:
+        void createContext();
+
+        void configureSocket();
+
+        void receiveEntry();
+
+        void handleDatagram(const struct sockaddr_storage &addr,
+                            const unsigned char *data, size_t length);
+
+        std::shared_ptr<DTLSMuxPeer>
+        acceptHello(const std::string &key, const struct sockaddr_storage &addr,
+                    const unsigned char *data, size_t length);
+
+        std::shared_ptr<DTLSMuxPeer> createPeer();
+
+        static int listen(SSL *ssl);
+
+        bool continueHandshake(const std::shared_ptr<DTLSMuxPeer> &peer);
+
+        void serviceHandshakes();
+
+        void removePeer(const std::string &key);
+
+        static std::string makeKey(const struct sockaddr_storage &addr);
+
+        static int generateCookie(SSL *ssl, unsigned char *cookie,
+                                  unsigned int *cookieLen);
+
+        static int verifyCookie(SSL *ssl, const unsigned char *cookie,
+                                unsigned int cookieLen);
+
+      private:
+        /// largest datagram we can receive
+        static const size_t kMaxDatagramSize = 65536;
+        /// most received bytes buffered for a peer; further datagrams are
+        /// dropped until it reads some of them
+        static const size_t kMaxBufferedBytes = (1024 * 16);
+        /// requested size of the socket's send and receive buffers
+        static const int kSocketBufferSize = (1024 * 1024 * 4);
+        /// how often retransmissions and timeouts are checked (msec)
+        static constexpr int kTimerInterval = 100;
+        /// default time a peer has to complete the handshake
+        static constexpr std::chrono::milliseconds kDefaultHandshakeTimeout{
+                10000};
+        /// default number of handshakes that may be in progress at once
+        static const size_t kDefaultMaxPendingHandshakes = 1024;
+        /// number of sessions kept in the session cache
+        static const long kSessionCacheSize = 8192;
+        /// how long sessions (and tickets) may be resumed for (sec)
+        static const long kSessionTimeout = (60 * 60 * 24);
+
+      private:
+        /// thread that receives datagrams
+        std::thread *receiveThread = nullptr;
+        /// set when the receive thread should exit
+        std::atomic_bool shutdown = false;
+        /// set by stop(), after which the server isn't started again
+        bool stopped = false;
+
+        /// protects the peer maps
+        mutable std::mutex peersLock;
+        /// answers ClientHellos from unknown peers (receive thread only)
+        std::shared_ptr<DTLSMuxPeer> listener;
+
+        /// all peers, keyed by their address
+        std::unordered_map<std::string, std::shared_ptr<DTLSMuxPeer>> peers;
+        /// peers whose handshake hasn't yet completed
+        std::unordered_map<std::string, std::shared_ptr<DTLSMuxPeer>> handshaking;
+
+        /// how long a peer has to complete the handshake
+        std::chrono::milliseconds handshakeTimeout = kDefaultHandshakeTimeout;
+        /// maximum number of handshakes in progress at once
+        size_t maxPendingHandshakes = kDefaultMaxPendingHandshakes;
+
+        /// protects the ready queue
+        std::mutex readyLock;
+        /// signalled when a session is established, or the server stops
+        std::condition_variable readyCv;
+        /// established sessions that haven't been returned by run()
+        std::deque<std::shared_ptr<GenericServerClient>> ready;
+
+        /// counters
+        std::atomic<uint64_t> statDatagrams = 0, statDropped = 0,
+                statCompleted = 0, statResumed = 0, statFailed = 0,
+                statTimedOut = 0;
+    };
+  }
+}
+
+#endif //LIBLICHTENSTEIN_DTLSMUXSERVER_H
@@ -5,6 +5,9 @@
 #include "DTLSServer.h"
 #include "OpenSSLError.h"
 #include "GenericServerClient.h"
+#include "BatchedDatagramBIO.h"
+#include "DTLSCookieEngine.h"
+#include "CipherPolicy.h"
 
 #include <glog/logging.h>
 
@@ -21,29 +24,14 @@
 #include <openssl/ssl.h>
 #include <openssl/bio.h>
 #include <openssl/err.h>
-#include <openssl/rand.h>
 #include <openssl/opensslv.h>
 
 
 
 namespace liblichtenstein {
   namespace io {
-    /**
-     * Secret used to generate DTLS cookies: the first invocation of the DTLS
-     * cookie generator will generate a random secret.
-     */
-    static bool cookieSecretValid = false;
-    static const size_t cookieSecretLength = 16;
-    static unsigned char cookieSecret[cookieSecretLength];
-
-    int DTLSGenerateCookieCb(SSL *ssl, unsigned char *cookie,
-                             unsigned int *cookieLen);
-
-    int DTLSVerifyCookieCb(SSL *ssl, const unsigned char *cookie,
-                           unsigned int cookieLen);
-
-    int DTLSCalculateCookie(SSL *ssl, unsigned char *result,
-                            unsigned int *resultLength);
+    /// identifies sessions created by this server
+    static const unsigned char kSessionIdContext[] = "lichtenstein-rt";
 
     /**
      * Initializes the DTLS server.
@@ -52,10 +40,26 @@ namespace liblichtenstein {
      * listening purposes.
      */
     DTLSServer::DTLSServer(int fd) : GenericTLSServer(fd) {
+      // cookies are generated by the engine shared by all servers, so that any
+      // of them can verify a cookie issued by another
+      DTLSCookieEngine::shared();
+
       // set up OpenSSL context
       this->createContext();
     }
 
+    /**
+     * Initializes a DTLS server that shares the SSL context of another server;
+     * this way, both use the same certificate and session cache.
+     *
+     * @param fd Socket to listen on; this should already be configured for
+     * listening purposes.
+     * @param ctx Context created by another DTLSServer
+     */
+    DTLSServer::DTLSServer(int fd, SSL_CTX *ctx) : GenericTLSServer(fd, ctx) {
+      DTLSCookieEngine::shared();
+    }
+
     /**
      * Tears down the DTLS server. Any existing sessions are closed.
      */
@@ -63,6 +67,15 @@ namespace liblichtenstein {
     }
 
 
+    /**
+     * Makes run() stop waiting for new clients; it throws once the current
+     * receive timeout expires.
+     */
+    void DTLSServer::stop() {
+      this->shutdown = true;
+    }
+
+
     /**
      * Creates the OpenSSL context for TLS; we create it with TLS 1.2.
      *
@@ -87,8 +100,19 @@ namespace liblichtenstein {
       // set read-ahead and cookie verification callbacks
       SSL_CTX_set_read_ahead(this->ctx, 1);
 
-      SSL_CTX_set_cookie_generate_cb(this->ctx, DTLSGenerateCookieCb);
-      SSL_CTX_set_cookie_verify_cb(this->ctx, DTLSVerifyCookieCb);
+      CipherPolicy::apply(this->ctx, true);
+
+      SSL_CTX_set_cookie_generate_cb(this->ctx,
+                                     DTLSCookieEngine::generateCookieCb);
+      SSL_CTX_set_cookie_verify_cb(this->ctx, DTLSCookieEngine::verifyCookieCb);
+
+      // allow nodes to resume their session when they reconnect
+      SSL_CTX_set_session_cache_mode(this->ctx, SSL_SESS_CACHE_SERVER);
+      SSL_CTX_sess_set_cache_size(this->ctx, kSessionCacheSize);
+      SSL_CTX_set_timeout(this->ctx, kSessionTimeout);
+      SSL_CTX_set_session_id_context(this->ctx, kSessionIdContext,
+                                     sizeof(kSessionIdContext) - 1);
+      SSL_CTX_clear_options(this->ctx, SSL_OP_NO_TICKET);
     }
 
 
@@ -132,7 +156,33 @@ namespace liblichtenstein {
       SSL_set_options(ssl, SSL_OP_COOKIE_EXCHANGE);
 
       // listen for incoming requests
-      while (DTLSv1_listen(ssl, &clientAddr) <= 0);
+      while (true) {
+        while (DTLSv1_listen(ssl, &clientAddr) <= 0) {
+          if (this->shutdown) {
+            SSL_free(ssl);
+            throw std::system_error(ECONNABORTED, std::system_category(),
+                                    "DTLS server was stopped");
+          }
+
+          // get rid of closed sessions while we're idle
+          this->registry->reapIfDue();
+        }
+
+        // the peer returned a valid cookie; only hand it a session if there's
+        // room for one, even after getting rid of closed ones
+        if (!this->registry->hasCapacity()) {
+          this->registry->reap();
+        }
+        if (this->registry->hasCapacity()) {
+          break;
+        }
+
+        VLOG(1) << "Ignoring DTLS client: too many connections";
+        this->registry->reject();
+
+        SSL_clear(ssl);
+        SSL_set_options(ssl, SSL_OP_COOKIE_EXCHANGE);
+      }
 
 
       // create a socket connected to this client
@@ -143,7 +193,9 @@ namespace liblichtenstein {
                                 "Could not open socket for client");
       }
 
-      // allow addresses to be reused
+      // allow addresses to be reused; on Linux, the client socket must not
+      // join the listening sockets' SO_REUSEPORT group, or it would be handed
+      // datagrams from new peers when listening is sharded
       setsockopt(clientFd, SOL_SOCKET, SO_REUSEADDR, (const void *) &on,
                  (socklen_t) sizeof(on));
 #if defined(SO_REUSEPORT) && !defined(__linux__)
@@ -225,165 +277,44 @@ namespace liblichtenstein {
 #endif
       } while (err == 0);
 
+      VLOG(1) << "DTLS handshake complete (resumed: "
+              << SSL_session_reused(ssl) << ", " << CipherPolicy::describe(ssl)
+              << ")";
+
       // configure timeout on this client connection
       memset(&timeout, 0, sizeof(timeout));
 
       timeout.tv_sec = 2;
       BIO_ctrl(bio, BIO_CTRL_DGRAM_SET_RECV_TIMEOUT, 0, &timeout);
 
-      // create client instance
-      auto *client = new GenericServerClient(this, clientFd, ssl,
-                                             clientAddr.s4);
-      return this->clients.emplace_back(client);
-    }
-
+      // now that the handshake is done, switch to batched IO if requested
+      if (this->batchedIO || this->datagramOffload) {
+        BIO *batched = BatchedDatagramBIO::create(clientFd, BIO_NOCLOSE);
+        BIO_ctrl(batched, BIO_CTRL_DGRAM_SET_RECV_TIMEOUT, 0, &timeout);
 
-    /**
-     * Generates a DTLS session cookie. This contains some random bytes, plus
-     * the address/port of the connecting client.
-     *
-     * @param ssl SSL context for which to generate the cookie for
-     * @param cookie Buffer into which we write the cookie
-     * @param cookieLen Length of cookie, in bytes
-     * @return 1 if successful, 0 otherwise.
-     */
-    int DTLSGenerateCookieCb(SSL *ssl, unsigned char *cookie,
-                             unsigned int *cookieLen) {
-      unsigned char result[EVP_MAX_MD_SIZE];
-      unsigned int resultLength;
-
-      // generate a random secret to use for cookies
-      if (!cookieSecretValid) {
-        if (!RAND_bytes(cookieSecret, cookieSecretLength)) {
-          LOG(ERROR) << "Could not generate DTLS cookie secret!";
-          return 0;
+        if (this->datagramOffload) {
+          BatchedDatagramBIO::enableSendOffload(batched);
+          BatchedDatagramBIO::enableReceiveOffload(batched);
         }
 
-        cookieSecretValid = true;
-      }
-
-      // calculate the cookie
-      DTLSCalculateCookie(ssl, result, &resultLength);
-
-      // copy cookie into result buffer
-      memcpy(cookie, result, resultLength);
-      *cookieLen = resultLength;
-
-      return 1;
-    }
-
-    /**
-     * Verifies a DTLS cookie.
-     *
-     * @param ssl SSL context on which we received the cookie
-     * @param cookie Buffer containing the cookie
-     * @param cookieLen Length of cookie, in bytes
-     * @return 1 if the cookie was validated successfully, 0 otherwise.
-     */
-    int DTLSVerifyCookieCb(SSL *ssl, const unsigned char *cookie,
-                           unsigned int cookieLen) {
-      unsigned char result[EVP_MAX_MD_SIZE];
-      unsigned int resultLength;
-
-      // abort if cookie secret is not set
-      if (!cookieSecretValid) {
-        LOG(ERROR) << "Attempt to validate DTLS cookie (len = " << cookieLen
-                   << ") but cookie secret has not been initialized";
-        return 0;
-      }
-      // calculate the cookie
-      DTLSCalculateCookie(ssl, result, &resultLength);
-
-      // make sure it's valid (TODO: timing independent compare?)
-      if (cookieLen == resultLength &&
-          memcmp(result, cookie, resultLength) == 0) {
-        // cookie was valid
-        return 1;
-      }
-
-      // invalid cookie
-      LOG(WARNING) << "DTLS cookie failed HMAC (len = " << cookieLen << ")";
-      return 0;
-    }
-
-    /**
-     * Given a client connected SSL context, generates the correct cookie value.
-     *
-     * @param ssl An SSL context
-     * @param result Buffer into which cookie is written
-     * @param resultLength Number of bytes of cookie generated
-     * @return 0 if successful, an error code otherwise.
-     */
-    int DTLSCalculateCookie(SSL *ssl, unsigned char *result,
-                            unsigned int *resultLength) {
-      // size of the buffer to allocate
-      unsigned int length = 0;
-      // temporary buffer to write client address into
-      unsigned char *buffer = nullptr;
-
-      // this is where the client address will be read to
-      union {
-        struct sockaddr_storage ss;
-        struct sockaddr_in6 s6;
-        struct sockaddr_in s4;
-      } peer;
-      memset(&peer, 0, sizeof(peer));
-
-
-      // get peer information from BIO
-      BIO_dgram_get_peer(SSL_get_rbio(ssl), &peer);
-
-      // get the number of bytes we need in our buffer
-      length = 0;
-      switch (peer.ss.ss_family) {
-        case AF_INET:
-          length += sizeof(struct in_addr);
-          break;
-        case AF_INET6:
-          length += sizeof(struct in6_addr);
-          break;
-        default:
-          LOG(ERROR) << "Invalid family: " << peer.ss.ss_family;
-          return 0;
+        // this frees the datagram BIO
+        SSL_set_bio(ssl, batched, batched);
       }
 
-      length += sizeof(in_port_t);
-
-      // allocate cookie buffer
-      buffer = (unsigned char *) OPENSSL_malloc(length);
-      CHECK_NOTNULL(buffer);
-
-      // copy the address and port into the buffer
-      switch (peer.ss.ss_family) {
-        case AF_INET:
-          memcpy(buffer,
-                 &peer.s4.sin_port,
-                 sizeof(in_port_t));
-          memcpy(buffer + sizeof(peer.s4.sin_port),
-                 &peer.s4.sin_addr,
-                 sizeof(struct in_addr));
-          break;
-        case AF_INET6:
-          memcpy(buffer,
-                 &peer.s6.sin6_port,
-                 sizeof(in_port_t));
-          memcpy(buffer + sizeof(in_port_t),
-                 &peer.s6.sin6_addr,
-                 sizeof(struct in6_addr));
-          break;
-
-        default:
-          LOG(ERROR) << "Invalid family: " << peer.ss.ss_family;
-          return 0;
+      // create client instance
+      auto *client = new GenericServerClient(this, clientFd, ssl,
+                                             clientAddr.s4);
+      std::shared_ptr<GenericServerClient> ptr(client);
+
+      // this also reaps closed sessions; a shared registry may have filled up
+      if (!this->registry->add(ptr)) {
+        ptr->setBlocking(false);
+        ptr->close();
+        throw std::system_error(EAGAIN, std::system_category(),
+                                "Too many DTLS connections");
       }
 
-      // calculate a HMAC over the buffer using our secret
-      HMAC(EVP_sha1(), (const void *) cookieSecret, cookieSecretLength,
-           (const unsigned char *) buffer, length, result, resultLength);
-      OPENSSL_free(buffer);
-
-      // always success
-      return 0;
+      return ptr;
     }
   }
 }
\ No newline at end of file
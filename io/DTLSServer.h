@@ -7,6 +7,8 @@
 
 #include "GenericTLSServer.h"
 
+#include <atomic>
+
 namespace liblichtenstein {
   namespace io {
     /**
@@ -28,13 +30,49 @@ namespace liblichtenstein {
       public:
         explicit DTLSServer(int fd);
 
+        DTLSServer(int fd, SSL_CTX *ctx);
+
         virtual ~DTLSServer();
 
       public:
         virtual std::shared_ptr<GenericServerClient> run();
 
+        virtual void stop();
+
+        /**
+         * Sets whether sessions accepted from now on receive datagrams in
+         * batches (and send them in batches, between beginBatch() and
+         * endBatch() calls on the client.)
+         */
+        void setBatchedIO(bool batched) {
+          this->batchedIO = batched;
+        }
+
+        /**
+         * Sets whether sessions accepted from now on use UDP segmentation
+         * offload (GSO and GRO) where the kernel supports it; this implies
+         * batched IO.
+         */
+        void setDatagramOffload(bool offload) {
+          this->datagramOffload = offload;
+        }
+
       private:
         void createContext();
+
+      private:
+        /// number of sessions kept in the session cache
+        static const long kSessionCacheSize = 1024;
+        /// how long sessions (and tickets) may be resumed for (sec)
+        static const long kSessionTimeout = (60 * 60 * 24);
+
+      private:
+        /// set when run() should stop waiting for clients
+        std::atomic_bool shutdown = false;
+        /// whether accepted sessions use a batched datagram BIO
+        std::atomic_bool batchedIO = false;
+        /// whether accepted sessions use segmentation offload
+        std::atomic_bool datagramOffload = false;
     };
   }
 }
@@ -6,6 +6,9 @@
 #include "TLSServer.h"
 #include "OpenSSLError.h"
 #include "SSLSessionClosedError.h"
+#include "KernelTLS.h"
+#include "BatchedDatagramBIO.h"
+#include "CipherPolicy.h"
 
 #include <glog/logging.h>
 
@@ -13,6 +16,8 @@
 #include <stdexcept>
 #include <system_error>
 
+#include <fcntl.h>
+#include <poll.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <openssl/ssl.h>
@@ -103,20 +108,35 @@ namespace liblichtenstein::io {
    * @throws std::system_error, TLSServer::OpenSSLError
    */
   size_t GenericServerClient::write(const std::vector<std::byte> &data) {
-    int err, errType;
-
-    // pull out pointers to data
-    const std::byte *buf = data.data();
-    const size_t bufSz = data.size();
+    return this->write(data.data(), data.size());
+  }
 
+  /**
+   * Writes data to the client through the SSL session.
+   *
+   * @param buf Pointer to the bytes to write to the connection
+   * @param bufSz Number of bytes to write
+   * @return Number of bytes written
+   * @throws std::system_error, TLSServer::OpenSSLError
+   */
+  size_t GenericServerClient::write(const std::byte *buf, size_t bufSz) {
+    int err, errType;
 
     // perform write
+    retry:;
     err = SSL_write(this->ctx, buf, bufSz);
 
     if (err <= 0) {
       // figure out what went wrong
       errType = SSL_get_error(this->ctx, err);
 
+      // on non-blocking sockets, wait for the socket to become ready
+      if (!this->blocking && (errType == SSL_ERROR_WANT_WRITE ||
+                              errType == SSL_ERROR_WANT_READ)) {
+        this->waitForSocket(errType == SSL_ERROR_WANT_WRITE);
+        goto retry;
+      }
+
       if (errType == SSL_ERROR_SYSCALL) {
         // a syscall failed, so forward that
         throw std::system_error(errno, std::system_category(),
@@ -142,30 +162,26 @@ namespace liblichtenstein::io {
    * TLS is based on records, we can only process entire records at a time, so
    * extra data may be available.
    *
-   * @param data Vector into which data should be read
-   * @param wanted How many bytes are desired to read
-   * @return How many bytes were actually read, or -1 if session was closed
+   * @param buf Buffer into which data should be read
+   * @param bufSz How many bytes are desired to read
+   * @return How many bytes were actually read
    * @throws std::system_error, TLSServer::OpenSSLError
    */
-  size_t
-  GenericServerClient::read(std::vector<std::byte> &data, size_t wanted) {
+  size_t GenericServerClient::read(std::byte *buf, size_t bufSz) {
     int err, errType;
 
-    // allocate a temporary read buffer and read into it
-    auto buf = new std::byte[wanted];
-    err = SSL_read(this->ctx, buf, wanted);
+    err = SSL_read(this->ctx, buf, bufSz);
 
     if (err <= 0) {
-      // deallocate the read buffer and figure out cause of error
-      delete[] buf;
-
+      // figure out cause of error
       errType = SSL_get_error(this->ctx, err);
 
       if (errType == SSL_ERROR_SYSCALL) {
         // a syscall failed, so forward that
         throw std::system_error(errno, std::system_category(),
                                 "SSL_read() failed");
-      } else if (errType == SSL_ERROR_WANT_READ) {
+      } else if (errType == SSL_ERROR_WANT_READ ||
+                 errType == SSL_ERROR_WANT_WRITE) {
         // no data is available on the socket for us to consume
         return 0;
       } else if (errType == SSL_ERROR_ZERO_RETURN) {
@@ -180,13 +196,65 @@ namespace liblichtenstein::io {
       }
     }
 
-    // read was successful, copy the bytes and return
-    data.insert(data.end(), buf, (buf + err));
-    delete[] buf;
-
+    // read was successful
     return err;
   }
 
+  /**
+   * Switches the underlying socket between blocking and non-blocking mode.
+   *
+   * In non-blocking mode, reads return 0 if no data is available, rather than
+   * waiting for it. Writes still only return once all data was written, but
+   * will wait (up to a timeout) for the socket to become writable if needed.
+   *
+   * @param blocking Whether the socket should be blocking
+   * @throws std::system_error
+   */
+  void GenericServerClient::setBlocking(bool blocking) {
+    int flags = fcntl(this->fd, F_GETFL, 0);
+
+    if (flags == -1) {
+      throw std::system_error(errno, std::system_category(),
+                              "fcntl(F_GETFL) failed");
+    }
+
+    flags = blocking ? (flags & ~O_NONBLOCK) : (flags | O_NONBLOCK);
+
+    if (fcntl(this->fd, F_SETFL, flags) == -1) {
+      throw std::system_error(errno, std::system_category(),
+                              "fcntl(F_SETFL) failed");
+    }
+
+    this->blocking = blocking;
+  }
+
+  /**
+   * Waits for a non-blocking socket to become readable or writable, so that an
+   * SSL operation can be retried.
+   *
+   * @param write Whether to wait for the socket to become writable, rather
+   * than readable
+   * @throws std::system_error If the socket doesn't become ready in time
+   */
+  void GenericServerClient::waitForSocket(bool write) {
+    int err;
+
+    struct pollfd pfd{};
+    pfd.fd = this->fd;
+    pfd.events = write ? POLLOUT : POLLIN;
+
+    do {
+      err = poll(&pfd, 1, kNonBlockingTimeout);
+    } while (err < 0 && errno == EINTR);
+
+    if (err < 0) {
+      throw std::system_error(errno, std::system_category(), "poll() failed");
+    } else if (err == 0) {
+      throw std::system_error(ETIMEDOUT, std::system_category(),
+                              "Timed out waiting for socket");
+    }
+  }
+
   /**
    * Gets the number of bytes pending to be read from the client.
    *
@@ -200,4 +268,90 @@ namespace liblichtenstein::io {
 
     return err;
   }
-}
\ No newline at end of file
+
+  /**
+   * Starts a batch of writes: until endBatch() is called, datagrams are
+   * queued and sent several at a time, rather than with a syscall each. This
+   * only has an effect on connections using a batched datagram BIO.
+   */
+  void GenericServerClient::beginBatch() {
+    BatchedDatagramBIO::setCorked(SSL_get_wbio(this->ctx), true);
+  }
+
+  /**
+   * Ends a batch of writes, sending all datagrams queued since beginBatch().
+   */
+  void GenericServerClient::endBatch() {
+    BatchedDatagramBIO::setCorked(SSL_get_wbio(this->ctx), false);
+  }
+
+  /**
+   * Enables UDP segmentation offload for the connection: batches of equal
+   * sized datagrams are sent as GSO super-packets, and the kernel may hand us
+   * received datagrams coalesced (GRO.) This only works for connections
+   * using a batched datagram BIO, on Linux.
+   *
+   * @return Whether either offload is in effect
+   */
+  bool GenericServerClient::enableDatagramOffload() {
+    BIO *bio = SSL_get_rbio(this->ctx);
+
+    const bool send = BatchedDatagramBIO::enableSendOffload(bio);
+    const bool receive = BatchedDatagramBIO::enableReceiveOffload(bio);
+
+    return send || receive;
+  }
+
+  /**
+   * Sends part of a file to the client. If kTLS is active, the kernel
+   * encrypts the file's contents as it sends them; otherwise, the file is
+   * read and written like any other data.
+   *
+   * @param file File descriptor of the file to send
+   * @param offset Offset into the file at which to start
+   * @param length Number of bytes to send
+   * @return Number of bytes sent; less than `length` if the file is shorter
+   * @throws std::system_error, OpenSSLError, SSLSessionClosedError
+   */
+  size_t GenericServerClient::sendFile(int file, off_t offset, size_t length) {
+    return KernelTLS::sendFile(this->ctx, *this, file, offset, length);
+  }
+
+  /**
+   * Whether the kernel encrypts (or decrypts) records for this session.
+   */
+  bool GenericServerClient::isKernelTLSActive() const {
+    return KernelTLS::isSendOffloaded(this->ctx) ||
+           KernelTLS::isReceiveOffloaded(this->ctx);
+  }
+
+  /**
+   * Describes the protocol version and cipher suite negotiated with the
+   * client.
+   */
+  std::string GenericServerClient::getCipherDescription() const {
+    return CipherPolicy::describe(this->ctx);
+  }
+
+  /**
+   * Estimates how much memory the session takes up, in bytes. OpenSSL doesn't
+   * report this, so it's approximated from the session's configuration: its
+   * state, its record buffers (unless they're released while idle) and the
+   * buffers of a batched datagram BIO, if it uses one.
+   */
+  size_t GenericServerClient::estimateMemoryUsage() const {
+    size_t bytes = sizeof(*this);
+
+    if(!this->ctx) return bytes;
+
+    bytes += kSessionStateSize;
+
+    if(!(SSL_get_mode(this->ctx) & SSL_MODE_RELEASE_BUFFERS)) {
+      bytes += (2 * kRecordBufferSize);
+    }
+
+    bytes += BatchedDatagramBIO::getMemoryUsage(SSL_get_rbio(this->ctx));
+
+    return bytes;
+  }
+}
@@ -5,14 +5,19 @@
 #ifndef LIBLICHTENSTEIN_GENERICSERVERCLIENT_H
 #define LIBLICHTENSTEIN_GENERICSERVERCLIENT_H
 
+#include <atomic>
+#include <string>
 #include <vector>
 #include <cstddef>
 
+#include <sys/types.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
 #include <openssl/ssl.h>
 
+#include "ITransport.h"
+
 namespace liblichtenstein {
   namespace io {
     class GenericTLSServer;
@@ -25,7 +30,7 @@ namespace liblichtenstein {
      * `TLSServer` class will create one with the appropriate fields filled in
      * and return it.
      */
-    class GenericServerClient {
+    class GenericServerClient : public ITransport {
         friend class TLSServer;
 
         friend class DTLSServer;
@@ -40,26 +45,69 @@ namespace liblichtenstein {
         virtual ~GenericServerClient();
 
       public:
-        [[nodiscard]] bool isSessionOpen() const {
+        [[nodiscard]] bool isSessionOpen() const override {
           return this->isOpen;
         }
 
-        void close();
+        void close() override;
 
         size_t write(const std::vector<std::byte> &data);
 
-        size_t read(std::vector<std::byte> &data, size_t wanted);
+        size_t write(const std::byte *buf, size_t bufSz) override;
+
+        using ITransport::read;
+
+        size_t read(std::byte *buf, size_t bufSz) override;
 
-        [[nodiscard]] size_t pending() const;
+        [[nodiscard]] size_t pending() const override;
 
         [[nodiscard]] GenericTLSServer *getServer() const {
           return this->server;
         }
 
+        virtual void setBlocking(bool blocking);
+
+        /// whether the socket is in blocking mode
+        [[nodiscard]] bool isBlocking() const {
+          return this->blocking;
+        }
+
+        /// returns the socket the client is connected on
+        [[nodiscard]] int getFd() const {
+          return this->fd;
+        }
+
+        void beginBatch();
+
+        void endBatch();
+
+        bool enableDatagramOffload();
+
+        size_t sendFile(int file, off_t offset, size_t length);
+
+        [[nodiscard]] bool isKernelTLSActive() const;
+
+        [[nodiscard]] std::string getCipherDescription() const;
+
+        [[nodiscard]] virtual size_t estimateMemoryUsage() const;
+
+      private:
+        void waitForSocket(bool write);
+
+      private:
+        /// how long to wait for a non-blocking socket to become ready (msec)
+        static const int kNonBlockingTimeout = 5000;
+        /// approximate size of an established session's state in OpenSSL,
+        /// not counting record buffers (measured for TLS 1.3)
+        static constexpr size_t kSessionStateSize = (1024 * 14);
+        /// approximate size of each of OpenSSL's read and write buffers
+        static constexpr size_t kRecordBufferSize = (1024 * 16) + 256;
+
       private:
         /// server associated with this client
         GenericTLSServer *server = nullptr;
 
+      protected:
         /// file descriptor (socket) that this client is bound to
         int fd = -1;
         /// SSL context used to interact with the client
@@ -68,7 +116,9 @@ namespace liblichtenstein {
         struct sockaddr_in clientAddr;
 
         /// whether the client connection is open
-        bool isOpen = true;
+        std::atomic_bool isOpen = true;
+        /// whether the socket is blocking
+        bool blocking = true;
     };
   }
 }
@@ -5,11 +5,22 @@
 #include "GenericTLSClient.h"
 #include "OpenSSLError.h"
 #include "SSLSessionClosedError.h"
+#include "KernelTLS.h"
+#include "BatchedDatagramBIO.h"
+#include "CipherPolicy.h"
 
 #include <glog/logging.h>
 
 #include <openssl/ssl.h>
 
+#include <cerrno>
+#include <string>
+#include <system_error>
+#include <vector>
+#include <exception>
+
+#include <fcntl.h>
+
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
@@ -99,12 +110,18 @@ namespace liblichtenstein {
      * @return Actual number of bytes written
      */
     size_t GenericTLSClient::write(const std::vector<std::byte> &data) {
-      int err, errType;
-
-      // pull out pointers to data
-      const std::byte *buf = data.data();
-      const size_t bufSz = data.size();
+      return this->write(data.data(), data.size());
+    }
 
+    /**
+     * Writes data to the SSL session.
+     *
+     * @param buf Pointer to the data to write
+     * @param bufSz Number of bytes to write
+     * @return Actual number of bytes written
+     */
+    size_t GenericTLSClient::write(const std::byte *buf, size_t bufSz) {
+      int err, errType;
 
       // perform write
       err = SSL_write(this->ssl, buf, bufSz);
@@ -132,24 +149,21 @@ namespace liblichtenstein {
     }
 
     /**
-     * Attempts to read from the SSL session. Data is appended to the specified
-     * vector, up to `wanted` bytes.
+     * Attempts to read from the SSL session, straight into the caller's
+     * buffer.
      *
-     * @param data Vector into which data is appended
-     * @param wanted Maximum number of bytes to read
-     * @return Actual number of bytes read
+     * @param buf Buffer to read into
+     * @param bufSz Maximum number of bytes to read
+     * @return Actual number of bytes read; 0 if none are available (e.g. the
+     * receive timeout expired, or the socket is non-blocking)
      */
-    size_t GenericTLSClient::read(std::vector<std::byte> &data, size_t wanted) {
+    size_t GenericTLSClient::read(std::byte *buf, size_t bufSz) {
       int err, errType;
 
-      // allocate a temporary read buffer and read into it
-      auto buf = new std::byte[wanted];
-      err = SSL_read(this->ssl, buf, wanted);
+      err = SSL_read(this->ssl, buf, bufSz);
 
       if (err <= 0) {
-        // deallocate the read buffer and figure out cause of error
-        delete[] buf;
-
+        // figure out cause of error
         errType = SSL_get_error(this->ssl, err);
 
         if (errType == SSL_ERROR_SYSCALL) {
@@ -170,10 +184,7 @@ namespace liblichtenstein {
         }
       }
 
-      // read was successful, copy the bytes and return
-      data.insert(data.end(), buf, (buf + err));
-      delete[] buf;
-
+      // read was successful
       return err;
     }
 
@@ -191,6 +202,209 @@ namespace liblichtenstein {
       return err;
     }
 
+    /**
+     * Starts a batch of writes: until endBatch() is called, datagrams are
+     * queued and sent several at a time, rather than with a syscall each. This
+     * only has an effect on connections using a batched datagram BIO.
+     */
+    void GenericTLSClient::beginBatch() {
+      BatchedDatagramBIO::setCorked(SSL_get_wbio(this->ssl), true);
+    }
+
+    /**
+     * Ends a batch of writes, sending all datagrams queued since beginBatch().
+     */
+    void GenericTLSClient::endBatch() {
+      BatchedDatagramBIO::setCorked(SSL_get_wbio(this->ssl), false);
+    }
+
+    /**
+     * Enables UDP segmentation offload for the connection: batches of equal
+     * sized datagrams are sent as GSO super-packets, and the kernel may hand us
+     * received datagrams coalesced (GRO.) This only works for connections
+     * using a batched datagram BIO, on Linux.
+     *
+     * @return Whether either offload is in effect
+     */
+    bool GenericTLSClient::enableDatagramOffload() {
+      BIO *bio = SSL_get_rbio(this->ssl);
+
+      const bool send = BatchedDatagramBIO::enableSendOffload(bio);
+      const bool receive = BatchedDatagramBIO::enableReceiveOffload(bio);
+
+      return send || receive;
+    }
+
+    /**
+     * Sends part of a file to the server. If kTLS is active, the kernel
+     * encrypts the file's contents as it sends them; otherwise, the file is
+     * read and written like any other data.
+     *
+     * @param file File descriptor of the file to send
+     * @param offset Offset into the file at which to start
+     * @param length Number of bytes to send
+     * @return Number of bytes sent; less than `length` if the file is shorter
+     * @throws std::system_error, OpenSSLError, SSLSessionClosedError
+     */
+    size_t GenericTLSClient::sendFile(int file, off_t offset, size_t length) {
+      return KernelTLS::sendFile(this->ssl, *this, file, offset, length);
+    }
+
+    /**
+     * Whether the kernel encrypts (or decrypts) records for this session.
+     */
+    bool GenericTLSClient::isKernelTLSActive() const {
+      return KernelTLS::isSendOffloaded(this->ssl) ||
+             KernelTLS::isReceiveOffloaded(this->ssl);
+    }
+
+    /**
+     * Switches the socket between blocking and non-blocking mode. While
+     * non-blocking, reads return no data rather than waiting for some, so
+     * the socket can be polled (e.g. alongside other file descriptors) and
+     * then drained.
+     *
+     * A datagram BIO's receive timeout is cleared while non-blocking, so
+     * that it doesn't wait either, and restored afterwards.
+     *
+     * @param blocking Whether the socket should block
+     * @throws std::system_error
+     */
+    void GenericTLSClient::setBlocking(bool blocking) {
+      if(this->blocking == blocking) return;
+
+      int flags = fcntl(this->connectedSocket, F_GETFL, 0);
+
+      if(flags == -1) {
+        throw std::system_error(errno, std::system_category(),
+                                "fcntl(F_GETFL) failed");
+      }
+
+      flags = blocking ? (flags & ~O_NONBLOCK) : (flags | O_NONBLOCK);
+
+      if(fcntl(this->connectedSocket, F_SETFL, flags) == -1) {
+        throw std::system_error(errno, std::system_category(),
+                                "fcntl(F_SETFL) failed");
+      }
+
+      // stream BIOs don't have a receive timeout; these are no-ops for them
+      BIO *rbio = SSL_get_rbio(this->ssl);
+
+      if(!blocking) {
+        struct timeval none{};
+
+        BIO_ctrl(rbio, BIO_CTRL_DGRAM_GET_RECV_TIMEOUT, 0,
+                 &this->savedRecvTimeout);
+        BIO_ctrl(rbio, BIO_CTRL_DGRAM_SET_RECV_TIMEOUT, 0, &none);
+      } else {
+        BIO_ctrl(rbio, BIO_CTRL_DGRAM_SET_RECV_TIMEOUT, 0,
+                 &this->savedRecvTimeout);
+      }
+
+      this->blocking = blocking;
+    }
+
+    /**
+     * Describes the protocol version and cipher suite negotiated with the
+     * server.
+     *
+     * @return Description, or an empty string if not connected
+     */
+    std::string GenericTLSClient::getCipherDescription() const {
+      return CipherPolicy::describe(this->ssl);
+    }
+
+
+    /**
+     * Serializes the current TLS session (including a session ticket, if the
+     * server issued one) so that a later connection can resume it, and skip
+     * the full handshake.
+     *
+     * The session is DER encoded, then hex encoded so it can be stored as a
+     * string.
+     *
+     * With TLS 1.3, the server sends its session ticket after the handshake,
+     * and it's only processed once data has been read from the connection;
+     * until then, there's no session that can be resumed.
+     *
+     * @return Encoded session, or an empty string if there is none
+     */
+    std::string GenericTLSClient::exportSession() const {
+      if(!this->ssl) return "";
+
+      SSL_SESSION *session = SSL_get1_session(this->ssl);
+      if(!session) return "";
+
+#if !defined(LIBRESSL_VERSION_NUMBER) && OPENSSL_VERSION_NUMBER >= 0x10101000L
+      if(!SSL_SESSION_is_resumable(session)) {
+        SSL_SESSION_free(session);
+        return "";
+      }
+#endif
+
+      // get the DER-encoded session
+      std::string encoded;
+      int len = i2d_SSL_SESSION(session, nullptr);
+
+      if(len > 0) {
+        std::vector<unsigned char> der(len);
+        unsigned char *ptr = der.data();
+
+        len = i2d_SSL_SESSION(session, &ptr);
+
+        // then hex encode it
+        static const char kHexDigits[] = "0123456789abcdef";
+        encoded.reserve(len * 2);
+
+        for(int i = 0; i < len; i++) {
+          encoded.push_back(kHexDigits[der[i] >> 4]);
+          encoded.push_back(kHexDigits[der[i] & 0x0F]);
+        }
+      }
+
+      SSL_SESSION_free(session);
+      return encoded;
+    }
+
+    /**
+     * Sets up the connection to resume a previously exported session. This
+     * must be called before the handshake; if the server no longer knows the
+     * session, a full handshake takes place instead.
+     *
+     * @param encoded Session as returned by exportSession()
+     * @return Whether the session could be decoded
+     */
+    bool GenericTLSClient::resumeSession(const std::string &encoded) {
+      if(encoded.empty() || (encoded.size() % 2) != 0) return false;
+
+      // decode the hex string
+      std::vector<unsigned char> der;
+      der.reserve(encoded.size() / 2);
+
+      for(size_t i = 0; i < encoded.size(); i += 2) {
+        try {
+          der.push_back(std::stoul(encoded.substr(i, 2), nullptr, 16));
+        } catch(std::exception &) {
+          return false;
+        }
+      }
+
+      // then the session
+      const unsigned char *ptr = der.data();
+      SSL_SESSION *session = d2i_SSL_SESSION(nullptr, &ptr, der.size());
+
+      if(!session) {
+        LOG(WARNING) << "Failed to decode TLS session: "
+                     << OpenSSLError().what();
+        return false;
+      }
+
+      int err = SSL_set_session(this->ssl, session);
+      SSL_SESSION_free(session);
+
+      return (err == 1);
+    }
+
 
     /**
      * Resolves the given hostname and port
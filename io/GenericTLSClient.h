@@ -5,6 +5,8 @@
 #ifndef LIBLICHTENSTEIN_GENERICTLSCLIENT_H
 #define LIBLICHTENSTEIN_GENERICTLSCLIENT_H
 
+#include "ITransport.h"
+
 #include <openssl/ssl.h>
 
 #include <cstddef>
@@ -12,6 +14,8 @@
 #include <string>
 
 #include <netdb.h>
+#include <sys/time.h>
+#include <sys/types.h>
 
 namespace liblichtenstein {
   namespace io {
@@ -23,7 +27,7 @@ namespace liblichtenstein {
      * Various callbacks are available to control the certificate validation
      * and other parts of the session handshake.
      */
-    class GenericTLSClient {
+    class GenericTLSClient : public ITransport {
       public:
         explicit GenericTLSClient(std::string host, int port) : serverHost(
                 std::move(host)), serverPort(port) {};
@@ -31,29 +35,70 @@ namespace liblichtenstein {
         virtual ~GenericTLSClient();
 
       public:
-        [[nodiscard]] bool isSessionOpen() const {
+        [[nodiscard]] bool isSessionOpen() const override {
           return this->isOpen;
         }
 
-        void close();
+        void close() override;
 
         virtual void setVerifyPeer(const bool verify);
 
         virtual size_t write(const std::vector<std::byte> &data);
 
-        virtual size_t read(std::vector<std::byte> &data, size_t wanted);
+        size_t write(const std::byte *buf, size_t bufSz) override;
+
+        using ITransport::read;
+
+        size_t read(std::byte *buf, size_t bufSz) override;
+
+        [[nodiscard]] size_t pending() const override;
+
+        [[nodiscard]] std::string exportSession() const;
+
+        /// whether the handshake resumed a previous session
+        [[nodiscard]] bool isSessionReused() const {
+          return this->ssl && SSL_session_reused(this->ssl);
+        }
+
+        void beginBatch();
+
+        void endBatch();
 
-        [[nodiscard]] virtual size_t pending() const;
+        bool enableDatagramOffload();
+
+        size_t sendFile(int file, off_t offset, size_t length);
+
+        [[nodiscard]] bool isKernelTLSActive() const;
+
+        [[nodiscard]] std::string getCipherDescription() const;
+
+        void setBlocking(bool blocking);
+
+        /// whether the socket is in blocking mode
+        [[nodiscard]] bool isBlocking() const {
+          return this->blocking;
+        }
+
+        /// returns the socket connected to the server, e.g. to poll on it
+        [[nodiscard]] int getFd() const {
+          return this->connectedSocket;
+        }
 
       protected:
         static struct addrinfo *resolveHost(std::string &host, int port);
 
+        bool resumeSession(const std::string &encoded);
+
       protected:
         /// whether the connection is "open"
         bool isOpen = true;
 
         /// file descriptor that's connected to the server
         int connectedSocket = -1;
+        /// whether the socket is in blocking mode
+        bool blocking = true;
+        /// receive timeout of a datagram BIO, while it's non-blocking
+        struct timeval savedRecvTimeout{};
 
         /// hostname of the destination host
         std::string serverHost;
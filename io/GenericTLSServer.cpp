@@ -12,20 +12,25 @@
 namespace liblichtenstein {
   namespace io {
     /**
-     * Tears down the TLS server. Any existing sessions are closed.
+     * Creates a server that shares an existing SSL context, e.g. with other
+     * servers listening on the same port. The context (including any loaded
+     * certificate and session cache) is retained for the server's lifetime.
+     *
+     * @param fd Socket to listen on
+     * @param ctx SSL context to share
+     */
+    GenericTLSServer::GenericTLSServer(int fd, SSL_CTX *ctx)
+            : listeningSocket(fd), ctx(ctx) {
+      SSL_CTX_up_ref(this->ctx);
+    }
+
+    /**
+     * Tears down the TLS server. Any existing sessions are closed, including
+     * those of other servers sharing its registry.
      */
     GenericTLSServer::~GenericTLSServer() {
       // close all connections
-      for (auto client : this->clients) {
-        if (client->isSessionOpen()) {
-          // swallow any errors
-          try {
-            client->close();
-          } catch (std::exception &e) {
-            LOG(ERROR) << "Error closing client " << client << ": " << e.what();
-          }
-        }
-      }
+      this->registry->closeAll();
 
       // delete the context
       SSL_CTX_free(this->ctx);
@@ -5,8 +5,11 @@
 #ifndef LIBLICHTENSTEIN_GENERICTLSSERVER_H
 #define LIBLICHTENSTEIN_GENERICTLSSERVER_H
 
+#include "ConnectionRegistry.h"
+
 #include <string>
 #include <memory>
+#include <utility>
 #include <vector>
 
 #include <openssl/ssl.h>
@@ -19,6 +22,8 @@ namespace liblichtenstein {
       public:
         explicit GenericTLSServer(int fd) : listeningSocket(fd) {};
 
+        GenericTLSServer(int fd, SSL_CTX *ctx);
+
         virtual ~GenericTLSServer();
 
       public:
@@ -27,6 +32,32 @@ namespace liblichtenstein {
 
         virtual std::shared_ptr<GenericServerClient> run() = 0;
 
+        /**
+         * Stops the server: callers blocked in (or subsequently calling)
+         * `run()` will get an error.
+         */
+        virtual void stop() = 0;
+
+        /// returns the SSL context, e.g. to share it with other servers
+        [[nodiscard]] SSL_CTX *getContext() const {
+          return this->ctx;
+        }
+
+        /// returns the registry of established sessions, e.g. to set a limit
+        [[nodiscard]] const std::shared_ptr<ConnectionRegistry> &
+        getRegistry() const {
+          return this->registry;
+        }
+
+        /**
+         * Replaces the registry of established sessions, e.g. to share one
+         * (and its limit) with other servers. This must be done before any
+         * sessions are established.
+         */
+        void setRegistry(std::shared_ptr<ConnectionRegistry> registry) {
+          this->registry = std::move(registry);
+        }
+
       protected:
         /// listening socket
         int listeningSocket = -1;
@@ -34,8 +65,9 @@ namespace liblichtenstein {
         /// SSL context
         SSL_CTX *ctx = nullptr;
 
-        /// a list of all clients we've accepted.
-        std::vector<std::shared_ptr<GenericServerClient>> clients;
+        /// all established sessions that are still open
+        std::shared_ptr<ConnectionRegistry> registry =
+                std::make_shared<ConnectionRegistry>();
     };
   }
 }
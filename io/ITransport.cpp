@@ -0,0 +1,99 @@
+//
+// Created by Tristan Seifert on 2019-09-17.
+//
+
+#include "ITransport.h"
+
+#include <exception>
+
+
+namespace liblichtenstein::io {
+  /**
+   * Writes several buffers to the transport, in order, as if they were a
+   * single contiguous one. On datagram transports, they're sent as a single
+   * datagram (or record).
+   *
+   * By default, the buffers are gathered into a per-thread buffer and written
+   * at once; transports that can write them without copying (e.g. with
+   * sendmsg()) override this. A single buffer is always written as it is.
+   *
+   * @param iov Buffers to write
+   * @param iovCount Number of buffers
+   * @return Number of bytes written
+   */
+  size_t ITransport::writev(const struct iovec *iov, size_t iovCount) {
+    if(iovCount == 0) return 0;
+
+    if(iovCount == 1) {
+      return this->write(static_cast<const std::byte *>(iov[0].iov_base),
+                         iov[0].iov_len);
+    }
+
+    // gather all buffers
+    thread_local std::vector<std::byte> gather;
+
+    size_t total = 0;
+    for(size_t i = 0; i < iovCount; i++) {
+      total += iov[i].iov_len;
+    }
+
+    gather.clear();
+    gather.reserve(total);
+
+    for(size_t i = 0; i < iovCount; i++) {
+      const auto *base = static_cast<const std::byte *>(iov[i].iov_base);
+      gather.insert(gather.end(), base, base + iov[i].iov_len);
+    }
+
+    // then write them, and release the buffer if it got unusually large
+    size_t written;
+
+    try {
+      written = this->write(gather.data(), gather.size());
+    } catch(std::exception &) {
+      if(gather.capacity() > kMaxRetainedGatherSize) {
+        std::vector<std::byte>().swap(gather);
+      }
+
+      throw;
+    }
+
+    if(gather.capacity() > kMaxRetainedGatherSize) {
+      std::vector<std::byte>().swap(gather);
+    }
+
+    return written;
+  }
+
+  /**
+   * Reads up to `wanted` bytes from the transport, appending them to the
+   * given vector. This blocks until at least some data is available, unless
+   * the transport is non-blocking.
+   *
+   * The vector is grown by `wanted` bytes and read into directly, then
+   * shrunk to what was actually read. Growing it zero-fills those bytes, so
+   * each call costs a memset of `wanted` bytes, plus an allocation if the
+   * vector lacks the capacity. Hot paths should read into a reused buffer
+   * with the pointer-based read() instead, like MessageIO does.
+   *
+   * @param data Vector into which data is appended
+   * @param wanted Maximum number of bytes to read
+   * @return Number of bytes read
+   */
+  size_t ITransport::read(std::vector<std::byte> &data, size_t wanted) {
+    const size_t offset = data.size();
+    data.resize(offset + wanted);
+
+    size_t read;
+
+    try {
+      read = this->read(data.data() + offset, wanted);
+    } catch(std::exception &) {
+      data.resize(offset);
+      throw;
+    }
+
+    data.resize(offset + read);
+    return read;
+  }
+}
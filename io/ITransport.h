@@ -0,0 +1,100 @@
+//
+// Created by Tristan Seifert on 2019-09-04.
+//
+
+#ifndef LIBLICHTENSTEIN_ITRANSPORT_H
+#define LIBLICHTENSTEIN_ITRANSPORT_H
+
+#include <cstddef>
+#include <vector>
+
+#include <sys/uio.h>
+
+namespace liblichtenstein::io {
+  /**
+   * Interface for a bidirectional, reliable byte stream (or datagram
+   * connection) that messages can be exchanged over.
+   *
+   * This is implemented by the TLS/DTLS clients and server clients, as well as
+   * the plaintext in-memory and Unix domain socket transports, so that
+   * MessageIO works the same on top of any of them.
+   *
+   * Implementations throw SSLSessionClosedError from read() and write() when
+   * the connection was closed by the peer, and std::system_error (or a more
+   * specific error) when IO fails.
+   *
+   * Subclasses implement the pointer-based read() and write(); they should
+   * pull in the vector read() with a using declaration, since overriding one
+   * overload hides the others.
+   */
+  class ITransport {
+    public:
+      virtual ~ITransport() = default;
+
+    public:
+      /**
+       * Writes data to the transport.
+       *
+       * @param buf Pointer to the data to write
+       * @param bufSz Number of bytes to write
+       * @return Number of bytes written
+       */
+      virtual size_t write(const std::byte *buf, size_t bufSz) = 0;
+
+      /**
+       * Writes several buffers to the transport as if they were one; on
+       * datagram transports, they're sent as a single datagram.
+       *
+       * @param iov Buffers to write
+       * @param iovCount Number of buffers
+       * @return Number of bytes written
+       */
+      virtual size_t writev(const struct iovec *iov, size_t iovCount);
+
+      /**
+       * Reads up to `bufSz` bytes from the transport into the given buffer.
+       * This blocks until at least some data is available, unless the
+       * transport is non-blocking, in which case it returns 0 if there is
+       * none.
+       *
+       * @param buf Buffer to read into
+       * @param bufSz Size of the buffer, i.e. most bytes to read
+       * @return Number of bytes read
+       */
+      virtual size_t read(std::byte *buf, size_t bufSz) = 0;
+
+      /**
+       * Reads up to `wanted` bytes from the transport, appending them to the
+       * vector. For convenience only: the appended bytes are zero-filled
+       * before reading, so hot paths should use the pointer-based read().
+       *
+       * @param data Vector into which data is appended
+       * @param wanted Maximum number of bytes to read
+       * @return Number of bytes read
+       */
+      virtual size_t read(std::vector<std::byte> &data, size_t wanted);
+
+      /**
+       * Gets the number of bytes that can be read without blocking.
+       *
+       * @return Number of bytes available
+       */
+      [[nodiscard]] virtual size_t pending() const = 0;
+
+      /**
+       * Closes the transport.
+       */
+      virtual void close() = 0;
+
+      /**
+       * Determines whether the transport is still open.
+       */
+      [[nodiscard]] virtual bool isSessionOpen() const = 0;
+
+    private:
+      /// gather buffers larger than this aren't kept around between writes
+      static const size_t kMaxRetainedGatherSize = (1024 * 64);
+  };
+}
+
+#endif //LIBLICHTENSTEIN_ITRANSPORT_H
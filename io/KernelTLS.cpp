@@ -0,0 +1,166 @@
+//
+// Created by Tristan Seifert on 2019-09-12.
+//
+
+#include "KernelTLS.h"
+#include "ITransport.h"
+#include "OpenSSLError.h"
+#include "SSLSessionClosedError.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <poll.h>
+#include <unistd.h>
+
+#include <openssl/bio.h>
+
+
+namespace liblichtenstein::io {
+  /**
+   * Whether the OpenSSL we're built against is able to use kTLS at all.
+   */
+  bool KernelTLS::isSupported() {
+#ifdef SSL_OP_ENABLE_KTLS
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  /**
+   * Enables kTLS for all sessions created from the given context. This has
+   * no effect if kTLS isn't supported.
+   *
+   * @param ctx Context to enable kTLS on
+   */
+  void KernelTLS::enable(SSL_CTX *ctx) {
+#ifdef SSL_OP_ENABLE_KTLS
+    SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+#else
+    LOG(WARNING) << "kTLS not supported by this OpenSSL";
+#endif
+  }
+
+  /**
+   * Enables kTLS for a single session; this must be done before the
+   * handshake. This has no effect if kTLS isn't supported.
+   *
+   * @param ssl Session to enable kTLS on
+   */
+  void KernelTLS::enable(SSL *ssl) {
+#ifdef SSL_OP_ENABLE_KTLS
+    SSL_set_options(ssl, SSL_OP_ENABLE_KTLS);
+#else
+    LOG(WARNING) << "kTLS not supported by this OpenSSL";
+#endif
+  }
+
+  /**
+   * Whether records sent on this session are encrypted by the kernel.
+   */
+  bool KernelTLS::isSendOffloaded(SSL *ssl) {
+#ifdef SSL_OP_ENABLE_KTLS
+    return ssl && BIO_get_ktls_send(SSL_get_wbio(ssl));
+#else
+    return false;
+#endif
+  }
+
+  /**
+   * Whether records received on this session are decrypted by the kernel.
+   */
+  bool KernelTLS::isReceiveOffloaded(SSL *ssl) {
+#ifdef SSL_OP_ENABLE_KTLS
+    return ssl && BIO_get_ktls_recv(SSL_get_rbio(ssl));
+#else
+    return false;
+#endif
+  }
+
+  /**
+   * Sends (part of) a file over a session. If the kernel encrypts records
+   * for this session, the file is sent with sendfile(); otherwise, it's read
+   * in chunks and written to the transport.
+   *
+   * @param ssl Session to send the file on
+   * @param transport Transport that owns the session, used if the file can't
+   * be sent by the kernel
+   * @param fd File descriptor of the file to send
+   * @param offset Offset into the file at which to start
+   * @param length Number of bytes to send
+   * @return Number of bytes sent; this is less than `length` only if the end
+   * of the file was reached.
+   * @throws std::system_error, OpenSSLError, SSLSessionClosedError
+   */
+  size_t KernelTLS::sendFile(SSL *ssl, ITransport &transport, int fd,
+                             off_t offset, size_t length) {
+    size_t sent = 0;
+
+#ifdef SSL_OP_ENABLE_KTLS
+    if(isSendOffloaded(ssl)) {
+      while(sent < length) {
+        ossl_ssize_t err = SSL_sendfile(ssl, fd, offset + sent, length - sent,
+                                        0);
+
+        if(err > 0) {
+          sent += err;
+          continue;
+        } else if(err == 0) {
+          // reached the end of the file
+          break;
+        }
+
+        int errType = SSL_get_error(ssl, err);
+
+        if(errType == SSL_ERROR_WANT_WRITE) {
+          // the socket is non-blocking; wait for it to drain
+          struct pollfd pfd = {SSL_get_fd(ssl), POLLOUT, 0};
+          poll(&pfd, 1, -1);
+        } else if(errType == SSL_ERROR_SYSCALL) {
+          throw std::system_error(errno, std::system_category(),
+                                  "SSL_sendfile() failed");
+        } else if(errType == SSL_ERROR_ZERO_RETURN) {
+          throw SSLSessionClosedError("Session closed by peer");
+        } else {
+          throw OpenSSLError("SSL_sendfile() failed (type " +
+                             std::to_string(errType) + ")");
+        }
+      }
+
+      return sent;
+    }
+#endif
+
+    // read the file in chunks and write them as usual
+    std::vector<std::byte> buffer(kCopyChunkSize);
+
+    while(sent < length) {
+      const size_t wanted = std::min(buffer.size(), length - sent);
+      ssize_t read = pread(fd, buffer.data(), wanted, offset + sent);
+
+      if(read < 0) {
+        if(errno == EINTR) continue;
+
+        throw std::system_error(errno, std::system_category(),
+                                "pread() failed");
+      } else if(read == 0) {
+        break;
+      }
+
+      size_t written = 0;
+
+      while(written < static_cast<size_t>(read)) {
+        written += transport.write(buffer.data() + written, read - written);
+      }
+
+      sent += read;
+    }
+
+    return sent;
+  }
+}
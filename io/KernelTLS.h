@@ -0,0 +1,52 @@
+//
+// Created by Tristan Seifert on 2019-09-12.
+//
+
+#ifndef LIBLICHTENSTEIN_KERNELTLS_H
+#define LIBLICHTENSTEIN_KERNELTLS_H
+
+#include <cstddef>
+
+#include <sys/types.h>
+
+#include <openssl/ssl.h>
+
+namespace liblichtenstein::io {
+  class ITransport;
+
+  /**
+   * Helpers for kernel TLS (kTLS) offload.
+   *
+   * When enabled on a context, OpenSSL hands the session keys to the kernel
+   * once the handshake completes (if the kernel and negotiated cipher suite
+   * support it) and record encryption and decryption then happen in the
+   * kernel; reads and writes through the SSL object keep working as before.
+   * Files can then also be sent with sendfile(), without copying them
+   * through userspace.
+   *
+   * kTLS requires OpenSSL 3.0 or later built with kTLS support, and the
+   * kernel's `tls` module. If any of these aren't available, the session
+   * silently stays in userspace.
+   */
+  class KernelTLS {
+    public:
+      static bool isSupported();
+
+      static void enable(SSL_CTX *ctx);
+
+      static void enable(SSL *ssl);
+
+      static bool isSendOffloaded(SSL *ssl);
+
+      static bool isReceiveOffloaded(SSL *ssl);
+
+      static size_t sendFile(SSL *ssl, ITransport &transport, int fd,
+                             off_t offset, size_t length);
+
+    private:
+      /// size of the chunks a file is read in when not using sendfile()
+      static const size_t kCopyChunkSize = (1024 * 16);
+  };
+}
+
+#endif //LIBLICHTENSTEIN_KERNELTLS_H
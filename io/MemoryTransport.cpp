@@ -0,0 +1,156 @@
+//
+// Created by Tristan Seifert on 2019-09-04.
+//
+
+#include "MemoryTransport.h"
+#include "SSLSessionClosedError.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+namespace liblichtenstein::io {
+  /**
+   * Creates a pair of connected transports.
+   *
+   * @return Two transports; data written to either can be read from the other
+   */
+  MemoryTransport::pairType MemoryTransport::createPair() {
+    auto aToB = std::make_shared<Pipe>();
+    auto bToA = std::make_shared<Pipe>();
+
+    std::shared_ptr<MemoryTransport> a(new MemoryTransport(bToA, aToB));
+    std::shared_ptr<MemoryTransport> b(new MemoryTransport(aToB, bToA));
+
+    return std::make_pair(a, b);
+  }
+
+  /**
+   * Closes the connection when the transport is deallocated.
+   */
+  MemoryTransport::~MemoryTransport() {
+    this->close();
+  }
+
+
+  /**
+   * Writes data to the other end of the connection.
+   *
+   * @param buf Data to write
+   * @param bufSz Number of bytes to write
+   * @return Number of bytes written
+   * @throws SSLSessionClosedError If either end of the connection was closed
+   */
+  size_t MemoryTransport::write(const std::byte *buf, size_t bufSz) {
+    {
+      std::lock_guard guard(this->out->lock);
+
+      if(this->out->closed) {
+        throw SSLSessionClosedError("Memory transport closed");
+      }
+
+      this->out->data.insert(this->out->data.end(), buf, buf + bufSz);
+    }
+
+    this->out->cond.notify_all();
+    return bufSz;
+  }
+
+  /**
+   * Writes several buffers to the other end of the connection at once.
+   *
+   * @param iov Buffers to write
+   * @param iovCount Number of buffers
+   * @return Number of bytes written
+   * @throws SSLSessionClosedError If either end of the connection was closed
+   */
+  size_t MemoryTransport::writev(const struct iovec *iov, size_t iovCount) {
+    size_t written = 0;
+
+    {
+      std::lock_guard guard(this->out->lock);
+
+      if(this->out->closed) {
+        throw SSLSessionClosedError("Memory transport closed");
+      }
+
+      for(size_t i = 0; i < iovCount; i++) {
+        const auto *base = static_cast<const std::byte *>(iov[i].iov_base);
+
+        this->out->data.insert(this->out->data.end(), base,
+                               base + iov[i].iov_len);
+        written += iov[i].iov_len;
+      }
+    }
+
+    this->out->cond.notify_all();
+    return written;
+  }
+
+  /**
+   * Reads data written by the other end of the connection, blocking until some
+   * is available.
+   *
+   * @param buf Buffer to read into
+   * @param bufSz Maximum number of bytes to read
+   * @return Number of bytes read
+   * @throws SSLSessionClosedError If the connection was closed and all data that
+   * was written before has been read
+   */
+  size_t MemoryTransport::read(std::byte *buf, size_t bufSz) {
+    std::unique_lock lock(this->in->lock);
+
+    this->in->cond.wait(lock, [this] {
+      return this->in->closed ||
+             this->in->readOffset < this->in->data.size();
+    });
+
+    const size_t available = this->in->data.size() - this->in->readOffset;
+
+    if(available == 0) {
+      throw SSLSessionClosedError("Memory transport closed");
+    }
+
+    // copy out as much as we can
+    const size_t toRead = std::min(available, bufSz);
+
+    memcpy(buf, this->in->data.data() + this->in->readOffset, toRead);
+
+    this->in->readOffset += toRead;
+
+    if(this->in->readOffset == this->in->data.size()) {
+      this->in->data.clear();
+      this->in->readOffset = 0;
+    }
+
+    return toRead;
+  }
+
+  /**
+   * Gets the number of bytes that can be read without blocking.
+   *
+   * @return Number of bytes available
+   */
+  size_t MemoryTransport::pending() const {
+    std::lock_guard guard(this->in->lock);
+
+    return this->in->data.size() - this->in->readOffset;
+  }
+
+  /**
+   * Closes the connection. Any reads blocking on either end return, and
+   * subsequent writes fail.
+   */
+  void MemoryTransport::close() {
+    this->isOpen = false;
+
+    for(auto &pipe : {this->in, this->out}) {
+      {
+        std::lock_guard guard(pipe->lock);
+        pipe->closed = true;
+      }
+
+      pipe->cond.notify_all();
+    }
+  }
+}
@@ -0,0 +1,90 @@
+//
+// Created by Tristan Seifert on 2019-09-04.
+//
+
+#ifndef LIBLICHTENSTEIN_MEMORYTRANSPORT_H
+#define LIBLICHTENSTEIN_MEMORYTRANSPORT_H
+
+#include "ITransport.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace liblichtenstein::io {
+  /**
+   * A transport that passes data between two endpoints in the same process,
+   * without any sockets or encryption. Transports are always created in
+   * connected pairs; anything written to one can be read from the other.
+   *
+   * This is mostly useful to exercise the protocol (e.g. in benchmarks or
+   * tests) without the overhead of the network stack or TLS.
+   */
+  class MemoryTransport : public ITransport {
+    private:
+      /**
+       * One direction of the connection.
+       */
+      struct Pipe {
+        /// protects all fields in the pipe
+        std::mutex lock;
+        /// signalled when data is written or the pipe is closed
+        std::condition_variable cond;
+
+        /// data written to the pipe
+        std::vector<std::byte> data;
+        /// offset of the first byte in `data` that hasn't been read
+        size_t readOffset = 0;
+
+        /// set when either end is closed
+        bool closed = false;
+      };
+
+    public:
+      using pairType = std::pair<std::shared_ptr<MemoryTransport>, std::shared_ptr<MemoryTransport>>;
+
+      static pairType createPair();
+
+    public:
+      MemoryTransport() = delete;
+
+      ~MemoryTransport() override;
+
+    private:
+      MemoryTransport(std::shared_ptr<Pipe> in, std::shared_ptr<Pipe> out) : in(
+              std::move(in)), out(std::move(out)) {};
+
+    public:
+      size_t write(const std::byte *buf, size_t bufSz) override;
+
+      size_t writev(const struct iovec *iov, size_t iovCount) override;
+
+      using ITransport::read;
+
+      size_t read(std::byte *buf, size_t bufSz) override;
+
+      [[nodiscard]] size_t pending() const override;
+
+      void close() override;
+
+      [[nodiscard]] bool isSessionOpen() const override {
+        return this->isOpen;
+      }
+
+    private:
+      /// pipe from which data is read
+      std::shared_ptr<Pipe> in;
+      /// pipe to which data is written
+      std::shared_ptr<Pipe> out;
+
+      /// whether this end of the connection is open
+      std::atomic_bool isOpen = true;
+  };
+}
+
+
+#endif //LIBLICHTENSTEIN_MEMORYTRANSPORT_H
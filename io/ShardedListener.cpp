@@ -0,0 +1,353 @@
+//
+// Created by Tristan Seifert on 2019-09-11.
+//
+
+#include "ShardedListener.h"
+#include "GenericTLSServer.h"
+#include "GenericServerClient.h"
+#include "TLSServer.h"
+#include "DTLSServer.h"
+#include "DTLSMuxServer.h"
+#include "OpenSSLError.h"
+
+#include <glog/logging.h>
+
+#include <chrono>
+#include <system_error>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+
+namespace liblichtenstein::io {
+  namespace {
+    /**
+     * Closes a socket when it goes out of scope, unless it was released (i.e.
+     * handed to a server, which then closes it) first.
+     */
+    struct SocketGuard {
+      explicit SocketGuard(int fd) : fd(fd) {}
+
+      ~SocketGuard() {
+        if(this->fd >= 0) {
+          close(this->fd);
+        }
+      }
+
+      SocketGuard(const SocketGuard &) = delete;
+      SocketGuard &operator=(const SocketGuard &) = delete;
+
+      int release() {
+        int released = this->fd;
+        this->fd = -1;
+        return released;
+      }
+
+      int fd;
+    };
+  }
+
+
+  /**
+   * Creates the listening sockets and a server for each of them. The servers
+   * don't accept any connections until the listener is started.
+   *
+   * @param protocol Type of server to create
+   * @param addr Address to listen on; if the port is 0, an ephemeral port is
+   * chosen, which all shards then share.
+   * @param shards Number of shards to create
+   * @throws std::system_error, OpenSSLError
+   */
+  ShardedListener::ShardedListener(Protocol protocol,
+                                   const struct sockaddr_in &addr,
+                                   size_t shards) : protocol(protocol) {
+    if(shards == 0) {
+      shards = 1;
+    } else if(shards > 1 && !isSupported()) {
+      LOG(WARNING) << "SO_REUSEPORT not supported, using a single shard";
+      shards = 1;
+    }
+
+    struct sockaddr_in bindAddr = addr;
+
+    for(size_t i = 0; i < shards; i++) {
+      SocketGuard guard(this->createSocket(bindAddr));
+
+      // all other shards bind to the port the first one got
+      if(i == 0) {
+        socklen_t addrLen = sizeof(bindAddr);
+
+        if(getsockname(guard.fd,
+                       reinterpret_cast<struct sockaddr *>(&bindAddr),
+                       &addrLen) != 0) {
+          throw std::system_error(errno, std::system_category(),
+                                  "getsockname() failed");
+        }
+
+        this->port = ntohs(bindAddr.sin_port);
+      }
+
+      // the first shard creates the SSL context that the others share
+      auto shard = std::make_unique<Shard>();
+      SSL_CTX *ctx = (i == 0) ? nullptr
+                              : this->shards.front()->server->getContext();
+
+      /*
+       * The server owns the socket once its base class is constructed; its
+       * destructor closes it even if a subclass constructor then throws. The
+       * guard is only released after the server was allocated, which happens
+       * before the constructor arguments are evaluated.
+       */
+      switch(protocol) {
+        case Protocol::TLS:
+          shard->server.reset(ctx ? new TLSServer(guard.release(), ctx)
+                                  : new TLSServer(guard.release()));
+          break;
+        case Protocol::DTLS:
+          shard->server.reset(ctx ? new DTLSServer(guard.release(), ctx)
+                                  : new DTLSServer(guard.release()));
+          break;
+        case Protocol::DTLSMux:
+          shard->server.reset(ctx ? new DTLSMuxServer(guard.release(), ctx)
+                                  : new DTLSMuxServer(guard.release()));
+          break;
+      }
+
+      // all shards count against the same connection limit
+      if(i != 0) {
+        shard->server->setRegistry(
+                this->shards.front()->server->getRegistry());
+      }
+
+      this->shards.push_back(std::move(shard));
+    }
+
+    VLOG(1) << "Listening on port " << this->port << " with "
+            << this->shards.size() << " shards";
+  }
+
+  /**
+   * Stops all shards and closes their sockets. Shards are destroyed in the
+   * reverse order of creation, so that the one that created the SSL context
+   * goes away last.
+   */
+  ShardedListener::~ShardedListener() {
+    this->stop();
+
+    while(!this->shards.empty()) {
+      this->shards.pop_back();
+    }
+  }
+
+
+  /**
+   * Loads the certificate and private key into the shared SSL context.
+   *
+   * @param certPath Path to PEM-encoded certificate
+   * @param keyPath Path to PEM-encoded private key
+   * @throws OpenSSLError
+   */
+  void ShardedListener::loadCert(const std::string &certPath,
+                                 const std::string &keyPath) {
+    this->shards.front()->server->loadCert(certPath, keyPath);
+  }
+
+  /**
+   * Starts a thread for each shard that takes established sessions from its
+   * server. This is done automatically the first time run() is called; once
+   * the listener was stopped, it does nothing.
+   */
+  void ShardedListener::start() {
+    std::lock_guard<std::mutex> lg(this->readyLock);
+
+    if(this->shards.front()->thread || this->stopped) return;
+
+    this->shutdown = false;
+
+    for(auto &shard : this->shards) {
+      shard->thread = new std::thread(&ShardedListener::shardEntry, this,
+                                      shard.get());
+    }
+  }
+
+  /**
+   * Stops all shards. Callers blocked in (or subsequently calling) run() will
+   * get an error.
+   */
+  void ShardedListener::stop() {
+    {
+      // so that a caller about to wait in run() can't miss the wakeup
+      std::lock_guard<std::mutex> lg(this->readyLock);
+      this->stopped = true;
+      this->shutdown = true;
+    }
+
+    this->readyCv.notify_all();
+
+    for(auto &shard : this->shards) {
+      shard->server->stop();
+    }
+
+    for(auto &shard : this->shards) {
+      if(!shard->thread) continue;
+
+      if(shard->thread->joinable()) {
+        shard->thread->join();
+      }
+
+      delete shard->thread;
+      shard->thread = nullptr;
+    }
+  }
+
+  /**
+   * Waits for a session to be established on any of the shards.
+   *
+   * @return The newly established client
+   * @throws std::system_error If the listener was stopped
+   */
+  std::shared_ptr<GenericServerClient> ShardedListener::run() {
+    this->start();
+
+    std::unique_lock<std::mutex> lk(this->readyLock);
+    this->readyCv.wait(lk, [this] {
+      return !this->ready.empty() || this->shutdown;
+    });
+
+    if(!this->ready.empty()) {
+      auto client = this->ready.front();
+      this->ready.pop_front();
+
+      return client;
+    }
+
+    throw std::system_error(ECONNABORTED, std::system_category(),
+                            "Listener was stopped");
+  }
+
+  /**
+   * Gets the number of sessions that have been established on each shard;
+   * this shows how evenly the kernel spreads the load.
+   *
+   * @return Sessions established per shard
+   */
+  std::vector<uint64_t> ShardedListener::getShardCounts() const {
+    std::vector<uint64_t> counts;
+
+    for(const auto &shard : this->shards) {
+      counts.push_back(shard->established);
+    }
+
+    return counts;
+  }
+
+  /**
+   * Gets the connection registry shared by all shards, e.g. to limit the
+   * number of connections or read its statistics.
+   */
+  std::shared_ptr<ConnectionRegistry> ShardedListener::getRegistry() const {
+    return this->shards.front()->server->getRegistry();
+  }
+
+  /**
+   * Makes all shards use the given connection registry, e.g. to share it with
+   * other servers. This must be done before the listener is started.
+   *
+   * @param registry Registry to use
+   */
+  void ShardedListener::setRegistry(
+          const std::shared_ptr<ConnectionRegistry> &registry) {
+    for(auto &shard : this->shards) {
+      shard->server->setRegistry(registry);
+    }
+  }
+
+  /**
+   * Whether the kernel distributes connections between sockets bound with
+   * SO_REUSEPORT. Other systems support the option, but only ever deliver
+   * to one of the sockets.
+   */
+  bool ShardedListener::isSupported() {
+#if defined(SO_REUSEPORT) && defined(__linux__)
+    return true;
+#else
+    return false;
+#endif
+  }
+
+
+  /**
+   * Creates a shard's listening socket, bound to the given address.
+   *
+   * @param addr Address to bind to
+   * @return Socket
+   * @throws std::system_error
+   */
+  int ShardedListener::createSocket(const struct sockaddr_in &addr) {
+    int err, on = 1;
+    const int type = (this->protocol == Protocol::TLS) ? SOCK_STREAM
+                                                       : SOCK_DGRAM;
+
+    int fd = socket(addr.sin_family, type, 0);
+    if(fd < 0) {
+      throw std::system_error(errno, std::system_category(),
+                              "socket() failed");
+    }
+
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (const void *) &on,
+               (socklen_t) sizeof(on));
+#if defined(SO_REUSEPORT)
+    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, (const void *) &on,
+               (socklen_t) sizeof(on));
+#endif
+
+    err = bind(fd, reinterpret_cast<const struct sockaddr *>(&addr),
+               sizeof(addr));
+
+    if(err == 0 && type == SOCK_STREAM) {
+      err = listen(fd, kListenBacklog);
+    }
+
+    if(err != 0) {
+      int error = errno;
+      close(fd);
+
+      throw std::system_error(error, std::system_category(),
+                              "Could not listen on shard socket");
+    }
+
+    return fd;
+  }
+
+  /**
+   * Shard thread entry point: waits for sessions to be established on the
+   * shard's server, and adds them to the ready queue.
+   *
+   * @param shard Shard to service
+   */
+  void ShardedListener::shardEntry(Shard *shard) {
+    while(!this->shutdown) {
+      try {
+        auto client = shard->server->run();
+        shard->established++;
+
+        {
+          std::lock_guard<std::mutex> lg(this->readyLock);
+          this->ready.push_back(client);
+        }
+
+        this->readyCv.notify_one();
+      } catch(OpenSSLError &e) {
+        LOG(ERROR) << "TLS error accepting client: " << e.what();
+      } catch(std::system_error &e) {
+        if(this->shutdown) break;
+
+        LOG(ERROR) << "System error accepting client: " << e.what();
+        std::this_thread::sleep_for(std::chrono::milliseconds(kErrorBackoff));
+      } catch(std::runtime_error &e) {
+        LOG(ERROR) << "Runtime error accepting client: " << e.what();
+      }
+    }
+  }
+}
@@ -0,0 +1,144 @@
+//
+// Created by Tristan Seifert on 2019-09-11.
+//
+
+#ifndef LIBLICHTENSTEIN_SHARDEDLISTENER_H
+#define LIBLICHTENSTEIN_SHARDEDLISTENER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <netinet/in.h>
+
+namespace liblichtenstein {
+  namespace io {
+    class GenericServerClient;
+
+    class GenericTLSServer;
+
+    class ConnectionRegistry;
+
+    /**
+     * Listens on a single address with several sockets ("shards") bound with
+     * SO_REUSEPORT; the kernel distributes incoming connections (or, for
+     * datagram sockets, peers) between them, and each shard accepts them and
+     * performs handshakes on its own threads. This way, accept and handshake
+     * work is spread across cores, rather than being bottlenecked on a single
+     * listening thread.
+     *
+     * All shards share one SSL context (and thus the certificate and session
+     * cache) as well as the DTLS cookie secret, so it doesn't matter which
+     * shard a peer lands on when it resumes a session or returns a cookie.
+     * They also share a connection registry, so a connection limit applies to
+     * all shards together.
+     *
+     * Established sessions from all shards are returned by `run()`.
+     *
+     * SO_REUSEPORT only load balances on Linux; elsewhere, a single shard is
+     * created.
+     */
+    class ShardedListener {
+      public:
+        /// type of server created for each shard
+        enum class Protocol {
+          /// TLSServer on a TCP socket
+          TLS,
+          /// DTLSServer on a UDP socket
+          DTLS,
+          /// DTLSMuxServer on a UDP socket
+          DTLSMux,
+        };
+
+      public:
+        ShardedListener(Protocol protocol, const struct sockaddr_in &addr,
+                        size_t shards);
+
+        virtual ~ShardedListener();
+
+      public:
+        void loadCert(const std::string &certPath, const std::string &keyPath);
+
+        void start();
+
+        void stop();
+
+        std::shared_ptr<GenericServerClient> run();
+
+        /// returns the number of shards
+        [[nodiscard]] size_t getNumShards() const {
+          return this->shards.size();
+        }
+
+        /// returns the server of the given shard, e.g. to read its statistics
+        [[nodiscard]] GenericTLSServer *getShard(size_t shard) const {
+          return this->shards.at(shard)->server.get();
+        }
+
+        [[nodiscard]] std::vector<uint64_t> getShardCounts() const;
+
+        [[nodiscard]] std::shared_ptr<ConnectionRegistry> getRegistry() const;
+
+        void setRegistry(const std::shared_ptr<ConnectionRegistry> &registry);
+
+        /// returns the port all shards are listening on
+        [[nodiscard]] uint16_t getPort() const {
+          return this->port;
+        }
+
+        static bool isSupported();
+
+      private:
+        /// a single listening socket and its server
+        struct Shard {
+          /// server accepting on this shard's socket (which it owns)
+          std::unique_ptr<GenericTLSServer> server;
+          /// thread taking established sessions from the server
+          std::thread *thread = nullptr;
+          /// number of sessions established on this shard
+          std::atomic<uint64_t> established = 0;
+        };
+
+      private:
+        int createSocket(const struct sockaddr_in &addr);
+
+        void shardEntry(Shard *shard);
+
+      private:
+        /// backlog of each shard's listening socket (for TLS)
+        static const int kListenBacklog = SOMAXCONN;
+        /// how long to wait after an error from a shard's server (msec)
+        static constexpr int kErrorBackoff = 100;
+
+      private:
+        /// kind of server each shard runs
+        Protocol protocol;
+        /// port all shards are bound to
+        uint16_t port = 0;
+
+        /// all shards; the first one created the shared SSL context
+        std::vector<std::unique_ptr<Shard>> shards;
+
+        /// set when the shards should stop
+        std::atomic_bool shutdown = false;
+        /// set by stop(), after which the shards aren't started again
+        bool stopped = false;
+
+        /// protects the ready queue
+        std::mutex readyLock;
+        /// signalled when a session is established, or the listener stops
+        std::condition_variable readyCv;
+        /// established sessions that haven't been returned by run()
+        std::deque<std::shared_ptr<GenericServerClient>> ready;
+    };
+  }
+}
+
+#endif //LIBLICHTENSTEIN_SHARDEDLISTENER_H
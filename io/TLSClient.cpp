@@ -4,6 +4,8 @@
 
 #include "TLSClient.h"
 #include "OpenSSLError.h"
+#include "KernelTLS.h"
+#include "CipherPolicy.h"
 
 #include <glog/logging.h>
 
@@ -31,12 +33,15 @@ namespace liblichtenstein {
      *
      * @param host Hostname (such as 172.16.12.1) to connect to
      * @param port Port to connect to
+     * @param session A previously exported session to try to resume, if any
+     * @param kernelTLS Whether to hand record encryption to the kernel after
+     * the handshake, if supported
      *
      * @throws OpenSSLError, std::system_error
      */
-    TLSClient::TLSClient(std::string host, int port) : GenericTLSClient(
-            std::move(host),
-            port) {
+    TLSClient::TLSClient(std::string host, int port,
+                         const std::string &session, bool kernelTLS)
+            : GenericTLSClient(std::move(host), port) {
       int err, errType;
 
       // clear some variables
@@ -45,6 +50,15 @@ namespace liblichtenstein {
       // create the context
       this->createContext();
 
+      // try to resume the previous session (this falls back to a full handshake)
+      if (!session.empty() && !this->resumeSession(session)) {
+        LOG(WARNING) << "Ignoring invalid TLS session";
+      }
+
+      if (kernelTLS) {
+        KernelTLS::enable(this->ssl);
+      }
+
       // try to connect
       err = SSL_connect(this->ssl);
 
@@ -70,7 +84,8 @@ namespace liblichtenstein {
         throw OpenSSLError("SSL_connect() failed: " + std::to_string(err));
       }
 
-      VLOG(1) << "TLS handshake complete";
+      VLOG(1) << "TLS handshake complete (resumed: " << this->isSessionReused()
+              << ", " << this->getCipherDescription() << ")";
     }
 
     /**
@@ -94,9 +109,12 @@ namespace liblichtenstein {
       this->createSocket();
 
       // create the basic context
-      this->ctx = SSL_CTX_new(TLSv1_2_client_method());
+      this->ctx = SSL_CTX_new(TLS_client_method());
       SSL_CTX_set_read_ahead(this->ctx, 1);
 
+      SSL_CTX_set_min_proto_version(this->ctx, TLS1_2_VERSION);
+      CipherPolicy::apply(this->ctx, false);
+
       // create SSL context
       this->ssl = SSL_new(this->ctx);
 
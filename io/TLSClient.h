@@ -18,7 +18,8 @@ namespace liblichtenstein {
   namespace io {
     class TLSClient : public GenericTLSClient {
       public:
-        TLSClient(std::string host, int port);
+        TLSClient(std::string host, int port,
+                  const std::string &session = "", bool kernelTLS = false);
 
         ~TLSClient() override;
 
@@ -3,6 +3,7 @@
 //
 
 #include "TLSServer.h"
+#include "CipherPolicy.h"
 #include "GenericServerClient.h"
 #include "OpenSSLError.h"
 
@@ -14,7 +15,13 @@
 #include <stdexcept>
 #include <system_error>
 #include <memory>
+#include <algorithm>
 
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <openssl/ssl.h>
@@ -22,6 +29,9 @@
 
 
 namespace liblichtenstein::io {
+  /// identifies sessions created by this server
+  static const unsigned char kSessionIdContext[] = "lichtenstein-api";
+
   /**
    * Initializes the TLS server.
    *
@@ -33,25 +43,39 @@ namespace liblichtenstein::io {
     this->createContext();
   }
 
+  /**
+   * Initializes a TLS server that shares the SSL context of another server;
+   * this way, both use the same certificate and session cache.
+   *
+   * @param fd Socket to listen on; this should already be configured for
+   * listening purposes.
+   * @param ctx Context created by another TLSServer
+   */
+  TLSServer::TLSServer(int fd, SSL_CTX *ctx) : GenericTLSServer(fd, ctx) {
+  }
+
   /**
    * Tears down the TLS server. Any existing sessions are closed.
    */
   TLSServer::~TLSServer() {
+    this->stop();
   }
 
 
   /**
-   * Creates the OpenSSL context for TLS; we create it with TLS 1.2.
+   * Creates the OpenSSL context for TLS. TLS 1.2 and 1.3 are accepted; with
+   * TLS 1.3, the handshake takes one round trip less.
    *
    * The context is configured to automatically select the highest strength
-   * ECDH curve during key negotiation.
+   * ECDH curve during key negotiation, and the cipher suites fastest on this
+   * CPU.
    *
    * @throws TLSServer::OpenSSLError
    */
   void TLSServer::createContext() {
     // try to create an SSL context
     const SSL_METHOD *method;
-    method = TLSv1_2_server_method();
+    method = TLS_server_method();
 
     this->ctx = SSL_CTX_new(method);
     if (this->ctx == nullptr) {
@@ -59,47 +83,476 @@ namespace liblichtenstein::io {
     }
 
     // configure the context
+    SSL_CTX_set_min_proto_version(this->ctx, TLS1_2_VERSION);
     SSL_CTX_set_ecdh_auto(this->ctx, 1);
+
+    CipherPolicy::apply(this->ctx, true);
+
+    // allow clients to resume sessions, either from the cache or with tickets
+    SSL_CTX_set_session_cache_mode(this->ctx, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(this->ctx, kSessionCacheSize);
+    SSL_CTX_set_timeout(this->ctx, kSessionTimeout);
+    SSL_CTX_set_session_id_context(this->ctx, kSessionIdContext,
+                                   sizeof(kSessionIdContext) - 1);
+    SSL_CTX_clear_options(this->ctx, SSL_OP_NO_TICKET);
+
+#if defined(TLS1_3_VERSION) && !defined(LIBRESSL_VERSION_NUMBER)
+    // clients only keep the latest TLS 1.3 ticket, so don't send two
+    SSL_CTX_set_num_tickets(this->ctx, 1);
+#endif
+  }
+
+
+  /**
+   * Starts the handshake thread, which accepts connections on the listening
+   * socket and performs the TLS handshake with them. This is done
+   * automatically the first time run() is called; call it explicitly when
+   * using a handshake callback.
+   *
+   * The listening socket is made non-blocking. Once the server was stopped,
+   * this does nothing.
+   *
+   * @throws std::system_error
+   */
+  void TLSServer::start() {
+    int err;
+
+    // held throughout, so stop() can't miss a thread that's being started
+    std::lock_guard<std::mutex> lg(this->readyLock);
+
+    if(this->handshakeThread || this->stopped) return;
+
+    // accept as many connections as are waiting without blocking
+    int flags = fcntl(this->listeningSocket, F_GETFL, 0);
+    if(flags == -1 ||
+       fcntl(this->listeningSocket, F_SETFL, flags | O_NONBLOCK) == -1) {
+      throw std::system_error(errno, std::system_category(),
+                              "fcntl() on listening socket failed");
+    }
+
+    // create the wake-up pipe and start thread
+    err = pipe(this->wakePipe);
+    if(err != 0) {
+      throw std::system_error(errno, std::system_category(), "pipe() failed");
+    }
+
+    fcntl(this->wakePipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(this->wakePipe[1], F_SETFL, O_NONBLOCK);
+
+    this->shutdown = false;
+    this->handshakeThread = new std::thread(&TLSServer::handshakeEntry, this);
+  }
+
+  /**
+   * Stops the handshake thread. Any handshakes in progress are aborted, and
+   * callers blocked in (or subsequently calling) run() will get an error.
+   */
+  void TLSServer::stop() {
+    {
+      // so that a caller about to wait in run() can't miss the wakeup
+      std::lock_guard<std::mutex> lg(this->readyLock);
+      this->stopped = true;
+      this->shutdown = true;
+    }
+
+    this->readyCv.notify_all();
+
+    if(!this->handshakeThread) return;
+
+    this->wake();
+
+    if(this->handshakeThread->joinable()) {
+      this->handshakeThread->join();
+    }
+
+    delete this->handshakeThread;
+    this->handshakeThread = nullptr;
+
+    close(this->wakePipe[0]);
+    close(this->wakePipe[1]);
+    this->wakePipe[0] = this->wakePipe[1] = -1;
+  }
+
+  /**
+   * Sets a callback that's invoked (on the handshake thread) for every
+   * established session. Sessions are then no longer returned by run().
+   *
+   * The callback should return quickly, as no handshakes progress while it is
+   * executing.
+   *
+   * @param callback Callback to invoke, or nullptr to return sessions from run()
+   */
+  void TLSServer::setHandshakeCallback(HandshakeCallback callback) {
+    std::lock_guard<std::mutex> lg(this->readyLock);
+    this->callback = std::move(callback);
+  }
+
+  /**
+   * Gets the current handshake statistics.
+   *
+   * @return Handshake counters
+   */
+  TLSServer::HandshakeStats TLSServer::getHandshakeStats() const {
+    HandshakeStats stats;
+
+    stats.accepted = this->statAccepted;
+    stats.completed = this->statCompleted;
+    stats.resumed = this->statResumed;
+    stats.failed = this->statFailed;
+    stats.timedOut = this->statTimedOut;
+    stats.inProgress = this->statInProgress;
+
+    return stats;
   }
 
 
   /**
-   * Waits to accept a new connection on the listening socket.
+   * Waits for a new connection to complete its TLS handshake.
    *
    * @return A reference to a the accepted client
-   * @throws std::system_error, TLSServer::OpenSSLError
+   * @throws std::system_error If the listening socket was closed
    */
   std::shared_ptr<GenericServerClient> TLSServer::run() {
-    // store the address of the client and prepare an SSL context
-    struct sockaddr_in addr{};
-    socklen_t addrLen = sizeof(addr);
+    this->start();
 
-    memset(&addr, 0, addrLen);
+    std::unique_lock<std::mutex> lk(this->readyLock);
+    this->readyCv.wait(lk, [this] {
+      return !this->ready.empty() || this->shutdown;
+    });
 
-    SSL *ssl;
+    if(!this->ready.empty()) {
+      auto client = this->ready.front();
+      this->ready.pop_front();
 
-    // wait for a client
-    int clientFd = accept(this->listeningSocket,
-                          reinterpret_cast<struct sockaddr *>(&addr),
-                          &addrLen);
+      return client;
+    }
 
-    if (clientFd < 0) {
-      throw std::system_error(errno, std::system_category(),
-                              "accept() failed");
+    // the server was stopped, or the listening socket is no longer usable
+    int error = this->acceptError;
+
+    throw std::system_error(error ? error : ECONNABORTED,
+                            std::system_category(), "accept() failed");
+  }
+
+
+  /**
+   * Handshake thread entry point: waits for new connections and progress on
+   * handshakes in progress, and expires handshakes that are taking too long.
+   */
+  void TLSServer::handshakeEntry() {
+    int err;
+    std::vector<struct pollfd> fds;
+
+    // with TLS 1.3, session tickets are sent after the client has finished
+    // its side of the handshake; if it's already gone, writing them must not
+    // kill the process
+    sigset_t sigpipe;
+    sigemptyset(&sigpipe);
+    sigaddset(&sigpipe, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &sigpipe, nullptr);
+
+    while(!this->shutdown) {
+      const auto now = std::chrono::steady_clock::now();
+
+      // always watch the wake pipe, and the handshakes in progress
+      fds.clear();
+      fds.push_back({this->wakePipe[0], POLLIN, 0});
+
+      for(const auto &handshake : this->pending) {
+        fds.push_back({handshake.fd, handshake.events, 0});
+      }
+
+      // accept new connections unless we're at the limit
+      const bool canAccept = (this->pending.size() < this->maxPendingHandshakes)
+                             && (now >= this->acceptBackoffUntil);
+
+      if(canAccept) {
+        fds.push_back({this->listeningSocket, POLLIN, 0});
+      }
+
+      // wait no longer than until the next handshake expires
+      auto timeout = std::chrono::milliseconds(kMaxPollInterval);
+
+      for(const auto &handshake : this->pending) {
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+                handshake.deadline - now);
+        timeout = std::max(std::chrono::milliseconds(0),
+                           std::min(timeout, remaining));
+      }
+
+      err = poll(fds.data(), fds.size(), static_cast<int>(timeout.count()));
+
+      if(err < 0) {
+        if(errno == EINTR) continue;
+
+        PLOG(ERROR) << "poll() failed in handshake thread";
+        this->acceptError = errno;
+        break;
+      }
+
+      // drain the wake pipe; the loop condition checks for shutdown
+      if(fds[0].revents & POLLIN) {
+        char buf[16];
+        while(read(this->wakePipe[0], buf, sizeof(buf)) > 0) {}
+      }
+
+      // continue handshakes that have activity; failed ones are removed
+      for(size_t i = 0; i < this->pending.size(); i++) {
+        auto &handshake = this->pending[i];
+
+        if(fds[i + 1].revents != 0) {
+          if(this->continueHandshake(handshake)) {
+            handshake.fd = -1;
+          }
+        }
+      }
+
+      // expire any handshakes that are taking too long
+      const auto after = std::chrono::steady_clock::now();
+
+      for(auto &handshake : this->pending) {
+        if(handshake.fd != -1 && after >= handshake.deadline) {
+          VLOG(1) << "Handshake with fd " << handshake.fd << " timed out";
+
+          this->statTimedOut++;
+          this->abortHandshake(handshake);
+        }
+      }
+
+      this->pending.erase(std::remove_if(this->pending.begin(),
+                                         this->pending.end(),
+                                         [](const PendingHandshake &h) {
+                                           return h.fd == -1;
+                                         }), this->pending.end());
+      this->statInProgress = this->pending.size();
+
+      // get rid of sessions that were closed since
+      this->registry->reapIfDue();
+
+      // lastly, accept new connections
+      if(canAccept) {
+        const auto &listen = fds.back();
+
+        if(listen.revents & (POLLERR | POLLNVAL)) {
+          LOG(ERROR) << "Listening socket is no longer valid";
+          this->acceptError = ECONNABORTED;
+          break;
+        } else if(listen.revents != 0) {
+          this->acceptClients();
+        }
+      }
+    }
+
+    // abort all handshakes in progress
+    for(auto &handshake : this->pending) {
+      this->abortHandshake(handshake);
+    }
+
+    this->pending.clear();
+    this->statInProgress = 0;
+
+    // wake up anyone waiting in run()
+    {
+      std::lock_guard<std::mutex> lg(this->readyLock);
+      this->shutdown = true;
+    }
+
+    this->readyCv.notify_all();
+  }
+
+  /**
+   * Accepts all connections waiting on the listening socket (up to the limit
+   * of handshakes in progress) and starts their handshakes.
+   */
+  void TLSServer::acceptClients() {
+    while(this->pending.size() < this->maxPendingHandshakes) {
+      PendingHandshake handshake;
+      socklen_t addrLen = sizeof(handshake.addr);
+
+      int clientFd = accept(this->listeningSocket,
+                            reinterpret_cast<struct sockaddr *>(&handshake.addr),
+                            &addrLen);
+
+      if(clientFd < 0) {
+        switch(errno) {
+          // no more connections waiting
+          case EAGAIN:
+#if EAGAIN != EWOULDBLOCK
+          case EWOULDBLOCK:
+#endif
+            return;
+
+          // the connection went away before we accepted it
+          case EINTR:
+          case ECONNABORTED:
+          case EPROTO:
+            continue;
+
+          // out of resources: try again in a bit
+          case EMFILE:
+          case ENFILE:
+          case ENOBUFS:
+          case ENOMEM:
+            PLOG(WARNING) << "accept() failed, backing off";
+            this->acceptBackoffUntil = std::chrono::steady_clock::now() +
+                                       std::chrono::milliseconds(kAcceptBackoff);
+            return;
+
+          // anything else means the listening socket is broken
+          default:
+            PLOG(ERROR) << "accept() failed";
+            this->acceptError = errno;
+            this->shutdown = true;
+            return;
+        }
+      }
+
+      // turn the client away if we're at the connection limit, even counting
+      // only sessions that are still open
+      if(!this->registry->hasCapacity(this->pending.size())) {
+        this->registry->reap();
+
+        if(!this->registry->hasCapacity(this->pending.size())) {
+          VLOG(1) << "Rejecting client with FD " << clientFd
+                  << ": too many connections";
+
+          this->registry->reject();
+          close(clientFd);
+          continue;
+        }
+      }
+
+      // we've got a client, try to create an SSL session
+      VLOG(1) << "Got new client with FD " << clientFd;
+      this->statAccepted++;
+
+      int flags = fcntl(clientFd, F_GETFL, 0);
+      fcntl(clientFd, F_SETFL, flags | O_NONBLOCK);
+
+      handshake.fd = clientFd;
+      handshake.ssl = SSL_new(this->ctx);
+
+      if(!handshake.ssl) {
+        LOG(ERROR) << OpenSSLError("SSL_new() failed").what();
+        close(clientFd);
+        continue;
+      }
+
+      SSL_set_fd(handshake.ssl, clientFd);
+      SSL_set_accept_state(handshake.ssl);
+
+      handshake.deadline = std::chrono::steady_clock::now() +
+                           this->handshakeTimeout;
+
+      // the ClientHello may well have arrived already
+      if(!this->continueHandshake(handshake)) {
+        this->pending.push_back(handshake);
+      }
+    }
+  }
+
+  /**
+   * Continues the handshake with a client. If it completes, the session is
+   * delivered; if it fails, the connection is closed.
+   *
+   * @param handshake Handshake to continue
+   * @return Whether the handshake is done (successfully or not)
+   */
+  bool TLSServer::continueHandshake(PendingHandshake &handshake) {
+    int err = SSL_do_handshake(handshake.ssl);
+
+    if(err == 1) {
+      // the handshake was successful; the session is blocking by default
+      int flags = fcntl(handshake.fd, F_GETFL, 0);
+      fcntl(handshake.fd, F_SETFL, flags & ~O_NONBLOCK);
+
+      this->statCompleted++;
+
+      if(SSL_session_reused(handshake.ssl)) {
+        this->statResumed++;
+      }
+
+      VLOG(1) << "Handshake with fd " << handshake.fd << " complete (resumed: "
+              << SSL_session_reused(handshake.ssl) << ", "
+              << CipherPolicy::describe(handshake.ssl) << ")";
+
+      auto *client = new GenericServerClient(this, handshake.fd,
+                                             handshake.ssl, handshake.addr);
+      this->deliver(std::shared_ptr<GenericServerClient>(client));
+      return true;
     }
 
-    // we've got a client, try to create an SSL session
-    VLOG(1) << "Got new client with FD " << clientFd;
+    switch(SSL_get_error(handshake.ssl, err)) {
+      case SSL_ERROR_WANT_READ:
+        handshake.events = POLLIN;
+        return false;
+
+      case SSL_ERROR_WANT_WRITE:
+        handshake.events = POLLOUT;
+        return false;
 
-    ssl = SSL_new(this->ctx);
-    SSL_set_fd(ssl, clientFd);
+      default:
+        VLOG(1) << "Handshake with fd " << handshake.fd << " failed: "
+                << OpenSSLError("SSL_accept() failed").what();
 
-    if (SSL_accept(ssl) <= 0) {
-      throw OpenSSLError("SSL_accept() failed");
+        this->statFailed++;
+        this->abortHandshake(handshake);
+        return true;
     }
+  }
 
-    // the handshake was successful
-    auto *client = new GenericServerClient(this, clientFd, ssl, addr);
-    return this->clients.emplace_back(client);
+  /**
+   * Aborts a handshake, closing the connection.
+   *
+   * @param handshake Handshake to abort
+   */
+  void TLSServer::abortHandshake(PendingHandshake &handshake) {
+    SSL_free(handshake.ssl);
+    handshake.ssl = nullptr;
+
+    close(handshake.fd);
+    handshake.fd = -1;
+  }
+
+  /**
+   * Delivers an established session, either to the callback or to the queue
+   * read by run(). If the registry filled up in the meantime (e.g. it's
+   * shared with other servers) the session is closed instead.
+   *
+   * @param client Newly established client session
+   */
+  void TLSServer::deliver(std::shared_ptr<GenericServerClient> client) {
+    if(!this->registry->add(client)) {
+      VLOG(1) << "Closing client " << client << ": too many connections";
+
+      // don't wait for the peer's close notification on the handshake thread
+      client->setBlocking(false);
+      client->close();
+      return;
+    }
+
+    std::unique_lock<std::mutex> lk(this->readyLock);
+
+    if(this->callback) {
+      auto callback = this->callback;
+      lk.unlock();
+
+      callback(client);
+    } else {
+      this->ready.push_back(client);
+      lk.unlock();
+
+      this->readyCv.notify_one();
+    }
+  }
+
+  /**
+   * Wakes up the handshake thread.
+   */
+  void TLSServer::wake() {
+    const char c = 0;
+    ssize_t written = write(this->wakePipe[1], &c, sizeof(c));
+    PLOG_IF(ERROR, written != sizeof(c) && errno != EAGAIN)
+    << "Failed to wake handshake thread";
   }
 }
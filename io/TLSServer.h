@@ -7,6 +7,20 @@
 
 #include "GenericTLSServer.h"
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <netinet/in.h>
+
 namespace liblichtenstein {
   namespace io {
     class GenericServerClient;
@@ -23,19 +37,145 @@ namespace liblichtenstein {
      * them. When a session is established (or an error occurs) this function
      * will return.
      *
+     * Connections are accepted and their handshakes performed on a separate
+     * handshake thread, with non-blocking sockets; this way, many handshakes
+     * can be in progress at once, and a slow (or malicious) peer can't hold up
+     * other connections. Alternatively to `run()`, a callback can be set that
+     * is invoked on the handshake thread for every established session.
+     *
      * @note OpenSSL _must_ be initialized before trying to construct this class
      */
     class TLSServer : public GenericTLSServer {
+      public:
+        /// invoked on the handshake thread when a session is established
+        using HandshakeCallback = std::function<void(
+                std::shared_ptr<GenericServerClient>)>;
+
+        /// handshake counters, for monitoring purposes
+        struct HandshakeStats {
+          /// connections accepted
+          uint64_t accepted = 0;
+          /// handshakes that completed successfully
+          uint64_t completed = 0;
+          /// completed handshakes that resumed an earlier session
+          uint64_t resumed = 0;
+          /// handshakes that failed
+          uint64_t failed = 0;
+          /// handshakes that didn't complete in time
+          uint64_t timedOut = 0;
+          /// handshakes currently in progress
+          uint64_t inProgress = 0;
+        };
+
       public:
         explicit TLSServer(int fd);
 
+        TLSServer(int fd, SSL_CTX *ctx);
+
         virtual ~TLSServer();
 
       public:
         virtual std::shared_ptr<GenericServerClient> run();
 
+        void start();
+
+        void stop();
+
+        void setHandshakeCallback(HandshakeCallback callback);
+
+        /// sets how long a peer has to complete the handshake
+        void setHandshakeTimeout(std::chrono::milliseconds timeout) {
+          this->handshakeTimeout = timeout;
+        }
+
+        /// sets how many handshakes may be in progress at once
+        void setMaxPendingHandshakes(size_t max) {
+          this->maxPendingHandshakes = max;
+        }
+
+        [[nodiscard]] HandshakeStats getHandshakeStats() const;
+
+      private:
+        /// a connection whose handshake has not yet completed
+        struct PendingHandshake {
+          /// socket of the connection
+          int fd = -1;
+          /// TLS session being established
+          SSL *ssl = nullptr;
+          /// address of the peer
+          struct sockaddr_in addr{};
+
+          /// when the handshake times out
+          std::chrono::steady_clock::time_point deadline;
+          /// events to poll for before continuing the handshake
+          short events = 0;
+        };
+
       private:
         void createContext();
+
+        void handshakeEntry();
+
+        void acceptClients();
+
+        bool continueHandshake(PendingHandshake &handshake);
+
+        void abortHandshake(PendingHandshake &handshake);
+
+        void deliver(std::shared_ptr<GenericServerClient> client);
+
+        void wake();
+
+      private:
+        /// default time a peer has to complete the handshake
+        static constexpr std::chrono::milliseconds kDefaultHandshakeTimeout{
+                10000};
+        /// default number of handshakes that may be in progress at once
+        static const size_t kDefaultMaxPendingHandshakes = 256;
+        /// longest time to wait for events (msec) before checking timeouts
+        static constexpr int kMaxPollInterval = 1000;
+        /// how long to stop accepting when out of descriptors (msec)
+        static constexpr int kAcceptBackoff = 100;
+        /// number of sessions kept in the session cache
+        static const long kSessionCacheSize = 1024;
+        /// how long sessions (and tickets) may be resumed for (sec)
+        static const long kSessionTimeout = (60 * 60 * 24);
+
+      private:
+        /// thread on which connections are accepted and handshakes performed
+        std::thread *handshakeThread = nullptr;
+        /// pipe used to wake up the handshake thread
+        int wakePipe[2] = {-1, -1};
+        /// set when the handshake thread should exit
+        std::atomic_bool shutdown = false;
+        /// set by stop(), after which the server isn't started again
+        bool stopped = false;
+        /// error that caused the handshake thread to stop accepting, if any
+        std::atomic_int acceptError = 0;
+
+        /// handshakes in progress; only accessed by the handshake thread
+        std::vector<PendingHandshake> pending;
+        /// don't accept connections before this time
+        std::chrono::steady_clock::time_point acceptBackoffUntil;
+
+        /// how long a peer has to complete the handshake
+        std::chrono::milliseconds handshakeTimeout = kDefaultHandshakeTimeout;
+        /// maximum number of handshakes in progress at once
+        size_t maxPendingHandshakes = kDefaultMaxPendingHandshakes;
+
+        /// protects the ready queue and callback
+        std::mutex readyLock;
+        /// signalled when a session is established, or the server stops
+        std::condition_variable readyCv;
+        /// established sessions that haven't been returned by run()
+        std::deque<std::shared_ptr<GenericServerClient>> ready;
+        /// if set, established sessions are passed to this callback instead
+        HandshakeCallback callback;
+
+        /// counters
+        std::atomic<uint64_t> statAccepted = 0, statCompleted = 0,
+                statResumed = 0, statFailed = 0, statTimedOut = 0,
+                statInProgress = 0;
     };
   }
 }
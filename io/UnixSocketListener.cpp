@@ -0,0 +1,173 @@
+//
+// Created by Tristan Seifert on 2019-09-04.
+//
+
+#include "UnixSocketListener.h"
+#include "UnixSocketTransport.h"
+
+#include <glog/logging.h>
+
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+
+namespace liblichtenstein::io {
+  /**
+   * Creates a Unix domain socket at the given path and starts listening on it.
+   * If a stale socket (e.g. left behind by a process that crashed) exists at
+   * the path, it's removed first; anything else at the path is left alone.
+   *
+   * @param path Path at which to create the socket
+   * @param backlog Maximum number of pending connections
+   * @throws std::system_error If the socket couldn't be created; EADDRINUSE
+   * if something other than a stale socket exists at the path
+   */
+  UnixSocketListener::UnixSocketListener(std::string path, int backlog) : path(
+          std::move(path)) {
+    int err;
+    struct sockaddr_un addr{};
+
+    if(this->path.size() >= sizeof(addr.sun_path)) {
+      throw std::system_error(ENAMETOOLONG, std::system_category(),
+                              "Socket path too long");
+    }
+
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, this->path.c_str(), sizeof(addr.sun_path) - 1);
+
+    // create socket
+    this->fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if(this->fd < 0) {
+      throw std::system_error(errno, std::system_category(),
+                              "socket() failed");
+    }
+
+    // remove a stale socket, then bind and listen
+    try {
+      removeStaleSocket(addr);
+    } catch(std::exception &) {
+      this->close();
+      throw;
+    }
+
+    err = ::bind(this->fd, reinterpret_cast<struct sockaddr *>(&addr),
+                 sizeof(addr));
+
+    if(err == 0) {
+      this->ownsPath = true;
+      err = ::listen(this->fd, backlog);
+    }
+
+    if(err != 0) {
+      int listenErr = errno;
+      this->close();
+
+      throw std::system_error(listenErr, std::system_category(),
+                              "Failed to listen on Unix socket");
+    }
+
+    VLOG(1) << "Listening on Unix socket " << this->path;
+  }
+
+  /**
+   * Removes the socket at the given address, if it's stale: that is, it's a
+   * socket, but nobody is listening on it.
+   *
+   * @param addr Address of the socket
+   * @throws std::system_error EADDRINUSE if the path is in use, either by a
+   * file that's not a socket or a socket that accepts connections
+   */
+  void UnixSocketListener::removeStaleSocket(const struct sockaddr_un &addr) {
+    struct stat info{};
+
+    if(::lstat(addr.sun_path, &info) != 0) {
+      if(errno == ENOENT) return;
+
+      throw std::system_error(errno, std::system_category(),
+                              "lstat() failed");
+    }
+
+    if(!S_ISSOCK(info.st_mode)) {
+      throw std::system_error(EADDRINUSE, std::system_category(),
+                              "Socket path exists and is not a socket");
+    }
+
+    // a socket nobody listens on refuses connections
+    int probe = ::socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if(probe < 0) {
+      throw std::system_error(errno, std::system_category(),
+                              "socket() failed");
+    }
+
+    int err = ::connect(probe, reinterpret_cast<const struct sockaddr *>(&addr),
+                        sizeof(addr));
+    int connectErr = errno;
+
+    ::close(probe);
+
+    if(err == 0 || connectErr != ECONNREFUSED) {
+      throw std::system_error(EADDRINUSE, std::system_category(),
+                              "Socket is in use");
+    }
+
+    VLOG(1) << "Removing stale socket " << addr.sun_path;
+    ::unlink(addr.sun_path);
+  }
+
+
+  /**
+   * Closes the listening socket and removes it from the file system.
+   */
+  UnixSocketListener::~UnixSocketListener() {
+    this->close();
+  }
+
+
+  /**
+   * Waits for a connection on the socket.
+   *
+   * @return Transport for the accepted connection
+   * @throws std::system_error If accepting failed, e.g. because the listener
+   * was closed (ECONNABORTED or EBADF)
+   */
+  std::shared_ptr<UnixSocketTransport> UnixSocketListener::accept() {
+    int client;
+
+    do {
+      client = ::accept(this->fd, nullptr, nullptr);
+    } while(client < 0 && errno == EINTR);
+
+    if(client < 0) {
+      throw std::system_error(errno, std::system_category(),
+                              "accept() failed");
+    }
+
+    return std::make_shared<UnixSocketTransport>(client);
+  }
+
+  /**
+   * Closes the listening socket. Any thread blocked in accept() will return
+   * with an error.
+   */
+  void UnixSocketListener::close() {
+    if(this->fd == -1) return;
+
+    ::shutdown(this->fd, SHUT_RDWR);
+    ::close(this->fd);
+    this->fd = -1;
+
+    // only remove the socket if we created it
+    if(this->ownsPath) {
+      ::unlink(this->path.c_str());
+      this->ownsPath = false;
+    }
+  }
+}
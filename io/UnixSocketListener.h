@@ -0,0 +1,53 @@
+//
+// Created by Tristan Seifert on 2019-09-04.
+//
+
+#ifndef LIBLICHTENSTEIN_UNIXSOCKETLISTENER_H
+#define LIBLICHTENSTEIN_UNIXSOCKETLISTENER_H
+
+#include <memory>
+#include <string>
+
+struct sockaddr_un;
+
+namespace liblichtenstein::io {
+  class UnixSocketTransport;
+
+  /**
+   * Listens on a Unix domain socket and accepts connections on it as plaintext
+   * transports.
+   */
+  class UnixSocketListener {
+    public:
+      UnixSocketListener() = delete;
+
+      explicit UnixSocketListener(std::string path, int backlog = 5);
+
+      virtual ~UnixSocketListener();
+
+    public:
+      std::shared_ptr<UnixSocketTransport> accept();
+
+      void close();
+
+      /// returns the path of the socket
+      [[nodiscard]] const std::string &getPath() const {
+        return this->path;
+      }
+
+    private:
+      static void removeStaleSocket(const struct sockaddr_un &addr);
+
+    private:
+      /// path of the socket in the file system
+      std::string path;
+      /// whether we created the socket at the path (and should remove it)
+      bool ownsPath = false;
+
+      /// listening socket
+      int fd = -1;
+  };
+}
+
+
+#endif //LIBLICHTENSTEIN_UNIXSOCKETLISTENER_H
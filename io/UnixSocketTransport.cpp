@@ -0,0 +1,245 @@
+//
+// Created by Tristan Seifert on 2019-09-04.
+//
+
+#include "UnixSocketTransport.h"
+#include "SSLSessionClosedError.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <system_error>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+// macOS doesn't have MSG_NOSIGNAL, but a socket option instead
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+
+namespace liblichtenstein::io {
+  /**
+   * Connects to a Unix domain socket at the given path.
+   *
+   * @param path Path of the socket in the file system
+   * @return Transport for the connected socket
+   * @throws std::system_error If the connection couldn't be established
+   */
+  std::shared_ptr<UnixSocketTransport>
+  UnixSocketTransport::connect(const std::string &path) {
+    int err, fd;
+    struct sockaddr_un addr{};
+
+    if(path.size() >= sizeof(addr.sun_path)) {
+      throw std::system_error(ENAMETOOLONG, std::system_category(),
+                              "Socket path too long");
+    }
+
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+    // create the socket and connect it
+    fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if(fd < 0) {
+      throw std::system_error(errno, std::system_category(),
+                              "socket() failed");
+    }
+
+    err = ::connect(fd, reinterpret_cast<struct sockaddr *>(&addr),
+                    sizeof(addr));
+
+    if(err != 0) {
+      int connectErr = errno;
+      ::close(fd);
+
+      throw std::system_error(connectErr, std::system_category(),
+                              "connect() failed");
+    }
+
+    return std::make_shared<UnixSocketTransport>(fd);
+  }
+
+
+  /**
+   * Creates a transport on a connected socket. The transport takes ownership
+   * of the socket and closes it when deallocated.
+   *
+   * @param fd Connected Unix domain socket
+   */
+  UnixSocketTransport::UnixSocketTransport(int fd) : fd(fd) {
+    CHECK(fd >= 0) << "Invalid socket " << fd;
+
+#ifdef SO_NOSIGPIPE
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+  }
+
+  /**
+   * Closes the socket.
+   */
+  UnixSocketTransport::~UnixSocketTransport() {
+    this->close();
+  }
+
+
+  /**
+   * Writes data to the socket. This only returns once all data was written.
+   *
+   * @param buf Data to write
+   * @param bufSz Number of bytes to write
+   * @return Number of bytes written
+   * @throws std::system_error, SSLSessionClosedError
+   */
+  size_t UnixSocketTransport::write(const std::byte *buf, size_t bufSz) {
+    size_t written = 0;
+
+    while(written < bufSz) {
+      ssize_t err = ::send(this->fd, buf + written, bufSz - written,
+                           MSG_NOSIGNAL);
+
+      if(err < 0) {
+        if(errno == EINTR) continue;
+
+        if(errno == EPIPE || errno == ECONNRESET) {
+          this->close();
+          throw SSLSessionClosedError("Connection closed by peer");
+        }
+
+        throw std::system_error(errno, std::system_category(),
+                                "send() failed");
+      }
+
+      written += err;
+    }
+
+    return written;
+  }
+
+  /**
+   * Writes several buffers to the socket with a single sendmsg(), without
+   * copying them together first.
+   *
+   * @param iov Buffers to write
+   * @param iovCount Number of buffers
+   * @return Number of bytes written
+   * @throws std::system_error, SSLSessionClosedError
+   */
+  size_t UnixSocketTransport::writev(const struct iovec *iov,
+                                     size_t iovCount) {
+    // the buffer list is const, so partial writes are tracked as the index of
+    // the first buffer not completely written, and how much of it was
+    const size_t maxChunk = std::min(kMaxWriteBuffers,
+                                     static_cast<size_t>(IOV_MAX));
+    struct iovec chunk[kMaxWriteBuffers];
+    size_t next = 0, offset = 0, written = 0;
+
+    while(next < iovCount) {
+      const size_t count = std::min(iovCount - next, maxChunk);
+
+      std::copy(iov + next, iov + next + count, chunk);
+      chunk[0].iov_base = static_cast<char *>(chunk[0].iov_base) + offset;
+      chunk[0].iov_len -= offset;
+
+      struct msghdr msg{};
+      msg.msg_iov = chunk;
+      msg.msg_iovlen = count;
+
+      ssize_t err = ::sendmsg(this->fd, &msg, MSG_NOSIGNAL);
+
+      if(err < 0) {
+        if(errno == EINTR) continue;
+
+        if(errno == EPIPE || errno == ECONNRESET) {
+          this->close();
+          throw SSLSessionClosedError("Connection closed by peer");
+        }
+
+        throw std::system_error(errno, std::system_category(),
+                                "sendmsg() failed");
+      }
+
+      written += err;
+
+      // skip the buffers that were written completely
+      size_t sent = offset + err;
+
+      while(next < iovCount && sent >= iov[next].iov_len) {
+        sent -= iov[next++].iov_len;
+      }
+
+      offset = sent;
+    }
+
+    return written;
+  }
+
+  /**
+   * Reads data from the socket; this blocks until at least some data is
+   * available.
+   *
+   * @param buf Buffer to read into
+   * @param bufSz Maximum number of bytes to read
+   * @return Number of bytes read
+   * @throws std::system_error, SSLSessionClosedError
+   */
+  size_t UnixSocketTransport::read(std::byte *buf, size_t bufSz) {
+    ssize_t err;
+
+    do {
+      err = ::recv(this->fd, buf, bufSz, 0);
+    } while(err < 0 && errno == EINTR);
+
+    if(err <= 0) {
+      int recvErr = errno;
+
+      // the peer closed the connection
+      if(err == 0) {
+        this->close();
+        throw SSLSessionClosedError("Connection closed by peer");
+      }
+
+      throw std::system_error(recvErr, std::system_category(),
+                              "recv() failed");
+    }
+
+    return err;
+  }
+
+  /**
+   * Gets the number of bytes that can be read from the socket without
+   * blocking.
+   *
+   * @return Number of bytes available
+   */
+  size_t UnixSocketTransport::pending() const {
+    int available = 0;
+
+    if(ioctl(this->fd, FIONREAD, &available) != 0) {
+      return 0;
+    }
+
+    return available;
+  }
+
+  /**
+   * Closes the socket, if it hasn't been closed already.
+   */
+  void UnixSocketTransport::close() {
+    if(!this->isOpen.exchange(false)) return;
+
+    ::shutdown(this->fd, SHUT_RDWR);
+
+    int err = ::close(this->fd);
+    PLOG_IF(ERROR, err != 0) << "close() on Unix socket failed";
+  }
+}
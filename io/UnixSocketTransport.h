@@ -0,0 +1,71 @@
+//
+// Created by Tristan Seifert on 2019-09-04.
+//
+
+#ifndef LIBLICHTENSTEIN_UNIXSOCKETTRANSPORT_H
+#define LIBLICHTENSTEIN_UNIXSOCKETTRANSPORT_H
+
+#include "ITransport.h"
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace liblichtenstein::io {
+  /**
+   * A plaintext transport over a Unix domain (stream) socket. Since the socket
+   * never leaves the local machine and access to it is controlled by file
+   * system permissions, it's used without TLS: this lets local tooling talk to
+   * a node without the cost of a handshake and encryption.
+   */
+  class UnixSocketTransport : public ITransport {
+    public:
+      static std::shared_ptr<UnixSocketTransport>
+      connect(const std::string &path);
+
+    public:
+      UnixSocketTransport() = delete;
+
+      explicit UnixSocketTransport(int fd);
+
+      ~UnixSocketTransport() override;
+
+    public:
+      size_t write(const std::byte *buf, size_t bufSz) override;
+
+      size_t writev(const struct iovec *iov, size_t iovCount) override;
+
+      using ITransport::read;
+
+      size_t read(std::byte *buf, size_t bufSz) override;
+
+      [[nodiscard]] size_t pending() const override;
+
+      void close() override;
+
+      [[nodiscard]] bool isSessionOpen() const override {
+        return this->isOpen;
+      }
+
+      /// returns the underlying socket
+      [[nodiscard]] int getFd() const {
+        return this->fd;
+      }
+
+    private:
+      /// most buffers passed to a single sendmsg() call by writev()
+      static constexpr size_t kMaxWriteBuffers = 64;
+
+    private:
+      /// connected socket
+      int fd = -1;
+
+      /// whether the socket is still open
+      std::atomic_bool isOpen = true;
+  };
+}
+
+
+#endif //LIBLICHTENSTEIN_UNIXSOCKETTRANSPORT_H
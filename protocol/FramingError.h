@@ -0,0 +1,23 @@
+//
+// Created by Tristan Seifert on 2019-09-19.
+//
+
+#ifndef LIBLICHTENSTEIN_FRAMINGERROR_H
+#define LIBLICHTENSTEIN_FRAMINGERROR_H
+
+#include "ProtocolError.h"
+
+namespace liblichtenstein::api {
+  /**
+   * A protocol error after which no further messages can be read from the
+   * connection, e.g. because a frame header was invalid, so where the next
+   * frame starts is unknown. Unlike other protocol errors, this isn't
+   * recoverable: the connection has to be closed.
+   */
+  class FramingError : public ProtocolError {
+    public:
+      explicit FramingError(const char *what) : ProtocolError(what) {}
+  };
+}
+
+#endif //LIBLICHTENSTEIN_FRAMINGERROR_H
@@ -10,7 +10,7 @@
 #include "proto/shared/Message.pb.h"
 #include "proto/shared/Error.pb.h"
 
-#include "../io/GenericServerClient.h"
+#include "../io/ITransport.h"
 
 #include <glog/logging.h>
 
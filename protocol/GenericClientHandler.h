@@ -20,7 +20,7 @@ namespace lichtenstein::protocol {
 }
 
 namespace liblichtenstein::io {
-  class GenericServerClient;
+  class ITransport;
 }
 
 
@@ -30,7 +30,7 @@ namespace liblichtenstein::api {
    */
   class GenericClientHandler {
     protected:
-      using clientType = liblichtenstein::io::GenericServerClient;
+      using clientType = liblichtenstein::io::ITransport;
       using protoMessageType = lichtenstein::protocol::Message;
 
     public:
@@ -65,6 +65,14 @@ namespace liblichtenstein::api {
         this->io->readMessage(success);
       }
 
+      void readMessages(const std::function<void(protoMessageType &)> &success) {
+        this->io->readMessages(success);
+      }
+
+      size_t drainMessages(const std::function<void(protoMessageType &)> &success) {
+        return this->io->drainMessages(success);
+      }
+
     protected:
       // client connection
       std::shared_ptr<clientType> client;
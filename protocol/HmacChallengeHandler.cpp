@@ -5,6 +5,7 @@
 #include "MessageIO.h"
 #include "version.h"
 #include "MessageSerializer.h"
+#include "MessageTypes.h"
 #include "WireMessage.h"
 #include "ProtocolError.h"
 
@@ -32,6 +33,7 @@
 
 
 using liblichtenstein::api::MessageSerializer;
+using liblichtenstein::api::MessageType;
 using liblichtenstein::api::ProtocolError;
 using liblichtenstein::io::OpenSSLError;
 
@@ -210,35 +212,39 @@ namespace liblichtenstein::api {
   HmacChallengeHandler::getAuthResponse(const std::vector<std::byte> &computed,
                                         const std::vector<std::byte> &nonce) {
     this->io->readMessage([this, computed, nonce](protoMessageType &message) {
-      std::string type = message.payload().type_url();
-
-      // is it an error?
-      if(type == "type.googleapis.com/lichtenstein.protocol.Error") {
-        this->handleError(message);
-      }
-      // is it an auth response?
-      if(type == "type.googleapis.com/lichtenstein.protocol.AuthResponse") {
-        // unpack the outer message
-        AuthResponse response;
-        if(!message.payload().UnpackTo(&response)) {
-          throw std::runtime_error("Failed to unpack AuthResponse");
+      switch(MessageSerializer::getType(message)) {
+        // is it an error?
+        case MessageType::Error:
+          this->handleError(message);
+          break;
+
+          // is it an auth response?
+        case MessageType::AuthResponse: {
+          // unpack the outer message
+          AuthResponse response;
+          if(!MessageSerializer::unpack(message, response)) {
+            throw std::runtime_error("Failed to unpack AuthResponse");
+          }
+
+          // then, unpack the HMAC message
+          HmacAuthResponse hmacResponse;
+          if(!response.payload().UnpackTo(&hmacResponse)) {
+            throw std::runtime_error("Failed to unpack HmacAuthResponse");
+          }
+
+          // we got the response, so check it
+          this->checkResponse(computed, nonce, hmacResponse);
+          break;
         }
 
-        // then, unpack the HMAC message
-        HmacAuthResponse hmacResponse;
-        if(!response.payload().UnpackTo(&hmacResponse)) {
-          throw std::runtime_error("Failed to unpack HmacAuthResponse");
+          // we received a message type we didn't expect
+        default: {
+          std::stringstream error;
+          error << "Received unexpected message type '"
+                << message.payload().type_url() << "' ("
+                << message.type() << "); expected Error or AuthResponse";
+          throw ProtocolError(error.str().c_str());
         }
-
-        // we got the response, so check it
-        this->checkResponse(computed, nonce, hmacResponse);
-      }
-        // we received a message type we didn't expect
-      else {
-        std::stringstream error;
-        error << "Received unexpected message type '" << type << "'; expected ";
-        error << "Error or AuthResponse";
-        throw ProtocolError(error.str().c_str());
       }
     });
   }
@@ -332,32 +338,33 @@ namespace liblichtenstein::api {
    */
   void HmacChallengeHandler::getAuthChallenge() {
     this->io->readMessage([this](protoMessageType &message) {
-      std::string type = message.payload().type_url();
-
-      // is it an error message?
-      if(type == "type.googleapis.com/lichtenstein.protocol.Error") {
-        this->handleError(message);
-      }
-
-        // is it an auth challenge?
-      else if(type ==
-              "type.googleapis.com/lichtenstein.protocol.AuthChallenge") {
-        AuthChallenge challenge;
-        if(!message.payload().UnpackTo(&challenge)) {
-          throw ProtocolError("Failed to unpack AuthChallenge");
+      switch(MessageSerializer::getType(message)) {
+        // is it an error message?
+        case MessageType::Error:
+          this->handleError(message);
+          break;
+
+          // is it an auth challenge?
+        case MessageType::AuthChallenge: {
+          AuthChallenge challenge;
+          if(!MessageSerializer::unpack(message, challenge)) {
+            throw ProtocolError("Failed to unpack AuthChallenge");
+          }
+
+          this->respondToChallenge(challenge);
+          break;
         }
 
-        this->respondToChallenge(challenge);
-      }
-
-        // undefined message type :(
-      else {
-        std::stringstream error;
+          // undefined message type :(
+        default: {
+          std::stringstream error;
 
-        error << "Received unexpected message type '" << type << "'; expected ";
-        error << "Error or AuthChallenge";
+          error << "Received unexpected message type '"
+                << message.payload().type_url() << "' ("
+                << message.type() << "); expected Error or AuthChallenge";
 
-        throw ProtocolError(error.str().c_str());
+          throw ProtocolError(error.str().c_str());
+        }
       }
     });
   }
@@ -457,37 +464,41 @@ namespace liblichtenstein::api {
    */
   void HmacChallengeHandler::getAuthState() {
     this->io->readMessage([this](protoMessageType &message) {
-      std::string type = message.payload().type_url();
-
-      // is it an error message?
-      if(type == "type.googleapis.com/lichtenstein.protocol.Error") {
-        this->handleError(message);
-      }
-        // is it an auth state
-      else if(type == "type.googleapis.com/lichtenstein.protocol.AuthState") {
-        AuthState state;
-        if(!message.payload().UnpackTo(&state)) {
-          throw ProtocolError("Failed to unpack AuthState");
+      switch(MessageSerializer::getType(message)) {
+        // is it an error message?
+        case MessageType::Error:
+          this->handleError(message);
+          break;
+
+          // is it an auth state
+        case MessageType::AuthState: {
+          AuthState state;
+          if(!MessageSerializer::unpack(message, state)) {
+            throw ProtocolError("Failed to unpack AuthState");
+          }
+
+          // was it successful?
+          if(state.success()) {
+            // yay, nothing to do really
+          } else {
+            // throw an error
+            std::stringstream error;
+            error << "Auth failed: \"" << state.errordetails() << "\"";
+            throw ProtocolError(error.str().c_str());
+          }
+          break;
         }
 
-        // was it successful?
-        if(state.success()) {
-          // yay, nothing to do really
-        } else {
-          // throw an error
+          // undefined message type :(
+        default: {
           std::stringstream error;
-          error << "Auth failed: \"" << state.errordetails() << "\"";
-          throw ProtocolError(error.str().c_str());
-        }
-      }
-        // undefined message type :(
-      else {
-        std::stringstream error;
 
-        error << "Received unexpected message type '" << type << "'; expected ";
-        error << "Error or AuthState";
+          error << "Received unexpected message type '"
+                << message.payload().type_url() << "' ("
+                << message.type() << "); expected Error or AuthState";
 
-        throw ProtocolError(error.str().c_str());
+          throw ProtocolError(error.str().c_str());
+        }
       }
     });
   }
@@ -499,7 +510,7 @@ namespace liblichtenstein::api {
    */
   void HmacChallengeHandler::handleError(const protoMessageType &message) {
     Error error;
-    if(!message.payload().UnpackTo(&error)) {
+    if(!MessageSerializer::unpack(message, error)) {
       throw ProtocolError("Failed to unpack Error");
     }
 
@@ -513,7 +524,8 @@ namespace liblichtenstein::api {
    * The HMAC is comprised of 16 raw bytes of the node UUID, followed directly
    * by the nonce.
    *
-   * @param outBuffer Buffer to which the resultant digest is written
+   * @param outBuffer Buffer to which the resultant digest is written; it must
+   * be at least as large as the digest
    * @param fn Hash function to use
    * @param nonce Nonce to include in the hash
    */
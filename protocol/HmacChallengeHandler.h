@@ -34,6 +34,10 @@ namespace liblichtenstein::io {
   class GenericServerClient;
 }
 
+namespace liblichtenstein::bench {
+  class HmacBenchmark;
+}
+
 namespace liblichtenstein::api {
   class MessageIO;
 
@@ -99,6 +103,10 @@ namespace liblichtenstein::api {
 
       void generateRandom(std::vector<std::byte> &outBuffer, size_t bytes);
 
+    private:
+      // the benchmarks time the HMAC computation on its own
+      friend class bench::HmacBenchmark;
+
     private:
       // UUID to send in the AuthHello
       uuids::uuid uuid;
@@ -7,20 +7,25 @@
 #include "MessageSerializer.h"
 #include "WireMessage.h"
 #include "ProtocolError.h"
+#include "FramingError.h"
 
 #include "proto/shared/Message.pb.h"
 #include "proto/shared/Error.pb.h"
 
-#include "../io/GenericTLSClient.h"
-#include "../io/GenericServerClient.h"
+#include "../io/ITransport.h"
 #include "../io/OpenSSLError.h"
 
 #include <sstream>
+#include <algorithm>
+#include <cstring>
+
+#include <arpa/inet.h>
 
 #include <glog/logging.h>
 
 using liblichtenstein::api::MessageSerializer;
 using liblichtenstein::api::ProtocolError;
+using liblichtenstein::api::FramingError;
 using liblichtenstein::io::OpenSSLError;
 
 using lichtenstein::protocol::Error;
@@ -28,60 +33,262 @@ using lichtenstein::protocol::Error;
 
 namespace liblichtenstein::api {
   /**
-   * Creates an IO wrapper with a TLS client.
+   * Creates an IO wrapper on top of a transport, such as a TLS client or server
+   * client, or one of the plaintext transports.
    *
-   * @param client Client connection to communicate with
+   * @param transport Connection to communicate over
+   */
+  MessageIO::MessageIO(std::shared_ptr<io::ITransport> transport) : transport(
+          std::move(transport)) {
+    CHECK(this->transport) << "Transport may not be null";
+
+    this->createArena();
+  }
+
+
+  /**
+   * Releases the receive buffers.
+   */
+  MessageIO::~MessageIO() = default;
+
+  /**
+   * Sets up the arena into which received messages are decoded. Its first
+   * block is allocated up front, and kept around when the arena is reset after
+   * each message; so as long as messages (and whatever handlers allocate on
+   * the arena) fit in it, receiving a message doesn't hit the heap at all.
    */
-  MessageIO::MessageIO(std::shared_ptr<io::GenericTLSClient> client) {
-    this->readCallback = [client](std::vector<std::byte> &data, size_t wanted) {
-      return client->read(data, wanted);
-    };
+  void MessageIO::createArena() {
+    this->arenaBlock = std::make_unique<char[]>(kArenaInitialBlockSize);
+
+    google::protobuf::ArenaOptions options;
+    options.initial_block = this->arenaBlock.get();
+    options.initial_block_size = kArenaInitialBlockSize;
 
-    this->writeCallback = [client](const std::vector<std::byte> &data) {
-      return client->write(data);
-    };
+    this->arena = std::make_unique<google::protobuf::Arena>(options);
   }
 
+
   /**
-   * Creates an IO wrapper with a TLS server client.
+   * Enables or disables use of the compact message form.
    *
-   * @param serverClient Server client to communicate with
+   * When enabled, all sent messages indicate support for the compact form by
+   * their protocol version; once a message from the peer indicates it supports
+   * it as well, messages are sent in the compact form. This avoids encoding
+   * payloads twice (once for the Any, then again as part of the outer message)
+   * and allows the receiver to dispatch on an integer type.
+   *
+   * @note Peers that only speak the base protocol version will reject all
+   * messages once this is enabled, so it's off by default.
+   *
+   * @param enabled Whether compact messages may be used
    */
-  MessageIO::MessageIO(std::shared_ptr<io::GenericServerClient> serverClient) {
-    this->readCallback = [serverClient](std::vector<std::byte> &data,
-                                        size_t wanted) {
-      return serverClient->read(data, wanted);
-    };
+  void MessageIO::setCompactMessages(bool enabled) {
+    this->useCompactMessages = enabled;
+  }
 
-    this->writeCallback = [serverClient](const std::vector<std::byte> &data) {
-      return serverClient->write(data);
-    };
+
+  /**
+   * Sets the maximum number of bytes that are written to the connection at
+   * once when sending a batch of messages. This should be the maximum size of
+   * a TLS record, or the largest datagram payload for DTLS connections.
+   *
+   * Messages are never split between writes, so a message larger than this
+   * size is always written on its own.
+   *
+   * @param size Maximum record size, in bytes
+   */
+  void MessageIO::setMaxRecordSize(size_t size) {
+    CHECK(size > 0) << "Invalid record size " << size;
+
+    this->maxRecordSize = size;
   }
 
 
   /**
    * Sends a response to a previous request.
    *
+   * If the IO is corked, the message is only added to the send buffer; it's
+   * written once the IO is uncorked, or enough messages to fill a record have
+   * been buffered.
+   *
    * @param response Message to respond with
    */
   void MessageIO::sendMessage(google::protobuf::Message &response) {
-    int written;
+    // serialize message into the (reused) send buffer, after pending messages
+    auto &responseBytes = this->sendBuffer;
+
+    if(this->useCompactMessages && this->peerSupportsCompact) {
+      MessageSerializer::serializeCompact(responseBytes, response);
+    } else if(this->useCompactMessages) {
+      // advertise that we understand compact messages
+      MessageSerializer::serialize(responseBytes, response,
+                                   LICHTENSTEIN_PROTOCOL_VERSION_COMPACT);
+    } else {
+      MessageSerializer::serialize(responseBytes, response);
+    }
 
-    // serialize message
-    std::vector<std::byte> responseBytes;
-    MessageSerializer::serialize(responseBytes, response);
+    this->sendMessageEnds.push_back(responseBytes.size());
 
-    // send it
-    written = this->writeCallback(responseBytes);
+    VLOG(1) << "Queued response: " << response.DebugString();
+
+    // send it (or at least everything that fills up a record)
+    this->writeSendBuffer(this->corkDepth == 0);
+  }
+
+  /**
+   * Sends multiple messages, coalescing as many of them into a single write as
+   * the maximum record size allows.
+   *
+   * @param messages Messages to send, in order
+   */
+  void MessageIO::sendBatch(
+          const std::vector<google::protobuf::Message *> &messages) {
+    size_t queued = 0;
+
+    this->cork();
+
+    try {
+      for(auto message : messages) {
+        this->sendMessage(*message);
+        queued++;
+      }
+    } catch(std::exception &) {
+      // messages queued before the batch (e.g. under an outer cork) are kept
+      this->corkDepth--;
+      this->discardLastMessages(queued);
+
+      throw;
+    }
+
+    this->uncork();
+  }
+
+  /**
+   * Corks the IO: until a matching call to uncork(), sent messages are buffered
+   * and written in as few writes as possible. Calls may be nested.
+   */
+  void MessageIO::cork() {
+    this->corkDepth++;
+  }
+
+  /**
+   * Balances a previous call to cork(); once all calls have been balanced, any
+   * buffered messages are written.
+   */
+  void MessageIO::uncork() {
+    CHECK(this->corkDepth > 0) << "Unbalanced call to MessageIO::uncork()";
+
+    if(--this->corkDepth == 0) {
+      this->flush();
+    }
+  }
 
-    if(written != responseBytes.size()) {
+  /**
+   * Writes all buffered messages, even if the IO is corked.
+   */
+  void MessageIO::flush() {
+    this->writeSendBuffer(true);
+  }
+
+  /**
+   * Writes buffered messages to the connection. Consecutive messages are
+   * grouped into writes of up to the maximum record size, without splitting
+   * any of them between writes.
+   *
+   * @param all When set, all buffered messages are written; otherwise, the last
+   * group of messages is left in the buffer unless it fills up a record.
+   */
+  void MessageIO::writeSendBuffer(bool all) {
+    auto &buffer = this->sendBuffer;
+    auto &ends = this->sendMessageEnds;
+
+    if(ends.empty()) return;
+
+    size_t start = 0, groupEnd = 0, numWritten = 0;
+
+    try {
+      // write a group whenever the next message wouldn't fit in the record
+      for(size_t end : ends) {
+        if((end - start) > this->maxRecordSize && groupEnd > start) {
+          this->writeBytes(buffer.data() + start, groupEnd - start);
+          start = groupEnd;
+        }
+
+        groupEnd = end;
+      }
+
+      // then, the last group if requested (or it's as large as a record)
+      if(all || (buffer.size() - start) >= this->maxRecordSize) {
+        this->writeBytes(buffer.data() + start, buffer.size() - start);
+        start = buffer.size();
+      }
+    } catch(std::exception &) {
+      this->discardSendBuffer();
+      throw;
+    }
+
+    // remove written messages from the buffer
+    if(start == buffer.size()) {
+      this->discardSendBuffer();
+    } else if(start != 0) {
+      buffer.erase(buffer.begin(), buffer.begin() + start);
+
+      for(auto &end : ends) {
+        if(end > start) {
+          end -= start;
+        } else {
+          end = 0;
+          numWritten++;
+        }
+      }
+
+      ends.erase(ends.begin(), ends.begin() + numWritten);
+    }
+  }
+
+  /**
+   * Writes a block of data to the connection.
+   *
+   * @param data Data to write
+   * @param length Number of bytes to write
+   */
+  void MessageIO::writeBytes(const std::byte *data, size_t length) {
+    size_t written = this->transport->write(data, length);
+
+    if(written != length) {
       LOG(ERROR) << "Couldn't write full message! (Wrote " << written << ", "
-                 << "but total is " << responseBytes.size() << ")";
-      return;
+                 << "but total is " << length << ")";
+    }
+
+    VLOG(2) << "Wrote " << written << " bytes";
+  }
+
+  /**
+   * Throws away all buffered messages. If the send buffer was grown by an
+   * unusually large message, it's released.
+   */
+  void MessageIO::discardSendBuffer() {
+    this->sendBuffer.clear();
+    this->sendMessageEnds.clear();
+
+    if(this->sendBuffer.capacity() > kMaxRetainedBufferSize) {
+      std::vector<std::byte>().swap(this->sendBuffer);
     }
+  }
+
+  /**
+   * Throws away the most recently queued messages that haven't been written
+   * yet, along with anything past the end of the last message that remains
+   * (e.g. a message that failed to serialize.)
+   *
+   * @param count Number of messages to remove from the end of the buffer
+   */
+  void MessageIO::discardLastMessages(size_t count) {
+    auto &ends = this->sendMessageEnds;
 
-    // done, I guess
-    VLOG(1) << "Sent response: " << response.DebugString();
+    // written messages were removed from the front, so these are the last ones
+    ends.resize(ends.size() - std::min(count, ends.size()));
+    this->sendBuffer.resize(ends.empty() ? 0 : ends.back());
   }
 
   /**
@@ -111,20 +318,28 @@ namespace liblichtenstein::api {
    * contained within.
    *
    * @param outMessage Protocol message into which we deserialize
-   * @param buffer Buffer containing message bytes; all fields that require it
-   * are swapped to host byte order at this point.
+   * @param buffer Buffer containing a complete wire message, exactly as it was
+   * received (e.g. with its header in network byte order)
    */
   void MessageIO::decodeMessage(protoMessageType &outMessage,
-                                std::vector<std::byte> &buffer) {
-    // get wire message struct
-    auto *wire = reinterpret_cast<lichtenstein_message_t *>(buffer.data());
+                                const std::vector<std::byte> &buffer) {
+    const size_t wireHeaderLen = sizeof(lichtenstein_message_t);
+
+    if(buffer.size() < wireHeaderLen) {
+      throw ProtocolError("Wire message too short for header");
+    }
+
+    // get the payload length from the header
+    uint32_t payloadLen;
+    memcpy(&payloadLen, buffer.data(), sizeof(payloadLen));
+    payloadLen = ntohl(payloadLen);
 
     // we should have at least as much in the vector as the payload size says
-    if(wire->length > buffer.size()) {
+    if(payloadLen > (buffer.size() - wireHeaderLen)) {
       std::stringstream error;
 
       error << "Invalid message length (wire message indicates "
-            << wire->length;
+            << payloadLen;
       error << " bytes of payload, but a total of " << buffer.size();
       error << " bytes were read from the client, including wire message)";
 
@@ -132,69 +347,368 @@ namespace liblichtenstein::api {
     }
 
     // cool, we have enough data. try to decode it
-    int realPayloadSize = std::min((size_t) wire->length, (buffer.size() -
-                                                           sizeof(lichtenstein_message_t)));
+    this->decodePayload(outMessage, buffer.data() + wireHeaderLen, payloadLen);
+  }
 
-    if(!outMessage.ParseFromArray(wire->payload, realPayloadSize)) {
+  /**
+   * Decodes the payload of a wire message (e.g. everything following its
+   * header) and validates its protocol version.
+   *
+   * @param outMessage Protocol message into which we deserialize
+   * @param payload Start of the payload
+   * @param length Number of bytes of payload
+   */
+  void MessageIO::decodePayload(protoMessageType &outMessage,
+                                const std::byte *payload, size_t length) {
+    if(!outMessage.ParseFromArray(payload, length)) {
       throw ProtocolError("Could not decode protobuf");
     }
 
     // neat, the message could be decoded. validate version
-    if(outMessage.version() != lichtenstein_protocol_get_version()) {
+    const auto version = outMessage.version();
+
+    if(version < lichtenstein_protocol_get_min_version() ||
+       version > lichtenstein_protocol_get_version()) {
       std::stringstream error;
 
       error << "Invalid protocol version (wire message is version 0x";
-      error << std::hex << outMessage.version()
-            << ", whereas the protocol lib is 0x";
+      error << std::hex << version
+            << ", whereas the protocol lib supports 0x";
+      error << std::hex << lichtenstein_protocol_get_min_version() << " - 0x";
       error << std::hex << lichtenstein_protocol_get_version() << ")";
 
       throw ProtocolError(error.str().c_str());
     }
+
+    // the peer understands the compact message form if it uses its version
+    if(version >= LICHTENSTEIN_PROTOCOL_VERSION_COMPACT &&
+       !this->peerSupportsCompact) {
+      VLOG(1) << "Peer supports compact messages (version 0x" << std::hex
+              << version << ")";
+      this->peerSupportsCompact = true;
+    }
   }
 
+
   /**
    * Reads a message from the client; this will either throw an exception or
    * invoke the specified success closure.
    *
+   * If a complete message has already been received (because it was read
+   * together with an earlier message) it's decoded without reading from the
+   * connection at all. Otherwise, data is read from the connection in large
+   * chunks until a complete message is available; anything past the end of
+   * that message stays buffered for the next call.
+   *
+   * Messages are decoded into a message allocated on the connection's arena,
+   * which is reset once the success closure returns. Handlers may allocate
+   * their own messages on it as well (via the received message's GetArena())
+   * so that once the receive buffer has grown to fit the messages on this
+   * connection, receiving doesn't allocate any memory.
+   *
+   * @note The message passed to the success closure (and anything else on the
+   * arena) is only valid for the duration of the call.
+   *
+   * A message that can't be decoded is skipped, and a ProtocolError thrown;
+   * the next call continues with the message after it. But if a frame's
+   * header is invalid, the start of the next frame is unknown: the buffered
+   * data is dropped, and a FramingError is thrown by this and every later
+   * read. The connection should then be closed.
+   *
    * @param success Closure to run when a valid message has been received.
+   * @throws FramingError If the stream can't be split into frames any more
+   * @throws ProtocolError If a message couldn't be decoded
    */
   void MessageIO::readMessage(
           const std::function<void(protoMessageType &)> &success) {
-    std::vector<std::byte> received;
-    int read;
+    this->readMessage(success, true);
+  }
+
+  /**
+   * Reads a message from the client, then continues to decode messages as long
+   * as more of them can be decoded without blocking, e.g. they're already in
+   * the receive buffer or the TLS library has data pending. The success closure
+   * is invoked for each of them.
+   *
+   * This should be preferred over readMessage() by anything that reads
+   * messages in a loop, since bursts of messages are handled with as few
+   * calls into the TLS library as possible.
+   *
+   * @param success Closure to run for every valid message received.
+   */
+  void MessageIO::readMessages(
+          const std::function<void(protoMessageType &)> &success) {
+    if(!this->readMessage(success, true)) return;
+
+    while(this->readMessage(success, false)) {
+      // keep going until we'd have to wait for data
+    }
+  }
+
+  /**
+   * Reads and dispatches messages until the transport has no more data to
+   * read. This is meant for non-blocking transports: their reads return no
+   * data rather than waiting, so this returns as soon as everything the peer
+   * has sent so far was consumed. Partial messages stay in the receive buffer
+   * until the next call.
+   *
+   * @param success Closure to run for every valid message received.
+   * @return Number of messages that were received
+   */
+  size_t MessageIO::drainMessages(
+          const std::function<void(protoMessageType &)> &success) {
+    size_t count = 0;
+
+    while(this->readMessage(success, true)) {
+      count++;
+    }
+
+    return count;
+  }
+
+  /**
+   * Determines whether there is data that can be read without blocking, e.g.
+   * there is data in the receive buffer, or the TLS library has data pending.
+   *
+   * @return Whether data is available without blocking
+   */
+  bool MessageIO::hasBufferedData() const {
+    if(this->receiveFailed) return false;
+
+    return (this->receiveOffset < this->receiveLength) ||
+           (this->transport->pending() > 0);
+  }
+
+  /**
+   * Reads a message and invokes the success closure with it.
+   *
+   * @param success Closure to run when a valid message has been received.
+   * @param mayBlock Whether we may read from the connection even if the TLS
+   * library does not have any data pending
+   * @return Whether a message was received
+   */
+  bool MessageIO::readMessage(
+          const std::function<void(protoMessageType &)> &success,
+          bool mayBlock) {
+    const bool outermost = (this->readDepth == 0);
+
+    // the success closure may itself read a message; the stream is shared, but
+    // each read decodes into its own message, all of them on the arena
+    auto *message = google::protobuf::Arena::CreateMessage<protoMessageType>(
+            this->arena.get());
+    bool received = false;
+
+    // decode the payload into the storage retained from the last message
+    if(outermost) {
+      message->mutable_data()->swap(this->receivedData);
+    }
+
+    try {
+      received = this->receiveMessage(*message, mayBlock);
+
+      if(received) {
+        this->readDepth++;
+
+        try {
+          success(*message);
+        } catch(std::exception &) {
+          this->readDepth--;
+          throw;
+        }
+
+        this->readDepth--;
+      }
+    } catch(std::exception &) {
+      if(outermost) this->finishRead(*message);
+      throw;
+    }
+
+    if(outermost) this->finishRead(*message);
+    return received;
+  }
+
+  /**
+   * Cleans up after a message has been dispatched: everything allocated on the
+   * arena (e.g. the decoded message, and any messages handlers allocated on it)
+   * is released, and the receive buffer is trimmed if needed.
+   *
+   * The arena only holds the string object of the message's data field; its
+   * contents live on the heap, so they're taken back out of the message first
+   * and reused for the next one.
+   *
+   * @param message Outermost message that was decoded
+   */
+  void MessageIO::finishRead(protoMessageType &message) {
+    message.mutable_data()->swap(this->receivedData);
+
+    if(this->receivedData.capacity() > kMaxRetainedBufferSize) {
+      std::string().swap(this->receivedData);
+    }
 
-    // read the wire header
+    const auto used = this->arena->Reset();
+    VLOG(3) << "Released " << used << " bytes of arena memory";
+
+    this->trimReceiveBuffer();
+  }
+
+  /**
+   * Decodes the next message from the receive buffer, reading more data from
+   * the connection as needed.
+   *
+   * @param message Protocol message into which we deserialize
+   * @param mayBlock Whether we may read from the connection even if the TLS
+   * library does not have any data pending
+   * @return Whether a message was read
+   */
+  bool MessageIO::receiveMessage(protoMessageType &message, bool mayBlock) {
     const size_t wireHeaderLen = sizeof(lichtenstein_message_t);
-    read = this->readCallback(received, wireHeaderLen);
+    size_t frameLen = wireHeaderLen;
 
-    if(read == 0) return;
+    if(this->receiveFailed) {
+      throw FramingError("Receive stream is out of sync after an invalid frame");
+    }
 
-    if(read != wireHeaderLen) {
-      std::stringstream error;
+    while(true) {
+      const size_t buffered = this->receiveLength - this->receiveOffset;
+      const std::byte *frame = this->receiveBuffer.get() + this->receiveOffset;
 
-      error << "Protocol error: expected to read ";
-      error << wireHeaderLen << " bytes, got " << read;
-      error << " bytes instead!";
+      // once we have the header, we know how long the frame is
+      if(buffered >= wireHeaderLen) {
+        uint32_t payloadLen;
+        memcpy(&payloadLen, frame, sizeof(payloadLen));
+        payloadLen = ntohl(payloadLen);
 
-      throw ProtocolError(error.str().c_str());
+        if(payloadLen > kMaxMessageSize) {
+          std::stringstream error;
+
+          error << "Invalid message length (wire message indicates ";
+          error << payloadLen << " bytes of payload, but at most ";
+          error << kMaxMessageSize << " are allowed)";
+
+          // there's no telling where the next frame starts
+          this->receiveFailed = true;
+          this->receiveLength = 0;
+          this->receiveOffset = 0;
+
+          throw FramingError(error.str().c_str());
+        }
+
+        frameLen = wireHeaderLen + payloadLen;
+
+        // decode the frame if it's been received completely
+        if(buffered >= frameLen) {
+          VLOG(2) << "Decoding message with " << payloadLen << " bytes ("
+                  << (buffered - frameLen) << " bytes remain buffered)";
+
+          // consume the frame even if it can't be decoded
+          this->receiveOffset += frameLen;
+
+          try {
+            this->decodePayload(message, frame + wireHeaderLen, payloadLen);
+          } catch(std::exception &) {
+            this->compactReceiveBuffer();
+            throw;
+          }
+
+          this->compactReceiveBuffer();
+          return true;
+        }
+      }
+
+      // we need more data; unless told otherwise, only read what's pending
+      size_t pending = this->transport->pending();
+
+      if(!mayBlock && pending == 0) {
+        return false;
+      }
+
+      // move the partial frame to the start of the buffer and make room
+      if(this->receiveOffset > 0) {
+        memmove(this->receiveBuffer.get(),
+                this->receiveBuffer.get() + this->receiveOffset, buffered);
+
+        this->receiveLength = buffered;
+        this->receiveOffset = 0;
+      }
+
+      this->reserveReceiveBuffer(std::max(frameLen, buffered + pending +
+                                                    kMinReadSize));
+
+      // then read as much as fits in the buffer
+      const size_t wanted = this->receiveCapacity - this->receiveLength;
+      size_t read = this->transport->read(
+              this->receiveBuffer.get() + this->receiveLength, wanted);
+
+      this->receiveLength += read;
+
+      VLOG(3) << "Read " << read << " bytes (wanted up to " << wanted
+              << ", pending " << pending << ")";
+
+      // no data available (e.g. a timeout expired) so try again later
+      if(read == 0) {
+        return false;
+      }
+    }
+  }
+
+
+  /**
+   * Resets the receive buffer once all data in it has been decoded.
+   */
+  void MessageIO::compactReceiveBuffer() {
+    if(this->receiveOffset == this->receiveLength) {
+      this->receiveLength = 0;
+      this->receiveOffset = 0;
+    }
+  }
+
+  /**
+   * Ensures the receive buffer can hold at least the given number of bytes.
+   * Its size is always rounded up to a power of two (no smaller than the
+   * minimum receive buffer size) so that it settles on a size quickly, rather
+   * than growing for every slightly larger message. Data already in the
+   * buffer is kept.
+   *
+   * @param bytes Number of bytes the buffer needs to hold
+   */
+  void MessageIO::reserveReceiveBuffer(size_t bytes) {
+    if(this->receiveCapacity >= bytes) return;
+
+    size_t sizeClass = kMinReceiveBufferSize;
+
+    while(sizeClass < bytes) {
+      sizeClass <<= 1;
     }
 
-    // byteswap all fields that need it
-    void *data = received.data();
-    auto *msg = reinterpret_cast<lichtenstein_message_t *>(data);
+    // the new buffer isn't initialized; only the part that was read is used
+    std::unique_ptr<std::byte[]> buffer(new std::byte[sizeClass]);
 
-    msg->length = ntohl(msg->length);
+    if(this->receiveLength) {
+      memcpy(buffer.get(), this->receiveBuffer.get(), this->receiveLength);
+    }
 
-    VLOG(2) << "Message contains " << msg->length << " more bytes";
+    this->receiveBuffer = std::move(buffer);
+    this->receiveCapacity = sizeClass;
+  }
 
-    // read the rest of the payload now (size checking happens during decode)
-    read = this->readCallback(received, msg->length);
-    VLOG(2) << "Read " << received.size() << " total bytes";
+  /**
+   * Releases the receive buffer if an unusually large message caused it to
+   * grow past the size we are willing to keep around for the lifetime of the
+   * connection.
+   *
+   * This only happens when the buffer is empty; otherwise, it's released
+   * once the remaining data has been consumed.
+   */
+  void MessageIO::trimReceiveBuffer() {
+    if(this->receiveCapacity <= kMaxRetainedBufferSize) return;
+    if(this->receiveOffset < this->receiveLength) return;
 
-    lichtenstein::protocol::Message message;
-    this->decodeMessage(message, received);
+    VLOG(2) << "Releasing receive buffer of " << this->receiveCapacity
+            << " bytes";
 
-    // message is valid, so run callback
-    success(message);
+    this->receiveBuffer.reset();
+    this->receiveCapacity = 0;
+    this->receiveLength = 0;
+    this->receiveOffset = 0;
   }
 }
\ No newline at end of file
@@ -6,26 +6,28 @@
 #define LIBLICHTENSTEIN_IO_MESSAGEIO_H
 
 #include <functional>
+#include <atomic>
 #include <cstddef>
+#include <memory>
+#include <string>
 #include <vector>
 
 #include <google/protobuf/message.h>
+#include <google/protobuf/arena.h>
 
 namespace lichtenstein::protocol {
   class Message;
 }
 
 namespace liblichtenstein::io {
-  class GenericTLSClient;
-
-  class GenericServerClient;
+  class ITransport;
 }
 
 namespace liblichtenstein::api {
   /**
-   * Provides a thin wrapper around TLS servers/clients, hiding the underlying
-   * wire protocol and exposing a few convenient methods to send/receive the
-   * Protobuf classes that make up the protocol.
+   * Provides a thin wrapper around a transport (usually a TLS server/client),
+   * hiding the underlying wire protocol and exposing a few convenient methods
+   * to send/receive the Protobuf classes that make up the protocol.
    */
   class MessageIO {
       using protoMessageType = lichtenstein::protocol::Message;
@@ -33,25 +35,135 @@ namespace liblichtenstein::api {
     public:
       MessageIO() = delete;
 
-      MessageIO(std::shared_ptr<io::GenericTLSClient> client);
+      explicit MessageIO(std::shared_ptr<io::ITransport> transport);
+
+      ~MessageIO();
+
+    public:
+      void setCompactMessages(bool enabled);
 
-      MessageIO(std::shared_ptr<io::GenericServerClient> serverClient);
+      /// whether messages are currently sent in the compact form
+      [[nodiscard]] bool isUsingCompactMessages() const {
+        return this->useCompactMessages && this->peerSupportsCompact;
+      }
 
     public:
       void sendMessage(google::protobuf::Message &response);
 
+      void sendBatch(const std::vector<google::protobuf::Message *> &messages);
+
+      void cork();
+
+      void uncork();
+
+      void flush();
+
+      void setMaxRecordSize(size_t size);
+
+      /// maximum number of bytes written at once for batched messages
+      [[nodiscard]] size_t getMaxRecordSize() const {
+        return this->maxRecordSize;
+      }
+
       void sendException(const std::exception &e) noexcept;
 
       void decodeMessage(protoMessageType &outMessage,
-                         std::vector<std::byte> &buffer);
+                         const std::vector<std::byte> &buffer);
 
       void readMessage(const std::function<void(protoMessageType &)> &success);
 
+      void readMessages(const std::function<void(protoMessageType &)> &success);
+
+      size_t drainMessages(const std::function<void(protoMessageType &)> &success);
+
+      [[nodiscard]] bool hasBufferedData() const;
+
+    private:
+      void writeSendBuffer(bool all);
+
+      void writeBytes(const std::byte *data, size_t length);
+
+      void discardSendBuffer();
+
+      void discardLastMessages(size_t count);
+
+      bool readMessage(const std::function<void(protoMessageType &)> &success,
+                       bool mayBlock);
+
+      bool receiveMessage(protoMessageType &message, bool mayBlock);
+
+      void decodePayload(protoMessageType &outMessage, const std::byte *payload,
+                         size_t length);
+
+      void createArena();
+
+      void finishRead(protoMessageType &message);
+
+      void compactReceiveBuffer();
+
+      void trimReceiveBuffer();
+
+      void reserveReceiveBuffer(size_t bytes);
+
+    private:
+      /// smallest size class of the receive buffer
+      static const size_t kMinReceiveBufferSize = (1024 * 4);
+      /// send/receive buffers larger than this are released after use
+      static const size_t kMaxRetainedBufferSize = (1024 * 256);
+      /// always leave room to read at least this many bytes at once
+      static const size_t kMinReadSize = (1024 * 16);
+      /// largest message payload we're willing to receive
+      static const size_t kMaxMessageSize = (1024 * 1024 * 16);
+      /// size of the arena block that's retained between messages
+      static const size_t kArenaInitialBlockSize = (1024 * 32);
+
+    public:
+      /// default maximum record size; this is the largest TLS record
+      static const size_t kDefaultMaxRecordSize = (1024 * 16);
+
+    public:
+      /// returns the transport messages are exchanged over
+      [[nodiscard]] std::shared_ptr<io::ITransport> getTransport() const {
+        return this->transport;
+      }
+
     private:
-      // read function
-      std::function<size_t(std::vector<std::byte> &, size_t)> readCallback;
-      // write function
-      std::function<size_t(const std::vector<std::byte> &)> writeCallback;
+      // connection over which messages are exchanged
+      std::shared_ptr<io::ITransport> transport;
+
+      // whether we may send messages in the compact form
+      std::atomic_bool useCompactMessages = false;
+      // whether the peer has indicated support for compact messages
+      std::atomic_bool peerSupportsCompact = false;
+
+      // send buffer, reused between messages
+      std::vector<std::byte> sendBuffer;
+      // offsets of the end of each message in the send buffer
+      std::vector<size_t> sendMessageEnds;
+      // number of outstanding calls to cork()
+      int corkDepth = 0;
+      // most bytes to write at once when coalescing messages
+      size_t maxRecordSize = kDefaultMaxRecordSize;
+
+      // receive buffer, reused between messages; the transport reads straight
+      // into it, so it's not a vector (which would zero it on every resize)
+      std::unique_ptr<std::byte[]> receiveBuffer;
+      // size of the receive buffer
+      size_t receiveCapacity = 0;
+      // number of bytes in the receive buffer
+      size_t receiveLength = 0;
+      // offset of the first byte in the receive buffer not yet decoded
+      size_t receiveOffset = 0;
+      // memory backing the first block of the arena
+      std::unique_ptr<char[]> arenaBlock;
+      // arena on which received messages are allocated; reset after each one
+      std::unique_ptr<google::protobuf::Arena> arena;
+      // storage for the data field of received messages, reused between them
+      std::string receivedData;
+      // number of success closures currently executing
+      int readDepth = 0;
+      // set once a frame couldn't be delimited; all later reads fail
+      bool receiveFailed = false;
   };
 }
 
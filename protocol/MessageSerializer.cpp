@@ -6,9 +6,10 @@
 #include "SerializationError.h"
 
 #include <string>
-#include <algorithm>
+#include <cstdint>
 
 #include <google/protobuf/any.h>
+#include <google/protobuf/io/coded_stream.h>
 
 #include <arpa/inet.h>
 
@@ -16,26 +17,165 @@
 #include "version.h"
 
 #include "proto/shared/Message.pb.h"
-#include "proto/shared/AuthToken.pb.h"
+
+using google::protobuf::io::CodedOutputStream;
 
 
 namespace liblichtenstein::api {
   /**
-   * Serializes the given message into the byte vector specified.
+   * Serializes the given message into the byte vector specified, indicating
+   * the base protocol version.
    *
    * @param out Vector to hold generated wire message
    * @param payload Message to encapsulate
    */
   void MessageSerializer::serialize(std::vector<std::byte> &out,
                                     google::protobuf::Message &payload) {
+    serialize(out, payload, LICHTENSTEIN_PROTOCOL_VERSION_BASE);
+  }
+
+  /**
+   * Serializes the given message into the byte vector specified. The wire
+   * message is appended to any data already in the vector; callers that send
+   * many messages should reuse the same vector, so its storage is recycled.
+   *
+   * @param out Vector to hold generated wire message
+   * @param payload Message to encapsulate
+   * @param version Protocol version to indicate in the message
+   */
+  void MessageSerializer::serialize(std::vector<std::byte> &out,
+                                    google::protobuf::Message &payload,
+                                    uint32_t version) {
     // generate the basic message
     lichtenstein::protocol::Message message;
-    makeBasicMessage(payload, message);
+    makeBasicMessage(payload, message, version);
 
     // serialize it into a buffer
     createWireMessage(out, message);
   }
 
+  /**
+   * Serializes the given message into the byte vector specified, using the
+   * compact message form: rather than packing the payload into an Any (which
+   * serializes it, only to copy the bytes again when the outer message is
+   * serialized) the envelope is written by hand, and the payload is serialized
+   * directly into the output buffer behind it.
+   *
+   * Messages that don't have a numeric message type are wrapped in an Any as
+   * usual.
+   *
+   * @note Only use this if the peer supports the compact message form, e.g.
+   * it has indicated a protocol version of at least
+   * LICHTENSTEIN_PROTOCOL_VERSION_COMPACT.
+   *
+   * @param out Vector to hold generated wire message
+   * @param payload Message to encapsulate
+   */
+  void
+  MessageSerializer::serializeCompact(std::vector<std::byte> &out,
+                                      const google::protobuf::Message &payload) {
+    // field tags of the envelope (version and type are varints, data is bytes)
+    static const uint8_t kVersionTag = (1 << 3) | 0;
+    static const uint8_t kTypeTag = (3 << 3) | 0;
+    static const uint8_t kDataTag = (4 << 3) | 2;
+
+    const uint32_t version = LICHTENSTEIN_PROTOCOL_VERSION_COMPACT;
+
+    // messages without a numeric type have to go into an Any
+    const auto type = static_cast<uint32_t>(MessageTypes::forMessage(payload));
+
+    if(type == static_cast<uint32_t>(MessageType::Unknown)) {
+      lichtenstein::protocol::Message message;
+      makeBasicMessage(payload, message, version);
+
+      createWireMessage(out, message);
+      return;
+    }
+
+    // calculate sizes of the payload and envelope
+    const size_t payloadSize = payload.ByteSizeLong();
+
+    if(payloadSize > INT32_MAX) {
+      throw SerializationError("Message too large to serialize");
+    }
+
+    const size_t messageSize =
+            1 + CodedOutputStream::VarintSize32(version) +
+            1 + CodedOutputStream::VarintSize32(type) +
+            1 + CodedOutputStream::VarintSize32(payloadSize) + payloadSize;
+
+    // make room for the wire header and message after any existing data
+    const size_t offset = out.size();
+    const size_t wireHeaderSize = sizeof(lichtenstein_message_t);
+
+    out.resize(offset + wireHeaderSize + messageSize);
+
+    auto *wireHeader = reinterpret_cast<lichtenstein_message_t *>(out.data() +
+                                                                  offset);
+    wireHeader->length = htonl(static_cast<uint32_t>(messageSize));
+
+    // write the envelope fields
+    auto *start = reinterpret_cast<uint8_t *>(wireHeader->payload);
+    auto *ptr = start;
+
+    *ptr++ = kVersionTag;
+    ptr = CodedOutputStream::WriteVarint32ToArray(version, ptr);
+    *ptr++ = kTypeTag;
+    ptr = CodedOutputStream::WriteVarint32ToArray(type, ptr);
+    *ptr++ = kDataTag;
+    ptr = CodedOutputStream::WriteVarint32ToArray(payloadSize, ptr);
+
+    // then, serialize the payload behind it
+    ptr = payload.SerializeWithCachedSizesToArray(ptr);
+
+    if(static_cast<size_t>(ptr - start) != messageSize) {
+      out.resize(offset);
+      throw SerializationError("Failed to serialize message");
+    }
+  }
+
+
+  /**
+   * Gets the numeric type of the payload of a message, regardless of whether
+   * it was sent in the compact form or wrapped in an Any.
+   *
+   * @param message Received message
+   * @return Type of its payload, or Unknown if it's not a known type
+   */
+  MessageType
+  MessageSerializer::getType(const lichtenstein::protocol::Message &message) {
+    if(message.type() != 0) {
+      return static_cast<MessageType>(message.type());
+    }
+
+    return MessageTypes::forTypeUrl(message.payload().type_url());
+  }
+
+  /**
+   * Decodes the payload of a message into the given message, regardless of
+   * whether it was sent in the compact form or wrapped in an Any.
+   *
+   * @param message Received message
+   * @param out Message to decode the payload into
+   * @return Whether the payload is of the type of the output message, and
+   * could be decoded.
+   */
+  bool MessageSerializer::unpack(const lichtenstein::protocol::Message &message,
+                                 google::protobuf::Message &out) {
+    // compact form
+    if(message.type() != 0) {
+      if(MessageTypes::forMessage(out) !=
+         static_cast<MessageType>(message.type())) {
+        return false;
+      }
+
+      return out.ParseFromString(message.data());
+    }
+
+    // wrapped in an Any
+    return message.payload().UnpackTo(&out);
+  }
+
 
   /**
    * Fills the field of the Lichtenstein message in to contain the payload
@@ -43,12 +183,14 @@ namespace liblichtenstein::api {
    *
    * @param payload Message to encode in the API message.
    * @param message API message to work on
+   * @param version Protocol version to indicate in the message
    */
   void
   MessageSerializer::makeBasicMessage(const google::protobuf::Message &payload,
-                                      lichtenstein::protocol::Message &message) {
+                                      lichtenstein::protocol::Message &message,
+                                      uint32_t version) {
     // set version
-    message.set_version(lichtenstein_protocol_get_version());
+    message.set_version(version);
 
     // then, put message in
     auto *any = new google::protobuf::Any();
@@ -60,38 +202,40 @@ namespace liblichtenstein::api {
   /**
    * Serializes the given message into wire format.
    *
-   * @param wire Buffer to contain the wire format message
+   * The size of the message is computed once up front, so space for both the
+   * wire header and the message can be reserved in the output buffer in one
+   * go; the protobuf is then serialized in place, directly after the header.
+   *
+   * @param wire Buffer to append the wire format message to
    * @param message Message to serialize
    */
   void MessageSerializer::createWireMessage(std::vector<std::byte> &wire,
                                             lichtenstein::protocol::Message &message) {
-    // serialize the protobuf
-    std::string protobufBytes;
+    // calculate the size of the message (this also caches sizes of submessages)
+    const size_t messageSize = message.ByteSizeLong();
 
-    if(!message.SerializeToString(&protobufBytes)) {
-      throw SerializationError("Failed to serialize message");
+    if(messageSize > UINT32_MAX) {
+      throw SerializationError("Message too large to serialize");
     }
 
-    // get its length into a wire message header
-    lichtenstein_message_t wireHeader{};
-
-    wireHeader.length = protobufBytes.size();
+    // make room for the header and message after any existing data
+    const size_t offset = wire.size();
+    const size_t wireHeaderSize = sizeof(lichtenstein_message_t);
 
-    // swap fields to network byte order
-    wireHeader.length = htonl(wireHeader.length);
+    wire.resize(offset + wireHeaderSize + messageSize);
 
-    // copy the header into the vector
-    std::byte *wireHeaderBytes = reinterpret_cast<std::byte *>(&wireHeader);
-    const size_t wireHeaderSize = sizeof(wireHeader);
+    // fill in the header (in network byte order)
+    auto *wireHeader = reinterpret_cast<lichtenstein_message_t *>(wire.data() +
+                                                                  offset);
+    wireHeader->length = htonl(static_cast<uint32_t>(messageSize));
 
-    std::copy(wireHeaderBytes, wireHeaderBytes + wireHeaderSize,
-              std::back_inserter(wire));
+    // then, serialize the protobuf right after it
+    auto *start = reinterpret_cast<uint8_t *>(wireHeader->payload);
+    auto *end = message.SerializeWithCachedSizesToArray(start);
 
-    // then, copy in the protobuf itself
-    std::byte *messageBytes = reinterpret_cast<std::byte *>(protobufBytes.data());
-    const size_t messageBytesSize = protobufBytes.size();
-
-    std::copy(messageBytes, messageBytes + messageBytesSize,
-              std::back_inserter(wire));
+    if(static_cast<size_t>(end - start) != messageSize) {
+      wire.resize(offset);
+      throw SerializationError("Failed to serialize message");
+    }
   }
 }
\ No newline at end of file
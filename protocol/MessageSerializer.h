@@ -5,7 +5,10 @@
 #ifndef LIBLICHTENSTEIN_MESSAGESERIALIZER_H
 #define LIBLICHTENSTEIN_MESSAGESERIALIZER_H
 
+#include "MessageTypes.h"
+
 #include <cstddef>
+#include <cstdint>
 #include <vector>
 
 namespace google::protobuf {
@@ -31,9 +34,23 @@ namespace liblichtenstein::api {
       static void serialize(std::vector<std::byte> &out,
                             google::protobuf::Message &payload);
 
+      static void serialize(std::vector<std::byte> &out,
+                            google::protobuf::Message &payload,
+                            uint32_t version);
+
+      static void serializeCompact(std::vector<std::byte> &out,
+                                   const google::protobuf::Message &payload);
+
+    public:
+      static MessageType getType(const lichtenstein::protocol::Message &message);
+
+      static bool unpack(const lichtenstein::protocol::Message &message,
+                         google::protobuf::Message &out);
+
     private:
       static void makeBasicMessage(const google::protobuf::Message &payload,
-                                   lichtenstein::protocol::Message &message);
+                                   lichtenstein::protocol::Message &message,
+                                   uint32_t version);
 
       static void createWireMessage(std::vector<std::byte> &wire,
                                     lichtenstein::protocol::Message &message);
@@ -0,0 +1,93 @@
+//
+// Created by Tristan Seifert on 2019-09-03.
+//
+
+#include "MessageTypes.h"
+
+#include <string_view>
+#include <unordered_map>
+
+#include <google/protobuf/message.h>
+#include <google/protobuf/descriptor.h>
+
+
+namespace liblichtenstein::api {
+  /**
+   * Returns the table mapping fully qualified protobuf message names to their
+   * numeric message type. It's built on first use.
+   */
+  static const std::unordered_map<std::string_view, MessageType> &getTypeTable() {
+    static const std::unordered_map<std::string_view, MessageType> table = {
+            {"lichtenstein.protocol.Error",                MessageType::Error},
+            {"lichtenstein.protocol.AuthHello",            MessageType::AuthHello},
+            {"lichtenstein.protocol.AuthChallenge",        MessageType::AuthChallenge},
+            {"lichtenstein.protocol.AuthResponse",         MessageType::AuthResponse},
+            {"lichtenstein.protocol.AuthState",            MessageType::AuthState},
+
+            {"lichtenstein.protocol.client.GetInfo",       MessageType::GetInfo},
+            {"lichtenstein.protocol.client.GetInfoResponse", MessageType::GetInfoResponse},
+            {"lichtenstein.protocol.client.RespStatus",    MessageType::RespStatus},
+            {"lichtenstein.protocol.client.AdoptRequest",  MessageType::AdoptRequest},
+            {"lichtenstein.protocol.client.AdoptAck",      MessageType::AdoptAck},
+
+            {"lichtenstein.protocol.server.ReqPing",       MessageType::ReqPing},
+            {"lichtenstein.protocol.server.RespPong",      MessageType::RespPong},
+
+            {"lichtenstein.protocol.rt.JoinChannel",       MessageType::JoinChannel},
+            {"lichtenstein.protocol.rt.JoinChannelAck",    MessageType::JoinChannelAck},
+            {"lichtenstein.protocol.rt.LeaveChannel",      MessageType::LeaveChannel},
+            {"lichtenstein.protocol.rt.LeaveChannelAck",   MessageType::LeaveChannelAck},
+            {"lichtenstein.protocol.rt.ChannelData",       MessageType::ChannelData},
+            {"lichtenstein.protocol.rt.ChannelDataAck",    MessageType::ChannelDataAck},
+            {"lichtenstein.protocol.rt.MulticastOutputReq", MessageType::MulticastOutputReq},
+    };
+
+    return table;
+  }
+
+
+  /**
+   * Looks up the message type for a fully qualified protobuf message name,
+   * such as "lichtenstein.protocol.Error".
+   *
+   * @param fullName Full name of the message
+   * @return Message type, or Unknown if there is none
+   */
+  MessageType MessageTypes::forName(std::string_view fullName) {
+    const auto &table = getTypeTable();
+
+    if(auto it = table.find(fullName); it != table.end()) {
+      return it->second;
+    }
+
+    return MessageType::Unknown;
+  }
+
+  /**
+   * Looks up the message type for the type URL of an Any.
+   *
+   * @param typeUrl Type URL, as produced by Any::PackFrom()
+   * @return Message type, or Unknown if there is none
+   */
+  MessageType MessageTypes::forTypeUrl(std::string_view typeUrl) {
+    // the message name is everything after the last slash
+    auto slash = typeUrl.rfind('/');
+
+    if(slash == std::string_view::npos) {
+      return MessageType::Unknown;
+    }
+
+    return MessageTypes::forName(typeUrl.substr(slash + 1));
+  }
+
+  /**
+   * Looks up the message type of a protobuf message.
+   *
+   * @param message Message whose type to get
+   * @return Message type, or Unknown if there is none
+   */
+  MessageType
+  MessageTypes::forMessage(const google::protobuf::Message &message) {
+    return MessageTypes::forName(message.GetDescriptor()->full_name());
+  }
+}
@@ -0,0 +1,73 @@
+//
+// Created by Tristan Seifert on 2019-09-03.
+//
+
+#ifndef LIBLICHTENSTEIN_MESSAGETYPES_H
+#define LIBLICHTENSTEIN_MESSAGETYPES_H
+
+#include <cstdint>
+#include <string_view>
+
+namespace google::protobuf {
+  class Message;
+}
+
+namespace liblichtenstein::api {
+  /**
+   * Numeric identifiers for all messages that can be sent as the payload of a
+   * protocol message. These are used by the compact message form in place of
+   * the type URL of an Any.
+   *
+   * @note These values go out over the wire: never change or reuse them.
+   */
+  enum class MessageType : uint32_t {
+    Unknown = 0,
+
+    // shared messages
+    Error = 1,
+    AuthHello = 2,
+    AuthChallenge = 3,
+    AuthResponse = 4,
+    AuthState = 5,
+
+    // client API
+    GetInfo = 16,
+    GetInfoResponse = 17,
+    RespStatus = 18,
+    AdoptRequest = 19,
+    AdoptAck = 20,
+
+    // server API
+    ReqPing = 32,
+    RespPong = 33,
+
+    // realtime protocol
+    JoinChannel = 48,
+    JoinChannelAck = 49,
+    LeaveChannel = 50,
+    LeaveChannelAck = 51,
+    ChannelData = 52,
+    ChannelDataAck = 53,
+    MulticastOutputReq = 54,
+  };
+
+  /**
+   * Maps between protobuf message types and their numeric message type.
+   */
+  class MessageTypes {
+    public:
+      MessageTypes() = delete;
+
+      ~MessageTypes() = delete;
+
+    public:
+      static MessageType forName(std::string_view fullName);
+
+      static MessageType forTypeUrl(std::string_view typeUrl);
+
+      static MessageType forMessage(const google::protobuf::Message &message);
+  };
+}
+
+
+#endif //LIBLICHTENSTEIN_MESSAGETYPES_H
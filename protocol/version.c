@@ -7,5 +7,12 @@
  * Returns the library version.
  */
 unsigned int lichtenstein_protocol_get_version(void) {
-    return 0x00000100;
-}
\ No newline at end of file
+    return LICHTENSTEIN_PROTOCOL_VERSION_COMPACT;
+}
+
+/**
+ * Returns the oldest protocol version the library can still communicate with.
+ */
+unsigned int lichtenstein_protocol_get_min_version(void) {
+    return LICHTENSTEIN_PROTOCOL_VERSION_BASE;
+}
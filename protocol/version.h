@@ -5,6 +5,16 @@
 #ifndef LIBLICHTENSTEIN_VERSION_H
 #define LIBLICHTENSTEIN_VERSION_H
 
+/**
+ * Initial protocol version; payloads are always wrapped in an Any.
+ */
+#define LICHTENSTEIN_PROTOCOL_VERSION_BASE      0x00000100
+/**
+ * Adds the compact message form, where payloads are identified by a numeric
+ * type rather than a type URL.
+ */
+#define LICHTENSTEIN_PROTOCOL_VERSION_COMPACT   0x00000101
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -14,6 +24,11 @@ extern "C" {
  */
 unsigned int lichtenstein_protocol_get_version(void);
 
+/**
+ * Returns the oldest protocol version the library can still communicate with.
+ */
+unsigned int lichtenstein_protocol_get_min_version(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,181 @@
+//
+// Created by Tristan Seifert on 2019-09-20.
+//
+
+#include "io/ConnectionRegistry.h"
+#include "io/GenericServerClient.h"
+#include "io/GenericTLSServer.h"
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <openssl/ssl.h>
+
+using liblichtenstein::io::ConnectionRegistry;
+using liblichtenstein::io::GenericServerClient;
+using liblichtenstein::io::GenericTLSServer;
+
+
+/**
+ * Server that never accepts anything; sessions just need one to belong to.
+ */
+class TestServer : public GenericTLSServer {
+  public:
+    explicit TestServer(SSL_CTX *ctx) : GenericTLSServer(-1, ctx) {}
+
+    std::shared_ptr<GenericServerClient> run() override {
+      return nullptr;
+    }
+
+    void stop() override {}
+};
+
+/**
+ * Session without a socket, which can be closed without any I/O.
+ */
+class TestSession : public GenericServerClient {
+  public:
+    TestSession(GenericTLSServer *server, SSL *ssl)
+            : GenericServerClient(server, -1, ssl, {}) {}
+
+    ~TestSession() override {
+      this->isOpen = false;
+    }
+
+    void close() override {
+      this->isOpen = false;
+      this->closes++;
+    }
+
+    /// how many times close() was called
+    int closes = 0;
+};
+
+/**
+ * Creates sessions to add to a registry.
+ */
+struct TestSessions {
+  TestSessions() : ctx(SSL_CTX_new(TLS_method())), server(this->ctx) {}
+
+  ~TestSessions() {
+    SSL_CTX_free(this->ctx);
+  }
+
+  std::shared_ptr<TestSession> make() {
+    return std::make_shared<TestSession>(&this->server, SSL_new(this->ctx));
+  }
+
+  SSL_CTX *ctx;
+  TestServer server;
+};
+
+
+TEST_CASE("ConnectionRegistry limits the number of sessions",
+          "[ConnectionRegistry]") {
+  TestSessions sessions;
+  ConnectionRegistry registry(2);
+
+  REQUIRE(registry.hasCapacity());
+  REQUIRE(registry.add(sessions.make()));
+  REQUIRE(registry.hasCapacity());
+  REQUIRE_FALSE(registry.hasCapacity(1));
+
+  const auto second = sessions.make();
+  REQUIRE(registry.add(second));
+  REQUIRE_FALSE(registry.hasCapacity());
+
+  SECTION("adding past the limit is rejected") {
+    REQUIRE_FALSE(registry.add(sessions.make()));
+    REQUIRE(registry.size() == 2);
+
+    const auto stats = registry.getStats();
+    REQUIRE(stats.added == 2);
+    REQUIRE(stats.rejected == 1);
+    REQUIRE(stats.peak == 2);
+  }
+
+  SECTION("closed sessions don't count against the limit") {
+    second->close();
+    REQUIRE(registry.add(sessions.make()));
+    REQUIRE(registry.size() == 2);
+    REQUIRE(registry.getStats().reaped == 1);
+  }
+
+  SECTION("the limit can be removed") {
+    registry.setMaxConnections(0);
+    REQUIRE(registry.hasCapacity(100));
+    REQUIRE(registry.add(sessions.make()));
+  }
+}
+
+TEST_CASE("ConnectionRegistry reaps closed sessions", "[ConnectionRegistry]") {
+  TestSessions sessions;
+  ConnectionRegistry registry;
+
+  std::vector<std::shared_ptr<TestSession>> added;
+
+  for(int i = 0; i < 4; i++) {
+    added.push_back(sessions.make());
+    REQUIRE(registry.add(added.back()));
+  }
+
+  added[1]->close();
+  added[2]->close();
+
+  // closed sessions stay registered until they're reaped
+  REQUIRE(registry.size() == 4);
+
+  SECTION("reap() removes them") {
+    REQUIRE(registry.reap() == 2);
+    REQUIRE(registry.size() == 2);
+    REQUIRE(registry.reap() == 0);
+
+    // the registry no longer holds a reference
+    REQUIRE(added[1].use_count() == 1);
+    REQUIRE(added[0].use_count() == 2);
+
+    REQUIRE(registry.getStats().reaped == 2);
+  }
+
+  SECTION("reapIfDue() reaps at most once per interval") {
+    registry.reapIfDue();
+    REQUIRE(registry.size() == 2);
+
+    added[3]->close();
+    registry.reapIfDue();
+    REQUIRE(registry.size() == 2);
+
+    // the interval is one second
+    std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+
+    registry.reapIfDue();
+    REQUIRE(registry.size() == 1);
+  }
+}
+
+TEST_CASE("ConnectionRegistry closes all open sessions",
+          "[ConnectionRegistry]") {
+  TestSessions sessions;
+  ConnectionRegistry registry;
+
+  const auto open = sessions.make(), closed = sessions.make();
+  REQUIRE(registry.add(open));
+  REQUIRE(registry.add(closed));
+
+  closed->close();
+  registry.closeAll();
+
+  REQUIRE(registry.size() == 0);
+  REQUIRE_FALSE(open->isSessionOpen());
+  REQUIRE(open->closes == 1);
+
+  // sessions that were already closed aren't closed again
+  REQUIRE(closed->closes == 1);
+
+  registry.closeAll();
+  REQUIRE(open->closes == 1);
+}
@@ -0,0 +1,122 @@
+//
+// Created by Tristan Seifert on 2019-09-19.
+//
+
+#include "io/DTLSCookieEngine.h"
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+using liblichtenstein::io::DTLSCookieEngine;
+
+
+/**
+ * Encoded address of a peer on the loopback interface.
+ */
+struct TestPeer {
+  explicit TestPeer(uint16_t port) {
+    struct sockaddr_storage storage{};
+    auto *addr = reinterpret_cast<struct sockaddr_in *>(&storage);
+
+    addr->sin_family = AF_INET;
+    addr->sin_port = htons(port);
+    addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    this->length = DTLSCookieEngine::encodePeer(storage, this->data);
+  }
+
+  unsigned char data[DTLSCookieEngine::kMaxPeerLength];
+  size_t length;
+};
+
+/**
+ * A cookie generated by an engine.
+ */
+struct TestCookie {
+  TestCookie(DTLSCookieEngine &engine, const TestPeer &peer) {
+    REQUIRE(engine.generate(peer.data, peer.length, this->data, &this->length));
+    REQUIRE(this->length == DTLSCookieEngine::kCookieLength);
+  }
+
+  bool verify(DTLSCookieEngine &engine, const TestPeer &peer) const {
+    return engine.verify(peer.data, peer.length, this->data, this->length);
+  }
+
+  unsigned char data[DTLSCookieEngine::kCookieLength];
+  unsigned int length = sizeof(data);
+};
+
+
+TEST_CASE("DTLS cookies are only valid for their peer", "[DTLSCookieEngine]") {
+  DTLSCookieEngine engine(std::chrono::seconds(0));
+  const TestPeer peer(4000), other(4001);
+
+  TestCookie cookie(engine, peer);
+
+  REQUIRE(cookie.verify(engine, peer));
+  REQUIRE_FALSE(cookie.verify(engine, other));
+
+  SECTION("a modified cookie is rejected") {
+    cookie.data[DTLSCookieEngine::kCookieLength - 1] ^= 0x01;
+    REQUIRE_FALSE(cookie.verify(engine, peer));
+  }
+
+  SECTION("a truncated cookie is rejected") {
+    cookie.length--;
+    REQUIRE_FALSE(cookie.verify(engine, peer));
+  }
+
+  SECTION("another engine's cookie is rejected") {
+    DTLSCookieEngine otherEngine(std::chrono::seconds(0));
+    REQUIRE_FALSE(cookie.verify(otherEngine, peer));
+  }
+}
+
+TEST_CASE("DTLS cookies are valid for one rotation", "[DTLSCookieEngine]") {
+  DTLSCookieEngine engine(std::chrono::seconds(0));
+  const TestPeer peer(4000);
+
+  TestCookie cookie(engine, peer);
+
+  engine.rotate();
+  REQUIRE(cookie.verify(engine, peer));
+
+  // cookies made with the new secret are valid as well
+  TestCookie newer(engine, peer);
+  REQUIRE(newer.verify(engine, peer));
+
+  engine.rotate();
+  REQUIRE_FALSE(cookie.verify(engine, peer));
+  REQUIRE(newer.verify(engine, peer));
+
+  REQUIRE(engine.getStats().rotations == 3);
+}
+
+TEST_CASE("DTLS cookie secrets expire while idle", "[DTLSCookieEngine]") {
+  // rotations are due after an interval; the grace period is one more
+  const auto kInterval = std::chrono::milliseconds(200);
+
+  DTLSCookieEngine engine(kInterval);
+  const TestPeer peer(4000);
+
+  TestCookie cookie(engine, peer);
+
+  SECTION("within the grace period") {
+    std::this_thread::sleep_for(kInterval + kInterval / 4);
+
+    REQUIRE(cookie.verify(engine, peer));
+    REQUIRE(engine.getStats().rotations == 2);
+  }
+
+  SECTION("past the grace period, with no cookies generated meanwhile") {
+    std::this_thread::sleep_for(2 * kInterval + kInterval / 4);
+
+    REQUIRE_FALSE(cookie.verify(engine, peer));
+    REQUIRE(engine.getStats().rotations == 3);
+  }
+}
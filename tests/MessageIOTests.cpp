@@ -0,0 +1,398 @@
+//
+// Created by Tristan Seifert on 2019-09-18.
+//
+
+#include "protocol/MessageIO.h"
+#include "protocol/FramingError.h"
+#include "io/MemoryTransport.h"
+#include "io/SSLSessionClosedError.h"
+
+#include "shared/Message.pb.h"
+#include "rt/ChannelData.pb.h"
+
+#include <catch2/catch.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+
+using liblichtenstein::api::FramingError;
+using liblichtenstein::api::MessageIO;
+using liblichtenstein::io::ITransport;
+using liblichtenstein::io::MemoryTransport;
+using liblichtenstein::io::SSLSessionClosedError;
+
+using lichtenstein::protocol::Message;
+using lichtenstein::protocol::rt::ChannelData;
+
+/// total number of allocations made
+static std::atomic_size_t gAllocations{0};
+
+
+/*
+ * Every form of operator new is replaced, not just the plain one, so that
+ * all memory that reaches the replaced operator delete (which calls free())
+ * was also allocated with malloc(); e.g. Catch allocates with std::nothrow.
+ */
+static void *countedAlloc(size_t size, size_t alignment) noexcept {
+  gAllocations.fetch_add(1, std::memory_order_relaxed);
+
+  if(alignment <= alignof(std::max_align_t)) {
+    return std::malloc(size ? size : 1);
+  }
+
+  void *ptr = nullptr;
+  return (posix_memalign(&ptr, alignment, size ? size : 1) == 0) ? ptr
+                                                                 : nullptr;
+}
+
+static void *countedAllocOrThrow(size_t size, size_t alignment) {
+  if(void *ptr = countedAlloc(size, alignment)) {
+    return ptr;
+  }
+
+  throw std::bad_alloc();
+}
+
+
+void *operator new(size_t size) {
+  return countedAllocOrThrow(size, 0);
+}
+
+void *operator new[](size_t size) {
+  return countedAllocOrThrow(size, 0);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+  return countedAlloc(size, 0);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+  return countedAlloc(size, 0);
+}
+
+void *operator new(size_t size, std::align_val_t alignment) {
+  return countedAllocOrThrow(size, static_cast<size_t>(alignment));
+}
+
+void *operator new[](size_t size, std::align_val_t alignment) {
+  return countedAllocOrThrow(size, static_cast<size_t>(alignment));
+}
+
+void *operator new(size_t size, std::align_val_t alignment,
+                   const std::nothrow_t &) noexcept {
+  return countedAlloc(size, static_cast<size_t>(alignment));
+}
+
+void *operator new[](size_t size, std::align_val_t alignment,
+                     const std::nothrow_t &) noexcept {
+  return countedAlloc(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void *ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+  std::free(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t &) noexcept {
+  std::free(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+
+void operator delete[](void *ptr, size_t, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t,
+                     const std::nothrow_t &) noexcept {
+  std::free(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t,
+                       const std::nothrow_t &) noexcept {
+  std::free(ptr);
+}
+
+
+/**
+ * Creates a ChannelData message with the given number of RGBW pixels.
+ */
+static ChannelData makeChannelData(size_t pixels) {
+  ChannelData data;
+
+  data.set_transaction(0x12345678);
+  data.set_format(ChannelData::RGBW);
+  data.set_offset(0);
+
+  data.mutable_channel()->set_nodeuuid(std::string(16, '\x42'));
+  data.mutable_channel()->set_number(1);
+  data.set_data(std::string(pixels * 4, '\x7F'));
+
+  return data;
+}
+
+
+TEST_CASE("MessageIO doesn't allocate once warmed up", "[MessageIO]") {
+  // number of messages exchanged before and while counting allocations
+  const size_t kWarmupMessages = 16;
+  const size_t kMessages = 1000;
+
+  auto transports = MemoryTransport::createPair();
+  MessageIO sender(transports.first), receiver(transports.second);
+
+  // compact messages are sent once each side has seen the other's version
+  sender.setCompactMessages(true);
+  receiver.setCompactMessages(true);
+
+  auto data = makeChannelData(512);
+  size_t received = 0;
+
+  const auto countMessage = [&received](Message &) {
+    received++;
+  };
+
+  for(size_t i = 0; i < kWarmupMessages; i++) {
+    sender.sendMessage(data);
+    receiver.readMessage(countMessage);
+
+    receiver.sendMessage(data);
+    sender.readMessage(countMessage);
+  }
+
+  REQUIRE(sender.isUsingCompactMessages());
+  REQUIRE(receiver.isUsingCompactMessages());
+
+  received = 0;
+  size_t sendAllocations = 0, receiveAllocations = 0;
+
+  for(size_t i = 0; i < kMessages; i++) {
+    const auto beforeSend = gAllocations.load();
+    sender.sendMessage(data);
+
+    const auto beforeReceive = gAllocations.load();
+    receiver.readMessage(countMessage);
+
+    sendAllocations += (beforeReceive - beforeSend);
+    receiveAllocations += (gAllocations.load() - beforeReceive);
+  }
+
+  CHECK(sendAllocations == 0);
+  CHECK(receiveAllocations == 0);
+  REQUIRE(received == kMessages);
+}
+
+
+/**
+ * Serializes a message into the bytes MessageIO sends for it.
+ */
+static std::vector<std::byte> makeFrame(google::protobuf::Message &message) {
+  auto transports = MemoryTransport::createPair();
+  MessageIO io(transports.first);
+
+  io.sendMessage(message);
+
+  std::vector<std::byte> frame(transports.second->pending());
+  transports.second->read(frame.data(), frame.size());
+
+  return frame;
+}
+
+/**
+ * Returns the transaction of a received ChannelData message.
+ */
+static uint32_t getTransaction(Message &message) {
+  ChannelData data;
+  REQUIRE(message.payload().UnpackTo(&data));
+
+  return data.transaction();
+}
+
+
+TEST_CASE("MessageIO splits the stream into frames", "[MessageIO]") {
+  auto transports = MemoryTransport::createPair();
+  MessageIO receiver(transports.second);
+
+  std::vector<uint32_t> transactions;
+
+  const auto collect = [&transactions](Message &message) {
+    transactions.push_back(getTransaction(message));
+  };
+
+  SECTION("a frame split across two writes") {
+    auto data = makeChannelData(64);
+    const auto frame = makeFrame(data);
+    const size_t half = frame.size() / 2;
+
+    transports.first->write(frame.data(), half);
+
+    // the rest arrives while the receiver is waiting for it
+    std::thread writer([&] {
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      transports.first->write(frame.data() + half, frame.size() - half);
+    });
+
+    receiver.readMessage(collect);
+    writer.join();
+
+    REQUIRE(transactions == std::vector<uint32_t>{0x12345678});
+    REQUIRE_FALSE(receiver.hasBufferedData());
+  }
+
+  SECTION("several frames in one write") {
+    std::vector<std::byte> frames;
+
+    for(uint32_t i = 1; i <= 3; i++) {
+      auto data = makeChannelData(16 * i);
+      data.set_transaction(i);
+
+      const auto frame = makeFrame(data);
+      frames.insert(frames.end(), frame.begin(), frame.end());
+    }
+
+    transports.first->write(frames.data(), frames.size());
+    receiver.readMessages(collect);
+
+    REQUIRE(transactions == std::vector<uint32_t>{1, 2, 3});
+    REQUIRE_FALSE(receiver.hasBufferedData());
+  }
+
+  SECTION("a header with an oversized length") {
+    // a valid frame follows, but the receiver can't know where it starts
+    const uint32_t length = htonl(0x7FFFFFFF);
+    transports.first->write(reinterpret_cast<const std::byte *>(&length),
+                            sizeof(length));
+
+    auto data = makeChannelData(16);
+    const auto frame = makeFrame(data);
+    transports.first->write(frame.data(), frame.size());
+
+    REQUIRE_THROWS_AS(receiver.readMessage(collect), FramingError);
+
+    // the error sticks, without reading (or blocking on) the transport
+    REQUIRE_FALSE(receiver.hasBufferedData());
+    REQUIRE_THROWS_AS(receiver.readMessage(collect), FramingError);
+    REQUIRE_THROWS_AS(receiver.drainMessages(collect), FramingError);
+
+    REQUIRE(transactions.empty());
+  }
+}
+
+
+/**
+ * Memory transport that is closed right before a given write.
+ */
+class ClosingTransport : public ITransport {
+  public:
+    ClosingTransport(std::shared_ptr<MemoryTransport> transport,
+                     size_t closeBeforeWrite) : transport(std::move(transport)),
+                                                writesLeft(closeBeforeWrite) {}
+
+    size_t write(const std::byte *buf, size_t bufSz) override {
+      if(this->writesLeft-- == 0) {
+        this->transport->close();
+      }
+
+      return this->transport->write(buf, bufSz);
+    }
+
+    using ITransport::read;
+
+    size_t read(std::byte *buf, size_t bufSz) override {
+      return this->transport->read(buf, bufSz);
+    }
+
+    [[nodiscard]] size_t pending() const override {
+      return this->transport->pending();
+    }
+
+    void close() override {
+      this->transport->close();
+    }
+
+    [[nodiscard]] bool isSessionOpen() const override {
+      return this->transport->isSessionOpen();
+    }
+
+  private:
+    std::shared_ptr<MemoryTransport> transport;
+    size_t writesLeft;
+};
+
+
+TEST_CASE("MessageIO keeps corked messages if a batch fails", "[MessageIO]") {
+  auto transports = MemoryTransport::createPair();
+  MessageIO sender(std::make_shared<ClosingTransport>(transports.first, 1));
+  MessageIO receiver(transports.second);
+
+  std::vector<ChannelData> messages;
+
+  for(uint32_t i = 1; i <= 5; i++) {
+    messages.push_back(makeChannelData(16));
+    messages.back().set_transaction(i);
+  }
+
+  // a record holds two and a half messages, so the batch is written in pieces
+  const size_t frameSize = makeFrame(messages[0]).size();
+  sender.setMaxRecordSize(2 * frameSize + frameSize / 2);
+
+  sender.cork();
+  sender.sendMessage(messages[0]);
+  sender.sendMessage(messages[1]);
+
+  // the first two messages are written when the third is queued; the
+  // transport is closed before the next write, in the middle of the batch
+  REQUIRE_THROWS_AS(sender.sendBatch({&messages[2], &messages[3],
+                                      &messages[4]}), SSLSessionClosedError);
+
+  // the outer cork is still balanced, and there's nothing left to write...
+  REQUIRE_NOTHROW(sender.uncork());
+
+  // ...so the next message is written (and fails) right away
+  REQUIRE_THROWS_AS(sender.sendMessage(messages[0]), SSLSessionClosedError);
+
+  std::vector<uint32_t> transactions;
+
+  const auto collect = [&transactions](Message &message) {
+    transactions.push_back(getTransaction(message));
+  };
+
+  receiver.readMessage(collect);
+  receiver.readMessage(collect);
+  REQUIRE_THROWS_AS(receiver.readMessage(collect), SSLSessionClosedError);
+
+  REQUIRE(transactions == std::vector<uint32_t>{1, 2});
+}
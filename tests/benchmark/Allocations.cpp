@@ -0,0 +1,69 @@
+//
+// Created by Tristan Seifert on 2019-09-05.
+//
+
+#include "Allocations.h"
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+/// total number of allocations made
+static std::atomic_size_t gAllocations{0};
+
+
+void *operator new(size_t size) {
+  gAllocations.fetch_add(1, std::memory_order_relaxed);
+
+  if(void *ptr = std::malloc(size ? size : 1)) {
+    return ptr;
+  }
+
+  throw std::bad_alloc();
+}
+
+void *operator new[](size_t size) {
+  return ::operator new(size);
+}
+
+void operator delete(void *ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+  std::free(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept {
+  std::free(ptr);
+}
+
+
+namespace liblichtenstein::bench {
+  /**
+   * Returns the number of allocations made so far.
+   */
+  size_t Allocations::count() {
+    return gAllocations.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Adds an "allocs/op" counter to the benchmark, with the number of
+   * allocations made since the given count, averaged over all iterations.
+   *
+   * @param state Benchmark state
+   * @param start Allocation count when the benchmark loop started
+   */
+  void Allocations::report(benchmark::State &state, size_t start) {
+    const auto allocs = static_cast<double>(count() - start);
+
+    state.counters["allocs/op"] = benchmark::Counter(allocs,
+                                                     benchmark::Counter::kAvgIterations);
+  }
+}
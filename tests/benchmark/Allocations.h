@@ -0,0 +1,30 @@
+//
+// Created by Tristan Seifert on 2019-09-05.
+//
+
+#ifndef LIBLICHTENSTEIN_BENCH_ALLOCATIONS_H
+#define LIBLICHTENSTEIN_BENCH_ALLOCATIONS_H
+
+#include <cstddef>
+
+namespace benchmark {
+  class State;
+}
+
+namespace liblichtenstein::bench {
+  /**
+   * Counts heap allocations made through operator new, which is replaced for
+   * the entire benchmark executable.
+   */
+  class Allocations {
+    public:
+      Allocations() = delete;
+
+    public:
+      static size_t count();
+
+      static void report(benchmark::State &state, size_t start);
+  };
+}
+
+#endif //LIBLICHTENSTEIN_BENCH_ALLOCATIONS_H
@@ -0,0 +1,257 @@
+//
+// Created by Tristan Seifert on 2019-09-14.
+//
+
+#include "io/DTLSCookieEngine.h"
+
+#include <benchmark/benchmark.h>
+
+#include <glog/logging.h>
+
+#include <openssl/bio.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+#include <openssl/ssl.h>
+
+#include <cstddef>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+using liblichtenstein::io::DTLSCookieEngine;
+
+
+/// secret for the one-shot HMAC cookies that DTLSServer used to generate
+static unsigned char legacySecret[16];
+
+/**
+ * Generates a cookie the way DTLSServer used to: the peer's address is
+ * copied into a heap buffer, then a one-shot HMAC-SHA1 is computed over it,
+ * which keys a new HMAC context every time.
+ */
+static int LegacyGenerateCookie(SSL *ssl, unsigned char *cookie,
+                                unsigned int *cookieLen) {
+  struct sockaddr_storage addr{};
+  BIO_dgram_get_peer(SSL_get_rbio(ssl), &addr);
+
+  if(addr.ss_family != AF_INET) return 0;
+  const auto *in = reinterpret_cast<const struct sockaddr_in *>(&addr);
+
+  const size_t length = sizeof(in_port_t) + sizeof(struct in_addr);
+  auto *buffer = static_cast<unsigned char *>(OPENSSL_malloc(length));
+
+  memcpy(buffer, &in->sin_port, sizeof(in_port_t));
+  memcpy(buffer + sizeof(in_port_t), &in->sin_addr, sizeof(struct in_addr));
+
+  HMAC(EVP_sha1(), legacySecret, sizeof(legacySecret), buffer, length, cookie,
+       cookieLen);
+  OPENSSL_free(buffer);
+
+  return 1;
+}
+
+/**
+ * Verifies a cookie generated by LegacyGenerateCookie().
+ */
+static int LegacyVerifyCookie(SSL *ssl, const unsigned char *cookie,
+                              unsigned int cookieLen) {
+  unsigned char expected[EVP_MAX_MD_SIZE];
+  unsigned int expectedLen = 0;
+
+  if(!LegacyGenerateCookie(ssl, expected, &expectedLen)) return 0;
+
+  return (cookieLen == expectedLen &&
+          memcmp(expected, cookie, expectedLen) == 0) ? 1 : 0;
+}
+
+
+/**
+ * Generates a cookie's HMAC the way DTLSServer used to, for comparison.
+ */
+static void BM_CookieGenerateLegacy(benchmark::State &state) {
+  const unsigned char peer[] = {0x1F, 0x90, 10, 0, 0, 42};
+  unsigned char cookie[EVP_MAX_MD_SIZE];
+  unsigned int cookieLen = 0;
+
+  for(auto _ : state) {
+    auto *buffer = static_cast<unsigned char *>(OPENSSL_malloc(sizeof(peer)));
+    memcpy(buffer, peer, sizeof(peer));
+
+    HMAC(EVP_sha1(), legacySecret, sizeof(legacySecret), buffer, sizeof(peer),
+         cookie, &cookieLen);
+    OPENSSL_free(buffer);
+
+    benchmark::DoNotOptimize(cookie);
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_CookieGenerateLegacy);
+
+/**
+ * Generates cookies with the shared engine; with several threads, this
+ * shows whether they contend on anything.
+ */
+static void BM_CookieGenerate(benchmark::State &state) {
+  auto &engine = DTLSCookieEngine::shared();
+
+  unsigned char peer[DTLSCookieEngine::kMaxPeerLength] = {0x1F, 0x90, 10, 0,
+                                                          0, 42};
+  unsigned char cookie[DTLSCookieEngine::kCookieLength];
+  unsigned int cookieLen = 0;
+
+  for(auto _ : state) {
+    engine.generate(peer, 6, cookie, &cookieLen);
+    benchmark::DoNotOptimize(cookie);
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_CookieGenerate)->ThreadRange(1, 4)->UseRealTime();
+
+/**
+ * Verifies a valid cookie with the shared engine.
+ */
+static void BM_CookieVerify(benchmark::State &state) {
+  auto &engine = DTLSCookieEngine::shared();
+
+  unsigned char peer[DTLSCookieEngine::kMaxPeerLength] = {0x1F, 0x90, 10, 0,
+                                                          0, 42};
+  unsigned char cookie[DTLSCookieEngine::kCookieLength];
+  unsigned int cookieLen = 0;
+
+  engine.generate(peer, 6, cookie, &cookieLen);
+
+  for(auto _ : state) {
+    bool valid = engine.verify(peer, 6, cookie, cookieLen);
+    benchmark::DoNotOptimize(valid);
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK(BM_CookieVerify);
+
+
+/**
+ * Builds the first datagram of a DTLS handshake: a ClientHello without a
+ * cookie.
+ */
+static std::vector<unsigned char> MakeClientHello() {
+  SSL_CTX *ctx = SSL_CTX_new(DTLS_client_method());
+  SSL *ssl = SSL_new(ctx);
+
+  BIO *in = BIO_new(BIO_s_mem());
+  BIO *out = BIO_new(BIO_s_mem());
+
+  SSL_set_bio(ssl, in, out);
+  SSL_set_options(ssl, SSL_OP_NO_QUERY_MTU);
+  SSL_set_mtu(ssl, 1400);
+
+  SSL_connect(ssl);
+
+  std::vector<unsigned char> hello(2048);
+  int len = BIO_read(out, hello.data(), hello.size());
+  CHECK(len > 0) << "failed to build ClientHello";
+
+  hello.resize(len);
+
+  SSL_free(ssl);
+  SSL_CTX_free(ctx);
+
+  return hello;
+}
+
+/**
+ * Sends ClientHellos without a cookie to a listening DTLS server, as a flood
+ * of spoofed handshakes would; each one is answered with a HelloVerifyRequest
+ * by DTLSv1_listen() without the server keeping any state. This is the cost
+ * of each hello to the listening thread, including the kernel's.
+ *
+ * @param legacy Whether to use the cookie callbacks DTLSServer used to have,
+ * rather than the cookie engine
+ */
+static void BM_ClientHelloFlood(benchmark::State &state, bool legacy) {
+  RAND_bytes(legacySecret, sizeof(legacySecret));
+
+  // set up a server socket, and a client socket connected to it
+  struct sockaddr_in addr{};
+  socklen_t addrLen = sizeof(addr);
+
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  int server = socket(AF_INET, SOCK_DGRAM, 0);
+  int client = socket(AF_INET, SOCK_DGRAM, 0);
+  PCHECK(server >= 0 && client >= 0) << "socket() failed";
+
+  int err = bind(server, reinterpret_cast<struct sockaddr *>(&addr), addrLen);
+  PCHECK(err == 0) << "bind() failed";
+  err = getsockname(server, reinterpret_cast<struct sockaddr *>(&addr),
+                    &addrLen);
+  PCHECK(err == 0) << "getsockname() failed";
+  err = connect(client, reinterpret_cast<struct sockaddr *>(&addr), addrLen);
+  PCHECK(err == 0) << "connect() failed";
+
+  // DTLSv1_listen() only returns once it's out of hellos if it can't block
+  err = fcntl(server, F_SETFL, O_NONBLOCK);
+  PCHECK(err == 0) << "fcntl() failed";
+
+  // server context, configured like DTLSServer's
+  SSL_CTX *ctx = SSL_CTX_new(DTLS_server_method());
+  SSL_CTX_set_read_ahead(ctx, 1);
+
+  if(legacy) {
+    SSL_CTX_set_cookie_generate_cb(ctx, LegacyGenerateCookie);
+    SSL_CTX_set_cookie_verify_cb(ctx, LegacyVerifyCookie);
+  } else {
+    SSL_CTX_set_cookie_generate_cb(ctx, DTLSCookieEngine::generateCookieCb);
+    SSL_CTX_set_cookie_verify_cb(ctx, DTLSCookieEngine::verifyCookieCb);
+  }
+
+  SSL *ssl = SSL_new(ctx);
+  SSL_set_bio(ssl, BIO_new_dgram(server, BIO_NOCLOSE),
+              BIO_new_dgram(server, BIO_NOCLOSE));
+  SSL_set_options(ssl, SSL_OP_COOKIE_EXCHANGE);
+
+  const auto hello = MakeClientHello();
+  std::vector<unsigned char> reply(2048);
+
+  struct sockaddr_storage peer{};
+
+  for(auto _ : state) {
+    ssize_t sent = send(client, hello.data(), hello.size(), 0);
+    PCHECK(sent == static_cast<ssize_t>(hello.size())) << "send() failed";
+
+    // this receives the hello and replies with a HelloVerifyRequest
+#if defined(LIBRESSL_VERSION_NUMBER) || OPENSSL_VERSION_NUMBER < 0x10100000L
+    int ret = DTLSv1_listen(ssl, &peer);
+#else
+    int ret = DTLSv1_listen(ssl, reinterpret_cast<BIO_ADDR *>(&peer));
+#endif
+    benchmark::DoNotOptimize(ret);
+
+    ssize_t received = recv(client, reply.data(), reply.size(), 0);
+    benchmark::DoNotOptimize(received);
+  }
+
+  state.SetItemsProcessed(state.iterations());
+
+  SSL_free(ssl);
+  SSL_CTX_free(ctx);
+
+  close(client);
+  close(server);
+}
+
+BENCHMARK_CAPTURE(BM_ClientHelloFlood, Legacy, true);
+BENCHMARK_CAPTURE(BM_ClientHelloFlood, Engine, false);
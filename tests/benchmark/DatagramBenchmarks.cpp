@@ -0,0 +1,245 @@
+//
+// Created by Tristan Seifert on 2019-09-13.
+//
+
+#include "io/BatchedDatagramBIO.h"
+
+#include <benchmark/benchmark.h>
+
+#include <glog/logging.h>
+
+#include <openssl/bio.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+using liblichtenstein::io::BatchedDatagramBIO;
+
+/// size of each datagram; about what a DTLS record of pixel data takes up
+static const size_t kDatagramSize = 1200;
+
+
+/**
+ * Creates a pair of UDP sockets on the loopback interface, connected to one
+ * another.
+ */
+static std::pair<int, int> CreateSocketPair() {
+  int fds[2];
+  struct sockaddr_in addrs[2]{};
+
+  for(int i = 0; i < 2; i++) {
+    fds[i] = socket(AF_INET, SOCK_DGRAM, 0);
+    PCHECK(fds[i] >= 0) << "socket() failed";
+
+    addrs[i].sin_family = AF_INET;
+    addrs[i].sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    socklen_t len = sizeof(addrs[i]);
+    auto *addr = reinterpret_cast<struct sockaddr *>(&addrs[i]);
+
+    int err = bind(fds[i], addr, len);
+    PCHECK(err == 0) << "bind() failed";
+    err = getsockname(fds[i], addr, &len);
+    PCHECK(err == 0) << "getsockname() failed";
+  }
+
+  for(int i = 0; i < 2; i++) {
+    auto *peer = reinterpret_cast<struct sockaddr *>(&addrs[1 - i]);
+    int err = connect(fds[i], peer, sizeof(addrs[0]));
+    PCHECK(err == 0) << "connect() failed";
+  }
+
+  return {fds[0], fds[1]};
+}
+
+/**
+ * Creates the BIO under test on the given (connected) socket.
+ */
+static BIO *CreateBio(int fd, bool batched) {
+  if(batched) {
+    return BatchedDatagramBIO::create(fd, BIO_NOCLOSE);
+  }
+
+  // the stock BIO must be told its peer, like DTLSClient does
+  BIO *bio = BIO_new_dgram(fd, BIO_NOCLOSE);
+
+  struct sockaddr_storage peer{};
+  socklen_t peerLen = sizeof(peer);
+
+  int err = getpeername(fd, reinterpret_cast<struct sockaddr *>(&peer),
+                        &peerLen);
+  PCHECK(err == 0) << "getpeername() failed";
+
+  BIO_ctrl(bio, BIO_CTRL_DGRAM_SET_CONNECTED, 0, &peer);
+
+  return bio;
+}
+
+/**
+ * Reports the number of syscalls the BIO made per datagram, if it counts them.
+ */
+static void ReportStats(benchmark::State &state, BIO *bio) {
+  if(!BatchedDatagramBIO::isBatched(bio)) return;
+
+  const auto stats = BatchedDatagramBIO::getStats(bio);
+
+  if(stats.recvDatagrams) {
+    state.counters["recv calls/dgram"] =
+            double(stats.recvCalls) / double(stats.recvDatagrams);
+  }
+  if(stats.sendDatagrams) {
+    state.counters["send calls/dgram"] =
+            double(stats.sendCalls) / double(stats.sendDatagrams);
+  }
+}
+
+
+/**
+ * Reads a burst of datagrams through the BIO, one BIO_read() each, as the
+ * DTLS layer does when a frame of pixel data arrives.
+ *
+ * @param batched Whether to use a BatchedDatagramBIO, rather than the stock
+ * datagram BIO
+ */
+static void BM_DatagramRead(benchmark::State &state, bool batched) {
+  const size_t burst = state.range(0);
+  auto [sender, receiver] = CreateSocketPair();
+
+  BIO *bio = CreateBio(receiver, batched);
+  std::vector<char> buffer(kDatagramSize);
+
+  for(auto _ : state) {
+    state.PauseTiming();
+    for(size_t i = 0; i < burst; i++) {
+      ssize_t ret = send(sender, buffer.data(), buffer.size(), 0);
+      PCHECK(ret == static_cast<ssize_t>(buffer.size())) << "send() failed";
+    }
+    state.ResumeTiming();
+
+    for(size_t i = 0; i < burst; i++) {
+      int ret = BIO_read(bio, buffer.data(), buffer.size());
+      benchmark::DoNotOptimize(ret);
+    }
+  }
+
+  ReportStats(state, bio);
+  state.SetItemsProcessed(state.iterations() * burst);
+
+  BIO_free(bio);
+  close(sender);
+  close(receiver);
+}
+
+BENCHMARK_CAPTURE(BM_DatagramRead, Dgram, false)->Arg(1)->Arg(16);
+BENCHMARK_CAPTURE(BM_DatagramRead, Batched, true)->Arg(1)->Arg(16);
+
+/**
+ * Writes a burst of datagrams through the BIO; the batched BIO is corked for
+ * the duration of the burst, as GenericTLSClient::beginBatch() does.
+ *
+ * @param batched Whether to use a BatchedDatagramBIO, rather than the stock
+ * datagram BIO
+ */
+static void BM_DatagramWrite(benchmark::State &state, bool batched) {
+  const size_t burst = state.range(0);
+  auto [sender, receiver] = CreateSocketPair();
+
+  BIO *bio = CreateBio(sender, batched);
+  std::vector<char> buffer(kDatagramSize);
+
+  for(auto _ : state) {
+    BatchedDatagramBIO::setCorked(bio, true);
+
+    for(size_t i = 0; i < burst; i++) {
+      int ret = BIO_write(bio, buffer.data(), buffer.size());
+      benchmark::DoNotOptimize(ret);
+    }
+
+    BatchedDatagramBIO::setCorked(bio, false);
+
+    // drain the receiving socket so it never fills up
+    state.PauseTiming();
+    while(recv(receiver, buffer.data(), buffer.size(), MSG_DONTWAIT) > 0) {}
+    state.ResumeTiming();
+  }
+
+  ReportStats(state, bio);
+  state.SetItemsProcessed(state.iterations() * burst);
+
+  BIO_free(bio);
+  close(sender);
+  close(receiver);
+}
+
+BENCHMARK_CAPTURE(BM_DatagramWrite, Dgram, false)->Arg(1)->Arg(16);
+BENCHMARK_CAPTURE(BM_DatagramWrite, Batched, true)->Arg(1)->Arg(16);
+
+/**
+ * Streams a burst of datagrams from one BIO to another, as a server pushing
+ * a frame of pixel data does; both BIOs are the same kind.
+ *
+ * @param batched Whether to use batched datagram BIOs
+ * @param offload Whether to enable segmentation offload (GSO/GRO) on them
+ */
+static void BM_DatagramStream(benchmark::State &state, bool batched,
+                              bool offload) {
+  const size_t burst = state.range(0);
+  auto [sender, receiver] = CreateSocketPair();
+
+  BIO *out = CreateBio(sender, batched);
+  BIO *in = CreateBio(receiver, batched);
+
+  if(offload && (!BatchedDatagramBIO::enableSendOffload(out) ||
+                 !BatchedDatagramBIO::enableReceiveOffload(in))) {
+    state.SkipWithError("segmentation offload not supported");
+  }
+
+  std::vector<char> buffer(kDatagramSize);
+
+  for(auto _ : state) {
+    BatchedDatagramBIO::setCorked(out, true);
+
+    for(size_t i = 0; i < burst; i++) {
+      int ret = BIO_write(out, buffer.data(), buffer.size());
+      benchmark::DoNotOptimize(ret);
+    }
+
+    BatchedDatagramBIO::setCorked(out, false);
+
+    for(size_t i = 0; i < burst; i++) {
+      int ret = BIO_read(in, buffer.data(), buffer.size());
+      benchmark::DoNotOptimize(ret);
+    }
+  }
+
+  ReportStats(state, out);
+  ReportStats(state, in);
+
+  if(offload) {
+    const auto sent = BatchedDatagramBIO::getStats(out);
+    const auto received = BatchedDatagramBIO::getStats(in);
+
+    state.counters["segmented"] =
+            double(sent.sendSegmented) / double(sent.sendDatagrams);
+    state.counters["coalesced"] =
+            double(received.recvCoalesced) / double(received.recvDatagrams);
+  }
+
+  state.SetItemsProcessed(state.iterations() * burst);
+
+  BIO_free(out);
+  BIO_free(in);
+  close(sender);
+  close(receiver);
+}
+
+BENCHMARK_CAPTURE(BM_DatagramStream, Dgram, false, false)->Arg(16);
+BENCHMARK_CAPTURE(BM_DatagramStream, Batched, true, false)->Arg(16);
+BENCHMARK_CAPTURE(BM_DatagramStream, Offload, true, true)->Arg(16);
@@ -0,0 +1,79 @@
+//
+// Created by Tristan Seifert on 2019-09-05.
+//
+
+#include "Allocations.h"
+
+#include "protocol/HmacChallengeHandler.h"
+#include "protocol/MessageIO.h"
+#include "io/MemoryTransport.h"
+
+#include <benchmark/benchmark.h>
+
+#include <openssl/evp.h>
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+using liblichtenstein::api::HmacChallengeHandler;
+using liblichtenstein::api::MessageIO;
+using liblichtenstein::io::MemoryTransport;
+using liblichtenstein::bench::Allocations;
+
+
+namespace liblichtenstein::bench {
+  /**
+   * Calls into the otherwise private HMAC computation of the challenge
+   * handler.
+   */
+  class HmacBenchmark {
+    public:
+      HmacBenchmark() = delete;
+
+    public:
+      static void doHmac(HmacChallengeHandler &handler,
+                         std::vector<std::byte> &outBuffer, const EVP_MD *fn,
+                         const std::vector<std::byte> &nonce) {
+        handler.doHmac(outBuffer, fn, nonce);
+      }
+  };
+}
+
+using liblichtenstein::bench::HmacBenchmark;
+
+
+/**
+ * Computes the HMAC of a nonce, as done for every authentication.
+ *
+ * @param fn Hash function to use
+ */
+static void BM_Hmac(benchmark::State &state, const EVP_MD *fn) {
+  auto transports = MemoryTransport::createPair();
+  auto io = std::make_shared<MessageIO>(transports.first);
+
+  std::array<uuids::uuid::value_type, 16> uuidBytes{};
+  uuidBytes.fill(0x42);
+
+  HmacChallengeHandler handler(io, "this is a secret for benchmarking",
+                               uuids::uuid(uuidBytes));
+
+  std::vector<std::byte> nonce(HmacChallengeHandler::kNonceLength,
+                               std::byte(0x69));
+  std::vector<std::byte> hmac(EVP_MD_size(fn), std::byte(0));
+
+  const auto allocs = Allocations::count();
+
+  for(auto _ : state) {
+    HmacBenchmark::doHmac(handler, hmac, fn, nonce);
+
+    benchmark::DoNotOptimize(hmac.data());
+  }
+
+  Allocations::report(state, allocs);
+  state.SetBytesProcessed(state.iterations() * (nonce.size() + 16));
+}
+
+BENCHMARK_CAPTURE(BM_Hmac, SHA1, EVP_sha1());
+BENCHMARK_CAPTURE(BM_Hmac, Whirlpool, EVP_whirlpool());
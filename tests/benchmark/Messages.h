@@ -0,0 +1,50 @@
+//
+// Created by Tristan Seifert on 2019-09-05.
+//
+
+#ifndef LIBLICHTENSTEIN_BENCH_MESSAGES_H
+#define LIBLICHTENSTEIN_BENCH_MESSAGES_H
+
+#include "rt/ChannelData.pb.h"
+
+#include <cstddef>
+#include <string>
+
+namespace liblichtenstein::bench {
+  /// bytes per RGBW pixel
+  constexpr size_t kBytesPerPixel = 4;
+
+  /**
+   * Creates a ChannelData message with the given number of RGBW pixels, like
+   * the ones sent to a node for every frame.
+   *
+   * @param pixels Number of pixels
+   * @return Channel data message
+   */
+  inline lichtenstein::protocol::rt::ChannelData makeChannelData(size_t pixels) {
+    using lichtenstein::protocol::rt::ChannelData;
+
+    ChannelData data;
+
+    data.set_transaction(0x12345678);
+    data.set_format(ChannelData::RGBW);
+    data.set_offset(0);
+
+    data.mutable_channel()->set_nodeuuid(std::string(16, '\x42'));
+    data.mutable_channel()->set_number(1);
+
+    std::string pixelData(pixels * kBytesPerPixel, '\0');
+
+    for(size_t i = 0; i < pixelData.size(); i++) {
+      pixelData[i] = static_cast<char>(i & 0xFF);
+    }
+
+    data.set_data(std::move(pixelData));
+    return data;
+  }
+}
+
+/// pixel counts to run channel data benchmarks with
+#define LICHTENSTEIN_BENCH_PIXELS ->Arg(10)->Arg(170)->Arg(512)->Arg(1000)->Arg(10000)
+
+#endif //LIBLICHTENSTEIN_BENCH_MESSAGES_H
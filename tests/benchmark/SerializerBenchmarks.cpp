@@ -0,0 +1,177 @@
+//
+// Created by Tristan Seifert on 2019-09-05.
+//
+
+#include "Allocations.h"
+#include "Messages.h"
+
+#include "protocol/MessageIO.h"
+#include "protocol/MessageSerializer.h"
+#include "io/MemoryTransport.h"
+
+#include "shared/Message.pb.h"
+#include "rt/ChannelData.pb.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstddef>
+#include <vector>
+
+using liblichtenstein::api::MessageIO;
+using liblichtenstein::api::MessageSerializer;
+using liblichtenstein::io::MemoryTransport;
+using liblichtenstein::bench::Allocations;
+using liblichtenstein::bench::makeChannelData;
+
+using lichtenstein::protocol::Message;
+using lichtenstein::protocol::rt::ChannelData;
+
+
+/**
+ * Serializes a channel data message (wrapped in an Any) into a reused buffer.
+ */
+static void BM_Serialize(benchmark::State &state) {
+  auto data = makeChannelData(state.range(0));
+  std::vector<std::byte> buffer;
+
+  const auto allocs = Allocations::count();
+
+  for(auto _ : state) {
+    buffer.clear();
+    MessageSerializer::serialize(buffer, data);
+
+    benchmark::DoNotOptimize(buffer.data());
+  }
+
+  Allocations::report(state, allocs);
+  state.SetBytesProcessed(state.iterations() * buffer.size());
+}
+
+BENCHMARK(BM_Serialize) LICHTENSTEIN_BENCH_PIXELS;
+
+/**
+ * Serializes a channel data message in the compact form into a reused buffer.
+ */
+static void BM_SerializeCompact(benchmark::State &state) {
+  auto data = makeChannelData(state.range(0));
+  std::vector<std::byte> buffer;
+
+  const auto allocs = Allocations::count();
+
+  for(auto _ : state) {
+    buffer.clear();
+    MessageSerializer::serializeCompact(buffer, data);
+
+    benchmark::DoNotOptimize(buffer.data());
+  }
+
+  Allocations::report(state, allocs);
+  state.SetBytesProcessed(state.iterations() * buffer.size());
+}
+
+BENCHMARK(BM_SerializeCompact) LICHTENSTEIN_BENCH_PIXELS;
+
+
+/**
+ * Decodes a wire message containing channel data into a protocol message.
+ */
+static void BM_DecodeMessage(benchmark::State &state) {
+  auto data = makeChannelData(state.range(0));
+  std::vector<std::byte> buffer;
+  MessageSerializer::serialize(buffer, data);
+
+  auto transports = MemoryTransport::createPair();
+  MessageIO io(transports.first);
+
+  Message message;
+
+  const auto allocs = Allocations::count();
+
+  for(auto _ : state) {
+    io.decodeMessage(message, buffer);
+
+    benchmark::DoNotOptimize(message.payload().value().data());
+  }
+
+  Allocations::report(state, allocs);
+  state.SetBytesProcessed(state.iterations() * buffer.size());
+}
+
+BENCHMARK(BM_DecodeMessage) LICHTENSTEIN_BENCH_PIXELS;
+
+
+/**
+ * Packs channel data into an Any.
+ */
+static void BM_AnyPack(benchmark::State &state) {
+  auto data = makeChannelData(state.range(0));
+  Message message;
+
+  const auto allocs = Allocations::count();
+
+  for(auto _ : state) {
+    message.mutable_payload()->PackFrom(data);
+
+    benchmark::DoNotOptimize(message.payload().value().data());
+  }
+
+  Allocations::report(state, allocs);
+  state.SetBytesProcessed(state.iterations() * data.ByteSizeLong());
+}
+
+BENCHMARK(BM_AnyPack) LICHTENSTEIN_BENCH_PIXELS;
+
+/**
+ * Unpacks channel data from an Any.
+ */
+static void BM_AnyUnpack(benchmark::State &state) {
+  auto data = makeChannelData(state.range(0));
+  Message message;
+  message.mutable_payload()->PackFrom(data);
+
+  ChannelData out;
+
+  const auto allocs = Allocations::count();
+
+  for(auto _ : state) {
+    if(!message.payload().UnpackTo(&out)) {
+      state.SkipWithError("Failed to unpack message");
+      break;
+    }
+
+    benchmark::DoNotOptimize(out.data().data());
+  }
+
+  Allocations::report(state, allocs);
+  state.SetBytesProcessed(state.iterations() * data.ByteSizeLong());
+}
+
+BENCHMARK(BM_AnyUnpack) LICHTENSTEIN_BENCH_PIXELS;
+
+
+/**
+ * Sends channel data through a message IO, then receives it on the other end
+ * of an in-memory transport; this covers the entire path of a message, minus
+ * the network and encryption.
+ */
+static void BM_MessageIORoundTrip(benchmark::State &state) {
+  auto data = makeChannelData(state.range(0));
+
+  auto transports = MemoryTransport::createPair();
+  MessageIO sender(transports.first), receiver(transports.second);
+
+  const auto allocs = Allocations::count();
+
+  for(auto _ : state) {
+    sender.sendMessage(data);
+
+    receiver.readMessage([](Message &message) {
+      benchmark::DoNotOptimize(message.payload().value().data());
+    });
+  }
+
+  Allocations::report(state, allocs);
+  state.SetBytesProcessed(state.iterations() * data.ByteSizeLong());
+}
+
+BENCHMARK(BM_MessageIORoundTrip) LICHTENSTEIN_BENCH_PIXELS;
@@ -0,0 +1,25 @@
+//
+// Created by Tristan Seifert on 2019-09-05.
+//
+
+#include <benchmark/benchmark.h>
+
+#include <glog/logging.h>
+
+/**
+ * Benchmark entry point; logging is set up so that only errors are printed,
+ * since the library logs every message it sends.
+ */
+int main(int argc, char **argv) {
+  google::InitGoogleLogging(argv[0]);
+  FLAGS_stderrthreshold = google::GLOG_ERROR;
+
+  benchmark::Initialize(&argc, argv);
+
+  if(benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
@@ -0,0 +1,916 @@
+//
+// Created by Tristan Seifert on 2019-09-08.
+//
+
+/*
+ * Handshake benchmark: floods a TLSServer, DTLSServer or DTLSMuxServer
+ * listening on the loopback interface with connections from a number of
+ * client threads, each of which connects, completes the handshake and
+ * disconnects as quickly as possible. This is how many node reconnects per
+ * second the server can absorb.
+ *
+ * Optionally, a number of "slow" peers connect first that never send a
+ * ClientHello; they tie up handshake slots until they time out, which used to
+ * stall all other connections. This only applies to TLS.
+ *
+ * With --resume, each client thread resumes the session from its previous
+ * connection, so all but the first handshake per thread are abbreviated.
+ *
+ * With --shards, the server listens on several SO_REUSEPORT sockets, each
+ * with its own handshake thread; run it with increasing shard counts to see
+ * how handshake throughput scales with the number of cores.
+ *
+ * If no certificate is given, a self-signed one is generated with an RSA
+ * (2048 bit) or ECDSA (P-256) key. With --all, the benchmark is run for both
+ * key types, with and without resumption, and a summary is printed.
+ *
+ * Clients negotiate TLS 1.3 where the server supports it; --tls12 limits them
+ * to TLS 1.2, for comparison.
+ *
+ * Once done, handshake throughput, client-observed latency percentiles (from
+ * connect() until the handshake completed) and the CPU time used per
+ * handshake, by the server and by the clients, are printed.
+ */
+#include "io/TLSServer.h"
+#include "io/DTLSServer.h"
+#include "io/DTLSMuxServer.h"
+#include "io/ShardedListener.h"
+#include "io/CipherPolicy.h"
+#include "io/GenericServerClient.h"
+#include "io/OpenSSLError.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <getopt.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/ec.h>
+#include <openssl/pem.h>
+#include <openssl/rsa.h>
+#include <openssl/x509.h>
+
+using liblichtenstein::io::CipherPolicy;
+using liblichtenstein::io::DTLSMuxServer;
+using liblichtenstein::io::DTLSServer;
+using liblichtenstein::io::GenericServerClient;
+using liblichtenstein::io::GenericTLSServer;
+using liblichtenstein::io::ShardedListener;
+using liblichtenstein::io::TLSServer;
+
+using Clock = std::chrono::steady_clock;
+using Protocol = ShardedListener::Protocol;
+
+
+/**
+ * Benchmark options
+ */
+struct Options {
+  /// number of client threads
+  size_t concurrency = 16;
+  /// total number of connections to make
+  size_t connections = 2000;
+  /// number of peers that connect but never handshake
+  size_t slowPeers = 0;
+  /// server handshake timeout (msec)
+  size_t timeout = 2000;
+  /// whether clients resume their previous session
+  bool resume = false;
+  /// number of listening shards; 0 uses a single server
+  size_t shards = 0;
+  /// kind of server to benchmark
+  Protocol protocol = Protocol::TLS;
+  /// type of key to generate a certificate for, if none is given
+  std::string keyType = "rsa";
+  /// whether to run with both key types, with and without resumption
+  bool all = false;
+  /// whether clients are limited to TLS 1.2
+  bool tls12 = false;
+
+  std::string certPath;
+  std::string keyPath;
+};
+
+/**
+ * Results of a single benchmark run
+ */
+struct Results {
+  /// client-observed handshake latencies (nsec), sorted
+  std::vector<uint64_t> latencies;
+  /// handshakes that failed
+  size_t failed = 0;
+  /// handshakes that the client saw resume a session
+  size_t resumed = 0;
+  /// sessions the server established
+  size_t established = 0;
+  /// wall clock time of the run (usec)
+  uint64_t elapsed = 0;
+
+  /// CPU time used by the server during the run (usec)
+  uint64_t serverCpu = 0;
+  /// CPU time used by the client threads (usec); 0 if unknown
+  uint64_t clientCpu = 0;
+
+  /// protocol version and cipher suite the clients negotiated
+  std::string cipher;
+  /// the server's own counters, formatted
+  std::string serverStats;
+  /// sessions established per shard
+  std::vector<uint64_t> shardCounts;
+
+  /// returns the p-th percentile of latency, in usec
+  [[nodiscard]] double percentile(double p) const {
+    if(this->latencies.empty()) return 0;
+
+    size_t index = std::min(this->latencies.size() - 1,
+                            static_cast<size_t>(p * this->latencies.size()));
+    return this->latencies[index] / 1000.;
+  }
+
+  /// returns the number of handshakes per second
+  [[nodiscard]] double throughput() const {
+    return this->elapsed ? (this->latencies.size() * 1000000. / this->elapsed)
+                         : 0;
+  }
+};
+
+
+/**
+ * Gets the CPU time (user and system) used so far, in usec.
+ *
+ * @param who RUSAGE_SELF for the whole process, or RUSAGE_THREAD for the
+ * calling thread
+ */
+static uint64_t cpuTime(int who) {
+  struct rusage usage{};
+  getrusage(who, &usage);
+
+  return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000ULL +
+         usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+/**
+ * Gets the CPU time used by the calling thread, if the platform can tell.
+ */
+static uint64_t threadCpuTime() {
+#ifdef RUSAGE_THREAD
+  return cpuTime(RUSAGE_THREAD);
+#else
+  return 0;
+#endif
+}
+
+
+/**
+ * Generates a key and a self-signed certificate for it, and writes both to
+ * temporary files.
+ *
+ * @param keyType Either "rsa" (2048 bit) or "ecdsa" (P-256)
+ * @param certPath Receives the path of the certificate
+ * @param keyPath Receives the path of the private key
+ */
+static void generateCertificate(const std::string &keyType,
+                                std::string &certPath, std::string &keyPath) {
+  int err;
+  EVP_PKEY *pkey = nullptr;
+
+  // generate the key
+  const bool rsa = (keyType == "rsa");
+  EVP_PKEY_CTX *kctx = EVP_PKEY_CTX_new_id(rsa ? EVP_PKEY_RSA : EVP_PKEY_EC,
+                                           nullptr);
+  CHECK(kctx != nullptr) << "EVP_PKEY_CTX_new_id() failed";
+
+  err = EVP_PKEY_keygen_init(kctx);
+  CHECK(err == 1) << "EVP_PKEY_keygen_init() failed";
+
+  if(rsa) {
+    err = EVP_PKEY_CTX_set_rsa_keygen_bits(kctx, 2048);
+  } else {
+    err = EVP_PKEY_CTX_set_ec_paramgen_curve_nid(kctx, NID_X9_62_prime256v1);
+    CHECK(err == 1) << "EVP_PKEY_CTX_set_ec_paramgen_curve_nid() failed";
+
+    err = EVP_PKEY_CTX_set_ec_param_enc(kctx, OPENSSL_EC_NAMED_CURVE);
+  }
+  CHECK(err == 1) << "Failed to configure key generation";
+
+  err = EVP_PKEY_keygen(kctx, &pkey);
+  CHECK(err == 1) << "EVP_PKEY_keygen() failed";
+
+  EVP_PKEY_CTX_free(kctx);
+
+  // create a certificate for it that's valid for a day
+  X509 *cert = X509_new();
+  CHECK(cert != nullptr) << "X509_new() failed";
+
+  X509_set_version(cert, 2);
+  ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+  X509_gmtime_adj(X509_get_notBefore(cert), 0);
+  X509_gmtime_adj(X509_get_notAfter(cert), 60 * 60 * 24);
+  X509_set_pubkey(cert, pkey);
+
+  X509_NAME *name = X509_get_subject_name(cert);
+  X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+                             reinterpret_cast<const unsigned char *>("localhost"),
+                             -1, -1, 0);
+  X509_set_issuer_name(cert, name);
+
+  err = X509_sign(cert, pkey, EVP_sha256());
+  CHECK(err > 0) << "X509_sign() failed";
+
+  // write both to temporary files
+  char certTemplate[] = "/tmp/handshake_bench_cert.XXXXXX";
+  char keyTemplate[] = "/tmp/handshake_bench_key.XXXXXX";
+
+  int certFd = mkstemp(certTemplate);
+  int keyFd = mkstemp(keyTemplate);
+  PCHECK(certFd >= 0 && keyFd >= 0) << "mkstemp() failed";
+
+  FILE *certFile = fdopen(certFd, "w");
+  FILE *keyFile = fdopen(keyFd, "w");
+  PCHECK(certFile && keyFile) << "fdopen() failed";
+
+  err = PEM_write_X509(certFile, cert);
+  CHECK(err == 1) << "PEM_write_X509() failed";
+  err = PEM_write_PrivateKey(keyFile, pkey, nullptr, nullptr, 0, nullptr,
+                             nullptr);
+  CHECK(err == 1) << "PEM_write_PrivateKey() failed";
+
+  fclose(certFile);
+  fclose(keyFile);
+
+  X509_free(cert);
+  EVP_PKEY_free(pkey);
+
+  certPath = certTemplate;
+  keyPath = keyTemplate;
+}
+
+
+/**
+ * Connects to the server and performs a TLS or DTLS handshake.
+ *
+ * @param ctx Client context
+ * @param addr Server address
+ * @param datagram Whether to perform a DTLS handshake over UDP
+ * @param session If non-null, a session to resume; it's replaced with the
+ * session of this connection.
+ * @param resumed Set if the session was resumed
+ * @param cipher If non-null and empty, receives the negotiated cipher suite
+ * @return Time from connecting until the handshake completed, in nsec, or 0 if
+ * the handshake failed
+ */
+static uint64_t handshake(SSL_CTX *ctx, const struct sockaddr_in &addr,
+                          bool datagram, SSL_SESSION **session,
+                          bool &resumed, std::string *cipher) {
+  const auto start = Clock::now();
+  uint64_t elapsed = 0;
+
+  int fd = socket(AF_INET, datagram ? SOCK_DGRAM : SOCK_STREAM, 0);
+  PCHECK(fd > 0) << "socket() failed";
+
+  if(!datagram) {
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+  }
+
+  if(connect(fd, reinterpret_cast<const struct sockaddr *>(&addr),
+             sizeof(addr)) != 0) {
+    PLOG(WARNING) << "connect() failed";
+    close(fd);
+    return 0;
+  }
+
+  SSL *ssl = SSL_new(ctx);
+
+  if(datagram) {
+    BIO *bio = BIO_new_dgram(fd, BIO_NOCLOSE);
+    BIO_ctrl(bio, BIO_CTRL_DGRAM_SET_CONNECTED, 0,
+             const_cast<struct sockaddr_in *>(&addr));
+
+    SSL_set_bio(ssl, bio, bio);
+  } else {
+    SSL_set_fd(ssl, fd);
+  }
+
+  if(session && *session) {
+    SSL_set_session(ssl, *session);
+  }
+
+  if(SSL_connect(ssl) == 1) {
+    elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            Clock::now() - start).count();
+    resumed = SSL_session_reused(ssl);
+
+    if(cipher && cipher->empty()) {
+      *cipher = CipherPolicy::describe(ssl);
+    }
+
+#ifdef TLS1_3_VERSION
+    // TLS 1.3 session tickets arrive after the handshake; the server closes
+    // the connection right after sending them, so this doesn't block long
+    if(session && !datagram && SSL_version(ssl) == TLS1_3_VERSION) {
+      char byte;
+      SSL_read(ssl, &byte, sizeof(byte));
+    }
+#endif
+
+    if(session) {
+      SSL_SESSION_free(*session);
+      *session = SSL_get1_session(ssl);
+    }
+
+    SSL_shutdown(ssl);
+  } else {
+    ERR_clear_error();
+  }
+
+  SSL_free(ssl);
+  close(fd);
+
+  return elapsed;
+}
+
+
+/**
+ * Creates a socket for the server, bound to an ephemeral port on the
+ * loopback interface.
+ *
+ * @param protocol Kind of server the socket is for
+ * @param addr Receives the address the socket is bound to
+ * @return Socket
+ */
+static int createServerSocket(Protocol protocol, struct sockaddr_in &addr) {
+  int err;
+  const bool datagram = (protocol != Protocol::TLS);
+
+  int fd = socket(AF_INET, datagram ? SOCK_DGRAM : SOCK_STREAM, 0);
+  PCHECK(fd > 0) << "socket() failed";
+
+  // DTLSServer binds each client's socket to the same address
+  int on = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+  err = bind(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr));
+  PCHECK(err == 0) << "bind() failed";
+
+  if(!datagram) {
+    err = listen(fd, SOMAXCONN);
+    PCHECK(err == 0) << "listen() failed";
+  }
+
+  socklen_t addrLen = sizeof(addr);
+  err = getsockname(fd, reinterpret_cast<struct sockaddr *>(&addr), &addrLen);
+  PCHECK(err == 0) << "getsockname() failed";
+
+  return fd;
+}
+
+/**
+ * Formats the counters kept by the servers, if they keep any.
+ *
+ * @param servers Servers (or shards) to read counters from
+ */
+static std::string formatServerStats(
+        const std::vector<GenericTLSServer *> &servers) {
+  std::stringstream str;
+
+  TLSServer::HandshakeStats tls;
+  DTLSMuxServer::Stats mux;
+  bool haveTLS = false, haveMux = false;
+
+  for(auto *s : servers) {
+    if(auto *server = dynamic_cast<TLSServer *>(s)) {
+      const auto stats = server->getHandshakeStats();
+      haveTLS = true;
+
+      tls.accepted += stats.accepted;
+      tls.completed += stats.completed;
+      tls.resumed += stats.resumed;
+      tls.failed += stats.failed;
+      tls.timedOut += stats.timedOut;
+      tls.inProgress += stats.inProgress;
+    } else if(auto *muxServer = dynamic_cast<DTLSMuxServer *>(s)) {
+      const auto stats = muxServer->getStats();
+      haveMux = true;
+
+      mux.datagrams += stats.datagrams;
+      mux.dropped += stats.dropped;
+      mux.completed += stats.completed;
+      mux.resumed += stats.resumed;
+      mux.failed += stats.failed;
+      mux.timedOut += stats.timedOut;
+    }
+  }
+
+  if(haveTLS) {
+    str << tls.accepted << " accepted, " << tls.completed << " completed ("
+        << tls.resumed << " resumed), " << tls.failed << " failed, "
+        << tls.timedOut << " timed out, " << tls.inProgress << " in progress";
+  } else if(haveMux) {
+    str << mux.datagrams << " datagrams (" << mux.dropped << " dropped), "
+        << mux.completed << " completed (" << mux.resumed << " resumed), "
+        << mux.failed << " failed, " << mux.timedOut << " timed out";
+  }
+
+  return str.str();
+}
+
+
+/**
+ * Runs the benchmark once: starts a server, floods it with handshakes and
+ * shuts it down again.
+ *
+ * @param options Benchmark options
+ * @param certPath Path of the server's certificate
+ * @param keyPath Path of the server's private key
+ * @param resume Whether clients resume their previous session
+ * @return Results of the run
+ */
+static Results runBenchmark(const Options &options, const std::string &certPath,
+                            const std::string &keyPath, bool resume) {
+  int err;
+  Results results;
+
+  const bool datagram = (options.protocol != Protocol::TLS);
+
+  // listen on an ephemeral port on the loopback interface
+  struct sockaddr_in addr{};
+
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0;
+
+  std::unique_ptr<GenericTLSServer> server;
+  std::unique_ptr<ShardedListener> listener;
+  std::vector<GenericTLSServer *> servers;
+
+  if(options.shards) {
+    listener = std::make_unique<ShardedListener>(options.protocol, addr,
+                                                 options.shards);
+    listener->loadCert(certPath, keyPath);
+
+    addr.sin_port = htons(listener->getPort());
+
+    for(size_t i = 0; i < listener->getNumShards(); i++) {
+      servers.push_back(listener->getShard(i));
+    }
+  } else {
+    int fd = createServerSocket(options.protocol, addr);
+
+    switch(options.protocol) {
+      case Protocol::TLS:
+        server = std::make_unique<TLSServer>(fd);
+        break;
+      case Protocol::DTLS:
+        server = std::make_unique<DTLSServer>(fd);
+        break;
+      case Protocol::DTLSMux:
+        server = std::make_unique<DTLSMuxServer>(fd);
+        break;
+    }
+
+    server->loadCert(certPath, keyPath);
+    servers.push_back(server.get());
+  }
+
+  const auto timeout = std::chrono::milliseconds(options.timeout);
+
+  for(auto *s : servers) {
+    if(auto *tls = dynamic_cast<TLSServer *>(s)) {
+      tls->setHandshakeTimeout(timeout);
+    } else if(auto *mux = dynamic_cast<DTLSMuxServer *>(s)) {
+      mux->setHandshakeTimeout(timeout);
+    }
+  }
+
+  // set up a thread to take established sessions
+  std::atomic_size_t established = 0;
+
+  std::thread serverThread([&server, &listener, &options, &established] {
+    while(true) {
+      try {
+        auto client = listener ? listener->run() : server->run();
+        established++;
+
+        // mux clients share the server's socket, which must stay as it is;
+        // others shouldn't wait for the client's close notification
+        if(options.protocol != Protocol::DTLSMux) {
+          client->setBlocking(false);
+        }
+
+        client->close();
+      } catch(std::system_error &) {
+        // server was stopped
+        break;
+      } catch(std::exception &e) {
+        LOG(WARNING) << "Error accepting client: " << e.what();
+      }
+    }
+  });
+
+  // connect the slow peers; they never send anything
+  std::vector<int> slowPeers;
+
+  for(size_t i = 0; i < options.slowPeers && !datagram; i++) {
+    int peer = socket(AF_INET, SOCK_STREAM, 0);
+    PCHECK(peer > 0) << "socket() failed";
+
+    err = connect(peer, reinterpret_cast<struct sockaddr *>(&addr),
+                  sizeof(addr));
+    PCHECK(err == 0) << "connect() failed";
+
+    slowPeers.push_back(peer);
+  }
+
+  // then flood the server with handshakes
+  SSL_CTX *clientCtx = SSL_CTX_new(datagram ? DTLS_client_method()
+                                            : TLS_client_method());
+  CHECK(clientCtx != nullptr) << "SSL_CTX_new() failed";
+
+  SSL_CTX_set_session_cache_mode(clientCtx, SSL_SESS_CACHE_CLIENT);
+
+  if(options.tls12 && !datagram) {
+    SSL_CTX_set_max_proto_version(clientCtx, TLS1_2_VERSION);
+  }
+
+  std::atomic_size_t next = 0;
+  std::atomic_size_t failed = 0;
+  std::atomic_size_t resumed = 0;
+  std::atomic<uint64_t> clientCpu = 0;
+  std::mutex latencyLock;
+
+  results.latencies.reserve(options.connections);
+
+  const auto start = Clock::now();
+  const uint64_t startCpu = cpuTime(RUSAGE_SELF);
+  std::vector<std::thread> clients;
+
+  for(size_t i = 0; i < options.concurrency; i++) {
+    clients.emplace_back([&] {
+      std::vector<uint64_t> local;
+      SSL_SESSION *session = nullptr;
+      std::string cipher;
+
+      while(next++ < options.connections) {
+        bool wasResumed = false;
+        uint64_t elapsed = handshake(clientCtx, addr, datagram,
+                                     resume ? &session : nullptr,
+                                     wasResumed, &cipher);
+
+        if(elapsed) {
+          local.push_back(elapsed);
+
+          if(wasResumed) {
+            resumed++;
+          }
+        } else {
+          failed++;
+        }
+      }
+
+      SSL_SESSION_free(session);
+      clientCpu += threadCpuTime();
+
+      std::lock_guard<std::mutex> lg(latencyLock);
+      results.latencies.insert(results.latencies.end(), local.begin(),
+                               local.end());
+
+      if(results.cipher.empty()) {
+        results.cipher = cipher;
+      }
+    });
+  }
+
+  for(auto &client : clients) {
+    client.join();
+  }
+
+  // the server may finish its side of the handshake after the client did
+  // (e.g. with TLS 1.3) so wait for it to catch up before measuring
+  const auto deadline = Clock::now() + timeout + std::chrono::seconds(1);
+
+  while(established < results.latencies.size() && Clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  results.established = established;
+  results.elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+          Clock::now() - start).count();
+
+  // everything but the client threads was the server (or idle)
+  const uint64_t totalCpu = cpuTime(RUSAGE_SELF) - startCpu;
+
+  results.clientCpu = clientCpu;
+  results.serverCpu = (totalCpu > results.clientCpu)
+                      ? (totalCpu - results.clientCpu) : 0;
+
+  // gather statistics, then shut down
+  results.failed = failed;
+  results.resumed = resumed;
+  results.serverStats = formatServerStats(servers);
+
+  if(listener) {
+    results.shardCounts = listener->getShardCounts();
+  }
+
+  for(int peer : slowPeers) {
+    close(peer);
+  }
+
+  if(listener) {
+    listener->stop();
+  } else {
+    server->stop();
+  }
+
+  serverThread.join();
+  servers.clear();
+  listener.reset();
+  server.reset();
+
+  SSL_CTX_free(clientCtx);
+
+  std::sort(results.latencies.begin(), results.latencies.end());
+
+  return results;
+}
+
+/**
+ * Prints the results of a run.
+ */
+static void printResults(const Options &options, const Results &results) {
+  const size_t completed = results.latencies.size();
+
+  std::cout << std::fixed << std::setprecision(2);
+  std::cout << "Handshakes: " << completed << " of " << options.connections
+            << " completed (" << results.resumed << " resumed), "
+            << results.failed << " failed, " << results.established
+            << " established by the server" << std::endl;
+  std::cout << "Throughput: " << results.throughput()
+            << " handshakes per second" << std::endl;
+  std::cout << "Latency:    p50 " << results.percentile(.5) << " us, p90 "
+            << results.percentile(.9) << " us, p99 " << results.percentile(.99)
+            << " us, p99.9 " << results.percentile(.999) << " us, max "
+            << results.percentile(1.) << " us" << std::endl;
+
+  if(!results.cipher.empty()) {
+    std::cout << "Cipher:     " << results.cipher << std::endl;
+  }
+
+  if(completed) {
+    std::cout << "CPU:        " << (double(results.serverCpu) / completed)
+              << " us server";
+
+    if(results.clientCpu) {
+      std::cout << ", " << (double(results.clientCpu) / completed)
+                << " us client";
+    }
+
+    std::cout << " per handshake" << std::endl;
+  }
+
+  if(!results.serverStats.empty()) {
+    std::cout << "Server:     " << results.serverStats << std::endl;
+  }
+
+  if(!results.shardCounts.empty()) {
+    std::cout << "Shards:    ";
+
+    for(auto count : results.shardCounts) {
+      std::cout << " " << count;
+    }
+
+    std::cout << std::endl;
+  }
+}
+
+
+/**
+ * Prints usage information.
+ */
+static void usage(const char *name) {
+  std::cerr << "usage: " << name << " [options] [cert key]" << std::endl
+            << "  -c, --concurrency N  client threads (default 16)"
+            << std::endl
+            << "  -n, --connections N  total connections (default 2000)"
+            << std::endl
+            << "  -s, --slow N         peers that never handshake (default 0)"
+            << std::endl
+            << "  -t, --timeout N      handshake timeout, msec (default 2000)"
+            << std::endl
+            << "  -r, --resume         resume the previous session" << std::endl
+            << "  -S, --shards N       listen on N SO_REUSEPORT sockets"
+            << std::endl
+            << "  -p, --protocol P     tls, dtls or dtlsmux (default tls)"
+            << std::endl
+            << "  -k, --key TYPE       rsa or ecdsa, for a generated "
+               "certificate (default rsa)" << std::endl
+            << "  -a, --all            run with both key types, with and "
+               "without resumption" << std::endl
+            << "  -2, --tls12          limit clients to TLS 1.2" << std::endl;
+}
+
+/**
+ * Parses command line options.
+ */
+static bool parseOptions(int argc, char **argv, Options &options) {
+  static const struct option longOptions[] = {
+          {"concurrency", required_argument, nullptr, 'c'},
+          {"connections", required_argument, nullptr, 'n'},
+          {"slow",        required_argument, nullptr, 's'},
+          {"timeout",     required_argument, nullptr, 't'},
+          {"resume",      no_argument,       nullptr, 'r'},
+          {"shards",      required_argument, nullptr, 'S'},
+          {"protocol",    required_argument, nullptr, 'p'},
+          {"key",         required_argument, nullptr, 'k'},
+          {"all",         no_argument,       nullptr, 'a'},
+          {"tls12",       no_argument,       nullptr, '2'},
+          {nullptr, 0,                       nullptr, 0}
+  };
+
+  int c;
+  std::string protocol;
+
+  while((c = getopt_long(argc, argv, "c:n:s:t:rS:p:k:a2", longOptions,
+                         nullptr)) != -1) {
+    switch(c) {
+      case 'c':
+        options.concurrency = std::stoul(optarg);
+        break;
+      case 'n':
+        options.connections = std::stoul(optarg);
+        break;
+      case 's':
+        options.slowPeers = std::stoul(optarg);
+        break;
+      case 't':
+        options.timeout = std::stoul(optarg);
+        break;
+      case 'r':
+        options.resume = true;
+        break;
+      case 'S':
+        options.shards = std::stoul(optarg);
+        break;
+      case 'p':
+        protocol = optarg;
+        break;
+      case 'k':
+        options.keyType = optarg;
+        break;
+      case 'a':
+        options.all = true;
+        break;
+      case '2':
+        options.tls12 = true;
+        break;
+      default:
+        return false;
+    }
+  }
+
+  if(protocol.empty() || protocol == "tls") {
+    options.protocol = Protocol::TLS;
+  } else if(protocol == "dtls") {
+    options.protocol = Protocol::DTLS;
+  } else if(protocol == "dtlsmux") {
+    options.protocol = Protocol::DTLSMux;
+  } else {
+    return false;
+  }
+
+  if(options.keyType != "rsa" && options.keyType != "ecdsa") {
+    return false;
+  }
+
+  // a certificate is only needed if we're not generating them
+  const int positional = (argc - optind);
+
+  if((positional != 0 && positional != 2) || (options.all && positional) ||
+     options.concurrency == 0 || options.connections == 0) {
+    return false;
+  }
+
+  if(positional == 2) {
+    options.certPath = argv[optind];
+    options.keyPath = argv[optind + 1];
+  }
+
+  return true;
+}
+
+
+int main(int argc, char **argv) {
+  Options options;
+
+  // initialize logging and OpenSSL
+  FLAGS_logtostderr = true;
+  FLAGS_stderrthreshold = google::GLOG_WARNING;
+  google::InitGoogleLogging(argv[0]);
+
+  SSL_load_error_strings();
+  OpenSSL_add_ssl_algorithms();
+
+  // clients disconnect right after the handshake, so the server's writes
+  // (e.g. TLS 1.3 session tickets, or its close notify) may hit a dead socket
+  signal(SIGPIPE, SIG_IGN);
+
+  if(!parseOptions(argc, argv, options)) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  if(options.slowPeers && options.protocol != Protocol::TLS) {
+    LOG(WARNING) << "Slow peers are only supported with TLS";
+  }
+
+  // with a certificate, just run once
+  if(!options.certPath.empty()) {
+    auto results = runBenchmark(options, options.certPath, options.keyPath,
+                                options.resume);
+    printResults(options, results);
+
+    return (results.failed == 0) ? 0 : 1;
+  }
+
+  // otherwise, generate certificates for the requested key types
+  std::vector<std::string> keyTypes{options.keyType};
+  std::vector<bool> resumeModes{options.resume};
+
+  if(options.all) {
+    keyTypes = {"rsa", "ecdsa"};
+    resumeModes = {false, true};
+  }
+
+  struct Row {
+    std::string name;
+    Results results;
+  };
+
+  std::vector<Row> rows;
+  bool failed = false;
+
+  for(const auto &keyType : keyTypes) {
+    std::string certPath, keyPath;
+    generateCertificate(keyType, certPath, keyPath);
+
+    for(bool resume : resumeModes) {
+      const std::string name = keyType + (resume ? ", resumed" : ", full");
+      std::cout << "=== " << name << std::endl;
+
+      auto results = runBenchmark(options, certPath, keyPath, resume);
+      printResults(options, results);
+      std::cout << std::endl;
+
+      failed |= (results.failed != 0);
+      rows.push_back({name, std::move(results)});
+    }
+
+    unlink(certPath.c_str());
+    unlink(keyPath.c_str());
+  }
+
+  // summarize all runs
+  if(rows.size() > 1) {
+    std::cout << std::left << std::setw(16) << "run" << std::right
+              << std::setw(12) << "hs/s" << std::setw(12) << "p50 us"
+              << std::setw(12) << "p99 us" << std::setw(14) << "server us/hs"
+              << std::setw(14) << "client us/hs" << std::endl;
+
+    for(const auto &row : rows) {
+      const auto &r = row.results;
+      const double completed = std::max<size_t>(1, r.latencies.size());
+
+      std::cout << std::left << std::setw(16) << row.name << std::right
+                << std::setw(12) << r.throughput()
+                << std::setw(12) << r.percentile(.5)
+                << std::setw(12) << r.percentile(.99)
+                << std::setw(14) << (r.serverCpu / completed)
+                << std::setw(14) << (r.clientCpu / completed) << std::endl;
+    }
+  }
+
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,272 @@
+//
+// Created by Tristan Seifert on 2019-09-12.
+//
+
+/*
+ * TLS bulk throughput benchmark: a TLSClient uploads a payload to a TLSServer
+ * over the loopback interface, as when uploading a large config or cue list.
+ *
+ * The payload is either written from memory in chunks, or sent from a
+ * temporary file with sendFile(). With --ktls, both sides ask OpenSSL to
+ * hand record encryption to the kernel once the handshake completes; whether
+ * that actually happened is printed along with the results, since it falls
+ * back to userspace if the kernel's `tls` module isn't loaded.
+ */
+#include "io/TLSServer.h"
+#include "io/TLSClient.h"
+#include "io/GenericServerClient.h"
+#include "io/KernelTLS.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#include <openssl/ssl.h>
+
+using liblichtenstein::io::GenericServerClient;
+using liblichtenstein::io::KernelTLS;
+using liblichtenstein::io::TLSClient;
+using liblichtenstein::io::TLSServer;
+
+using Clock = std::chrono::steady_clock;
+
+
+/**
+ * Benchmark options
+ */
+struct Options {
+  /// size of the payload (MiB)
+  size_t size = 256;
+  /// size of the chunks written when not using sendFile() (bytes)
+  size_t chunkSize = (1024 * 64);
+  /// whether kTLS is requested
+  bool kernelTLS = false;
+  /// whether the payload is sent from a file with sendFile()
+  bool sendFile = false;
+
+  std::string certPath;
+  std::string keyPath;
+};
+
+
+/**
+ * Prints usage information.
+ */
+static void usage(const char *name) {
+  std::cerr << "usage: " << name << " [options] cert key" << std::endl
+            << "  -s, --size N      payload size, MiB (default 256)"
+            << std::endl
+            << "  -b, --chunk N     write size, bytes (default 65536)"
+            << std::endl
+            << "  -k, --ktls        enable kernel TLS" << std::endl
+            << "  -f, --sendfile    send the payload from a file" << std::endl;
+}
+
+/**
+ * Parses command line options.
+ */
+static bool parseOptions(int argc, char **argv, Options &options) {
+  static const struct option longOptions[] = {
+          {"size",     required_argument, nullptr, 's'},
+          {"chunk",    required_argument, nullptr, 'b'},
+          {"ktls",     no_argument,       nullptr, 'k'},
+          {"sendfile", no_argument,       nullptr, 'f'},
+          {nullptr, 0,                    nullptr, 0}
+  };
+
+  int c;
+
+  while((c = getopt_long(argc, argv, "s:b:kf", longOptions, nullptr)) != -1) {
+    switch(c) {
+      case 's':
+        options.size = std::stoul(optarg);
+        break;
+      case 'b':
+        options.chunkSize = std::stoul(optarg);
+        break;
+      case 'k':
+        options.kernelTLS = true;
+        break;
+      case 'f':
+        options.sendFile = true;
+        break;
+      default:
+        return false;
+    }
+  }
+
+  if((argc - optind) != 2 || options.size == 0 || options.chunkSize == 0) {
+    return false;
+  }
+
+  options.certPath = argv[optind];
+  options.keyPath = argv[optind + 1];
+
+  return true;
+}
+
+/**
+ * Gets the CPU time (user and system) used by the process so far, in usec.
+ */
+static uint64_t cpuTime() {
+  struct rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+
+  return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000ULL +
+         usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+
+int main(int argc, char **argv) {
+  int err;
+  Options options;
+
+  // initialize logging and OpenSSL
+  FLAGS_logtostderr = true;
+  FLAGS_stderrthreshold = google::GLOG_WARNING;
+  google::InitGoogleLogging(argv[0]);
+
+  SSL_load_error_strings();
+  OpenSSL_add_ssl_algorithms();
+
+  if(!parseOptions(argc, argv, options)) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  const size_t total = options.size * 1024 * 1024;
+
+  // listen on an ephemeral port on the loopback interface
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  PCHECK(fd > 0) << "socket() failed";
+
+  struct sockaddr_in addr{};
+  socklen_t addrLen = sizeof(addr);
+
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0;
+
+  err = bind(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr));
+  PCHECK(err == 0) << "bind() failed";
+
+  err = listen(fd, SOMAXCONN);
+  PCHECK(err == 0) << "listen() failed";
+
+  err = getsockname(fd, reinterpret_cast<struct sockaddr *>(&addr), &addrLen);
+  PCHECK(err == 0) << "getsockname() failed";
+
+  auto server = std::make_unique<TLSServer>(fd);
+  server->loadCert(options.certPath, options.keyPath);
+
+  if(options.kernelTLS) {
+    KernelTLS::enable(server->getContext());
+  }
+
+  // the server reads until it's received the entire payload
+  std::atomic_bool serverKernelTLS = false;
+  Clock::time_point finished;
+
+  std::thread serverThread([&] {
+    auto client = server->run();
+    serverKernelTLS = client->isKernelTLSActive();
+
+    std::vector<std::byte> buffer;
+    buffer.reserve(options.chunkSize);
+
+    size_t received = 0;
+
+    while(received < total) {
+      buffer.clear();
+      received += client->read(buffer, options.chunkSize);
+    }
+
+    finished = Clock::now();
+    client->close();
+  });
+
+  // prepare the payload
+  std::vector<std::byte> payload(options.chunkSize);
+  for(size_t i = 0; i < payload.size(); i++) {
+    payload[i] = static_cast<std::byte>(i * 31);
+  }
+
+  int file = -1;
+
+  if(options.sendFile) {
+    char path[] = "/tmp/ktlsbench.XXXXXX";
+    file = mkstemp(path);
+    PCHECK(file >= 0) << "mkstemp() failed";
+
+    unlink(path);
+
+    for(size_t written = 0; written < total; written += payload.size()) {
+      size_t len = std::min(payload.size(), total - written);
+      ssize_t ret = write(file, payload.data(), len);
+      PCHECK(ret == static_cast<ssize_t>(len)) << "write() failed";
+    }
+  }
+
+  // connect and upload the payload
+  TLSClient client("127.0.0.1", ntohs(addr.sin_port), "", options.kernelTLS);
+
+  const auto cpuStart = cpuTime();
+  const auto start = Clock::now();
+
+  if(options.sendFile) {
+    size_t sent = client.sendFile(file, 0, total);
+    CHECK(sent == total) << "sent only " << sent << " of " << total;
+  } else {
+    for(size_t sent = 0; sent < total;) {
+      size_t len = std::min(payload.size(), total - sent);
+      sent += client.write(payload.data(), len);
+    }
+  }
+
+  // both sides wait for the other's close notification
+  const bool clientKernelTLS = client.isKernelTLSActive();
+
+  client.close();
+  serverThread.join();
+
+  const auto cpuUsed = cpuTime() - cpuStart;
+  const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+          finished - start).count();
+
+  server->stop();
+  server.reset();
+
+  if(file != -1) {
+    close(file);
+  }
+
+  std::cout << std::fixed << std::setprecision(2);
+  std::cout << "Payload:    " << options.size << " MiB, "
+            << (options.sendFile ? "sendFile()" : "write()") << std::endl;
+  std::cout << "kTLS:       " << (options.kernelTLS ? "requested" : "off")
+            << ", client " << (clientKernelTLS ? "offloaded" : "userspace")
+            << ", server " << (serverKernelTLS ? "offloaded" : "userspace")
+            << std::endl;
+  std::cout << "Throughput: " << (total / 1048576. * 1000000. / elapsed)
+            << " MiB/s" << std::endl;
+  std::cout << "CPU:        " << (cpuUsed / 1000.) << " ms ("
+            << (cpuUsed * 1000. / total) << " ns per byte)" << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,594 @@
+//
+// Created by Tristan Seifert on 2019-09-06.
+//
+
+/*
+ * Realtime protocol load generator: runs a stand-in realtime server and any
+ * number of realtime clients in the same process, all talking DTLS over the
+ * loopback interface, then streams channel data to all of them at a fixed
+ * frame rate.
+ *
+ * Once done, the number of frames delivered (and lost), the CPU time used per
+ * frame and latency percentiles are printed. Since both ends run in this
+ * process, the CPU time includes both the server and all nodes.
+ */
+#include "io/DTLSServer.h"
+#include "io/GenericServerClient.h"
+#include "io/OpenSSLError.h"
+
+#include "client/Client.h"
+#include "client/IClientDataStore.h"
+#include "client/RealtimeClient.h"
+
+#include "protocol/HmacChallengeHandler.h"
+#include "protocol/MessageIO.h"
+#include "protocol/MessageSerializer.h"
+
+#include "shared/Message.pb.h"
+#include "shared/AuthHello.pb.h"
+#include "rt/ChannelData.pb.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+
+using liblichtenstein::Client;
+using liblichtenstein::IClientDataStore;
+using liblichtenstein::api::HmacChallengeHandler;
+using liblichtenstein::api::MessageIO;
+using liblichtenstein::api::MessageSerializer;
+using liblichtenstein::api::RealtimeClient;
+using liblichtenstein::io::DTLSServer;
+using liblichtenstein::io::GenericServerClient;
+
+using lichtenstein::protocol::AuthHello;
+using lichtenstein::protocol::Message;
+using lichtenstein::protocol::rt::ChannelData;
+
+using Clock = std::chrono::steady_clock;
+
+
+/// secret shared by all nodes
+static const std::string kSecret = "rt load generator secret";
+/// most bytes of pixel data to send in a single message
+static const size_t kMaxDatagramPayload = 1200;
+/// bytes per (RGBW) pixel
+static const size_t kBytesPerPixel = 4;
+
+
+/**
+ * A data store that keeps everything in memory.
+ */
+class MemoryDataStore : public IClientDataStore {
+  public:
+    bool hasKey(const KeyType &key) const override {
+      std::lock_guard guard(this->lock);
+      return this->values.count(key) != 0;
+    }
+
+    void set(const KeyType &key, ValueType value) override {
+      std::lock_guard guard(this->lock);
+      this->values[key] = std::move(value);
+    }
+
+    std::optional<std::string> get(const KeyType &key) const override {
+      std::lock_guard guard(this->lock);
+
+      if(auto it = this->values.find(key); it != this->values.end()) {
+        return it->second;
+      }
+
+      return std::nullopt;
+    }
+
+  private:
+    mutable std::mutex lock;
+    std::map<KeyType, ValueType> values;
+};
+
+
+/**
+ * Parameters of the test run
+ */
+struct Options {
+  std::string certPath;
+  std::string keyPath;
+
+  unsigned int nodes = 8;
+  unsigned int fps = 60;
+  unsigned int pixels = 512;
+  unsigned int seconds = 10;
+  unsigned int port = 45420;
+  unsigned int connectTimeout = 30;
+};
+
+/**
+ * A node under test, and what it has received.
+ */
+struct Node {
+  std::unique_ptr<Client> client;
+  std::unique_ptr<RealtimeClient> rt;
+
+  /// protects all statistics
+  std::mutex lock;
+
+  /// number of segments (messages) received
+  uint64_t segments = 0;
+  /// number of frames for which all segments were received
+  uint64_t frames = 0;
+
+  /// frame whose segments are currently being received
+  uint32_t currentFrame = UINT32_MAX;
+  /// number of segments of the current frame received
+  size_t currentFrameSegments = 0;
+
+  /// latency of every segment, in nanoseconds
+  std::vector<uint64_t> latencies;
+};
+
+/**
+ * Server side of a realtime connection.
+ */
+struct Session {
+  std::shared_ptr<GenericServerClient> client;
+  std::shared_ptr<MessageIO> io;
+
+  bool alive = true;
+};
+
+
+/**
+ * Returns the current time in nanoseconds.
+ */
+static uint64_t now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+          Clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Returns the CPU time (user + system) used by this process, in microseconds.
+ */
+static uint64_t cpuTime() {
+  struct rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+
+  auto toUsec = [](const struct timeval &tv) {
+    return static_cast<uint64_t>(tv.tv_sec) * 1000000ULL + tv.tv_usec;
+  };
+
+  return toUsec(usage.ru_utime) + toUsec(usage.ru_stime);
+}
+
+
+/**
+ * Authenticates a node that connected to the server; the AuthHello tells us
+ * which node it is.
+ *
+ * @param io Message IO of the connection
+ */
+static void authenticate(std::shared_ptr<MessageIO> io) {
+  io->readMessage([&io](Message &message) {
+    AuthHello hello;
+
+    if(!MessageSerializer::unpack(message, hello) ||
+       hello.uuid().size() != 16) {
+      throw std::runtime_error("Expected AuthHello");
+    }
+
+    std::array<uuids::uuid::value_type, 16> uuidBytes{};
+    std::copy(hello.uuid().begin(), hello.uuid().end(), uuidBytes.begin());
+
+    HmacChallengeHandler handler(io, kSecret, uuids::uuid(uuidBytes));
+    handler.handleAuthentication(hello);
+  });
+}
+
+/**
+ * Handles a message received by a node.
+ *
+ * @param node Node that received the message
+ * @param segmentsPerFrame Number of segments each frame is split into
+ * @param message Received message
+ */
+static void receive(Node &node, size_t segmentsPerFrame,
+                    const Message &message) {
+  const auto received = now();
+
+  auto &data = *google::protobuf::Arena::CreateMessage<ChannelData>(
+          message.GetArena());
+
+  if(!MessageSerializer::unpack(message, data) ||
+     data.data().size() < sizeof(uint64_t)) {
+    return;
+  }
+
+  uint64_t sent;
+  memcpy(&sent, data.data().data(), sizeof(sent));
+
+  std::lock_guard guard(node.lock);
+
+  node.segments++;
+  node.latencies.push_back(received - sent);
+
+  // count the frame once all of its segments were received
+  if(data.transaction() != node.currentFrame) {
+    node.currentFrame = data.transaction();
+    node.currentFrameSegments = 0;
+  }
+
+  if(++node.currentFrameSegments == segmentsPerFrame) {
+    node.frames++;
+  }
+}
+
+
+/**
+ * Prints usage information.
+ */
+static void usage(const char *name) {
+  std::cerr << "usage: " << name << " [options] cert key" << std::endl
+            << "  -n, --nodes N      number of nodes (default 8)" << std::endl
+            << "  -f, --fps N        frames per second (default 60)"
+            << std::endl
+            << "  -p, --pixels N     RGBW pixels per frame (default 512)"
+            << std::endl
+            << "  -t, --seconds N    duration of the test (default 10)"
+            << std::endl
+            << "  -P, --port N       UDP port to use (default 45420)"
+            << std::endl
+            << "  -T, --timeout N    seconds to wait for all nodes to connect "
+               "(default 30)" << std::endl;
+}
+
+/**
+ * Parses command line options.
+ */
+static bool parseOptions(int argc, char **argv, Options &options) {
+  static const struct option longOptions[] = {
+          {"nodes",   required_argument, nullptr, 'n'},
+          {"fps",     required_argument, nullptr, 'f'},
+          {"pixels",  required_argument, nullptr, 'p'},
+          {"seconds", required_argument, nullptr, 't'},
+          {"port",    required_argument, nullptr, 'P'},
+          {"timeout", required_argument, nullptr, 'T'},
+          {nullptr, 0,                   nullptr, 0}
+  };
+
+  int c;
+
+  while((c = getopt_long(argc, argv, "n:f:p:t:P:T:", longOptions, nullptr)) !=
+        -1) {
+    switch(c) {
+      case 'n':
+        options.nodes = std::stoul(optarg);
+        break;
+      case 'f':
+        options.fps = std::stoul(optarg);
+        break;
+      case 'p':
+        options.pixels = std::stoul(optarg);
+        break;
+      case 't':
+        options.seconds = std::stoul(optarg);
+        break;
+      case 'P':
+        options.port = std::stoul(optarg);
+        break;
+      case 'T':
+        options.connectTimeout = std::stoul(optarg);
+        break;
+      default:
+        return false;
+    }
+  }
+
+  if((argc - optind) != 2 || options.nodes == 0 || options.fps == 0 ||
+     options.pixels == 0) {
+    return false;
+  }
+
+  options.certPath = argv[optind];
+  options.keyPath = argv[optind + 1];
+
+  return true;
+}
+
+
+int main(int argc, char **argv) {
+  int err;
+  Options options;
+
+  // initialize logging and OpenSSL
+  FLAGS_logtostderr = true;
+  FLAGS_stderrthreshold = google::GLOG_WARNING;
+  google::InitGoogleLogging(argv[0]);
+
+  SSL_load_error_strings();
+  OpenSSL_add_ssl_algorithms();
+
+  if(!parseOptions(argc, argv, options)) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  // split frames into segments that fit in a datagram
+  const size_t pixelsPerSegment = kMaxDatagramPayload / kBytesPerPixel;
+  const size_t segmentsPerFrame =
+          (options.pixels + pixelsPerSegment - 1) / pixelsPerSegment;
+
+  // create the server socket
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  PCHECK(fd > 0) << "socket() failed";
+
+  int on = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+  struct sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(options.port);
+
+  err = bind(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr));
+  PCHECK(err == 0) << "bind() failed";
+
+  DTLSServer server(fd);
+  server.loadCert(options.certPath, options.keyPath);
+
+  // accept and authenticate nodes until all of them that could connect did
+  std::vector<Session> sessions;
+  size_t failedNodes = 0;
+
+  std::mutex acceptLock;
+  std::condition_variable acceptCv;
+
+  auto acceptDone = [&]() {
+    return (sessions.size() + failedNodes) >= options.nodes;
+  };
+
+  std::thread acceptor([&]() {
+    while(true) {
+      {
+        std::lock_guard guard(acceptLock);
+        if(acceptDone()) break;
+      }
+
+      try {
+        Session session;
+        session.client = server.run();
+
+        session.io = std::make_shared<MessageIO>(session.client);
+        session.io->setMaxRecordSize(kMaxDatagramPayload);
+
+        authenticate(session.io);
+
+        std::lock_guard guard(acceptLock);
+        sessions.push_back(std::move(session));
+      } catch(std::system_error &e) {
+        // the server was stopped because we gave up waiting
+        if(e.code().value() == ECONNABORTED) break;
+
+        LOG(ERROR) << "Failed to accept node: " << e.what();
+      } catch(std::exception &e) {
+        LOG(ERROR) << "Failed to accept node: " << e.what();
+      }
+
+      acceptCv.notify_all();
+    }
+  });
+
+  // then, create the nodes
+  std::vector<std::unique_ptr<Node>> nodes;
+  std::mt19937 random(std::random_device{}());
+
+  for(size_t i = 0; i < options.nodes; i++) {
+    auto node = std::make_unique<Node>();
+    node->latencies.reserve(
+            options.fps * options.seconds * segmentsPerFrame + 16);
+
+    auto store = std::make_shared<MemoryDataStore>();
+    store->set("adoption.secret", kSecret);
+
+    std::array<uint8_t, 16> uuidBytes{};
+    for(auto &byte : uuidBytes) {
+      byte = random() & 0xFF;
+    }
+
+    node->client = std::make_unique<Client>("127.0.0.1", 0, "", "");
+    node->client->setNodeUuid(uuidBytes);
+    node->client->setDataStore(store);
+
+    auto *nodePtr = node.get();
+
+    try {
+      node->rt = std::make_unique<RealtimeClient>(node->client.get(),
+                                                  "127.0.0.1", options.port,
+                                                  [nodePtr, segmentsPerFrame](
+                                                          const Message &message) {
+                                                    receive(*nodePtr,
+                                                            segmentsPerFrame,
+                                                            message);
+                                                  });
+    } catch(std::exception &e) {
+      LOG(ERROR) << "Failed to connect node " << i << ": " << e.what();
+
+      std::lock_guard guard(acceptLock);
+      failedNodes++;
+
+      acceptCv.notify_all();
+      continue;
+    }
+
+    nodes.push_back(std::move(node));
+  }
+
+  // wait for the server to accept the nodes that connected, but not forever
+  {
+    std::unique_lock lock(acceptLock);
+    acceptCv.wait_for(lock, std::chrono::seconds(options.connectTimeout),
+                      acceptDone);
+  }
+
+  server.stop();
+  acceptor.join();
+
+  if(sessions.size() < options.nodes) {
+    std::cerr << "Only " << sessions.size() << " of " << options.nodes
+              << " nodes connected (" << failedNodes
+              << " failed to connect)" << std::endl;
+
+    nodes.clear();
+
+    for(auto &session : sessions) {
+      session.client->close();
+    }
+
+    sessions.clear();
+
+    close(fd);
+    return 1;
+  }
+
+  std::cout << "Authenticated " << sessions.size() << " nodes; sending "
+            << options.pixels << " pixels (" << segmentsPerFrame
+            << " segments) at " << options.fps << " fps for "
+            << options.seconds << " seconds" << std::endl;
+
+  // build the segments of a frame
+  std::vector<ChannelData> segments(segmentsPerFrame);
+
+  for(size_t i = 0; i < segmentsPerFrame; i++) {
+    const size_t offset = i * pixelsPerSegment;
+    const size_t count = std::min(pixelsPerSegment, options.pixels - offset);
+
+    segments[i].set_format(ChannelData::RGBW);
+    segments[i].set_offset(offset);
+    segments[i].mutable_channel()->set_number(0);
+    // (leave room for the timestamp, even if there's only one pixel)
+    segments[i].set_data(std::string(
+            std::max(count * kBytesPerPixel, sizeof(uint64_t)), '\x7F'));
+  }
+
+  // stream frames
+  const auto period = std::chrono::nanoseconds(1000000000ULL / options.fps);
+  const uint32_t totalFrames = options.fps * options.seconds;
+
+  uint64_t sendErrors = 0;
+
+  const auto cpuStart = cpuTime();
+  const auto start = Clock::now();
+
+  for(uint32_t frame = 0; frame < totalFrames; frame++) {
+    std::this_thread::sleep_until(start + (period * frame));
+
+    for(auto &session : sessions) {
+      if(!session.alive) continue;
+
+      try {
+        session.io->cork();
+
+        for(auto &segment : segments) {
+          const uint64_t timestamp = now();
+
+          segment.set_transaction(frame);
+          memcpy(segment.mutable_data()->data(), &timestamp,
+                 sizeof(timestamp));
+
+          session.io->sendMessage(segment);
+        }
+
+        session.io->uncork();
+      } catch(std::exception &e) {
+        LOG(ERROR) << "Failed to send to node: " << e.what();
+
+        session.alive = false;
+        sendErrors++;
+      }
+    }
+  }
+
+  // wait for stragglers
+  std::this_thread::sleep_for(std::chrono::milliseconds(250));
+
+  const auto cpuUsed = cpuTime() - cpuStart;
+  const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+          Clock::now() - start).count();
+
+  // collect statistics
+  uint64_t frames = 0, received = 0;
+  std::vector<uint64_t> latencies;
+
+  for(auto &node : nodes) {
+    std::lock_guard guard(node->lock);
+
+    frames += node->frames;
+    received += node->segments;
+    latencies.insert(latencies.end(), node->latencies.begin(),
+                     node->latencies.end());
+  }
+
+  std::sort(latencies.begin(), latencies.end());
+
+  auto percentile = [&latencies](double p) -> double {
+    if(latencies.empty()) return 0;
+
+    size_t index = std::min(latencies.size() - 1,
+                            static_cast<size_t>(p * latencies.size()));
+    return latencies[index] / 1000.;
+  };
+
+  const uint64_t sentFrames = uint64_t(totalFrames) * sessions.size();
+  const uint64_t sentSegments = sentFrames * segmentsPerFrame;
+
+  std::cout << std::fixed << std::setprecision(2);
+  std::cout << "Frames:    " << frames << " of " << sentFrames
+            << " delivered (" << (100. * (sentFrames - frames) / sentFrames)
+            << "% lost)" << std::endl;
+  std::cout << "Segments:  " << received << " of " << sentSegments
+            << " delivered, " << sendErrors << " send errors" << std::endl;
+  std::cout << "Pixels:    "
+            << (double(frames) * options.pixels * 1000000. / elapsed)
+            << " per second" << std::endl;
+  std::cout << "CPU:       " << (cpuUsed / 1000000.) << " s ("
+            << (100. * cpuUsed / elapsed) << "% of one core), "
+            << (frames ? (double(cpuUsed) / frames) : 0.) << " us per frame"
+            << std::endl;
+  std::cout << "Latency:   p50 " << percentile(.5) << " us, p90 "
+            << percentile(.9) << " us, p99 " << percentile(.99)
+            << " us, p99.9 " << percentile(.999) << " us, max "
+            << percentile(1.) << " us" << std::endl;
+
+  // shut down the nodes first, so they don't try to reconnect
+  nodes.clear();
+
+  for(auto &session : sessions) {
+    session.client->close();
+  }
+
+  sessions.clear();
+
+  close(fd);
+  return (frames == sentFrames) ? 0 : 1;
+}